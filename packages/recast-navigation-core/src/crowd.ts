@@ -1,3 +1,4 @@
+import { IntArray } from './arrays';
 import type { NavMesh } from './nav-mesh';
 import { NavMeshQuery, QueryFilter } from './nav-mesh-query';
 import { Raw, RawModule } from './raw';
@@ -89,6 +90,167 @@ export const crowdAgentParamsDefaults: CrowdAgentParams = {
   userData: 0,
 };
 
+export type CrowdLodTier = {
+  /**
+   * Agents further than this distance from every focus point fall through to the next tier.
+   * @default Infinity
+   */
+  distance: number;
+
+  /**
+   * The number of crowd updates between updates of agents in this tier.
+   * The time skipped is integrated in a single larger step.
+   * @default 1
+   */
+  updateInterval: number;
+
+  /**
+   * Scales how far an agent moves before its collision boundary is refreshed.
+   * @default 1
+   */
+  boundaryUpdateScale: number;
+
+  /**
+   * Whether agents in this tier sample velocities for obstacle avoidance.
+   * Crowd obstacles are only avoided while sampling, agents in tiers without it walk through them.
+   * @default true
+   */
+  obstacleAvoidance: boolean;
+};
+
+export const crowdLodTierDefaults: CrowdLodTier = {
+  distance: Infinity,
+  updateInterval: 1,
+  boundaryUpdateScale: 1,
+  obstacleAvoidance: true,
+};
+
+export type CrowdLodTierStats = {
+  /**
+   * The number of active agents in the tier.
+   */
+  agentCount: number;
+
+  /**
+   * The number of agents in the tier that were updated in the last crowd update.
+   */
+  updatedAgentCount: number;
+
+  /**
+   * Microseconds spent on the tier's agents in the last crowd update.
+   */
+  updateTime: number;
+};
+
+export type CrowdUpdateStats = {
+  /**
+   * Microseconds spent in the last crowd update.
+   */
+  totalTime: number;
+
+  /**
+   * Microseconds spent in each phase of the last crowd update.
+   */
+  lodTime: number;
+  pathValidityTime: number;
+  moveRequestTime: number;
+  topologyOptimizationTime: number;
+  proximityGridTime: number;
+  neighbourhoodTime: number;
+  offMeshTriggerTime: number;
+  steeringTime: number;
+  velocityPlanningTime: number;
+  integrationTime: number;
+  collisionTime: number;
+  positionTime: number;
+  offMeshAnimationTime: number;
+
+  /**
+   * The number of path requests in the path queue after the update.
+   */
+  pathQueueDepth: number;
+
+  /**
+   * The number of agents waiting for a free slot in the path queue.
+   */
+  pathQueueWaiting: number;
+
+  /**
+   * The number of path requests added to the path queue.
+   */
+  pathRequestsIssued: number;
+
+  /**
+   * The number of path requests that completed and were applied to agent corridors.
+   */
+  pathRequestsServed: number;
+
+  /**
+   * The number of path requests that failed.
+   */
+  pathRequestsFailed: number;
+
+  /**
+   * The number of path requests turned away because the path queue was full. The agents retry on the next update.
+   */
+  pathRequestsDropped: number;
+
+  /**
+   * The number of agents that had their path replanned.
+   */
+  replans: number;
+
+  /**
+   * The number of agents that had their path topology optimized.
+   */
+  topologyOptimizations: number;
+
+  /**
+   * The number of agents registered to the proximity grid.
+   */
+  gridItemCount: number;
+
+  /**
+   * The number of grid cell entries covered by the registered agents.
+   */
+  gridCellEntries: number;
+
+  /**
+   * The most agents found in the grid cell of any one agent.
+   */
+  gridMaxCellOccupancy: number;
+};
+
+export type CrowdAgentQueryResult = {
+  /**
+   * Offsets into `indices` for each query, with one extra entry at the end.
+   * Query `i` found the agents `indices[offsets[i]]` to `indices[offsets[i + 1] - 1]`.
+   */
+  offsets: Int32Array;
+
+  /**
+   * The agent indices found by all queries, packed in query order.
+   */
+  indices: Int32Array;
+};
+
+export type CrowdEventType =
+  | 'targetReached'
+  | 'offMeshEntered'
+  | 'offMeshLeft'
+  | 'becameInvalid'
+  | 'pathPartial'
+  | 'replanned';
+
+export type CrowdEvent = {
+  type: CrowdEventType;
+
+  /**
+   * The index of the agent the event is for.
+   */
+  agentIndex: number;
+};
+
 export class CrowdAgent implements CrowdAgentParams {
   raw: RawModule.dtCrowdAgent;
 
@@ -240,7 +402,7 @@ export class CrowdAgent implements CrowdAgentParams {
    */
   teleport(position: Vector3) {
     Raw.CrowdUtils.agentTeleport(
-      this.crowd.raw,
+      this.crowd.raw.getCrowd(),
       this.agentIndex,
       vec3.toArray(position),
       vec3.toArray(this.crowd.navMeshQuery.defaultQueryHalfExtents),
@@ -412,13 +574,31 @@ export class CrowdAgent implements CrowdAgentParams {
     this.crowd.raw.updateAgentParameters(this.agentIndex, dtCrowdAgentParams);
   }
 
+  /**
+   * Pins the agent to a level of detail tier.
+   * @param tier the tier index, or null to derive the tier from the crowd's focus points
+   */
+  setLodTier(tier: number | null): void {
+    this.crowd.raw.setAgentLodTier(
+      this.agentIndex,
+      tier === null ? -1 : tier
+    );
+  }
+
+  /**
+   * Returns the level of detail tier the agent was updated with in the last crowd update.
+   */
+  lodTier(): number {
+    return this.crowd.raw.getAgentLodTier(this.agentIndex);
+  }
+
   /**
    * Returns whether the agent is over an off-mesh connection.
    * @returns
    */
   overOffMeshConnection(): boolean {
     return Raw.CrowdUtils.overOffMeshConnection(
-      this.crowd.raw,
+      this.crowd.raw.getCrowd(),
       this.agentIndex
     );
   }
@@ -427,7 +607,8 @@ export class CrowdAgent implements CrowdAgentParams {
 export type CrowdParams = {
   /**
    * The maximum number of agents that can be managed by the crowd.
-   * [Limit: >= 1]
+   * With `autoResize`, the initial and minimum capacity.
+   * [Limit: >= 1, <= 16383]
    */
   maxAgents: number;
 
@@ -436,10 +617,25 @@ export type CrowdParams = {
    * [Limit: > 0]
    */
   maxAgentRadius: number;
+
+  /**
+   * The number of threads to spread the crowd update across, including the calling thread.
+   * Only has an effect with a build of @recast-navigation/wasm that has threads enabled.
+   * Clamped so the worker threads of every crowd and tile cache fit in the pthread pool (`navigator.hardwareConcurrency`).
+   * @default 1
+   */
+  threads?: number;
+
+  /**
+   * Whether the capacity grows when adding an agent to a full crowd, and shrinks back as agents are removed.
+   * Agent indices are kept when the capacity changes. The capacity never grows above 16383 agents.
+   * @default false
+   */
+  autoResize?: boolean;
 };
 
 export class Crowd {
-  raw: RawModule.dtCrowd;
+  raw: RawModule.Crowd;
 
   /**
    * The agents in the crowd.
@@ -461,6 +657,16 @@ export class Crowd {
    */
   private accumulator = 0;
 
+  /**
+   * The capacity the agents' raw objects were fetched for
+   */
+  private agentCapacity: number;
+
+  /**
+   * Query filters returned by getFilter, their raw objects are refetched with the agents'
+   */
+  private filters: { [idx: number]: QueryFilter } = {};
+
   /**
    *
    * @param navMesh the navmesh the crowd will use for planning
@@ -474,10 +680,16 @@ export class Crowd {
    * });
    * ```
    */
-  constructor(navMesh: NavMesh, { maxAgents, maxAgentRadius }: CrowdParams) {
+  constructor(
+    navMesh: NavMesh,
+    { maxAgents, maxAgentRadius, threads = 1, autoResize = false }: CrowdParams
+  ) {
     this.navMesh = navMesh;
-    this.raw = Raw.Detour.allocCrowd();
+    this.raw = new Raw.Module.Crowd();
+    this.raw.setThreadCount(threads);
     this.raw.init(maxAgents, maxAgentRadius, navMesh.raw.getNavMesh());
+    this.raw.setAutoResize(autoResize);
+    this.agentCapacity = maxAgents;
 
     this.navMeshQuery = new NavMeshQuery(
       new Raw.Module.NavMeshQuery(this.raw.getNavMeshQuery())
@@ -572,6 +784,8 @@ export class Crowd {
       dtCrowdAgentParams
     );
 
+    this.syncAgentCapacity();
+
     const agent = new CrowdAgent(this, agentIndex);
     this.agents[agentIndex] = agent;
 
@@ -602,6 +816,8 @@ export class Crowd {
     this.raw.removeAgent(agentIndex);
 
     delete this.agents[agentIndex];
+
+    this.syncAgentCapacity();
   }
 
   /**
@@ -611,11 +827,56 @@ export class Crowd {
     return this.raw.getAgentCount();
   }
 
+  /**
+   * Changes the maximum number of agents without reinitializing the crowd. Agents keep their indices.
+   * @returns false if an agent's index is at or above the new maximum, or the new maximum is above 16383
+   */
+  setMaxAgents(maxAgents: number): boolean {
+    const success = this.raw.setMaxAgents(maxAgents);
+
+    this.syncAgentCapacity();
+
+    return success;
+  }
+
+  /**
+   * Sets whether the capacity grows when adding an agent to a full crowd, and shrinks back as agents are removed.
+   */
+  setAutoResize(enabled: boolean): void {
+    this.raw.setAutoResize(enabled);
+  }
+
+  /**
+   * Returns whether the capacity is resized as agents are added and removed.
+   */
+  getAutoResize(): boolean {
+    return this.raw.getAutoResize();
+  }
+
+  /**
+   * Agents and query filters move in memory when the capacity changes, refetches their raw objects if it has.
+   * Called by methods that can change the capacity.
+   */
+  syncAgentCapacity(): void {
+    const capacity = this.raw.getAgentCount();
+    if (capacity === this.agentCapacity) return;
+
+    this.agentCapacity = capacity;
+
+    for (const agent of Object.values(this.agents)) {
+      agent.raw = this.raw.getEditableAgent(agent.agentIndex);
+    }
+
+    for (const [filterIndex, filter] of Object.entries(this.filters)) {
+      filter.raw = this.raw.getEditableFilter(Number(filterIndex));
+    }
+  }
+
   /**
    * Returns the number of active agents in the crowd.
    */
   getActiveAgentCount(): number {
-    return Raw.CrowdUtils.getActiveAgentCount(this.raw);
+    return this.raw.getActiveAgentCount();
   }
 
   /**
@@ -625,19 +886,362 @@ export class Crowd {
     return Object.values(this.agents);
   }
 
+  /**
+   * Finds the agents within a radius of each center, measured on the xz plane.
+   *
+   * Runs all queries in one call against the crowd's proximity grid, which holds the agents registered by the last `update`.
+   * Agents removed since then are skipped, agents added since then are found after the next `update`.
+   * @param centers the query centers
+   * @param radius a radius shared by all queries, or a radius per query
+   */
+  queryAgentsInRadius(
+    centers: Vector3[],
+    radius: number | number[]
+  ): CrowdAgentQueryResult {
+    const radii = typeof radius === 'number' ? [radius] : radius;
+
+    return this.runAgentQuery((offsets, indices) =>
+      this.raw.queryAgentsInRadius(
+        centers.flatMap((center) => vec3.toArray(center)),
+        radii,
+        radii.length,
+        centers.length,
+        offsets.raw,
+        indices.raw
+      )
+    );
+  }
+
+  /**
+   * Finds the agents inside each box.
+   *
+   * Runs all queries in one call against the crowd's proximity grid, which holds the agents registered by the last `update`.
+   * Agents removed since then are skipped, agents added since then are found after the next `update`.
+   * @param boxes the query boxes
+   */
+  queryAgentsInBox(
+    boxes: { min: Vector3; max: Vector3 }[]
+  ): CrowdAgentQueryResult {
+    return this.runAgentQuery((offsets, indices) =>
+      this.raw.queryAgentsInBox(
+        boxes.flatMap((box) => vec3.toArray(box.min)),
+        boxes.flatMap((box) => vec3.toArray(box.max)),
+        boxes.length,
+        offsets.raw,
+        indices.raw
+      )
+    );
+  }
+
+  private runAgentQuery(
+    query: (offsets: IntArray, indices: IntArray) => void
+  ): CrowdAgentQueryResult {
+    const offsets = new IntArray();
+    const indices = new IntArray();
+
+    query(offsets, indices);
+
+    const result = {
+      offsets: offsets.toTypedArray(),
+      indices: indices.toTypedArray(),
+    };
+
+    offsets.destroy();
+    indices.destroy();
+
+    return result;
+  }
+
   /**
    * Gets the query filter for the specified index.
+   * The same filter is returned for an index, and it stays valid when the crowd capacity changes.
    * @param filterIndex the index of the query filter to retrieve, (min 0, max 15)
    * @returns the query filter
    */
   getFilter(filterIndex: number): QueryFilter {
-    return new QueryFilter(this.raw.getEditableFilter(filterIndex));
+    let filter = this.filters[filterIndex];
+
+    if (!filter) {
+      filter = new QueryFilter(this.raw.getEditableFilter(filterIndex));
+      this.filters[filterIndex] = filter;
+    }
+
+    return filter;
+  }
+
+  /**
+   * Sets the level of detail tiers, ordered from nearest to furthest.
+   * Agents are assigned the first tier whose distance contains their nearest focus point, or the last tier.
+   * @param tiers up to 4 tiers, unspecified values use the defaults
+   */
+  setLodTiers(tiers: Partial<CrowdLodTier>[]): void {
+    const params = new Raw.Module.CrowdLodTierParams();
+
+    tiers.forEach((tier, index) => {
+      const {
+        distance,
+        updateInterval,
+        boundaryUpdateScale,
+        obstacleAvoidance,
+      } = {
+        ...crowdLodTierDefaults,
+        ...tier,
+      };
+
+      params.distance = distance;
+      params.updateInterval = updateInterval;
+      params.boundaryUpdateScale = boundaryUpdateScale;
+      params.obstacleAvoidance = obstacleAvoidance;
+
+      this.raw.setLodTierParams(index, params);
+    });
+
+    Raw.destroy(params);
+
+    this.raw.setLodTierCount(Math.max(1, tiers.length));
+  }
+
+  /**
+   * Sets the points, e.g. player or camera positions, agent level of detail tiers are derived from.
+   * With no focus points every agent without a pinned tier uses the first tier.
+   */
+  setLodFocusPoints(points: Vector3[]): void {
+    const flat = points.flatMap((point) => vec3.toArray(point));
+
+    this.raw.setLodFocusPoints(flat, points.length);
+  }
+
+  /**
+   * Returns agent counts and timings for each level of detail tier from the last crowd update.
+   */
+  getLodTierStats(): CrowdLodTierStats[] {
+    const stats: CrowdLodTierStats[] = [];
+
+    for (let i = 0; i < this.raw.getLodTierCount(); i++) {
+      const { agentCount, updatedAgentCount, updateTime } =
+        this.raw.getLodTierStats(i);
+
+      stats.push({ agentCount, updatedAgentCount, updateTime });
+    }
+
+    return stats;
+  }
+
+  /**
+   * Returns profiling statistics for the last crowd update: time spent per phase, path queue activity and proximity grid occupancy.
+   */
+  getUpdateStats(): CrowdUpdateStats {
+    const stats = this.raw.getUpdateStats();
+
+    return {
+      totalTime: stats.totalTime,
+      lodTime: stats.lodTime,
+      pathValidityTime: stats.pathValidityTime,
+      moveRequestTime: stats.moveRequestTime,
+      topologyOptimizationTime: stats.topologyOptimizationTime,
+      proximityGridTime: stats.proximityGridTime,
+      neighbourhoodTime: stats.neighbourhoodTime,
+      offMeshTriggerTime: stats.offMeshTriggerTime,
+      steeringTime: stats.steeringTime,
+      velocityPlanningTime: stats.velocityPlanningTime,
+      integrationTime: stats.integrationTime,
+      collisionTime: stats.collisionTime,
+      positionTime: stats.positionTime,
+      offMeshAnimationTime: stats.offMeshAnimationTime,
+      pathQueueDepth: stats.pathQueueDepth,
+      pathQueueWaiting: stats.pathQueueWaiting,
+      pathRequestsIssued: stats.pathRequestsIssued,
+      pathRequestsServed: stats.pathRequestsServed,
+      pathRequestsFailed: stats.pathRequestsFailed,
+      pathRequestsDropped: stats.pathRequestsDropped,
+      replans: stats.replans,
+      topologyOptimizations: stats.topologyOptimizations,
+      gridItemCount: stats.gridItemCount,
+      gridCellEntries: stats.gridCellEntries,
+      gridMaxCellOccupancy: stats.gridMaxCellOccupancy,
+    };
+  }
+
+  /**
+   * Returns the events recorded by crowd updates since the last call, oldest first.
+   * Call once per frame instead of polling each agent's state.
+   */
+  drainEvents(): CrowdEvent[] {
+    const packed = new IntArray();
+    const count = this.raw.drainEvents(packed.raw);
+    const data = packed.getHeapView();
+
+    const types: Record<number, CrowdEventType> = {
+      [Raw.Module.CROWD_EVENT_TARGET_REACHED]: 'targetReached',
+      [Raw.Module.CROWD_EVENT_OFFMESH_ENTERED]: 'offMeshEntered',
+      [Raw.Module.CROWD_EVENT_OFFMESH_LEFT]: 'offMeshLeft',
+      [Raw.Module.CROWD_EVENT_BECAME_INVALID]: 'becameInvalid',
+      [Raw.Module.CROWD_EVENT_PATH_PARTIAL]: 'pathPartial',
+      [Raw.Module.CROWD_EVENT_REPLANNED]: 'replanned',
+    };
+
+    const events: CrowdEvent[] = [];
+    for (let i = 0; i < count; i++) {
+      events.push({
+        type: types[data[i * 2]],
+        agentIndex: data[i * 2 + 1],
+      });
+    }
+
+    packed.destroy();
+
+    return events;
+  }
+
+  /**
+   * Sets how many events are kept between drains, when exceeded the oldest events are dropped.
+   * Changing the capacity clears recorded events.
+   */
+  setEventCapacity(capacity: number): void {
+    this.raw.setEventCapacity(capacity);
+  }
+
+  /**
+   * Returns how many events are kept between drains.
+   */
+  getEventCapacity(): number {
+    return this.raw.getEventCapacity();
+  }
+
+  /**
+   * Returns the total number of events dropped because they were not drained in time.
+   */
+  getDroppedEventCount(): number {
+    return this.raw.getDroppedEventCount();
+  }
+
+  /**
+   * Adds a moving circle obstacle that agents with obstacle avoidance steer around, without rebuilding the nav mesh.
+   * Obstacles only steer agents, agents are not pushed out of them.
+   * @param position the base of the obstacle
+   * @param velocity used to predict the obstacle's movement
+   * @returns the obstacle id, or -1 if the obstacle could not be added
+   */
+  addCircleObstacle(
+    position: Vector3,
+    radius: number,
+    height: number,
+    velocity: Vector3 = { x: 0, y: 0, z: 0 }
+  ): number {
+    return this.raw.addCircleObstacle(
+      vec3.toArray(position),
+      radius,
+      height,
+      vec3.toArray(velocity)
+    );
+  }
+
+  /**
+   * Adds a moving oriented box obstacle that agents with obstacle avoidance steer around, without rebuilding the nav mesh.
+   * Moving boxes are avoided as a chain of circles covering them, static boxes by their outline.
+   * @param position the center of the box
+   * @param angle rotation around the y axis in radians, as for tile cache box obstacles
+   * @param velocity used to predict the obstacle's movement
+   * @returns the obstacle id, or -1 if the obstacle could not be added
+   */
+  addBoxObstacle(
+    position: Vector3,
+    halfExtents: Vector3,
+    angle: number,
+    velocity: Vector3 = { x: 0, y: 0, z: 0 }
+  ): number {
+    return this.raw.addBoxObstacle(
+      vec3.toArray(position),
+      vec3.toArray(halfExtents),
+      angle,
+      vec3.toArray(velocity)
+    );
+  }
+
+  /**
+   * Moves a crowd obstacle. Takes effect on the next crowd update.
+   * @param angle rotation around the y axis in radians, ignored for circle obstacles
+   */
+  updateObstacle(
+    id: number,
+    position: Vector3,
+    angle: number,
+    velocity: Vector3 = { x: 0, y: 0, z: 0 }
+  ): boolean {
+    return this.raw.updateObstacle(
+      id,
+      vec3.toArray(position),
+      angle,
+      vec3.toArray(velocity)
+    );
+  }
+
+  /**
+   * Removes a crowd obstacle.
+   */
+  removeObstacle(id: number): boolean {
+    return this.raw.removeObstacle(id);
+  }
+
+  /**
+   * Returns the number of crowd obstacles.
+   */
+  getObstacleCount(): number {
+    return this.raw.getObstacleCount();
+  }
+
+  /**
+   * Sets how many crowd obstacles in range of an agent are considered before the nearest 8 are avoided.
+   * Past the limit obstacles are dropped in no particular order, raise it when agents are in range of many obstacles at once.
+   * @default 32
+   */
+  setMaxObstacleCandidates(count: number): void {
+    this.raw.setMaxObstacleCandidates(count);
+  }
+
+  /**
+   * Returns how many crowd obstacles in range of an agent are considered.
+   */
+  getMaxObstacleCandidates(): number {
+    return this.raw.getMaxObstacleCandidates();
+  }
+
+  /**
+   * Sets the number of threads the crowd update is spread across, including the calling thread.
+   * Always 1 unless @recast-navigation/wasm was built with threads enabled.
+   * Clamped so the worker threads of every crowd and tile cache fit in the pthread pool, use `getThreadCount` to check the result.
+   */
+  setThreadCount(threads: number): void {
+    this.raw.setThreadCount(threads);
+  }
+
+  /**
+   * Returns the number of threads the crowd update is spread across.
+   */
+  getThreadCount(): number {
+    return this.raw.getThreadCount();
+  }
+
+  /**
+   * Sets whether obstacle avoidance velocities are sampled four candidates at a time.
+   * Enabled by default when @recast-navigation/wasm was built with SIMD, chosen velocities match the scalar sampler.
+   */
+  setSimdObstacleAvoidance(enabled: boolean): void {
+    this.raw.setSimdObstacleAvoidance(enabled);
+  }
+
+  /**
+   * Returns whether obstacle avoidance velocities are sampled four candidates at a time.
+   */
+  getSimdObstacleAvoidance(): boolean {
+    return this.raw.getSimdObstacleAvoidance();
   }
 
   /**
    * Destroys the crowd.
    */
   destroy(): void {
-    Raw.Detour.freeCrowd(this.raw);
+    this.raw.destroy();
+    Raw.Module.destroy(this.raw);
   }
 }
@@ -0,0 +1,256 @@
+import { NavMesh } from './nav-mesh';
+import { NavMeshQuery } from './nav-mesh-query';
+import { Raw, RawModule } from './raw';
+import {
+  RecastCompactHeightfield,
+  RecastContourSet,
+  RecastHeightfield,
+  RecastHeightfieldLayer,
+  RecastHeightfieldLayerSet,
+  RecastPolyMesh,
+  RecastPolyMeshDetail,
+} from './recast';
+
+export type DebugDrawerBuffer = {
+  /**
+   * Vertex positions, 3 floats per vertex
+   */
+  positions: Float32Array;
+
+  /**
+   * Vertex colors, 4 normalizable bytes per vertex (r, g, b, a)
+   */
+  colors: Uint8Array;
+
+  /**
+   * Vertex indices, 1 per point, 2 per line, 3 per triangle
+   */
+  indices: Uint32Array;
+};
+
+export type DebugDrawerBuffers = {
+  points: DebugDrawerBuffer;
+  lines: DebugDrawerBuffer;
+  /**
+   * Triangles, including quads split into two triangles
+   */
+  tris: DebugDrawerBuffer;
+};
+
+/**
+ * Draws debug geometry into packed vertex buffers in wasm memory.
+ *
+ * Unlike `DebugDrawerUtils`, no JS is called per vertex. The returned buffers are views into wasm memory, and are only valid until the next draw, or until wasm memory grows. Upload or copy them before drawing again.
+ */
+export class DebugDrawerBufferUtils {
+  raw: RawModule.DebugDrawBuffers;
+
+  constructor() {
+    this.raw = new Raw.Module.DebugDrawBuffers();
+  }
+
+  drawHeightfieldSolid(hf: RecastHeightfield): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawHeightfieldSolid(this.raw, hf.raw)
+    );
+  }
+
+  drawHeightfieldWalkable(hf: RecastHeightfield): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawHeightfieldWalkable(this.raw, hf.raw)
+    );
+  }
+
+  drawCompactHeightfieldSolid(
+    chf: RecastCompactHeightfield
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawCompactHeightfieldSolid(this.raw, chf.raw)
+    );
+  }
+
+  drawCompactHeightfieldRegions(
+    chf: RecastCompactHeightfield
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawCompactHeightfieldRegions(this.raw, chf.raw)
+    );
+  }
+
+  drawCompactHeightfieldDistance(
+    chf: RecastCompactHeightfield
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawCompactHeightfieldDistance(
+        this.raw,
+        chf.raw
+      )
+    );
+  }
+
+  drawHeightfieldLayer(
+    layer: RecastHeightfieldLayer,
+    idx: number
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawHeightfieldLayer(this.raw, layer.raw, idx)
+    );
+  }
+
+  drawHeightfieldLayers(lset: RecastHeightfieldLayerSet): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawHeightfieldLayers(this.raw, lset.raw)
+    );
+  }
+
+  drawRegionConnections(
+    cset: RecastContourSet,
+    alpha: number = 1
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawRegionConnections(this.raw, cset.raw, alpha)
+    );
+  }
+
+  drawRawContours(
+    cset: RecastContourSet,
+    alpha: number = 1
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawRawContours(this.raw, cset.raw, alpha)
+    );
+  }
+
+  drawContours(cset: RecastContourSet, alpha: number = 1): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawContours(this.raw, cset.raw, alpha)
+    );
+  }
+
+  drawPolyMesh(mesh: RecastPolyMesh): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawPolyMesh(this.raw, mesh.raw)
+    );
+  }
+
+  drawPolyMeshDetail(dmesh: RecastPolyMeshDetail): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.RecastDebugDraw.debugDrawPolyMeshDetail(this.raw, dmesh.raw)
+    );
+  }
+
+  drawNavMesh(mesh: NavMesh, flags: number = 0): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMesh(
+        this.raw,
+        mesh.raw.getNavMesh(),
+        flags
+      )
+    );
+  }
+
+  drawNavMeshWithClosedList(
+    mesh: NavMesh,
+    query: NavMeshQuery,
+    flags: number = 0
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMeshWithClosedList(
+        this.raw,
+        mesh.raw.m_navMesh,
+        query.raw.m_navQuery,
+        flags
+      )
+    );
+  }
+
+  drawNavMeshNodes(query: NavMeshQuery): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMeshNodes(this.raw, query.raw.m_navQuery)
+    );
+  }
+
+  drawNavMeshBVTree(mesh: NavMesh): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMeshBVTree(this.raw, mesh.raw.m_navMesh)
+    );
+  }
+
+  drawNavMeshPortals(mesh: NavMesh): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMeshPortals(this.raw, mesh.raw.m_navMesh)
+    );
+  }
+
+  drawNavMeshPolysWithFlags(
+    mesh: NavMesh,
+    flags: number,
+    col: number
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMeshPolysWithFlags(
+        this.raw,
+        mesh.raw.m_navMesh,
+        flags,
+        col
+      )
+    );
+  }
+
+  drawNavMeshPoly(
+    mesh: NavMesh,
+    ref: number,
+    col: number
+  ): DebugDrawerBuffers {
+    return this.draw(() =>
+      Raw.DetourDebugDraw.debugDrawNavMeshPoly(
+        this.raw,
+        mesh.raw.m_navMesh,
+        ref,
+        col
+      )
+    );
+  }
+
+  /**
+   * Disposes of the debug drawer and releases resources.
+   */
+  dispose(): void {
+    Raw.Module.destroy(this.raw);
+  }
+
+  private draw(fn: () => void): DebugDrawerBuffers {
+    this.raw.clear();
+
+    fn();
+
+    return {
+      points: this.getBuffer(Raw.Module.DU_DRAW_POINTS),
+      lines: this.getBuffer(Raw.Module.DU_DRAW_LINES),
+      tris: this.getBuffer(Raw.Module.DU_DRAW_TRIS),
+    };
+  }
+
+  private getBuffer(prim: number): DebugDrawerBuffer {
+    const vertexCount = this.raw.getVertexCount(prim);
+    const indexCount = this.raw.getIndexCount(prim);
+
+    return {
+      positions: new Float32Array(
+        Raw.Module.HEAPF32.buffer,
+        this.raw.getPositions(prim),
+        vertexCount * 3
+      ),
+      colors: new Uint8Array(
+        Raw.Module.HEAPU8.buffer,
+        this.raw.getColors(prim),
+        vertexCount * 4
+      ),
+      indices: new Uint32Array(
+        Raw.Module.HEAPU32.buffer,
+        this.raw.getIndices(prim),
+        indexCount
+      ),
+    };
+  }
+}
@@ -1,5 +1,6 @@
 export * from './arrays';
 export * from './crowd';
+export * from './debug-drawer-buffers';
 export * from './debug-drawer-utils';
 export * from './detour';
 export * from './nav-mesh';
@@ -9,4 +10,5 @@ export * from './raw';
 export * from './recast';
 export * from './serdes';
 export * from './tile-cache';
+export * from './tile-cache-streamer';
 export * from './utils';
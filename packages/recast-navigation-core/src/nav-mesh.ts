@@ -97,6 +97,59 @@ export type NavMeshParamsType = {
   maxPolys: number;
 };
 
+export type NavMeshPolyEdit = {
+  /**
+   * Flag bits to set
+   */
+  setFlags?: number;
+
+  /**
+   * Flag bits to clear, cleared before `setFlags` are set
+   */
+  clearFlags?: number;
+
+  /**
+   * The area to set, the area is unchanged if not given
+   */
+  area?: number;
+};
+
+/**
+ * The previous flags and areas of the polys bulk poly edits changed, for undoing them with `NavMesh.undoPolyEdit`.
+ * Only polys whose flags or area changed are recorded. A record can be passed to several edits, they are undone together.
+ */
+export class NavMeshPolyEditRecord {
+  raw: RawModule.NavMeshPolyEditRecord;
+
+  constructor() {
+    this.raw = new Raw.Module.NavMeshPolyEditRecord();
+  }
+
+  /**
+   * The number of polys recorded
+   */
+  get polyCount(): number {
+    return this.raw.getPolyCount();
+  }
+
+  /**
+   * The refs of the recorded polys
+   */
+  getPolyRefs(): number[] {
+    return Array.from({ length: this.polyCount }, (_, i) =>
+      this.raw.getPolyRef(i)
+    );
+  }
+
+  clear(): void {
+    this.raw.clear();
+  }
+
+  destroy(): void {
+    Raw.destroy(this.raw);
+  }
+}
+
 export class NavMeshParams {
   constructor(public raw: RawModule.dtNavMeshParams) {}
 
@@ -456,6 +509,118 @@ export class NavMesh {
     return this.raw.setPolyArea(ref, area);
   }
 
+  /**
+   * Sets or clears flag bits and sets the area of the polys whose bounds overlap a box.
+   * @param min the box minimum
+   * @param max the box maximum
+   * @param edit the flags and area to set
+   * @param undo records the previous flags and areas of the polys that changed
+   * @returns the number of polys that changed
+   */
+  editPolysInBox(
+    min: Vector3,
+    max: Vector3,
+    edit: NavMeshPolyEdit,
+    undo?: NavMeshPolyEditRecord
+  ): number {
+    const { setFlags = 0, clearFlags = 0, area = -1 } = edit;
+
+    return this.raw.editPolysInBox(
+      vec3.toArray(min),
+      vec3.toArray(max),
+      setFlags,
+      clearFlags,
+      area,
+      undo?.raw as never
+    );
+  }
+
+  /**
+   * Sets or clears flag bits and sets the area of the polys whose center is inside a convex volume.
+   * @param vertices the convex polygon of the volume on the xz plane
+   * @param minHeight the volume's minimum height
+   * @param maxHeight the volume's maximum height
+   * @param edit the flags and area to set
+   * @param undo records the previous flags and areas of the polys that changed
+   * @returns the number of polys that changed
+   */
+  editPolysInConvexVolume(
+    vertices: Vector3[],
+    minHeight: number,
+    maxHeight: number,
+    edit: NavMeshPolyEdit,
+    undo?: NavMeshPolyEditRecord
+  ): number {
+    const { setFlags = 0, clearFlags = 0, area = -1 } = edit;
+
+    return this.raw.editPolysInConvexVolume(
+      vertices.flatMap((v) => vec3.toArray(v)),
+      vertices.length,
+      minHeight,
+      maxHeight,
+      setFlags,
+      clearFlags,
+      area,
+      undo?.raw as never
+    );
+  }
+
+  /**
+   * Sets or clears flag bits and sets the area of the polys with an area.
+   * @param matchArea the area of the polys to edit
+   * @param edit the flags and area to set
+   * @param undo records the previous flags and areas of the polys that changed
+   * @returns the number of polys that changed
+   */
+  editPolysWithArea(
+    matchArea: number,
+    edit: NavMeshPolyEdit,
+    undo?: NavMeshPolyEditRecord
+  ): number {
+    const { setFlags = 0, clearFlags = 0, area = -1 } = edit;
+
+    return this.raw.editPolysWithArea(
+      matchArea,
+      setFlags,
+      clearFlags,
+      area,
+      undo?.raw as never
+    );
+  }
+
+  /**
+   * Sets or clears flag bits and sets the area of polys by ref. Invalid refs are skipped.
+   * @param refs the poly refs
+   * @param edit the flags and area to set
+   * @param undo records the previous flags and areas of the polys that changed
+   * @returns the number of polys that changed
+   */
+  editPolys(
+    refs: ArrayLike<number>,
+    edit: NavMeshPolyEdit,
+    undo?: NavMeshPolyEditRecord
+  ): number {
+    const { setFlags = 0, clearFlags = 0, area = -1 } = edit;
+
+    return this.raw.editPolys(
+      Array.from(refs),
+      refs.length,
+      setFlags,
+      clearFlags,
+      area,
+      undo?.raw as never
+    );
+  }
+
+  /**
+   * Restores the flags and areas recorded by bulk poly edits, then clears the record.
+   * Polys in tiles that were rebuilt since the edits are skipped.
+   * @returns the number of polys restored
+   */
+  undoPolyEdit(undo: NavMeshPolyEditRecord): number {
+    return this.raw.undoPolyEdit(undo.raw);
+  }
+
   /**
    * Gets the user defined area for the specified polygon.
    * @param ref The polygon reference.
@@ -486,6 +651,7 @@ export class NavMesh {
 
   /**
    * Stores the non-structural state of the tile in the specified buffer. (Flags, area ids, etc.)
+   * The result's data is owned by the nav mesh, and is valid until the next call.
    * @param tile The tile.
    * @param maxDataSize The size of the data buffer. [Limit: >= #getTileStateSize]
    * @returns
@@ -514,6 +680,66 @@ export class NavMesh {
     return this.raw.restoreTileState(tile.raw, data, maxDataSize);
   }
 
+  /**
+   * Packs the flags and area of every poly into one compact buffer, for persisting dynamic poly state.
+   * @returns the state, which can be restored with `restorePolyState` or diffed with `diffPolyState`
+   */
+  storePolyState(): Uint8Array {
+    const output = new UnsignedCharArray();
+
+    const size = this.raw.storePolyState(output.raw);
+    const state = output.getHeapView().slice(0, size);
+
+    output.destroy();
+
+    return state;
+  }
+
+  /**
+   * Packs the flags and area of only the polys that changed since a previous `storePolyState`.
+   * Polys of tiles the previous state has no record of are all included.
+   * @param previous a state from `storePolyState`
+   * @returns the diff, which can be applied with `restorePolyState`
+   */
+  diffPolyState(previous: Uint8Array): Uint8Array {
+    const previousArray = new UnsignedCharArray();
+    previousArray.copy(previous);
+
+    const output = new UnsignedCharArray();
+
+    const size = this.raw.diffPolyState(previousArray.raw, output.raw);
+    const diff = size >= 0 ? output.getHeapView().slice(0, size) : null;
+
+    previousArray.destroy();
+    output.destroy();
+
+    if (!diff) {
+      throw new Error('Failed to diff poly state, is it a poly state?');
+    }
+
+    return diff;
+  }
+
+  /**
+   * Restores a state from `storePolyState`, or applies a diff from `diffPolyState`.
+   * Tiles that were rebuilt since the state was stored are skipped.
+   * @returns the number of polys restored
+   */
+  restorePolyState(state: Uint8Array): number {
+    const stateArray = new UnsignedCharArray();
+    stateArray.copy(state);
+
+    const restored = this.raw.restorePolyState(stateArray.raw);
+
+    stateArray.destroy();
+
+    if (restored < 0) {
+      throw new Error('Failed to restore poly state, is it a poly state?');
+    }
+
+    return restored;
+  }
+
   /**
    * Destroys the NavMesh.
    */
@@ -15,6 +15,8 @@ const instances = [
   'DetourTileCacheBuilder',
   'NavMeshImporter',
   'NavMeshExporter',
+  'CrowdImporter',
+  'CrowdExporter',
   'CrowdUtils',
   'ChunkyTriMeshUtils',
   'RecastDebugDraw',
@@ -28,6 +30,7 @@ const classes = [
   'dtNavMeshCreateParams',
   'RecastLinearAllocator',
   'RecastFastLZCompressor',
+  'RecastTileCacheCompressor',
   'rcChunkyTriMesh',
   'dtTileCacheParams',
   'dtTileCacheLayerHeader',
@@ -168,6 +171,9 @@ export const Detour = {} as {
   DT_CROWDAGENT_TARGET_VELOCITY: number;
   DT_COMPRESSEDTILE_FREE_DATA: number;
   DT_TILE_FREE_DATA: number;
+  DT_OBSTACLE_CYLINDER: number;
+  DT_OBSTACLE_BOX: number;
+  DT_OBSTACLE_ORIENTED_BOX: number;
 };
 
 export const init = async (impl?: typeof Module) => {
@@ -285,4 +291,7 @@ export const init = async (impl?: typeof Module) => {
   Detour.DT_CROWDAGENT_TARGET_VELOCITY = Raw.Module.DT_CROWDAGENT_TARGET_VELOCITY;
   Detour.DT_COMPRESSEDTILE_FREE_DATA = Raw.Module.DT_COMPRESSEDTILE_FREE_DATA;
   Detour.DT_TILE_FREE_DATA = Raw.Module.DT_TILE_FREE_DATA;
+  Detour.DT_OBSTACLE_CYLINDER = Raw.Module.DT_OBSTACLE_CYLINDER;
+  Detour.DT_OBSTACLE_BOX = Raw.Module.DT_OBSTACLE_BOX;
+  Detour.DT_OBSTACLE_ORIENTED_BOX = Raw.Module.DT_OBSTACLE_ORIENTED_BOX;
 };
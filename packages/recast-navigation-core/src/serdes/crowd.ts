@@ -0,0 +1,64 @@
+import { Crowd, CrowdAgent } from '../crowd';
+import { Raw } from '../raw';
+
+/**
+ * Snapshots the state of every agent in a crowd, including corridors, local boundaries and move targets, along with the crowd's obstacles.
+ * Agent `userData` is not part of the snapshot.
+ *
+ * Snapshots are meant to be restored with `importCrowd` into a crowd on the same nav mesh.
+ */
+export const exportCrowd = (crowd: Crowd): Uint8Array => {
+  const crowdExport = Raw.CrowdExporter.exportCrowd(crowd.raw);
+
+  const arrView = new Uint8Array(
+    Raw.Module.HEAPU8.buffer,
+    crowdExport.dataPointer,
+    crowdExport.size
+  );
+
+  const data = new Uint8Array(crowdExport.size);
+  data.set(arrView);
+  Raw.CrowdExporter.freeCrowdExport(crowdExport);
+
+  return data;
+};
+
+/**
+ * Restores a snapshot created with `exportCrowd`.
+ *
+ * The crowd must use the same nav mesh as the exported crowd, it grows to the exported crowd's max agents if needed.
+ * Agents keep their indices and obstacles their ids, ones that are not in the snapshot are removed.
+ * Agents that were already in the crowd keep their `userData`, other agents have none.
+ * Pending path requests are queued again on the next update.
+ *
+ * @returns true if the snapshot was restored, the crowd is left unchanged otherwise
+ */
+export const importCrowd = (crowd: Crowd, data: Uint8Array): boolean => {
+  const dataPtr = Raw.Module._malloc(data.length);
+  Raw.Module.HEAPU8.set(data, dataPtr);
+
+  const crowdExport = new Raw.Module.CrowdExport();
+  crowdExport.dataPointer = dataPtr;
+  crowdExport.size = data.length;
+
+  const success = Raw.CrowdImporter.importCrowd(crowd.raw, crowdExport);
+
+  Raw.Module._free(dataPtr);
+  Raw.Module.destroy(crowdExport);
+
+  if (!success) return false;
+
+  crowd.syncAgentCapacity();
+
+  for (let i = 0; i < crowd.getAgentCount(); i++) {
+    if (!crowd.raw.getAgent(i).active) {
+      delete crowd.agents[i];
+    } else if (!crowd.agents[i]) {
+      crowd.agents[i] = new CrowdAgent(crowd, i);
+    } else {
+      crowd.agents[i].interpolatedPosition = crowd.agents[i].position();
+    }
+  }
+
+  return true;
+};
@@ -1,6 +1,11 @@
+import { UnsignedCharArray } from '../arrays';
 import { NavMesh } from '../nav-mesh';
-import { TileCache } from '../tile-cache';
-import { Raw } from '../raw';
+import {
+  TileCache,
+  TileCacheCompressorType,
+  createTileCacheCompressor,
+} from '../tile-cache';
+import { Raw, type RawModule } from '../raw';
 
 const exportImpl = (navMesh: NavMesh, tileCache?: TileCache): Uint8Array => {
   const navMeshExport = Raw.NavMeshExporter.exportNavMesh(
@@ -8,19 +13,31 @@ const exportImpl = (navMesh: NavMesh, tileCache?: TileCache): Uint8Array => {
     tileCache?.raw as never
   );
 
-  const arrView = new Uint8Array(
-    Raw.Module.HEAPU8.buffer,
+  // a single copy out of the wasm heap, into a buffer that can be transferred
+  const data = Raw.Module.HEAPU8.slice(
     navMeshExport.dataPointer,
-    navMeshExport.size
+    navMeshExport.dataPointer + navMeshExport.size
   );
 
-  const data = new Uint8Array(navMeshExport.size);
-  data.set(arrView);
   Raw.NavMeshExporter.freeNavMeshExport(navMeshExport);
 
   return data;
 };
 
+const exportIntoImpl = (
+  navMesh: NavMesh,
+  tileCache: TileCache | undefined,
+  output: UnsignedCharArray
+): Uint8Array => {
+  const size = Raw.NavMeshExporter.exportNavMeshInto(
+    navMesh.raw,
+    tileCache?.raw as never,
+    output.raw
+  );
+
+  return output.getHeapView().subarray(0, size);
+};
+
 export const exportNavMesh = (navMesh: NavMesh): Uint8Array => {
   return exportImpl(navMesh);
 };
@@ -31,3 +48,121 @@ export const exportTileCache = (
 ): Uint8Array => {
   return exportImpl(navMesh, tileCache);
 };
+
+/**
+ * Exports a nav mesh with a tile directory, so single tiles or regions can be loaded with an `IndexedNavMeshImporter`.
+ * `importNavMesh` also imports indexed exports, loading every tile.
+ * @param compressorType compresses each tile on its own, tiles are only decompressed when they are loaded
+ */
+export const exportNavMeshIndexed = (
+  navMesh: NavMesh,
+  compressorType: TileCacheCompressorType = 'none'
+): Uint8Array => {
+  const compressor = createTileCacheCompressor(compressorType);
+
+  const navMeshExport = Raw.NavMeshExporter.exportNavMeshIndexed(
+    navMesh.raw,
+    compressor
+  );
+
+  Raw.destroy(compressor);
+
+  const data = Raw.Module.HEAPU8.slice(
+    navMeshExport.dataPointer,
+    navMeshExport.dataPointer + navMeshExport.size
+  );
+
+  Raw.NavMeshExporter.freeNavMeshExport(navMeshExport);
+
+  return data;
+};
+
+/**
+ * Returns the size in bytes of a nav mesh export, or a tile cache export if a tile cache is given.
+ */
+export const getNavMeshExportSize = (
+  navMesh: NavMesh,
+  tileCache?: TileCache
+): number => {
+  return Raw.NavMeshExporter.getExportSize(
+    navMesh.raw,
+    tileCache?.raw as never
+  );
+};
+
+/**
+ * Exports a nav mesh into an UnsignedCharArray, without copying it out of the wasm heap.
+ * The array is only reallocated when it is too small, so it can be reused across exports.
+ * @returns a view of the export in the wasm heap, valid until the array is resized or destroyed, or the wasm memory grows
+ */
+export const exportNavMeshInto = (
+  navMesh: NavMesh,
+  output: UnsignedCharArray
+): Uint8Array => {
+  return exportIntoImpl(navMesh, undefined, output);
+};
+
+/**
+ * Exports a tile cache into an UnsignedCharArray, without copying it out of the wasm heap.
+ * The array is only reallocated when it is too small, so it can be reused across exports.
+ * @returns a view of the export in the wasm heap, valid until the array is resized or destroyed, or the wasm memory grows
+ */
+export const exportTileCacheInto = (
+  navMesh: NavMesh,
+  tileCache: TileCache,
+  output: UnsignedCharArray
+): Uint8Array => {
+  return exportIntoImpl(navMesh, tileCache, output);
+};
+
+/**
+ * Tracks which tiles of a nav mesh change between snapshots, so only the tiles that changed are sent to clients.
+ *
+ * Tiles are compared by tile ref, which changes whenever a tile is removed, added, or rebuilt, such as by tile cache obstacles.
+ * Poly flag and area changes are not tracked.
+ *
+ * Clients import a full export of the nav mesh at snapshot 0, then apply deltas with `applyNavMeshDelta`.
+ */
+export class NavMeshDeltaTracker {
+  raw: RawModule.NavMeshDeltaTracker;
+
+  /**
+   * @param navMesh the nav mesh to track, the tiles it has now are snapshot 0
+   */
+  constructor(navMesh: NavMesh) {
+    this.raw = new Raw.Module.NavMeshDeltaTracker(navMesh.raw);
+  }
+
+  /**
+   * Records the tiles that changed since the last snapshot.
+   * @returns the new snapshot id, which only advances when tiles changed
+   */
+  snapshot(): number {
+    return this.raw.snapshot();
+  }
+
+  getSnapshotId(): number {
+    return this.raw.getSnapshotId();
+  }
+
+  /**
+   * Takes a snapshot, then exports the tiles added, replaced, or removed after `sinceSnapshotId`.
+   * @param sinceSnapshotId the snapshot id the client is at
+   */
+  exportDelta(sinceSnapshotId: number): Uint8Array {
+    const navMeshExport = this.raw.exportDelta(sinceSnapshotId);
+
+    const data = Raw.Module.HEAPU8.slice(
+      navMeshExport.dataPointer,
+      navMeshExport.dataPointer + navMeshExport.size
+    );
+
+    Raw.NavMeshExporter.freeNavMeshExport(navMeshExport);
+
+    return data;
+  }
+
+  destroy(): void {
+    Raw.destroy(this.raw);
+  }
+}
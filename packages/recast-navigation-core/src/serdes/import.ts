@@ -1,6 +1,13 @@
 import { NavMesh } from '../nav-mesh';
 import { Raw, type RawModule } from '../raw';
-import { TileCache, TileCacheMeshProcess } from '../tile-cache';
+import {
+  TileCache,
+  TileCacheCompressorType,
+  TileCacheMeshProcess,
+  toTileCacheCompressorType,
+} from '../tile-cache';
+import { TileCacheStreamer } from '../tile-cache-streamer';
+import { Vector3, vec3 } from '../utils';
 
 const createNavMeshExport = (data: Uint8Array) => {
   const nDataBytes = data.length * data.BYTES_PER_ELEMENT;
@@ -38,11 +45,34 @@ export const importNavMesh = (
   return { navMesh };
 };
 
+/**
+ * Imports a nav mesh export without copying each tile.
+ * The export is copied into the wasm heap once, and the nav mesh tiles point into that copy, which the nav mesh frees when destroyed.
+ * This halves peak memory use while importing large nav meshes.
+ */
+export const importNavMeshInPlace = (
+  data: Uint8Array
+): ImportNavMeshResult => {
+  const { navMeshExport, dataHeap } = createNavMeshExport(data);
+
+  const result = Raw.NavMeshImporter.importNavMeshInPlace(navMeshExport);
+
+  if (!result.success) {
+    Raw.Module._free(dataHeap.byteOffset);
+
+    throw new Error('Failed to import nav mesh, is it a nav mesh export?');
+  }
+
+  const navMesh = new NavMesh(result.navMesh);
+
+  return { navMesh };
+};
+
 export type ImportTileCacheResult = {
   navMesh: NavMesh;
   tileCache: TileCache;
   allocator: RawModule.RecastLinearAllocator;
-  compressor: RawModule.RecastFastLZCompressor;
+  compressor: RawModule.RecastTileCacheCompressor;
 };
 
 export const importTileCache = (
@@ -66,3 +96,221 @@ export const importTileCache = (
 
   return { navMesh, tileCache, allocator, compressor };
 };
+
+export type ImportTileCacheStreamingResult = ImportTileCacheResult & {
+  streamer: TileCacheStreamer;
+};
+
+/**
+ * Imports a tile cache export without loading any tiles.
+ * Tiles are loaded and evicted around focus points by the returned `TileCacheStreamer`.
+ *
+ * The export is not copied into wasm memory, tiles are read from `data` as they load, so it must not be modified while the streamer is in use.
+ */
+export const importTileCacheStreaming = (
+  data: Uint8Array,
+  tileCacheMeshProcess: TileCacheMeshProcess
+): ImportTileCacheStreamingResult => {
+  const source = new Raw.Module.TileCacheStreamerSource();
+
+  source.read = (offset: number, size: number, outputPtr: number) => {
+    if (offset < 0 || size < 0 || offset + size > data.length) {
+      return false;
+    }
+
+    const output = Raw.Module.wrapPointer(
+      outputPtr,
+      Raw.Module.UnsignedCharArray
+    );
+
+    Raw.Module.HEAPU8.set(
+      data.subarray(offset, offset + size),
+      output.getDataPointer()
+    );
+
+    return true;
+  };
+
+  const result = Raw.NavMeshImporter.importTileCacheStreaming(
+    source,
+    data.length,
+    tileCacheMeshProcess.raw as never
+  );
+
+  if (!result.success) {
+    Raw.destroy(source);
+    throw new Error('Failed to import tile cache, is it a tile cache export?');
+  }
+
+  const navMesh = new NavMesh(result.navMesh);
+  const tileCache = new TileCache(result.tileCache);
+  const streamer = new TileCacheStreamer(result.streamer, source);
+
+  const allocator = result.allocator;
+  const compressor = result.compressor;
+
+  return { navMesh, tileCache, allocator, compressor, streamer };
+};
+
+export type ApplyNavMeshDeltaResult = {
+  /**
+   * The snapshot id the nav mesh is at after applying the delta
+   */
+  snapshotId: number;
+
+  /**
+   * The number of tiles added, including replaced tiles
+   */
+  added: number;
+
+  /**
+   * The number of tiles removed, including replaced tiles
+   */
+  removed: number;
+};
+
+/**
+ * Applies a delta from `NavMeshDeltaTracker.exportDelta` to a nav mesh in place.
+ * The nav mesh must have the tracked nav mesh's tile layout, such as an import of an export of it.
+ * Tiles keep their tile refs, so poly refs stay in sync with the tracked nav mesh.
+ * Throws if the delta is invalid, was not exported since `snapshotId`, or doesn't fit the nav mesh, which is then left unchanged.
+ * @param snapshotId the snapshot id the nav mesh is at, 0 for a full export
+ */
+export const applyNavMeshDelta = (
+  navMesh: NavMesh,
+  data: Uint8Array,
+  snapshotId: number
+): ApplyNavMeshDeltaResult => {
+  const { navMeshExport, dataHeap } = createNavMeshExport(data);
+
+  const result = Raw.NavMeshImporter.applyNavMeshDelta(
+    navMesh.raw,
+    navMeshExport,
+    snapshotId
+  );
+
+  Raw.Module._free(dataHeap.byteOffset);
+  Raw.destroy(navMeshExport);
+
+  if (!result.success) {
+    throw new Error('Failed to apply nav mesh delta');
+  }
+
+  const { snapshotId, added, removed } = result;
+
+  return { snapshotId, added, removed };
+};
+
+export type IndexedNavMeshTile = {
+  x: number;
+  y: number;
+  layer: number;
+
+  /**
+   * The size of the tile in the export in bytes, compressed if the export is
+   */
+  size: number;
+
+  /**
+   * The size of the tile data in bytes once loaded
+   */
+  dataSize: number;
+};
+
+/**
+ * Loads single tiles or regions of an indexed nav mesh export, created with `exportNavMeshIndexed`.
+ *
+ * The export has a tile directory, so tiles are found without reading the tiles before them.
+ * It is copied into the wasm heap once, and kept until `destroy` is called.
+ * Compressed tiles stay compressed until they are loaded.
+ */
+export class IndexedNavMeshImporter {
+  raw: RawModule.NavMeshIndexedImporter;
+
+  private dataPointer: number;
+
+  constructor(data: Uint8Array) {
+    const { navMeshExport, dataHeap } = createNavMeshExport(data);
+
+    this.dataPointer = dataHeap.byteOffset;
+    this.raw = new Raw.Module.NavMeshIndexedImporter();
+
+    const success = this.raw.init(navMeshExport);
+    Raw.destroy(navMeshExport);
+
+    if (!success) {
+      this.destroy();
+
+      throw new Error('Failed to read indexed nav mesh export');
+    }
+  }
+
+  /**
+   * Creates an empty nav mesh with the export's params, for tiles to be loaded into.
+   */
+  createNavMesh(): NavMesh {
+    return new NavMesh(this.raw.createNavMesh());
+  }
+
+  getTileCount(): number {
+    return this.raw.getTileCount();
+  }
+
+  /**
+   * The compressor type the tiles were exported with, `none` if they are not compressed
+   */
+  getCompressorType(): TileCacheCompressorType {
+    return toTileCacheCompressorType(this.raw.getCompressorType());
+  }
+
+  getTile(index: number): IndexedNavMeshTile {
+    const { x, y, layer, size, dataSize } = this.raw.getTile(index);
+
+    return { x, y, layer, size, dataSize };
+  }
+
+  /**
+   * @returns the index of the tile in the export's directory, or -1 if it has no such tile
+   */
+  findTile(x: number, y: number, layer = 0): number {
+    return this.raw.findTile(x, y, layer);
+  }
+
+  /**
+   * Loads a tile into the nav mesh, decompressing it if the export is compressed.
+   * @returns false if the tile fails its checksum or its directory entry is invalid, or a tile is already loaded at its location
+   */
+  loadTile(navMesh: NavMesh, index: number): boolean {
+    return this.raw.loadTile(navMesh.raw, index);
+  }
+
+  /**
+   * Loads every layer of the tiles overlapping the bounds on the xz plane that are not loaded yet.
+   * @returns the number of tiles loaded
+   */
+  loadTilesInBounds(navMesh: NavMesh, min: Vector3, max: Vector3): number {
+    return this.raw.loadTilesInBounds(
+      navMesh.raw,
+      vec3.toArray(min),
+      vec3.toArray(max)
+    );
+  }
+
+  /**
+   * Loads every layer of the tiles at the given tile coordinates that are not loaded yet.
+   * @returns the number of tiles loaded
+   */
+  loadTilesAt(navMesh: NavMesh, tiles: { x: number; y: number }[]): number {
+    const tileCoords = tiles.flatMap(({ x, y }) => [x, y]);
+
+    return this.raw.loadTilesAt(navMesh.raw, tileCoords, tiles.length);
+  }
+
+  /**
+   * Frees the export data. Loaded tiles are copies, nav meshes are unaffected.
+   */
+  destroy(): void {
+    Raw.Module._free(this.dataPointer);
+    Raw.destroy(this.raw);
+  }
+}
@@ -1,2 +1,3 @@
+export * from './crowd';
 export * from './export';
 export * from './import';
@@ -0,0 +1,121 @@
+import { Raw, type RawModule } from './raw';
+import { Vector3, vec3 } from './utils';
+
+export type TileCacheStreamerUpdateResult = {
+  /**
+   * The number of tiles loaded by the update
+   */
+  loaded: number;
+
+  /**
+   * The number of tiles evicted by the update
+   */
+  evicted: number;
+
+  /**
+   * The number of tiles in range of a focus point that are not loaded yet, because of the memory budget or `maxLoads`
+   */
+  pending: number;
+
+  /**
+   * The number of tiles loaded after the update
+   */
+  loadedTiles: number;
+
+  /**
+   * The bytes used by loaded compressed tiles and their nav mesh tiles, tiles that are not loaded use no wasm memory
+   */
+  loadedBytes: number;
+};
+
+/**
+ * Loads the tiles of a tile cache export around focus points rather than all of them up front.
+ *
+ * Tiles are read from the export as they load, and freed when evicted, so only loaded tiles are held in wasm memory.
+ * Tiles out of range stay loaded until their memory is needed, then the farthest are evicted from the tile cache and nav mesh.
+ * Obstacles over tiles that are not loaded apply when the tiles are loaded again.
+ *
+ * Created by `importTileCacheStreaming`.
+ */
+export class TileCacheStreamer {
+  constructor(
+    public raw: RawModule.TileCacheStreamer,
+    private source: RawModule.TileCacheStreamerSource
+  ) {}
+
+  /**
+   * Sets the bytes loaded compressed tiles and their nav mesh tiles may use.
+   * @param bytes the memory budget, or 0 for no limit
+   */
+  setMemoryBudget(bytes: number): void {
+    this.raw.setMemoryBudget(bytes);
+  }
+
+  getMemoryBudget(): number {
+    return this.raw.getMemoryBudget();
+  }
+
+  /**
+   * Loads tiles within `radius` of any of the focus points, nearest first, and evicts far tiles to stay under the memory budget.
+   * @param focusPoints points to load tiles around, such as the player and camera positions
+   * @param radius the distance on the xz plane from a focus point to a tile's bounds for the tile to be loaded
+   * @param maxLoads the maximum number of tiles to load and build in this update, or 0 for no limit
+   */
+  update(
+    focusPoints: Vector3[],
+    radius: number,
+    maxLoads = 0
+  ): TileCacheStreamerUpdateResult {
+    const points = focusPoints.flatMap((point) => vec3.toArray(point));
+
+    const result = this.raw.update(
+      points,
+      focusPoints.length,
+      radius,
+      maxLoads
+    );
+
+    const { loaded, evicted, pending, loadedTiles, loadedBytes } = result;
+
+    return { loaded, evicted, pending, loadedTiles, loadedBytes };
+  }
+
+  /**
+   * Unloads every loaded tile from the tile cache and nav mesh.
+   */
+  unloadAll(): void {
+    this.raw.unloadAll();
+  }
+
+  /**
+   * Returns the number of tiles in the streamed export.
+   */
+  getTileCount(): number {
+    return this.raw.getTileCount();
+  }
+
+  getLoadedTileCount(): number {
+    return this.raw.getLoadedTileCount();
+  }
+
+  getLoadedBytes(): number {
+    return this.raw.getLoadedBytes();
+  }
+
+  /**
+   * Returns whether any layer at the tile location is loaded.
+   */
+  isTileLoaded(tx: number, ty: number): boolean {
+    return this.raw.isTileLoaded(tx, ty);
+  }
+
+  /**
+   * Unloads every tile and releases the streamer's reference to the export.
+   * Must be called before the tile cache and nav mesh are destroyed.
+   */
+  destroy(): void {
+    this.raw.destroy();
+    Raw.destroy(this.raw);
+    Raw.destroy(this.source);
+  }
+}
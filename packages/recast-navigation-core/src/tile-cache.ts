@@ -1,4 +1,4 @@
-import { UnsignedCharArray, UnsignedShortArray } from './arrays';
+import { IntArray, UnsignedCharArray, UnsignedShortArray } from './arrays';
 import { NavMeshCreateParams, statusSucceed } from './detour';
 import { NavMesh } from './nav-mesh';
 import { Detour, Raw, type RawModule } from './raw';
@@ -22,6 +22,22 @@ export type CylinderObstacle = {
   height: number;
 };
 
+export type ConvexObstacle = {
+  type: 'convex';
+  ref: ObstacleRef;
+  position: Vector3;
+
+  /**
+   * Convex footprint relative to position, only x and z are used.
+   */
+  vertices: Vector3[];
+
+  /**
+   * Height the footprint is extruded upwards from position.
+   */
+  height: number;
+};
+
 export type AddObstacleResult<T> =
   | {
       success: true;
@@ -39,7 +55,43 @@ export type RemoveObstacleResult = {
   status: number;
 };
 
-export type Obstacle = BoxObstacle | CylinderObstacle;
+export type MoveObstacleResult = {
+  success: boolean;
+  status: number;
+};
+
+export type Obstacle = BoxObstacle | CylinderObstacle | ConvexObstacle;
+
+export type ObstacleDescriptor =
+  | Omit<BoxObstacle, 'ref'>
+  | Omit<CylinderObstacle, 'ref'>;
+
+export type AddObstaclesResult = {
+  /**
+   * Whether every obstacle was added.
+   */
+  success: boolean;
+
+  /**
+   * The added obstacles, in the order they were given, or null for obstacles that could not be added.
+   */
+  obstacles: Array<Obstacle | null>;
+};
+
+export type ObstacleMove = {
+  obstacle: Obstacle | ObstacleRef;
+  position: Vector3;
+
+  /**
+   * Only applies to box obstacles, defaults to the current angle.
+   */
+  angle?: number;
+};
+
+/**
+ * Number of floats per obstacle in the packed descriptors passed to `TileCache.addObstacles`
+ */
+const OBSTACLE_STRIDE = 8;
 
 export type TileCacheParamsType = {
   orig: ReadonlyArray<number>;
@@ -80,15 +132,80 @@ export class DetourTileCacheParams {
   }
 }
 
+/**
+ * Tile cache compressors:
+ * - `fastlz`: FastLZ level 1, the default
+ * - `fastlz-high`: FastLZ level 2, a better ratio for shipped assets
+ * - `lz4`: LZ4 block format, the fastest to decompress
+ * - `none`: layers are stored as is, the lowest tile rebuild latency at the cost of memory
+ */
+export type TileCacheCompressorType = 'fastlz' | 'fastlz-high' | 'lz4' | 'none';
+
+export const tileCacheCompressorTypes = (): Record<
+  TileCacheCompressorType,
+  number
+> => ({
+  fastlz: Raw.Module.TILECACHE_COMPRESSOR_FASTLZ,
+  'fastlz-high': Raw.Module.TILECACHE_COMPRESSOR_FASTLZ_HIGH,
+  lz4: Raw.Module.TILECACHE_COMPRESSOR_LZ4,
+  none: Raw.Module.TILECACHE_COMPRESSOR_NONE,
+});
+
+export const toTileCacheCompressorType = (
+  type: number
+): TileCacheCompressorType => {
+  const types = tileCacheCompressorTypes();
+
+  return (Object.keys(types) as TileCacheCompressorType[]).find(
+    (key) => types[key] === type
+  )!;
+};
+
+/**
+ * Creates a tile cache compressor.
+ *
+ * Tiles can only be decompressed by the type of compressor that compressed them.
+ * The compressor type is recorded in tile cache exports, `importTileCache` creates a matching compressor.
+ */
+export const createTileCacheCompressor = (
+  type: TileCacheCompressorType = 'fastlz'
+): RawModule.RecastTileCacheCompressor => {
+  return new Raw.Module.RecastTileCacheCompressor(
+    tileCacheCompressorTypes()[type]
+  );
+};
+
+/**
+ * Returns the type of a tile cache compressor.
+ */
+export const getTileCacheCompressorType = (
+  compressor: RawModule.RecastTileCacheCompressor
+): TileCacheCompressorType => {
+  return toTileCacheCompressorType(compressor.getType());
+};
+
 export type TileCacheUpdateResult = {
   success: boolean;
   status: number;
   upToDate: boolean;
+
+  /**
+   * The number of tiles still waiting to be rebuilt
+   */
+  pendingTiles: number;
+
+  /**
+   * The number of obstacle requests waiting to be passed on to Detour's TileCache
+   */
+  queuedRequests: number;
 };
 
 export class TileCache {
   raw: RawModule.TileCache;
 
+  /**
+   * Obstacles by ref. Each ref encodes a salt, so the ref of a removed obstacle never stands for a later one.
+   */
   obstacles: Map<ObstacleRef, Obstacle> = new Map();
 
   /**
@@ -113,7 +230,7 @@ export class TileCache {
   init(
     params: DetourTileCacheParams,
     alloc: RawModule.RecastLinearAllocator,
-    compressor: RawModule.RecastFastLZCompressor,
+    compressor: RawModule.RecastTileCacheCompressor,
     meshProcess: TileCacheMeshProcess
   ) {
     return this.raw.init(params.raw, alloc, compressor, meshProcess.raw);
@@ -125,14 +242,15 @@ export class TileCache {
    * After adding or removing obstacles you can call `tileCache.update(navMesh)` to rebuild navmesh tiles.
    *
    * Adding or removing an obstacle will internally create an "obstacle request".
-   * TileCache supports queuing up to 64 obstacle requests.
+   * Detour's TileCache processes up to 64 obstacle requests per update, further requests are queued and passed on by later updates.
+   * Moving an obstacle doesn't create a request, the tiles it left and entered are rebuilt by later updates.
    *
    * The `tileCache.update` method returns `upToDate`, whether the tile cache is fully up to date with obstacle requests and tile rebuilds.
    * Each update call processes up to 64 tiles touched by added or removed obstacles.
    * If the tile cache isn't up to date another call will continue processing obstacle requests and tile rebuilds; otherwise it will have no effect.
    *
    * If not many obstacle requests occur between updates, an easy pattern is to call `tileCache.update` periodically, such as every game update.
-   * If many obstacle requests have been made and you need to avoid reaching the 64 obstacle request limit, you can call `tileCache.update` multiple times, bailing out when `upToDate` is true or after a maximum number of updates.
+   * If many obstacle requests have been made, you can call `tileCache.update` multiple times, bailing out when `upToDate` is true or after a maximum number of updates.
    *
    * @example
    * ```ts
@@ -140,13 +258,61 @@ export class TileCache {
    * ```
    */
   update(navMesh: NavMesh): TileCacheUpdateResult {
-    const { status, upToDate } = this.raw.update(navMesh.raw);
+    return this.toUpdateResult(this.raw.update(navMesh.raw));
+  }
 
-    return {
-      success: statusSucceed(status),
-      status,
-      upToDate,
-    };
+  /**
+   * Updates the tile cache until it is up to date or the time budget runs out.
+   *
+   * The budget is checked between tile rebuilds, or between batches of rebuilds with more than one thread,
+   * so a single rebuild or batch can overrun it. At least one update is always made.
+   * Use `pendingTiles` and `queuedRequests` to spread large bursts of obstacle changes across frames.
+   *
+   * @param navMesh the nav mesh to rebuild tiles for
+   * @param maxTimeUs the time budget in microseconds
+   *
+   * @example
+   * ```ts
+   * const { upToDate, pendingTiles } = tileCache.updateWithBudget(navMesh, 2000);
+   * ```
+   */
+  updateWithBudget(navMesh: NavMesh, maxTimeUs: number): TileCacheUpdateResult {
+    return this.toUpdateResult(
+      this.raw.updateWithBudget(navMesh.raw, maxTimeUs)
+    );
+  }
+
+  /**
+   * Sets the number of threads tile rebuilds are spread across, including the calling thread.
+   * With more than one thread, each update rebuilds a batch of up to one tile per thread concurrently.
+   * `updateWithBudget` checks its budget between batches.
+   * Always 1 unless @recast-navigation/wasm was built with threads enabled.
+   * Clamped so the worker threads of every crowd and tile cache fit in the pthread pool, use `getThreadCount` to check the result.
+   */
+  setThreadCount(threads: number): void {
+    this.raw.setThreadCount(threads);
+  }
+
+  /**
+   * Returns the type of compressor the tile cache was initialised with.
+   */
+  getCompressorType(): TileCacheCompressorType {
+    return toTileCacheCompressorType(this.raw.getCompressorType());
+  }
+
+  /**
+   * Returns the peak number of bytes a single tile build has used from the tile cache allocator.
+   * Tile cache exports record this, so imports can size their allocator up front.
+   */
+  getAllocatorHighWaterMark(): number {
+    return this.raw.getAllocatorHighWaterMark();
+  }
+
+  /**
+   * Returns the number of threads tile rebuilds are spread across.
+   */
+  getThreadCount(): number {
+    return this.raw.getThreadCount();
   }
 
   /**
@@ -163,7 +329,7 @@ export class TileCache {
       height
     );
 
-    if (result.status !== Detour.DT_SUCCESS) {
+    if (!statusSucceed(result.status)) {
       return {
         success: false,
         status: result.status,
@@ -209,7 +375,7 @@ export class TileCache {
     Raw.destroy(rawPosition);
     Raw.destroy(rawHalfExtents);
 
-    if (result.status !== Detour.DT_SUCCESS) {
+    if (!statusSucceed(result.status)) {
       return {
         success: false,
         status: result.status,
@@ -235,28 +401,264 @@ export class TileCache {
     };
   }
 
+  /**
+   * Creates an obstacle with a convex footprint and adds it to the navigation mesh.
+   * Irregular footprints like walls and fences can be one obstacle rather than many boxes.
+   * @param position the base of the obstacle
+   * @param vertices the convex footprint relative to position, only x and z are used
+   * @param height the height the footprint is extruded upwards from position
+   */
+  addConvexObstacle(
+    position: Vector3,
+    vertices: Vector3[],
+    height: number
+  ): AddObstacleResult<ConvexObstacle> {
+    const rawPosition = vec3.toRaw(position);
+
+    const result = this.raw.addConvexObstacle(
+      vertices.flatMap(vec3.toArray),
+      vertices.length,
+      rawPosition,
+      height
+    );
+
+    Raw.destroy(rawPosition);
+
+    if (!statusSucceed(result.status)) {
+      return {
+        success: false,
+        status: result.status,
+      };
+    }
+
+    const ref = result.ref;
+
+    const obstacle: ConvexObstacle = {
+      type: 'convex',
+      ref,
+      position,
+      vertices,
+      height,
+    };
+
+    this.obstacles.set(ref, obstacle);
+
+    return {
+      success: true,
+      status: result.status,
+      obstacle,
+    };
+  }
+
   /**
    * Removes an obstacle from the navigation mesh.
+   * Fails for an obstacle that was already removed, whether given as the obstacle or its ref.
    */
   removeObstacle(obstacle: Obstacle | ObstacleRef): RemoveObstacleResult {
-    let ref: ObstacleRef;
+    const ref = this.resolveRef(obstacle);
 
-    if (typeof obstacle === 'object') {
-      ref = (obstacle as Obstacle).ref;
-    } else {
-      ref = obstacle;
+    const status = this.raw.removeObstacle(ref);
+    const success = statusSucceed(status);
+
+    if (success) {
+      this.obstacles.delete(ref);
     }
 
-    this.obstacles.delete(ref);
+    return { success, status };
+  }
 
-    const status = this.raw.removeObstacle(ref);
+  /**
+   * Moves an obstacle in place, without removing and adding it again.
+   * @param angle only applies to box obstacles, defaults to the current angle
+   */
+  moveObstacle(
+    obstacle: Obstacle | ObstacleRef,
+    position: Vector3,
+    angle?: number
+  ): MoveObstacleResult {
+    const target = this.resolveObstacle(obstacle);
+
+    if (!target) {
+      return { success: false, status: Detour.DT_FAILURE };
+    }
+
+    const nextAngle = target.type === 'box' ? angle ?? target.angle : 0;
+
+    const rawPosition = vec3.toRaw(position);
+    const status = this.raw.moveObstacle(target.ref, rawPosition, nextAngle);
+    Raw.destroy(rawPosition);
+
+    const success = statusSucceed(status);
+
+    if (success) {
+      target.position = position;
+
+      if (target.type === 'box') {
+        target.angle = nextAngle;
+      }
+    }
+
+    return { success, status };
+  }
+
+  /**
+   * Adds many obstacles in one call. Obstacles beyond the 64 obstacle request limit are queued and passed on by later updates.
+   */
+  addObstacles(descriptors: ObstacleDescriptor[]): AddObstaclesResult {
+    const packed: number[] = [];
+
+    for (const descriptor of descriptors) {
+      const { x, y, z } = descriptor.position;
+
+      if (descriptor.type === 'box') {
+        const { halfExtents, angle } = descriptor;
+        packed.push(
+          Detour.DT_OBSTACLE_ORIENTED_BOX,
+          x,
+          y,
+          z,
+          halfExtents.x,
+          halfExtents.y,
+          halfExtents.z,
+          angle
+        );
+      } else {
+        const { radius, height } = descriptor;
+        packed.push(Detour.DT_OBSTACLE_CYLINDER, x, y, z, radius, height, 0, 0);
+      }
+    }
+
+    const refs = new IntArray();
+    const added = this.raw.addObstacles(
+      packed,
+      packed.length / OBSTACLE_STRIDE,
+      refs.raw
+    );
+
+    const obstacles = descriptors.map((descriptor, i) => {
+      const pointer = refs.get(i);
+
+      if (pointer === 0) return null;
+
+      const ref = Raw.Module.wrapPointer(pointer, Raw.Module.dtObstacleRef);
+      const obstacle = { ...descriptor, ref } as Obstacle;
+      this.obstacles.set(ref, obstacle);
+
+      return obstacle;
+    });
+
+    refs.destroy();
+
+    return {
+      success: added === descriptors.length,
+      obstacles,
+    };
+  }
+
+  /**
+   * Removes many obstacles in one call. Obstacles that were already removed are skipped.
+   * @returns the number of obstacles removed
+   */
+  removeObstacles(obstacles: Array<Obstacle | ObstacleRef>): number {
+    const refs = obstacles.map((obstacle) => this.resolveRef(obstacle));
+    const pointers = refs.map((ref) => Raw.Module.getPointer(ref));
+
+    const results = new IntArray();
+    const removed = this.raw.removeObstacles(
+      pointers,
+      pointers.length,
+      results.raw
+    );
+
+    refs.forEach((ref, i) => {
+      if (results.get(i)) {
+        this.obstacles.delete(ref);
+      }
+    });
+
+    results.destroy();
+
+    return removed;
+  }
+
+  /**
+   * Moves many obstacles in place in one call. Obstacles that were already removed are skipped.
+   * @returns the number of obstacles moved
+   */
+  moveObstacles(moves: ObstacleMove[]): number {
+    const pointers: number[] = [];
+    const positions: number[] = [];
+    const angles: number[] = [];
+
+    const targets = moves.map((move) => this.resolveObstacle(move.obstacle));
+
+    moves.forEach((move, i) => {
+      const target = targets[i];
+
+      pointers.push(target ? Raw.Module.getPointer(target.ref) : 0);
+      positions.push(...vec3.toArray(move.position));
+      angles.push(target?.type === 'box' ? move.angle ?? target.angle : 0);
+    });
+
+    const results = new IntArray();
+    const moved = this.raw.moveObstacles(
+      pointers,
+      positions,
+      angles,
+      moves.length,
+      results.raw
+    );
+
+    moves.forEach((move, i) => {
+      const target = targets[i];
+
+      if (!target || !results.get(i)) return;
+
+      target.position = move.position;
+
+      if (target.type === 'box') {
+        target.angle = angles[i];
+      }
+    });
+
+    results.destroy();
+
+    return moved;
+  }
+
+  /**
+   * Returns the number of obstacles, including those still queued.
+   */
+  getObstacleCount(): number {
+    return this.raw.getObstacleCount();
+  }
+
+  private toUpdateResult(
+    result: RawModule.TileCacheUpdateResult
+  ): TileCacheUpdateResult {
+    const { status, upToDate, pendingTiles, queuedRequests } = result;
 
     return {
       success: statusSucceed(status),
       status,
+      upToDate,
+      pendingTiles,
+      queuedRequests,
     };
   }
 
+  private resolveRef(obstacle: Obstacle | ObstacleRef): ObstacleRef {
+    return typeof obstacle === 'object' && 'type' in obstacle
+      ? obstacle.ref
+      : (obstacle as ObstacleRef);
+  }
+
+  private resolveObstacle(
+    obstacle: Obstacle | ObstacleRef
+  ): Obstacle | undefined {
+    return this.obstacles.get(this.resolveRef(obstacle));
+  }
+
   addTile(
     data: UnsignedCharArray,
     flags: number = Detour.DT_COMPRESSEDTILE_FREE_DATA
@@ -272,6 +674,14 @@ export class TileCache {
     return this.raw.buildNavMeshTilesAt(tx, ty, navMesh.raw);
   }
 
+  /**
+   * Removes a tile from the tile cache, and its tile from the nav mesh.
+   * Obstacles over the tile apply again if a tile is added back at the same location.
+   */
+  removeTile(ref: RawModule.dtCompressedTileRef, navMesh: NavMesh) {
+    return this.raw.removeTile(ref, navMesh.raw);
+  }
+
   destroy(): void {
     this.raw.destroy();
   }
@@ -318,7 +728,7 @@ export class TileCacheMeshProcess {
 }
 
 export const buildTileCacheLayer = (
-  comp: RawModule.RecastFastLZCompressor,
+  comp: RawModule.RecastTileCacheCompressor,
   header: RawModule.dtTileCacheLayerHeader,
   heights: UnsignedCharArray,
   areas: UnsignedCharArray,
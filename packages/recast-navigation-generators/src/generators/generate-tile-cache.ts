@@ -13,6 +13,7 @@ import {
   RecastHeightfield,
   RecastHeightfieldLayerSet,
   TileCache,
+  TileCacheCompressorType,
   TileCacheData,
   TileCacheMeshProcess,
   TriangleAreasArray,
@@ -30,6 +31,7 @@ import {
   calcGridSize,
   cloneRcConfig,
   createHeightfield,
+  createTileCacheCompressor,
   createRcConfig,
   erodeWalkableArea,
   filterLedgeSpans,
@@ -76,6 +78,20 @@ export type TileCacheGeneratorConfig = Pretty<
      * @default createDefaultTileCacheMeshProcess()
      */
     tileCacheMeshProcess?: TileCacheMeshProcess;
+
+    /**
+     * How tile cache layers are compressed.
+     * `lz4` and `none` trade memory for faster tile rebuilds, `fastlz-high` gives smaller exports.
+     * @default 'fastlz'
+     */
+    compressor?: TileCacheCompressorType;
+
+    /**
+     * Initial size in bytes of the allocator used when building tiles.
+     * The allocator grows if a tile needs more, sizing it up front avoids the extra allocations.
+     * @default 32000
+     */
+    allocatorSize?: number;
   }
 >;
 
@@ -268,8 +284,12 @@ export const generateTileCache = (
     maxObstacles,
   });
 
-  const allocator = new Raw.RecastLinearAllocator(32000);
-  const compressor = new Raw.RecastFastLZCompressor();
+  const allocator = new Raw.RecastLinearAllocator(
+    navMeshGeneratorConfig.allocatorSize ?? 32000
+  );
+  const compressor = createTileCacheCompressor(
+    navMeshGeneratorConfig.compressor ?? 'fastlz'
+  );
 
   const tileCacheMeshProcess =
     navMeshGeneratorConfig.tileCacheMeshProcess ??
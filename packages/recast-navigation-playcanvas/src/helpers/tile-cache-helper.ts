@@ -87,6 +87,28 @@ export class TileCacheHelper extends Entity {
 
           obstacleEntity.setLocalScale(radius * 2, height, radius * 2);
           obstacleEntity.translateLocal(0, height / 2, 0);
+        } else if (obstacle.type === 'convex') {
+          const { vertices, height } = obstacle;
+
+          // drawn as the bounds of the footprint
+          const xs = vertices.map((v) => v.x);
+          const zs = vertices.map((v) => v.z);
+          const minX = Math.min(...xs);
+          const maxX = Math.max(...xs);
+          const minZ = Math.min(...zs);
+          const maxZ = Math.max(...zs);
+
+          obstacleEntity.addComponent('render', {
+            type: 'box',
+            material: this.obstacleMaterial,
+          });
+
+          obstacleEntity.setLocalScale(maxX - minX, height, maxZ - minZ);
+          obstacleEntity.translateLocal(
+            (minX + maxX) / 2,
+            height / 2,
+            (minZ + maxZ) / 2
+          );
         } else {
           throw new Error(
             `Unknown obstacle type: ${(obstacle as Obstacle).type}`
@@ -2,10 +2,13 @@ import { Obstacle, TileCache } from '@recast-navigation/core';
 import {
   BoxGeometry,
   CylinderGeometry,
+  ExtrudeGeometry,
   Material,
   Mesh,
   MeshBasicMaterial,
   Object3D,
+  Shape,
+  Vector2,
   Vector3,
 } from 'three';
 
@@ -72,6 +75,19 @@ export class TileCacheHelper extends Object3D {
           mesh.geometry = new CylinderGeometry(radius, radius, height, 16);
 
           mesh.position.y += height / 2;
+        } else if (obstacle.type === 'convex') {
+          const { vertices, height } = obstacle;
+
+          // the shape's y is -z, rotating it upright lays it on the xz plane
+          const shape = new Shape(
+            vertices.map(({ x, z }) => new Vector2(x, -z))
+          );
+
+          mesh.geometry = new ExtrudeGeometry(shape, {
+            depth: height,
+            bevelEnabled: false,
+          });
+          mesh.geometry.rotateX(-Math.PI / 2);
         } else {
           throw new Error(`Unknown obstacle type: ${obstacle}`);
         }
@@ -1,6 +1,8 @@
 #!/bin/sh
 
 # sh build.sh [release|debug]
+# THREADS=ON sh build.sh to build with pthreads, requires a cross-origin isolated page
+# SIMD=ON sh build.sh to build with wasm simd128
 
 if [ -z $1 ] 
 then
@@ -19,7 +21,7 @@ mkdir -p dist
 (cd recastnavigation && git checkout '599fd0f023181c0a484df2a18cf1d75a3553852e')
 
 # emscripten builds
-emcmake cmake -B build -DCMAKE_BUILD_TYPE=$BUILD_TYPE
+emcmake cmake -B build -DCMAKE_BUILD_TYPE=$BUILD_TYPE -DTHREADS=${THREADS:-OFF} -DSIMD=${SIMD:-OFF}
 cmake --build build
 
 # generate typescript definitions
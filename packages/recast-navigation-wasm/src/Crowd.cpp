@@ -1,5 +1,8 @@
 #include "./Crowd.h"
 
+#include <chrono>
+#include <string.h>
+
 int CrowdUtils::getActiveAgentCount(dtCrowd *crowd)
 {
     return crowd->getActiveAgents(NULL, crowd->getAgentCount());
@@ -65,3 +68,2273 @@ void CrowdUtils::agentTeleport(dtCrowd *crowd, int idx, const float *destination
 
     ag->targetState = DT_CROWDAGENT_TARGET_NONE;
 }
+
+static const int MAX_ITERS_PER_UPDATE = 100;
+static const int MAX_COMMON_NODES = 512;
+static const int MAX_PATH_RESULT = 256;
+
+static double getTimeMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float tween(const float t, const float t0, const float t1)
+{
+    return dtClamp((t - t0) / (t1 - t0), 0.0f, 1.0f);
+}
+
+static void integrate(dtCrowdAgent *ag, const float dt)
+{
+    // Fake dynamic constraint.
+    const float maxDelta = ag->params.maxAcceleration * dt;
+    float dv[3];
+    dtVsub(dv, ag->nvel, ag->vel);
+    float ds = dtVlen(dv);
+    if (ds > maxDelta)
+        dtVscale(dv, dv, maxDelta / ds);
+    dtVadd(ag->vel, ag->vel, dv);
+
+    // Integrate
+    if (dtVlen(ag->vel) > 0.0001f)
+        dtVmad(ag->npos, ag->npos, ag->vel, dt);
+    else
+        dtVset(ag->vel, 0, 0, 0);
+}
+
+static bool overOffmeshConnection(const dtCrowdAgent *ag, const float radius)
+{
+    if (!ag->ncorners)
+        return false;
+
+    const bool offMeshConnection = (ag->cornerFlags[ag->ncorners - 1] & DT_STRAIGHTPATH_OFFMESH_CONNECTION) ? true : false;
+    if (offMeshConnection)
+    {
+        const float distSq = dtVdist2DSqr(ag->npos, &ag->cornerVerts[(ag->ncorners - 1) * 3]);
+        if (distSq < radius * radius)
+            return true;
+    }
+
+    return false;
+}
+
+static float getDistanceToGoal(const dtCrowdAgent *ag, const float range)
+{
+    if (!ag->ncorners)
+        return range;
+
+    const bool endOfPath = (ag->cornerFlags[ag->ncorners - 1] & DT_STRAIGHTPATH_END) ? true : false;
+    if (endOfPath)
+        return dtMin(dtVdist2D(ag->npos, &ag->cornerVerts[(ag->ncorners - 1) * 3]), range);
+
+    return range;
+}
+
+static void calcSmoothSteerDirection(const dtCrowdAgent *ag, float *dir)
+{
+    if (!ag->ncorners)
+    {
+        dtVset(dir, 0, 0, 0);
+        return;
+    }
+
+    const int ip0 = 0;
+    const int ip1 = dtMin(1, ag->ncorners - 1);
+    const float *p0 = &ag->cornerVerts[ip0 * 3];
+    const float *p1 = &ag->cornerVerts[ip1 * 3];
+
+    float dir0[3], dir1[3];
+    dtVsub(dir0, p0, ag->npos);
+    dtVsub(dir1, p1, ag->npos);
+    dir0[1] = 0;
+    dir1[1] = 0;
+
+    float len0 = dtVlen(dir0);
+    float len1 = dtVlen(dir1);
+    if (len1 > 0.001f)
+        dtVscale(dir1, dir1, 1.0f / len1);
+
+    dir[0] = dir0[0] - dir1[0] * len0 * 0.5f;
+    dir[1] = 0;
+    dir[2] = dir0[2] - dir1[2] * len0 * 0.5f;
+
+    dtVnormalize(dir);
+}
+
+static void calcStraightSteerDirection(const dtCrowdAgent *ag, float *dir)
+{
+    if (!ag->ncorners)
+    {
+        dtVset(dir, 0, 0, 0);
+        return;
+    }
+    dtVsub(dir, &ag->cornerVerts[0], ag->npos);
+    dir[1] = 0;
+    dtVnormalize(dir);
+}
+
+static int addNeighbour(const int idx, const float dist, dtCrowdNeighbour *neis, const int nneis, const int maxNeis)
+{
+    // Insert neighbour based on the distance.
+    dtCrowdNeighbour *nei = 0;
+    if (!nneis)
+    {
+        nei = &neis[nneis];
+    }
+    else if (dist >= neis[nneis - 1].dist)
+    {
+        if (nneis >= maxNeis)
+            return nneis;
+        nei = &neis[nneis];
+    }
+    else
+    {
+        int i;
+        for (i = 0; i < nneis; ++i)
+            if (dist <= neis[i].dist)
+                break;
+
+        const int tgt = i + 1;
+        const int n = dtMin(nneis - i, maxNeis - tgt);
+
+        if (n > 0)
+            memmove(&neis[tgt], &neis[i], sizeof(dtCrowdNeighbour) * n);
+        nei = &neis[i];
+    }
+
+    memset(nei, 0, sizeof(dtCrowdNeighbour));
+
+    nei->idx = idx;
+    nei->dist = dist;
+
+    return dtMin(nneis + 1, maxNeis);
+}
+
+static int getNeighbours(const float *pos, const float height, const float range,
+                         const dtCrowdAgent *skip, dtCrowdNeighbour *result, const int maxResult,
+                         dtCrowdAgent **agents, const dtProximityGrid *grid)
+{
+    int n = 0;
+
+    static const int MAX_NEIS = 32;
+    unsigned short ids[MAX_NEIS];
+    int nids = grid->queryItems(pos[0] - range, pos[2] - range,
+                                pos[0] + range, pos[2] + range,
+                                ids, MAX_NEIS);
+
+    for (int i = 0; i < nids; ++i)
+    {
+        const dtCrowdAgent *ag = agents[ids[i]];
+
+        if (ag == skip)
+            continue;
+
+        // Check for overlap.
+        float diff[3];
+        dtVsub(diff, pos, ag->npos);
+        if (dtMathFabsf(diff[1]) >= (height + ag->params.height) / 2.0f)
+            continue;
+        diff[1] = 0;
+        const float distSqr = dtVlenSqr(diff);
+        if (distSqr > dtSqr(range))
+            continue;
+
+        n = addNeighbour(ids[i], distSqr, result, n, maxResult);
+    }
+    return n;
+}
+
+static int addToOptQueue(dtCrowdAgent *newag, dtCrowdAgent **agents, const int nagents, const int maxAgents)
+{
+    // Insert neighbour based on greatest time.
+    int slot = 0;
+    if (!nagents)
+    {
+        slot = nagents;
+    }
+    else if (newag->topologyOptTime <= agents[nagents - 1]->topologyOptTime)
+    {
+        if (nagents >= maxAgents)
+            return nagents;
+        slot = nagents;
+    }
+    else
+    {
+        int i;
+        for (i = 0; i < nagents; ++i)
+            if (newag->topologyOptTime >= agents[i]->topologyOptTime)
+                break;
+
+        const int tgt = i + 1;
+        const int n = dtMin(nagents - i, maxAgents - tgt);
+
+        if (n > 0)
+            memmove(&agents[tgt], &agents[i], sizeof(dtCrowdAgent *) * n);
+        slot = i;
+    }
+
+    agents[slot] = newag;
+
+    return dtMin(nagents + 1, maxAgents);
+}
+
+static int addToPathQueue(dtCrowdAgent *newag, dtCrowdAgent **agents, const int nagents, const int maxAgents)
+{
+    // Insert neighbour based on greatest time.
+    int slot = 0;
+    if (!nagents)
+    {
+        slot = nagents;
+    }
+    else if (newag->targetReplanTime <= agents[nagents - 1]->targetReplanTime)
+    {
+        if (nagents >= maxAgents)
+            return nagents;
+        slot = nagents;
+    }
+    else
+    {
+        int i;
+        for (i = 0; i < nagents; ++i)
+            if (newag->targetReplanTime >= agents[i]->targetReplanTime)
+                break;
+
+        const int tgt = i + 1;
+        const int n = dtMin(nagents - i, maxAgents - tgt);
+
+        if (n > 0)
+            memmove(&agents[tgt], &agents[i], sizeof(dtCrowdAgent *) * n);
+        slot = i;
+    }
+
+    agents[slot] = newag;
+
+    return dtMin(nagents + 1, maxAgents);
+}
+
+bool Crowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh *nav)
+{
+    if (!m_crowd || maxAgents > CROWD_MAX_AGENTS)
+        return false;
+
+    freeThreadData();
+
+    if (!m_crowd->init(maxAgents, maxAgentRadius, nav))
+        return false;
+
+    m_navMesh = nav;
+    m_maxAgents = maxAgents;
+    m_minAgents = maxAgents;
+    m_maxAgentRadius = maxAgentRadius;
+    m_agents = m_crowd->getEditableAgent(0);
+    m_activeAgentCount = 0;
+    m_gridAgentIndices.clear();
+
+    if (!m_navQuery)
+        m_navQuery = dtAllocNavMeshQuery();
+    if (!m_navQuery || dtStatusFailed(m_navQuery->init(nav, MAX_COMMON_NODES)))
+        return false;
+
+    dtFree(m_pathResult);
+    dtFree(m_activeAgents);
+    dtFree(m_agentAnims);
+    dtFree(m_agentLods);
+    dtFree(m_dueAgents);
+    dtFree(m_agentEventStates);
+
+    // Must match the corridor capacity dtCrowd::init gives each agent
+    m_maxPathResult = MAX_PATH_RESULT;
+    m_pathResult = (dtPolyRef *)dtAlloc(sizeof(dtPolyRef) * m_maxPathResult, DT_ALLOC_PERM);
+    m_activeAgents = (dtCrowdAgent **)dtAlloc(sizeof(dtCrowdAgent *) * m_maxAgents, DT_ALLOC_PERM);
+    m_agentAnims = (dtCrowdAgentAnimation *)dtAlloc(sizeof(dtCrowdAgentAnimation) * m_maxAgents, DT_ALLOC_PERM);
+    m_agentLods = (CrowdAgentLod *)dtAlloc(sizeof(CrowdAgentLod) * m_maxAgents, DT_ALLOC_PERM);
+    m_dueAgents = (dtCrowdAgent **)dtAlloc(sizeof(dtCrowdAgent *) * m_maxAgents, DT_ALLOC_PERM);
+    m_agentEventStates = (CrowdAgentEventState *)dtAlloc(sizeof(CrowdAgentEventState) * m_maxAgents, DT_ALLOC_PERM);
+    if (!m_pathResult || !m_activeAgents || !m_agentAnims || !m_agentLods || !m_dueAgents || !m_agentEventStates)
+        return false;
+
+    for (int i = 0; i < m_maxAgents; ++i)
+    {
+        m_agentAnims[i].active = false;
+        m_agentLods[i].manualTier = -1;
+    }
+
+    return initThreadData();
+}
+
+bool Crowd::initThreadData()
+{
+    freeThreadData();
+
+    const int threadCount = m_threadPool.getThreadCount();
+    m_threadData.resize(threadCount);
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        CrowdThreadData &thread = m_threadData[i];
+        thread.velocitySampleCount = 0;
+        thread.navQuery = 0;
+        thread.obstacleIds.resize(m_maxObstacleCandidates);
+        thread.sampler = new ObstacleAvoidanceSampler();
+        thread.obstacleQuery = dtAllocObstacleAvoidanceQuery();
+        // Room for the neighbours and boundary segments dtCrowd uses, plus the nearest dynamic obstacles
+        if (!thread.obstacleQuery ||
+            !thread.obstacleQuery->init(6 + CROWD_MAX_AGENT_OBSTACLES * CROWD_MAX_BOX_CIRCLES, 8 + CROWD_MAX_AGENT_OBSTACLES * 4))
+            return false;
+
+        if (i == 0)
+        {
+            // The calling thread shares the crowd's own query
+            thread.navQuery = m_navQuery;
+        }
+        else
+        {
+            thread.navQuery = dtAllocNavMeshQuery();
+            if (!thread.navQuery || dtStatusFailed(thread.navQuery->init(m_navMesh, MAX_COMMON_NODES)))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void Crowd::freeThreadData()
+{
+    for (size_t i = 0; i < m_threadData.size(); ++i)
+    {
+        if (i > 0)
+            dtFreeNavMeshQuery(m_threadData[i].navQuery);
+        dtFreeObstacleAvoidanceQuery(m_threadData[i].obstacleQuery);
+        delete m_threadData[i].sampler;
+    }
+    m_threadData.clear();
+}
+
+void Crowd::setObstacleAvoidanceParams(const int idx, const dtObstacleAvoidanceParams *params)
+{
+    m_crowd->setObstacleAvoidanceParams(idx, params);
+}
+
+const dtObstacleAvoidanceParams *Crowd::getObstacleAvoidanceParams(const int idx) const
+{
+    return m_crowd->getObstacleAvoidanceParams(idx);
+}
+
+const dtCrowdAgent *Crowd::getAgent(const int idx)
+{
+    return m_crowd->getAgent(idx);
+}
+
+dtCrowdAgent *Crowd::getEditableAgent(const int idx)
+{
+    return m_crowd->getEditableAgent(idx);
+}
+
+int Crowd::getAgentCount() const
+{
+    return m_crowd->getAgentCount();
+}
+
+int Crowd::getActiveAgentCount() const
+{
+    return m_activeAgentCount;
+}
+
+int Crowd::addAgent(const float *pos, const dtCrowdAgentParams *params)
+{
+    int idx = m_crowd->addAgent(pos, params);
+    if (idx < 0 && m_autoResize && m_maxAgents < CROWD_MAX_AGENTS && setMaxAgents(dtMin(m_maxAgents * 2, CROWD_MAX_AGENTS)))
+    {
+        idx = m_crowd->addAgent(pos, params);
+    }
+    if (idx >= 0)
+    {
+        insertActiveAgent(&m_agents[idx]);
+        m_agentAnims[idx].active = false;
+
+        CrowdAgentLod *lod = &m_agentLods[idx];
+        lod->tier = 0;
+        lod->manualTier = -1;
+        lod->due = false;
+        lod->stepDt = 0;
+        lod->accumulatedDt = 0;
+
+        resetAgentEventState(idx);
+    }
+
+    return idx;
+}
+
+void Crowd::updateAgentParameters(const int idx, const dtCrowdAgentParams *params)
+{
+    m_crowd->updateAgentParameters(idx, params);
+}
+
+void Crowd::removeAgent(const int idx)
+{
+    if (idx >= 0 && idx < m_maxAgents && m_agents[idx].active)
+    {
+        removeActiveAgent(&m_agents[idx]);
+    }
+    m_crowd->removeAgent(idx);
+    if (idx >= 0 && idx < m_maxAgents)
+    {
+        m_agentAnims[idx].active = false;
+    }
+
+    if (m_autoResize && m_maxAgents > m_minAgents)
+    {
+        const int highWaterMark = getAgentHighWaterMark();
+        if (highWaterMark <= m_maxAgents / 4)
+        {
+            setMaxAgents(dtMax(dtMax(m_maxAgents / 2, highWaterMark), m_minAgents));
+        }
+    }
+}
+
+int Crowd::getAgentHighWaterMark() const
+{
+    return m_activeAgentCount ? getAgentIndex(m_activeAgents[m_activeAgentCount - 1]) + 1 : 0;
+}
+
+void Crowd::insertActiveAgent(dtCrowdAgent *agent)
+{
+    // Agents are stored in one array, ordering by address orders by index
+    int lo = 0;
+    int hi = m_activeAgentCount;
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if (m_activeAgents[mid] < agent)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < m_activeAgentCount && m_activeAgents[lo] == agent)
+        return;
+
+    memmove(&m_activeAgents[lo + 1], &m_activeAgents[lo], sizeof(dtCrowdAgent *) * (m_activeAgentCount - lo));
+    m_activeAgents[lo] = agent;
+    m_activeAgentCount++;
+}
+
+void Crowd::removeActiveAgent(const dtCrowdAgent *agent)
+{
+    int lo = 0;
+    int hi = m_activeAgentCount;
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if (m_activeAgents[mid] < agent)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == m_activeAgentCount || m_activeAgents[lo] != agent)
+        return;
+
+    memmove(&m_activeAgents[lo], &m_activeAgents[lo + 1], sizeof(dtCrowdAgent *) * (m_activeAgentCount - lo - 1));
+    m_activeAgentCount--;
+}
+
+void Crowd::rebuildActiveAgents()
+{
+    m_activeAgentCount = m_crowd->getActiveAgents(m_activeAgents, m_maxAgents);
+}
+
+static void swapAgents(dtCrowdAgent *a, dtCrowdAgent *b)
+{
+    // Swapping the bytes moves the corridor path buffers along with the agents, each crowd frees
+    // whichever buffers it ends up with.
+    unsigned char tmp[sizeof(dtCrowdAgent)];
+    memcpy(tmp, (void *)a, sizeof(dtCrowdAgent));
+    memcpy((void *)a, (void *)b, sizeof(dtCrowdAgent));
+    memcpy((void *)b, tmp, sizeof(dtCrowdAgent));
+}
+
+bool Crowd::setMaxAgents(const int maxAgents)
+{
+    if (!m_agents || maxAgents < dtMax(getAgentHighWaterMark(), 1) || maxAgents > CROWD_MAX_AGENTS)
+        return false;
+
+    if (maxAgents == m_maxAgents)
+        return true;
+
+    dtCrowd *crowd = dtAllocCrowd();
+    dtCrowdAgent **activeAgents = (dtCrowdAgent **)dtAlloc(sizeof(dtCrowdAgent *) * maxAgents, DT_ALLOC_PERM);
+    dtCrowdAgentAnimation *agentAnims = (dtCrowdAgentAnimation *)dtAlloc(sizeof(dtCrowdAgentAnimation) * maxAgents, DT_ALLOC_PERM);
+    CrowdAgentLod *agentLods = (CrowdAgentLod *)dtAlloc(sizeof(CrowdAgentLod) * maxAgents, DT_ALLOC_PERM);
+    dtCrowdAgent **dueAgents = (dtCrowdAgent **)dtAlloc(sizeof(dtCrowdAgent *) * maxAgents, DT_ALLOC_PERM);
+    CrowdAgentEventState *agentEventStates = (CrowdAgentEventState *)dtAlloc(sizeof(CrowdAgentEventState) * maxAgents, DT_ALLOC_PERM);
+
+    if (!crowd || !activeAgents || !agentAnims || !agentLods || !dueAgents || !agentEventStates ||
+        !crowd->init(maxAgents, m_maxAgentRadius, m_navMesh))
+    {
+        dtFreeCrowd(crowd);
+        dtFree(activeAgents);
+        dtFree(agentAnims);
+        dtFree(agentLods);
+        dtFree(dueAgents);
+        dtFree(agentEventStates);
+        return false;
+    }
+
+    for (int i = 0; i < DT_CROWD_MAX_QUERY_FILTER_TYPE; ++i)
+    {
+        *crowd->getEditableFilter(i) = *m_crowd->getFilter(i);
+    }
+
+    for (int i = 0; i < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS; ++i)
+    {
+        crowd->setObstacleAvoidanceParams(i, m_crowd->getObstacleAvoidanceParams(i));
+    }
+
+    const int keepCount = dtMin(m_maxAgents, maxAgents);
+    for (int i = 0; i < keepCount; ++i)
+    {
+        dtCrowdAgent *ag = crowd->getEditableAgent(i);
+        swapAgents(ag, &m_agents[i]);
+
+        // Requests in the old crowd's path queue are lost, queue them again
+        ag->targetPathqRef = DT_PATHQ_INVALID;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_PATH)
+        {
+            ag->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE;
+        }
+    }
+
+    memcpy(agentAnims, m_agentAnims, sizeof(dtCrowdAgentAnimation) * keepCount);
+    memcpy(agentLods, m_agentLods, sizeof(CrowdAgentLod) * keepCount);
+    memcpy(agentEventStates, m_agentEventStates, sizeof(CrowdAgentEventState) * keepCount);
+    for (int i = keepCount; i < maxAgents; ++i)
+    {
+        agentAnims[i].active = false;
+        agentLods[i].manualTier = -1;
+    }
+
+    dtFreeCrowd(m_crowd);
+    dtFree(m_activeAgents);
+    dtFree(m_agentAnims);
+    dtFree(m_agentLods);
+    dtFree(m_dueAgents);
+    dtFree(m_agentEventStates);
+
+    m_crowd = crowd;
+    m_agents = crowd->getEditableAgent(0);
+    m_maxAgents = maxAgents;
+    m_activeAgents = activeAgents;
+    m_agentAnims = agentAnims;
+    m_agentLods = agentLods;
+    m_dueAgents = dueAgents;
+    m_agentEventStates = agentEventStates;
+    rebuildActiveAgents();
+
+    // The new crowd's grid is empty, register the agents of the last update again so queries keep working
+    dtProximityGrid *grid = const_cast<dtProximityGrid *>(m_crowd->getGrid());
+    for (int i = 0; i < (int)m_gridAgentIndices.size(); ++i)
+    {
+        const int idx = m_gridAgentIndices[i];
+        if (idx >= m_maxAgents || !m_agents[idx].active)
+            continue;
+
+        const float *p = m_agents[idx].npos;
+        const float r = m_agents[idx].params.radius;
+        grid->addItem((unsigned short)i, p[0] - r, p[2] - r, p[0] + r, p[2] + r);
+    }
+
+    return true;
+}
+
+void Crowd::setAutoResize(const bool enabled)
+{
+    m_autoResize = enabled;
+}
+
+bool Crowd::getAutoResize() const
+{
+    return m_autoResize;
+}
+
+bool Crowd::requestMoveTarget(const int idx, dtPolyRef ref, const float *pos)
+{
+    return m_crowd->requestMoveTarget(idx, ref, pos);
+}
+
+bool Crowd::requestMoveVelocity(const int idx, const float *vel)
+{
+    return m_crowd->requestMoveVelocity(idx, vel);
+}
+
+bool Crowd::resetMoveTarget(const int idx)
+{
+    return m_crowd->resetMoveTarget(idx);
+}
+
+const dtQueryFilter *Crowd::getFilter(const int i) const
+{
+    return m_crowd->getFilter(i);
+}
+
+dtQueryFilter *Crowd::getEditableFilter(const int i)
+{
+    return m_crowd->getEditableFilter(i);
+}
+
+const dtNavMeshQuery *Crowd::getNavMeshQuery() const
+{
+    return m_navQuery;
+}
+
+void Crowd::setThreadCount(const int threadCount)
+{
+    m_threadPool.setThreadCount(threadCount);
+
+    if (m_navMesh && (int)m_threadData.size() != m_threadPool.getThreadCount())
+    {
+        initThreadData();
+    }
+}
+
+int Crowd::getThreadCount() const
+{
+    return m_threadPool.getThreadCount();
+}
+
+int Crowd::getVelocitySampleCount() const
+{
+    return m_velocitySampleCount;
+}
+
+void Crowd::setSimdObstacleAvoidance(const bool enabled)
+{
+    m_simdObstacleAvoidance = enabled;
+}
+
+bool Crowd::getSimdObstacleAvoidance() const
+{
+    return m_simdObstacleAvoidance;
+}
+
+void Crowd::update(const float dt, dtCrowdAgentDebugInfo *debug)
+{
+    m_velocitySampleCount = 0;
+    m_updateCount++;
+
+    memset(&m_updateStats, 0, sizeof(m_updateStats));
+
+    const double updateStart = getTimeMs();
+    double phaseStart = updateStart;
+
+    // Stores the microseconds since the previous phase ended
+    auto endPhase = [&phaseStart](float &phaseTime)
+    {
+        const double now = getTimeMs();
+        phaseTime = (float)((now - phaseStart) * 1000.0);
+        phaseStart = now;
+    };
+
+    dtCrowdAgent **agents = m_activeAgents;
+    const int nagents = m_activeAgentCount;
+
+    // As in dtCrowd::update, the debug info's idx is a position in the active agent list.
+    const dtCrowdAgent *debugAgent = debug && debug->idx >= 0 && debug->idx < nagents ? agents[debug->idx] : 0;
+
+    // Assign level of detail tiers and collect the agents due an update.
+    updateAgentLods(agents, nagents, dt);
+    endPhase(m_updateStats.lodTime);
+
+    // Check that all agents still have valid paths.
+    checkPathValidity(agents, nagents, dt);
+    endPhase(m_updateStats.pathValidityTime);
+
+    // Update async move request and path finder.
+    updateMoveRequest(agents, nagents);
+    endPhase(m_updateStats.moveRequestTime);
+
+    // Optimize path topology.
+    updateTopologyOptimization(agents, nagents, dt);
+    endPhase(m_updateStats.topologyOptimizationTime);
+
+    // Register agents to proximity grid.
+    updateAgentGrid(agents, nagents);
+
+    // Register dynamic obstacles to their own grid.
+    updateObstacleGrid();
+    endPhase(m_updateStats.proximityGridTime);
+
+    // Get nearby navmesh segments and agents to collide with, then find the next corner to steer to.
+    forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int threadIndex)
+                    {
+        CrowdThreadData *thread = &m_threadData[threadIndex];
+        updateAgentsNeighbourhood(due, begin, end, thread);
+        updateAgentsCorners(due, begin, end, thread, debug, debugAgent); });
+    endPhase(m_updateStats.neighbourhoodTime);
+
+    // Trigger off-mesh connections (depends on corners).
+    updateOffMeshConnections(m_dueAgents, m_lodTierOffsets[m_lodTierCount]);
+    endPhase(m_updateStats.offMeshTriggerTime);
+
+    // Calculate steering.
+    forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int)
+                    { updateAgentsSteering(due, begin, end); });
+    endPhase(m_updateStats.steeringTime);
+
+    // Velocity planning.
+    forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int threadIndex)
+                    { updateAgentsVelocity(due, begin, end, &m_threadData[threadIndex], debug, debugAgent); });
+
+    for (size_t i = 0; i < m_threadData.size(); ++i)
+    {
+        m_velocitySampleCount += m_threadData[i].velocitySampleCount;
+        m_threadData[i].velocitySampleCount = 0;
+    }
+    endPhase(m_updateStats.velocityPlanningTime);
+
+    // Integrate.
+    forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int)
+                    { integrateAgents(due, begin, end); });
+    endPhase(m_updateStats.integrationTime);
+
+    // Handle collisions.
+    for (int iter = 0; iter < 4; ++iter)
+    {
+        forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int)
+                        { updateAgentsCollision(due, begin, end); });
+
+        forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int)
+                        { applyAgentsCollision(due, begin, end); });
+    }
+    endPhase(m_updateStats.collisionTime);
+
+    // Move along navmesh.
+    forEachDueAgent([&](dtCrowdAgent **due, int begin, int end, int threadIndex)
+                    { updateAgentsPosition(due, begin, end, &m_threadData[threadIndex]); });
+    endPhase(m_updateStats.positionTime);
+
+    // Update agents using off-mesh connection.
+    updateOffMeshAnimations(agents, nagents, dt);
+    endPhase(m_updateStats.offMeshAnimationTime);
+
+    // Record state changes as events.
+    recordAgentEvents(agents, nagents);
+
+    m_updateStats.totalTime = (float)((phaseStart - updateStart) * 1000.0);
+}
+
+void Crowd::updateAgentGrid(dtCrowdAgent **agents, const int nagents)
+{
+    dtProximityGrid *grid = const_cast<dtProximityGrid *>(m_crowd->getGrid());
+    grid->clear();
+    m_gridAgentIndices.resize(nagents);
+    const float invCellSize = 1.0f / grid->getCellSize();
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        const float *p = ag->npos;
+        const float r = ag->params.radius;
+        grid->addItem((unsigned short)i, p[0] - r, p[2] - r, p[0] + r, p[2] + r);
+        m_gridAgentIndices[i] = getAgentIndex(ag);
+
+        // Cells covered, as computed by dtProximityGrid::addItem
+        const int cellsX = (int)dtMathFloorf((p[0] + r) * invCellSize) - (int)dtMathFloorf((p[0] - r) * invCellSize) + 1;
+        const int cellsZ = (int)dtMathFloorf((p[2] + r) * invCellSize) - (int)dtMathFloorf((p[2] - r) * invCellSize) + 1;
+        m_updateStats.gridCellEntries += cellsX * cellsZ;
+    }
+    for (int i = 0; i < nagents; ++i)
+    {
+        const float *p = agents[i]->npos;
+        const int count = grid->getItemCountAt((int)dtMathFloorf(p[0] * invCellSize), (int)dtMathFloorf(p[2] * invCellSize));
+        m_updateStats.gridMaxCellOccupancy = dtMax(m_updateStats.gridMaxCellOccupancy, count);
+    }
+    m_updateStats.gridItemCount = nagents;
+}
+
+const dtCrowdAgent *Crowd::getGridAgent(const unsigned short id) const
+{
+    if (id >= m_gridAgentIndices.size())
+        return 0;
+
+    const int idx = m_gridAgentIndices[id];
+    if (idx >= m_maxAgents || !m_agents[idx].active)
+        return 0;
+
+    return &m_agents[idx];
+}
+
+void Crowd::storeQueryResults(IntArray *offsets, IntArray *indices)
+{
+    offsets->copy(m_queryOffsets.data(), (int)m_queryOffsets.size());
+    indices->copy(m_queryIndices.data(), (int)m_queryIndices.size());
+}
+
+int Crowd::queryAgentsInRadius(const float *centers, const float *radii, const int radiusCount, const int queryCount, IntArray *offsets, IntArray *indices)
+{
+    const dtProximityGrid *grid = m_crowd->getGrid();
+    m_queryGridIds.resize(dtMax((int)m_gridAgentIndices.size(), 1));
+
+    m_queryOffsets.resize(queryCount + 1);
+    m_queryIndices.clear();
+
+    for (int i = 0; i < queryCount; ++i)
+    {
+        m_queryOffsets[i] = (int)m_queryIndices.size();
+
+        const float *center = &centers[i * 3];
+        const float radius = radii[radiusCount == 1 ? 0 : i];
+
+        const int nids = grid->queryItems(center[0] - radius, center[2] - radius, center[0] + radius, center[2] + radius,
+                                          m_queryGridIds.data(), (int)m_queryGridIds.size());
+
+        for (int j = 0; j < nids; ++j)
+        {
+            const dtCrowdAgent *ag = getGridAgent(m_queryGridIds[j]);
+            if (!ag || dtVdist2DSqr(center, ag->npos) > dtSqr(radius))
+                continue;
+
+            m_queryIndices.push_back(getAgentIndex(ag));
+        }
+    }
+    m_queryOffsets[queryCount] = (int)m_queryIndices.size();
+
+    storeQueryResults(offsets, indices);
+
+    return (int)m_queryIndices.size();
+}
+
+int Crowd::queryAgentsInBox(const float *bmins, const float *bmaxs, const int queryCount, IntArray *offsets, IntArray *indices)
+{
+    const dtProximityGrid *grid = m_crowd->getGrid();
+    m_queryGridIds.resize(dtMax((int)m_gridAgentIndices.size(), 1));
+
+    m_queryOffsets.resize(queryCount + 1);
+    m_queryIndices.clear();
+
+    for (int i = 0; i < queryCount; ++i)
+    {
+        m_queryOffsets[i] = (int)m_queryIndices.size();
+
+        const float *bmin = &bmins[i * 3];
+        const float *bmax = &bmaxs[i * 3];
+
+        const int nids = grid->queryItems(bmin[0], bmin[2], bmax[0], bmax[2], m_queryGridIds.data(), (int)m_queryGridIds.size());
+
+        for (int j = 0; j < nids; ++j)
+        {
+            const dtCrowdAgent *ag = getGridAgent(m_queryGridIds[j]);
+            if (!ag)
+                continue;
+
+            const float *p = ag->npos;
+            if (p[0] < bmin[0] || p[1] < bmin[1] || p[2] < bmin[2] || p[0] > bmax[0] || p[1] > bmax[1] || p[2] > bmax[2])
+                continue;
+
+            m_queryIndices.push_back(getAgentIndex(ag));
+        }
+    }
+    m_queryOffsets[queryCount] = (int)m_queryIndices.size();
+
+    storeQueryResults(offsets, indices);
+
+    return (int)m_queryIndices.size();
+}
+
+void Crowd::updateAgentLods(dtCrowdAgent **agents, const int nagents, const float dt)
+{
+    const int focusCount = (int)m_lodFocusPoints.size() / 3;
+
+    m_threadPool.parallelFor(nagents, [&](int begin, int end, int)
+                             {
+        for (int i = begin; i < end; ++i)
+        {
+            const dtCrowdAgent *ag = agents[i];
+            CrowdAgentLod *lod = &m_agentLods[getAgentIndex(ag)];
+
+            if (lod->manualTier >= 0)
+            {
+                lod->tier = dtMin(lod->manualTier, m_lodTierCount - 1);
+                continue;
+            }
+
+            float minDistSqr = FLT_MAX;
+            for (int j = 0; j < focusCount; ++j)
+            {
+                minDistSqr = dtMin(minDistSqr, dtVdistSqr(ag->npos, &m_lodFocusPoints[j * 3]));
+            }
+
+            // Without focus points every agent is in the first tier
+            int tier = 0;
+            if (focusCount > 0)
+            {
+                while (tier < m_lodTierCount - 1 && minDistSqr > dtSqr(m_lodTiers[tier].distance))
+                    tier++;
+            }
+            lod->tier = tier;
+        } });
+
+    int counts[CROWD_MAX_LOD_TIERS];
+    memset(counts, 0, sizeof(counts));
+    memset(m_lodTierStats, 0, sizeof(m_lodTierStats));
+
+    for (int i = 0; i < nagents; ++i)
+    {
+        const int idx = getAgentIndex(agents[i]);
+        CrowdAgentLod *lod = &m_agentLods[idx];
+        const int interval = dtMax(1, m_lodTiers[lod->tier].updateInterval);
+
+        lod->accumulatedDt += dt;
+        m_lodTierStats[lod->tier].agentCount++;
+
+        // Stagger by agent index so a tier's work is spread evenly over its interval
+        lod->due = (m_updateCount + (unsigned int)idx) % interval == 0;
+        if (!lod->due)
+            continue;
+
+        lod->stepDt = lod->accumulatedDt;
+        lod->accumulatedDt = 0;
+        counts[lod->tier]++;
+    }
+
+    m_lodTierOffsets[0] = 0;
+    for (int tier = 0; tier < m_lodTierCount; ++tier)
+    {
+        m_lodTierOffsets[tier + 1] = m_lodTierOffsets[tier] + counts[tier];
+        m_lodTierStats[tier].updatedAgentCount = counts[tier];
+        counts[tier] = m_lodTierOffsets[tier];
+    }
+
+    // Bucket the due agents by tier, keeping active agent order within a tier
+    for (int i = 0; i < nagents; ++i)
+    {
+        const CrowdAgentLod *lod = &m_agentLods[getAgentIndex(agents[i])];
+        if (lod->due)
+            m_dueAgents[counts[lod->tier]++] = agents[i];
+    }
+}
+
+void Crowd::forEachDueAgent(const std::function<void(dtCrowdAgent **agents, int begin, int end, int threadIndex)> &fn)
+{
+    for (int tier = 0; tier < m_lodTierCount; ++tier)
+    {
+        dtCrowdAgent **due = m_dueAgents + m_lodTierOffsets[tier];
+        const int count = m_lodTierOffsets[tier + 1] - m_lodTierOffsets[tier];
+        if (!count)
+            continue;
+
+        const double start = getTimeMs();
+
+        m_threadPool.parallelFor(count, [&](int begin, int end, int threadIndex)
+                                 { fn(due, begin, end, threadIndex); });
+
+        m_lodTierStats[tier].updateTime += (float)((getTimeMs() - start) * 1000.0);
+    }
+}
+
+void Crowd::setLodTierCount(const int count)
+{
+    m_lodTierCount = dtClamp(count, 1, CROWD_MAX_LOD_TIERS);
+}
+
+int Crowd::getLodTierCount() const
+{
+    return m_lodTierCount;
+}
+
+void Crowd::setLodTierParams(const int tier, const CrowdLodTierParams *params)
+{
+    if (tier < 0 || tier >= CROWD_MAX_LOD_TIERS)
+        return;
+
+    m_lodTiers[tier] = *params;
+}
+
+const CrowdLodTierParams *Crowd::getLodTierParams(const int tier) const
+{
+    if (tier < 0 || tier >= CROWD_MAX_LOD_TIERS)
+        return 0;
+
+    return &m_lodTiers[tier];
+}
+
+void Crowd::setLodFocusPoints(const float *points, const int count)
+{
+    m_lodFocusPoints.assign(points, points + count * 3);
+}
+
+void Crowd::setAgentLodTier(const int idx, const int tier)
+{
+    if (idx < 0 || idx >= m_maxAgents)
+        return;
+
+    m_agentLods[idx].manualTier = tier < 0 ? -1 : dtMin(tier, CROWD_MAX_LOD_TIERS - 1);
+}
+
+int Crowd::getAgentLodTier(const int idx) const
+{
+    if (idx < 0 || idx >= m_maxAgents)
+        return -1;
+
+    return m_agentLods[idx].tier;
+}
+
+CrowdUpdateStats Crowd::getUpdateStats() const
+{
+    return m_updateStats;
+}
+
+void Crowd::setEventCapacity(const int capacity)
+{
+    m_events.resize(dtMax(capacity, 1));
+    m_eventHead = 0;
+    m_eventCount = 0;
+}
+
+int Crowd::getEventCapacity() const
+{
+    return (int)m_events.size();
+}
+
+int Crowd::drainEvents(IntArray *events)
+{
+    const int count = m_eventCount;
+    const int capacity = (int)m_events.size();
+
+    events->resize(count * 2);
+    for (int i = 0; i < count; ++i)
+    {
+        const CrowdEvent &event = m_events[(m_eventHead + i) % capacity];
+        events->data[i * 2 + 0] = event.type;
+        events->data[i * 2 + 1] = event.agentIndex;
+    }
+
+    m_eventHead = 0;
+    m_eventCount = 0;
+
+    return count;
+}
+
+int Crowd::getDroppedEventCount() const
+{
+    return m_droppedEventCount;
+}
+
+void Crowd::pushEvent(const int type, const dtCrowdAgent *agent)
+{
+    const int capacity = (int)m_events.size();
+
+    if (m_eventCount == capacity)
+    {
+        // Overwrite the oldest event
+        m_eventHead = (m_eventHead + 1) % capacity;
+        m_eventCount--;
+        m_droppedEventCount++;
+    }
+
+    CrowdEvent &event = m_events[(m_eventHead + m_eventCount) % capacity];
+    event.type = type;
+    event.agentIndex = getAgentIndex(agent);
+    m_eventCount++;
+}
+
+void Crowd::resetAgentEventState(const int idx)
+{
+    const dtCrowdAgent *ag = &m_agents[idx];
+    CrowdAgentEventState *eventState = &m_agentEventStates[idx];
+    eventState->state = ag->state;
+    eventState->partial = ag->partial;
+    eventState->arrived = false;
+}
+
+void Crowd::recordAgentEvents(dtCrowdAgent **agents, const int nagents)
+{
+    for (int i = 0; i < nagents; ++i)
+    {
+        const dtCrowdAgent *ag = agents[i];
+        CrowdAgentEventState *eventState = &m_agentEventStates[getAgentIndex(ag)];
+
+        if (ag->state == DT_CROWDAGENT_STATE_INVALID && eventState->state != DT_CROWDAGENT_STATE_INVALID)
+            pushEvent(CROWD_EVENT_BECAME_INVALID, ag);
+
+        if (ag->partial && !eventState->partial)
+            pushEvent(CROWD_EVENT_PATH_PARTIAL, ag);
+
+        // Arrived when the end of the path to the move target is within the agent's radius, or already consumed
+        bool arrived = false;
+        if (ag->state == DT_CROWDAGENT_STATE_WALKING && ag->targetState == DT_CROWDAGENT_TARGET_VALID && !ag->partial)
+        {
+            if (ag->ncorners == 0)
+                arrived = true;
+            else if (ag->cornerFlags[ag->ncorners - 1] & DT_STRAIGHTPATH_END)
+                arrived = dtVdist2DSqr(ag->npos, &ag->cornerVerts[(ag->ncorners - 1) * 3]) <= dtSqr(ag->params.radius);
+        }
+
+        if (arrived && !eventState->arrived)
+            pushEvent(CROWD_EVENT_TARGET_REACHED, ag);
+
+        eventState->state = ag->state;
+        eventState->partial = ag->partial;
+        eventState->arrived = arrived;
+    }
+}
+
+CrowdLodTierStats Crowd::getLodTierStats(const int tier) const
+{
+    if (tier < 0 || tier >= CROWD_MAX_LOD_TIERS)
+    {
+        CrowdLodTierStats empty;
+        memset(&empty, 0, sizeof(empty));
+        return empty;
+    }
+
+    return m_lodTierStats[tier];
+}
+
+void Crowd::requestMoveTargetReplan(dtCrowdAgent *ag, dtPolyRef ref, const float *pos)
+{
+    // Initialize request.
+    ag->targetRef = ref;
+    dtVcopy(ag->targetPos, pos);
+    ag->targetPathqRef = DT_PATHQ_INVALID;
+    ag->targetReplan = true;
+    if (ag->targetRef)
+        ag->targetState = DT_CROWDAGENT_TARGET_REQUESTING;
+    else
+        ag->targetState = DT_CROWDAGENT_TARGET_FAILED;
+}
+
+void Crowd::checkPathValidity(dtCrowdAgent **agents, const int nagents, const float dt)
+{
+    static const int CHECK_LOOKAHEAD = 10;
+    static const float TARGET_REPLAN_DELAY = 1.0; // seconds
+
+    dtNavMeshQuery *navquery = m_threadData[0].navQuery;
+    const float *halfExtents = m_crowd->getQueryHalfExtents();
+
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+
+        ag->targetReplanTime += dt;
+
+        bool replan = false;
+
+        const dtQueryFilter *filter = m_crowd->getFilter(ag->params.queryFilterType);
+
+        // First check that the current location is valid.
+        float agentPos[3];
+        dtPolyRef agentRef = ag->corridor.getFirstPoly();
+        dtVcopy(agentPos, ag->npos);
+        if (!navquery->isValidPolyRef(agentRef, filter))
+        {
+            // Current location is not valid, try to reposition.
+            float nearest[3];
+            dtVcopy(nearest, agentPos);
+            agentRef = 0;
+            navquery->findNearestPoly(ag->npos, halfExtents, filter, &agentRef, nearest);
+            dtVcopy(agentPos, nearest);
+
+            if (!agentRef)
+            {
+                // Could not find location in navmesh, set state to invalid.
+                ag->corridor.reset(0, agentPos);
+                ag->partial = false;
+                ag->boundary.reset();
+                ag->state = DT_CROWDAGENT_STATE_INVALID;
+                continue;
+            }
+
+            // Make sure the first polygon is valid, but leave other valid
+            // polygons in the path so that replanner can adjust the path better.
+            ag->corridor.fixPathStart(agentRef, agentPos);
+            ag->boundary.reset();
+            dtVcopy(ag->npos, agentPos);
+
+            replan = true;
+        }
+
+        // If the agent does not have move target or is controlled by velocity, no need to recover the target nor replan.
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+
+        // Try to recover move request position.
+        if (ag->targetState != DT_CROWDAGENT_TARGET_NONE && ag->targetState != DT_CROWDAGENT_TARGET_FAILED)
+        {
+            if (!navquery->isValidPolyRef(ag->targetRef, filter))
+            {
+                // Current target is not valid, try to reposition.
+                float nearest[3];
+                dtVcopy(nearest, ag->targetPos);
+                ag->targetRef = 0;
+                navquery->findNearestPoly(ag->targetPos, halfExtents, filter, &ag->targetRef, nearest);
+                dtVcopy(ag->targetPos, nearest);
+                replan = true;
+            }
+            if (!ag->targetRef)
+            {
+                // Failed to reposition target, fail moverequest.
+                ag->corridor.reset(agentRef, agentPos);
+                ag->partial = false;
+                ag->targetState = DT_CROWDAGENT_TARGET_NONE;
+            }
+        }
+
+        // If nearby corridor is not valid, replan.
+        if (!ag->corridor.isValid(CHECK_LOOKAHEAD, navquery, filter))
+        {
+            replan = true;
+        }
+
+        // If the end of the path is near and it is not the requested location, replan.
+        if (ag->targetState == DT_CROWDAGENT_TARGET_VALID)
+        {
+            if (ag->targetReplanTime > TARGET_REPLAN_DELAY &&
+                ag->corridor.getPathCount() < CHECK_LOOKAHEAD &&
+                ag->corridor.getLastPoly() != ag->targetRef)
+                replan = true;
+        }
+
+        // Try to replan path to goal.
+        if (replan)
+        {
+            if (ag->targetState != DT_CROWDAGENT_TARGET_NONE)
+            {
+                requestMoveTargetReplan(ag, ag->targetRef, ag->targetPos);
+                m_updateStats.replans++;
+                pushEvent(CROWD_EVENT_REPLANNED, ag);
+            }
+        }
+    }
+}
+
+void Crowd::updateMoveRequest(dtCrowdAgent **agents, const int nagents)
+{
+    const int PATH_MAX_AGENTS = 8;
+    dtCrowdAgent *queue[PATH_MAX_AGENTS];
+    int nqueue = 0;
+
+    dtNavMeshQuery *navquery = m_threadData[0].navQuery;
+    dtPathQueue *pathq = const_cast<dtPathQueue *>(m_crowd->getPathQueue());
+
+    // Fire off new requests.
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->state == DT_CROWDAGENT_STATE_INVALID)
+            continue;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+
+        const dtQueryFilter *filter = m_crowd->getFilter(ag->params.queryFilterType);
+
+        if (ag->targetState == DT_CROWDAGENT_TARGET_REQUESTING)
+        {
+            const dtPolyRef *path = ag->corridor.getPath();
+            const int npath = ag->corridor.getPathCount();
+
+            static const int MAX_RES = 32;
+            float reqPos[3];
+            dtPolyRef reqPath[MAX_RES]; // The path to the request location
+            int reqPathCount = 0;
+
+            // Quick search towards the goal.
+            static const int MAX_ITER = 20;
+            navquery->initSlicedFindPath(path[0], ag->targetRef, ag->npos, ag->targetPos, filter);
+            navquery->updateSlicedFindPath(MAX_ITER, 0);
+            dtStatus status = 0;
+            if (ag->targetReplan)
+            {
+                // Try to use existing steady path during replan if possible.
+                status = navquery->finalizeSlicedFindPathPartial(path, npath, reqPath, &reqPathCount, MAX_RES);
+            }
+            else
+            {
+                // Try to move towards target when goal changes.
+                status = navquery->finalizeSlicedFindPath(reqPath, &reqPathCount, MAX_RES);
+            }
+
+            if (!dtStatusFailed(status) && reqPathCount > 0)
+            {
+                // In progress or succeed.
+                if (reqPath[reqPathCount - 1] != ag->targetRef)
+                {
+                    // Partial path, constrain target position inside the last polygon.
+                    status = navquery->closestPointOnPoly(reqPath[reqPathCount - 1], ag->targetPos, reqPos, 0);
+                    if (dtStatusFailed(status))
+                        reqPathCount = 0;
+                }
+                else
+                {
+                    dtVcopy(reqPos, ag->targetPos);
+                }
+            }
+            else
+            {
+                reqPathCount = 0;
+            }
+
+            if (!reqPathCount)
+            {
+                // Could not find path, start the request from current location.
+                dtVcopy(reqPos, ag->npos);
+                reqPath[0] = path[0];
+                reqPathCount = 1;
+            }
+
+            ag->corridor.setCorridor(reqPos, reqPath, reqPathCount);
+            ag->boundary.reset();
+            ag->partial = false;
+
+            if (reqPath[reqPathCount - 1] == ag->targetRef)
+            {
+                ag->targetState = DT_CROWDAGENT_TARGET_VALID;
+                ag->targetReplanTime = 0.0;
+            }
+            else
+            {
+                // The path is longer or potentially unreachable, full plan.
+                ag->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE;
+            }
+        }
+
+        if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE)
+        {
+            nqueue = addToPathQueue(ag, queue, nqueue, PATH_MAX_AGENTS);
+        }
+    }
+
+    for (int i = 0; i < nqueue; ++i)
+    {
+        dtCrowdAgent *ag = queue[i];
+        ag->targetPathqRef = pathq->request(ag->corridor.getLastPoly(), ag->targetRef,
+                                            ag->corridor.getTarget(), ag->targetPos, m_crowd->getFilter(ag->params.queryFilterType));
+        if (ag->targetPathqRef != DT_PATHQ_INVALID)
+        {
+            ag->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_PATH;
+            m_updateStats.pathRequestsIssued++;
+        }
+        else
+        {
+            m_updateStats.pathRequestsDropped++;
+        }
+    }
+
+    // Update requests.
+    pathq->update(MAX_ITERS_PER_UPDATE);
+
+    dtStatus status;
+
+    // Process path results.
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+
+        if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_PATH)
+        {
+            // Poll path queue.
+            status = pathq->getRequestStatus(ag->targetPathqRef);
+            if (dtStatusFailed(status))
+            {
+                m_updateStats.pathRequestsFailed++;
+
+                // Path find failed, retry if the target location is still valid.
+                ag->targetPathqRef = DT_PATHQ_INVALID;
+                if (ag->targetRef)
+                    ag->targetState = DT_CROWDAGENT_TARGET_REQUESTING;
+                else
+                    ag->targetState = DT_CROWDAGENT_TARGET_FAILED;
+                ag->targetReplanTime = 0.0;
+            }
+            else if (dtStatusSucceed(status))
+            {
+                m_updateStats.pathRequestsServed++;
+
+                const dtPolyRef *path = ag->corridor.getPath();
+                const int npath = ag->corridor.getPathCount();
+
+                // Apply results.
+                float targetPos[3];
+                dtVcopy(targetPos, ag->targetPos);
+
+                dtPolyRef *res = m_pathResult;
+                bool valid = true;
+                int nres = 0;
+                status = pathq->getPathResult(ag->targetPathqRef, res, &nres, m_maxPathResult);
+                if (dtStatusFailed(status) || !nres)
+                    valid = false;
+
+                if (dtStatusDetail(status, DT_PARTIAL_RESULT))
+                    ag->partial = true;
+                else
+                    ag->partial = false;
+
+                // Merge result and existing path.
+                // The agent might have moved whilst the request is
+                // being processed, so the path may have changed.
+                // We assume that the end of the path is at the same location
+                // where the request was issued.
+
+                // The last ref in the old path should be the same as
+                // the location where the request was issued..
+                if (valid && path[npath - 1] != res[0])
+                    valid = false;
+
+                if (valid)
+                {
+                    // Put the old path infront of the old path.
+                    if (npath > 1)
+                    {
+                        // Make space for the old path.
+                        if ((npath - 1) + nres > m_maxPathResult)
+                            nres = m_maxPathResult - (npath - 1);
+
+                        memmove(res + npath - 1, res, sizeof(dtPolyRef) * nres);
+                        // Copy old path in the beginning.
+                        memcpy(res, path, sizeof(dtPolyRef) * (npath - 1));
+                        nres += npath - 1;
+
+                        // Remove trackbacks
+                        for (int j = 0; j < nres; ++j)
+                        {
+                            if (j - 1 >= 0 && j + 1 < nres)
+                            {
+                                if (res[j - 1] == res[j + 1])
+                                {
+                                    memmove(res + (j - 1), res + (j + 1), sizeof(dtPolyRef) * (nres - (j + 1)));
+                                    nres -= 2;
+                                    j -= 2;
+                                }
+                            }
+                        }
+                    }
+
+                    // Check for partial path.
+                    if (res[nres - 1] != ag->targetRef)
+                    {
+                        // Partial path, constrain target position inside the last polygon.
+                        float nearest[3];
+                        status = navquery->closestPointOnPoly(res[nres - 1], targetPos, nearest, 0);
+                        if (dtStatusSucceed(status))
+                            dtVcopy(targetPos, nearest);
+                        else
+                            valid = false;
+                    }
+                }
+
+                if (valid)
+                {
+                    // Set current corridor.
+                    ag->corridor.setCorridor(targetPos, res, nres);
+                    // Force to update boundary.
+                    ag->boundary.reset();
+                    ag->targetState = DT_CROWDAGENT_TARGET_VALID;
+                }
+                else
+                {
+                    // Something went wrong.
+                    ag->targetState = DT_CROWDAGENT_TARGET_FAILED;
+                }
+
+                ag->targetReplanTime = 0.0;
+            }
+        }
+
+        if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_PATH)
+            m_updateStats.pathQueueDepth++;
+        else if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE)
+            m_updateStats.pathQueueWaiting++;
+    }
+}
+
+void Crowd::updateTopologyOptimization(dtCrowdAgent **agents, const int nagents, const float dt)
+{
+    if (!nagents)
+        return;
+
+    const float OPT_TIME_THR = 0.5f; // seconds
+    const int OPT_MAX_AGENTS = 1;
+    dtCrowdAgent *queue[OPT_MAX_AGENTS];
+    int nqueue = 0;
+
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+        if ((ag->params.updateFlags & DT_CROWD_OPTIMIZE_TOPO) == 0)
+            continue;
+        ag->topologyOptTime += dt;
+        if (ag->topologyOptTime >= OPT_TIME_THR)
+            nqueue = addToOptQueue(ag, queue, nqueue, OPT_MAX_AGENTS);
+    }
+
+    for (int i = 0; i < nqueue; ++i)
+    {
+        dtCrowdAgent *ag = queue[i];
+        ag->corridor.optimizePathTopology(m_threadData[0].navQuery, m_crowd->getFilter(ag->params.queryFilterType));
+        ag->topologyOptTime = 0;
+        m_updateStats.topologyOptimizations++;
+    }
+}
+
+void Crowd::updateAgentsNeighbourhood(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread)
+{
+    const dtProximityGrid *grid = m_crowd->getGrid();
+
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+
+        const dtQueryFilter *filter = m_crowd->getFilter(ag->params.queryFilterType);
+
+        const CrowdLodTierParams *tier = &m_lodTiers[m_agentLods[getAgentIndex(ag)].tier];
+
+        // Update the collision boundary after certain distance has been passed or
+        // if it has become invalid.
+        const float updateThr = ag->params.collisionQueryRange * 0.25f * tier->boundaryUpdateScale;
+        if (dtVdist2DSqr(ag->npos, ag->boundary.getCenter()) > dtSqr(updateThr) ||
+            !ag->boundary.isValid(thread->navQuery, filter))
+        {
+            ag->boundary.update(ag->corridor.getFirstPoly(), ag->npos, ag->params.collisionQueryRange,
+                                thread->navQuery, filter);
+        }
+
+        // Query neighbour agents
+        ag->nneis = getNeighbours(ag->npos, ag->params.height, ag->params.collisionQueryRange,
+                                  ag, ag->neis, DT_CROWDAGENT_MAX_NEIGHBOURS,
+                                  m_activeAgents, grid);
+        for (int j = 0; j < ag->nneis; j++)
+            ag->neis[j].idx = getAgentIndex(m_activeAgents[ag->neis[j].idx]);
+    }
+}
+
+void Crowd::updateAgentsCorners(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread, dtCrowdAgentDebugInfo *debug, const dtCrowdAgent *debugAgent)
+{
+
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+
+        const dtQueryFilter *filter = m_crowd->getFilter(ag->params.queryFilterType);
+
+        // Find corners for steering
+        ag->ncorners = ag->corridor.findCorners(ag->cornerVerts, ag->cornerFlags, ag->cornerPolys,
+                                                DT_CROWDAGENT_MAX_CORNERS, thread->navQuery, filter);
+
+        // Check to see if the corner after the next corner is directly visible,
+        // and short cut to there.
+        if ((ag->params.updateFlags & DT_CROWD_OPTIMIZE_VIS) && ag->ncorners > 0)
+        {
+            const float *target = &ag->cornerVerts[dtMin(1, ag->ncorners - 1) * 3];
+            ag->corridor.optimizePathVisibility(target, ag->params.pathOptimizationRange, thread->navQuery, filter);
+
+            // Copy data for debug purposes.
+            if (ag == debugAgent)
+            {
+                dtVcopy(debug->optStart, ag->corridor.getPos());
+                dtVcopy(debug->optEnd, target);
+            }
+        }
+        else
+        {
+            // Copy data for debug purposes.
+            if (ag == debugAgent)
+            {
+                dtVset(debug->optStart, 0, 0, 0);
+                dtVset(debug->optEnd, 0, 0, 0);
+            }
+        }
+    }
+}
+
+void Crowd::updateOffMeshConnections(dtCrowdAgent **agents, const int nagents)
+{
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+
+        // Check
+        const float triggerRadius = ag->params.radius * 2.25f;
+        if (overOffmeshConnection(ag, triggerRadius))
+        {
+            // Prepare to off-mesh connection.
+            const int idx = getAgentIndex(ag);
+            dtCrowdAgentAnimation *anim = &m_agentAnims[idx];
+
+            // Adjust the path over the off-mesh connection.
+            dtPolyRef refs[2];
+            if (ag->corridor.moveOverOffmeshConnection(ag->cornerPolys[ag->ncorners - 1], refs,
+                                                       anim->startPos, anim->endPos, m_threadData[0].navQuery))
+            {
+                dtVcopy(anim->initPos, ag->npos);
+                anim->polyRef = refs[1];
+                anim->active = true;
+                anim->t = 0.0f;
+                anim->tmax = (dtVdist2D(anim->startPos, anim->endPos) / ag->params.maxSpeed) * 0.5f;
+
+                ag->state = DT_CROWDAGENT_STATE_OFFMESH;
+                ag->ncorners = 0;
+                ag->nneis = 0;
+                pushEvent(CROWD_EVENT_OFFMESH_ENTERED, ag);
+                continue;
+            }
+            else
+            {
+                // Path validity check will ensure that bad/blocked connections will be replanned.
+            }
+        }
+    }
+}
+
+void Crowd::updateAgentsSteering(dtCrowdAgent **agents, const int begin, const int end)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE)
+            continue;
+
+        float dvel[3] = {0, 0, 0};
+
+        if (ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+        {
+            dtVcopy(dvel, ag->targetPos);
+            ag->desiredSpeed = dtVlen(ag->targetPos);
+        }
+        else
+        {
+            // Calculate steering direction.
+            if (ag->params.updateFlags & DT_CROWD_ANTICIPATE_TURNS)
+                calcSmoothSteerDirection(ag, dvel);
+            else
+                calcStraightSteerDirection(ag, dvel);
+
+            // Calculate speed scale, which tells the agent to slowdown at the end of the path.
+            const float slowDownRadius = ag->params.radius * 2;
+            const float speedScale = getDistanceToGoal(ag, slowDownRadius) / slowDownRadius;
+
+            ag->desiredSpeed = ag->params.maxSpeed;
+            dtVscale(dvel, dvel, ag->desiredSpeed * speedScale);
+        }
+
+        // Separation
+        if (ag->params.updateFlags & DT_CROWD_SEPARATION)
+        {
+            const float separationDist = ag->params.collisionQueryRange;
+            const float invSeparationDist = 1.0f / separationDist;
+            const float separationWeight = ag->params.separationWeight;
+
+            float w = 0;
+            float disp[3] = {0, 0, 0};
+
+            for (int j = 0; j < ag->nneis; ++j)
+            {
+                const dtCrowdAgent *nei = &m_agents[ag->neis[j].idx];
+
+                float diff[3];
+                dtVsub(diff, ag->npos, nei->npos);
+                diff[1] = 0;
+
+                const float distSqr = dtVlenSqr(diff);
+                if (distSqr < 0.00001f)
+                    continue;
+                if (distSqr > dtSqr(separationDist))
+                    continue;
+                const float dist = dtMathSqrtf(distSqr);
+                const float weight = separationWeight * (1.0f - dtSqr(dist * invSeparationDist));
+
+                dtVmad(disp, disp, diff, weight / dist);
+                w += 1.0f;
+            }
+
+            if (w > 0.0001f)
+            {
+                // Adjust desired velocity.
+                dtVmad(dvel, dvel, disp, 1.0f / w);
+                // Clamp desired velocity to desired speed.
+                const float speedSqr = dtVlenSqr(dvel);
+                const float desiredSqr = dtSqr(ag->desiredSpeed);
+                if (speedSqr > desiredSqr)
+                    dtVscale(dvel, dvel, desiredSqr / speedSqr);
+            }
+        }
+
+        // Set the desired velocity.
+        dtVcopy(ag->dvel, dvel);
+    }
+}
+
+void Crowd::updateAgentsVelocity(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread, dtCrowdAgentDebugInfo *debug, const dtCrowdAgent *debugAgent)
+{
+    dtObstacleAvoidanceQuery *obstacleQuery = thread->obstacleQuery;
+
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+
+        const CrowdLodTierParams *tier = &m_lodTiers[m_agentLods[getAgentIndex(ag)].tier];
+
+        if ((ag->params.updateFlags & DT_CROWD_OBSTACLE_AVOIDANCE) && tier->obstacleAvoidance)
+        {
+            obstacleQuery->reset();
+
+            // Add neighbours as obstacles.
+            for (int j = 0; j < ag->nneis; ++j)
+            {
+                const dtCrowdAgent *nei = &m_agents[ag->neis[j].idx];
+                obstacleQuery->addCircle(nei->npos, nei->params.radius, nei->vel, nei->dvel);
+            }
+
+            // Add nearby dynamic obstacles.
+            addAgentObstacles(ag, obstacleQuery, thread);
+
+            // Append neighbour segments as obstacles.
+            for (int j = 0; j < ag->boundary.getSegmentCount(); ++j)
+            {
+                const float *s = ag->boundary.getSegment(j);
+                if (dtTriArea2D(ag->npos, s, s + 3) < 0.0f)
+                    continue;
+                obstacleQuery->addSegment(s, s + 3);
+            }
+
+            dtObstacleAvoidanceDebugData *vod = 0;
+            if (ag == debugAgent)
+                vod = debug->vod;
+
+            // Sample new safe velocity.
+            const dtObstacleAvoidanceParams *params = m_crowd->getObstacleAvoidanceParams(ag->params.obstacleAvoidanceType);
+
+            if (m_simdObstacleAvoidance)
+            {
+                thread->velocitySampleCount += thread->sampler->sampleVelocityAdaptive(obstacleQuery, ag->npos, ag->params.radius, ag->desiredSpeed,
+                                                                                       ag->vel, ag->dvel, ag->nvel, params, vod);
+            }
+            else
+            {
+                thread->velocitySampleCount += obstacleQuery->sampleVelocityAdaptive(ag->npos, ag->params.radius, ag->desiredSpeed,
+                                                                                     ag->vel, ag->dvel, ag->nvel, params, vod);
+            }
+        }
+        else
+        {
+            // If not using velocity planning, new velocity is directly the desired velocity.
+            dtVcopy(ag->nvel, ag->dvel);
+        }
+    }
+}
+
+void Crowd::integrateAgents(dtCrowdAgent **agents, const int begin, const int end)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+        // Agents in lower tiers integrate the time since their last update in one step
+        integrate(ag, m_agentLods[getAgentIndex(ag)].stepDt);
+    }
+}
+
+void Crowd::updateAgentsCollision(dtCrowdAgent **agents, const int begin, const int end)
+{
+    static const float COLLISION_RESOLVE_FACTOR = 0.7f;
+
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        const int idx0 = getAgentIndex(ag);
+
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+
+        dtVset(ag->disp, 0, 0, 0);
+
+        float w = 0;
+
+        for (int j = 0; j < ag->nneis; ++j)
+        {
+            const dtCrowdAgent *nei = &m_agents[ag->neis[j].idx];
+            const int idx1 = getAgentIndex(nei);
+
+            float diff[3];
+            dtVsub(diff, ag->npos, nei->npos);
+            diff[1] = 0;
+
+            float dist = dtVlenSqr(diff);
+            if (dist > dtSqr(ag->params.radius + nei->params.radius))
+                continue;
+            dist = dtMathSqrtf(dist);
+            float pen = (ag->params.radius + nei->params.radius) - dist;
+            if (dist < 0.0001f)
+            {
+                // Agents on top of each other, try to choose diverging separation directions.
+                if (idx0 > idx1)
+                    dtVset(diff, -ag->dvel[2], 0, ag->dvel[0]);
+                else
+                    dtVset(diff, ag->dvel[2], 0, -ag->dvel[0]);
+                pen = 0.01f;
+            }
+            else
+            {
+                pen = (1.0f / dist) * (pen * 0.5f) * COLLISION_RESOLVE_FACTOR;
+            }
+
+            dtVmad(ag->disp, ag->disp, diff, pen);
+
+            w += 1.0f;
+        }
+
+        if (w > 0.0001f)
+        {
+            const float iw = 1.0f / w;
+            dtVscale(ag->disp, ag->disp, iw);
+        }
+    }
+}
+
+void Crowd::applyAgentsCollision(dtCrowdAgent **agents, const int begin, const int end)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+
+        dtVadd(ag->npos, ag->npos, ag->disp);
+    }
+}
+
+void Crowd::updateAgentsPosition(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread)
+{
+    for (int i = begin; i < end; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        if (ag->state != DT_CROWDAGENT_STATE_WALKING)
+            continue;
+
+        // Move along navmesh.
+        ag->corridor.movePosition(ag->npos, thread->navQuery, m_crowd->getFilter(ag->params.queryFilterType));
+        // Get valid constrained position back.
+        dtVcopy(ag->npos, ag->corridor.getPos());
+
+        // If not using path, truncate the corridor to just one poly.
+        if (ag->targetState == DT_CROWDAGENT_TARGET_NONE || ag->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+        {
+            ag->corridor.reset(ag->corridor.getFirstPoly(), ag->npos);
+            ag->partial = false;
+        }
+    }
+}
+
+void Crowd::updateOffMeshAnimations(dtCrowdAgent **agents, const int nagents, const float dt)
+{
+    for (int i = 0; i < nagents; ++i)
+    {
+        dtCrowdAgent *ag = agents[i];
+        const int idx = getAgentIndex(ag);
+        dtCrowdAgentAnimation *anim = &m_agentAnims[idx];
+        if (!anim->active)
+            continue;
+
+        anim->t += dt;
+        if (anim->t > anim->tmax)
+        {
+            // Reset animation
+            anim->active = false;
+            // Prepare agent for walking.
+            ag->state = DT_CROWDAGENT_STATE_WALKING;
+            pushEvent(CROWD_EVENT_OFFMESH_LEFT, ag);
+            continue;
+        }
+
+        // Update position
+        const float ta = anim->tmax * 0.15f;
+        const float tb = anim->tmax;
+        if (anim->t < ta)
+        {
+            const float u = tween(anim->t, 0.0, ta);
+            dtVlerp(ag->npos, anim->initPos, anim->startPos, u);
+        }
+        else
+        {
+            const float u = tween(anim->t, ta, tb);
+            dtVlerp(ag->npos, anim->startPos, anim->endPos, u);
+        }
+
+        // Update velocity.
+        dtVset(ag->vel, 0, 0, 0);
+        dtVset(ag->dvel, 0, 0, 0);
+    }
+}
+
+// dtProximityGrid stores pool indices as unsigned shorts
+static const int MAX_OBSTACLE_GRID_POOL = 0xffff;
+// Obstacles covering more cells are checked by every agent instead
+static const int MAX_OBSTACLE_GRID_CELLS = 64;
+
+static void getObstacleBounds(const CrowdObstacle *ob, float *bmin, float *bmax)
+{
+    if (ob->type == CROWD_OBSTACLE_CIRCLE)
+    {
+        bmin[0] = ob->pos[0] - ob->radius;
+        bmin[1] = ob->pos[2] - ob->radius;
+        bmax[0] = ob->pos[0] + ob->radius;
+        bmax[1] = ob->pos[2] + ob->radius;
+        return;
+    }
+
+    const float ex = dtAbs(ob->rot[0]) * ob->halfExtents[0] + dtAbs(ob->rot[1]) * ob->halfExtents[2];
+    const float ez = dtAbs(ob->rot[1]) * ob->halfExtents[0] + dtAbs(ob->rot[0]) * ob->halfExtents[2];
+    bmin[0] = ob->pos[0] - ex;
+    bmin[1] = ob->pos[2] - ez;
+    bmax[0] = ob->pos[0] + ex;
+    bmax[1] = ob->pos[2] + ez;
+}
+
+// Distance on the xz-plane from pos to the obstacle's outline, 0 inside it
+static float getObstacleDistance(const CrowdObstacle *ob, const float *pos)
+{
+    const float dx = pos[0] - ob->pos[0];
+    const float dz = pos[2] - ob->pos[2];
+
+    if (ob->type == CROWD_OBSTACLE_CIRCLE)
+        return dtMax(0.0f, dtMathSqrtf(dx * dx + dz * dz) - ob->radius);
+
+    const float lx = dtMax(0.0f, dtAbs(dx * ob->rot[0] - dz * ob->rot[1]) - ob->halfExtents[0]);
+    const float lz = dtMax(0.0f, dtAbs(dx * ob->rot[1] + dz * ob->rot[0]) - ob->halfExtents[2]);
+    return dtMathSqrtf(lx * lx + lz * lz);
+}
+
+// Box local xz-plane coordinates to world, rotated the same way as dtTileCache box obstacles
+static void getBoxPoint(const CrowdObstacle *ob, const float lx, const float lz, float *dest)
+{
+    dest[0] = ob->pos[0] + lx * ob->rot[0] + lz * ob->rot[1];
+    dest[1] = ob->pos[1];
+    dest[2] = ob->pos[2] - lx * ob->rot[1] + lz * ob->rot[0];
+}
+
+int Crowd::allocObstacle()
+{
+    if (!m_freeObstacles.empty())
+    {
+        const int id = m_freeObstacles.back();
+        m_freeObstacles.pop_back();
+        return id;
+    }
+
+    if ((int)m_obstacles.size() >= CROWD_MAX_OBSTACLES)
+        return -1;
+
+    m_obstacles.push_back(CrowdObstacle());
+    return (int)m_obstacles.size() - 1;
+}
+
+int Crowd::addCircleObstacle(const float *pos, const float radius, const float height, const float *vel)
+{
+    const int id = allocObstacle();
+    if (id < 0)
+        return -1;
+
+    CrowdObstacle *ob = &m_obstacles[id];
+    memset(ob, 0, sizeof(CrowdObstacle));
+    ob->type = CROWD_OBSTACLE_CIRCLE;
+    ob->active = true;
+    dtVcopy(ob->pos, pos);
+    dtVcopy(ob->vel, vel);
+    ob->radius = radius;
+    ob->height = height;
+    ob->rot[0] = 1.0f;
+    m_obstacleCount++;
+
+    return id;
+}
+
+int Crowd::addBoxObstacle(const float *center, const float *halfExtents, const float yRadians, const float *vel)
+{
+    const int id = allocObstacle();
+    if (id < 0)
+        return -1;
+
+    CrowdObstacle *ob = &m_obstacles[id];
+    memset(ob, 0, sizeof(CrowdObstacle));
+    ob->type = CROWD_OBSTACLE_BOX;
+    ob->active = true;
+    dtVcopy(ob->pos, center);
+    dtVcopy(ob->vel, vel);
+    dtVcopy(ob->halfExtents, halfExtents);
+    ob->rot[0] = dtMathCosf(yRadians);
+    ob->rot[1] = dtMathSinf(yRadians);
+    m_obstacleCount++;
+
+    return id;
+}
+
+bool Crowd::updateObstacle(const int id, const float *pos, const float yRadians, const float *vel)
+{
+    if (id < 0 || id >= (int)m_obstacles.size() || !m_obstacles[id].active)
+        return false;
+
+    CrowdObstacle *ob = &m_obstacles[id];
+    dtVcopy(ob->pos, pos);
+    dtVcopy(ob->vel, vel);
+    if (ob->type == CROWD_OBSTACLE_BOX)
+    {
+        ob->rot[0] = dtMathCosf(yRadians);
+        ob->rot[1] = dtMathSinf(yRadians);
+    }
+
+    return true;
+}
+
+bool Crowd::removeObstacle(const int id)
+{
+    if (id < 0 || id >= (int)m_obstacles.size() || !m_obstacles[id].active)
+        return false;
+
+    m_obstacles[id].active = false;
+    m_freeObstacles.push_back(id);
+    m_obstacleCount--;
+
+    return true;
+}
+
+const CrowdObstacle *Crowd::getObstacle(const int id) const
+{
+    if (id < 0 || id >= (int)m_obstacles.size() || !m_obstacles[id].active)
+        return 0;
+
+    return &m_obstacles[id];
+}
+
+int Crowd::getObstacleCount() const
+{
+    return m_obstacleCount;
+}
+
+void Crowd::setMaxObstacleCandidates(const int count)
+{
+    m_maxObstacleCandidates = dtClamp(count, 1, CROWD_MAX_OBSTACLES);
+    for (size_t i = 0; i < m_threadData.size(); ++i)
+    {
+        m_threadData[i].obstacleIds.resize(m_maxObstacleCandidates);
+    }
+}
+
+int Crowd::getMaxObstacleCandidates() const
+{
+    return m_maxObstacleCandidates;
+}
+
+void Crowd::updateObstacleGrid()
+{
+    m_gridObstacles.clear();
+    m_largeObstacles.clear();
+    if (!m_obstacleCount)
+        return;
+
+    // Large obstacles are stored once per cell they cover. dtProximityGrid indexes its pool with unsigned shorts,
+    // obstacles covering too many cells, or past the pool limit, are kept in a list every agent checks instead.
+    const float cellSize = m_crowd->getGrid()->getCellSize();
+    const float invCellSize = 1.0f / cellSize;
+    int cellEntries = 0;
+    for (size_t i = 0; i < m_obstacles.size(); ++i)
+    {
+        const CrowdObstacle *ob = &m_obstacles[i];
+        if (!ob->active)
+            continue;
+
+        float bmin[2], bmax[2];
+        getObstacleBounds(ob, bmin, bmax);
+        const int cellsX = (int)dtMathFloorf(bmax[0] * invCellSize) - (int)dtMathFloorf(bmin[0] * invCellSize) + 1;
+        const int cellsZ = (int)dtMathFloorf(bmax[1] * invCellSize) - (int)dtMathFloorf(bmin[1] * invCellSize) + 1;
+        const long long cells = (long long)cellsX * cellsZ;
+        if (cells > MAX_OBSTACLE_GRID_CELLS || cellEntries + cells > MAX_OBSTACLE_GRID_POOL)
+        {
+            m_largeObstacles.push_back((int)i);
+            continue;
+        }
+
+        m_gridObstacles.push_back((int)i);
+        cellEntries += (int)cells;
+    }
+
+    if (m_gridObstacles.empty())
+        return;
+
+    if (!m_obstacleGrid || cellEntries > m_obstacleGridPoolSize)
+    {
+        dtFreeProximityGrid(m_obstacleGrid);
+        m_obstacleGridPoolSize = dtMin(dtMax(cellEntries, m_obstacleGridPoolSize * 2), MAX_OBSTACLE_GRID_POOL);
+        m_obstacleGrid = dtAllocProximityGrid();
+        if (!m_obstacleGrid || !m_obstacleGrid->init(m_obstacleGridPoolSize, cellSize))
+        {
+            dtFreeProximityGrid(m_obstacleGrid);
+            m_obstacleGrid = 0;
+            m_obstacleGridPoolSize = 0;
+
+            // Every agent checks every obstacle rather than none
+            m_largeObstacles.insert(m_largeObstacles.end(), m_gridObstacles.begin(), m_gridObstacles.end());
+            m_gridObstacles.clear();
+            return;
+        }
+    }
+
+    m_obstacleGrid->clear();
+    for (size_t i = 0; i < m_gridObstacles.size(); ++i)
+    {
+        const int id = m_gridObstacles[i];
+        float bmin[2], bmax[2];
+        getObstacleBounds(&m_obstacles[id], bmin, bmax);
+        m_obstacleGrid->addItem((unsigned short)id, bmin[0], bmin[1], bmax[0], bmax[1]);
+    }
+}
+
+void Crowd::addAgentObstacles(const dtCrowdAgent *ag, dtObstacleAvoidanceQuery *obstacleQuery, CrowdThreadData *thread)
+{
+    if (!m_obstacleCount)
+        return;
+
+    const float range = ag->params.collisionQueryRange;
+    const int nids = m_obstacleGrid && !m_gridObstacles.empty()
+                         ? m_obstacleGrid->queryItems(ag->npos[0] - range, ag->npos[2] - range, ag->npos[0] + range, ag->npos[2] + range,
+                                                      thread->obstacleIds.data(), m_maxObstacleCandidates)
+                         : 0;
+    const int nlarge = (int)m_largeObstacles.size();
+
+    // Keep the nearest obstacles, sorted by distance
+    const CrowdObstacle *nearest[CROWD_MAX_AGENT_OBSTACLES];
+    float nearestDist[CROWD_MAX_AGENT_OBSTACLES];
+    int nnearest = 0;
+
+    for (int i = 0; i < nids + nlarge; ++i)
+    {
+        const CrowdObstacle *ob = &m_obstacles[i < nids ? thread->obstacleIds[i] : m_largeObstacles[i - nids]];
+
+        // Check for overlap.
+        const float obMinY = ob->type == CROWD_OBSTACLE_CIRCLE ? ob->pos[1] : ob->pos[1] - ob->halfExtents[1];
+        const float obMaxY = ob->type == CROWD_OBSTACLE_CIRCLE ? ob->pos[1] + ob->height : ob->pos[1] + ob->halfExtents[1];
+        if (ag->npos[1] > obMaxY || ag->npos[1] + ag->params.height < obMinY)
+            continue;
+
+        const float dist = getObstacleDistance(ob, ag->npos);
+        if (dist > range)
+            continue;
+
+        int j = dtMin(nnearest, CROWD_MAX_AGENT_OBSTACLES - 1);
+        if (nnearest == CROWD_MAX_AGENT_OBSTACLES && dist >= nearestDist[j])
+            continue;
+
+        for (; j > 0 && nearestDist[j - 1] > dist; --j)
+        {
+            nearest[j] = nearest[j - 1];
+            nearestDist[j] = nearestDist[j - 1];
+        }
+        nearest[j] = ob;
+        nearestDist[j] = dist;
+        nnearest = dtMin(nnearest + 1, CROWD_MAX_AGENT_OBSTACLES);
+    }
+
+    for (int i = 0; i < nnearest; ++i)
+    {
+        const CrowdObstacle *ob = nearest[i];
+
+        if (ob->type == CROWD_OBSTACLE_CIRCLE)
+        {
+            obstacleQuery->addCircle(ob->pos, ob->radius, ob->vel, ob->vel);
+        }
+        else if (dtVlenSqr(ob->vel) < 1e-6f)
+        {
+            // Static boxes are avoided by their outline
+            const float hx = ob->halfExtents[0];
+            const float hz = ob->halfExtents[2];
+            float corners[4][3];
+            getBoxPoint(ob, -hx, -hz, corners[0]);
+            getBoxPoint(ob, hx, -hz, corners[1]);
+            getBoxPoint(ob, hx, hz, corners[2]);
+            getBoxPoint(ob, -hx, hz, corners[3]);
+            for (int j = 0; j < 4; ++j)
+                obstacleQuery->addSegment(corners[j], corners[(j + 1) % 4]);
+        }
+        else
+        {
+            // Segments are static to the avoidance query, moving boxes are covered with circles along their long axis instead
+            const bool alongX = ob->halfExtents[0] >= ob->halfExtents[2];
+            const float halfLength = alongX ? ob->halfExtents[0] : ob->halfExtents[2];
+            const float halfWidth = alongX ? ob->halfExtents[2] : ob->halfExtents[0];
+            const int ncircles = dtClamp((int)dtMathCeilf(2.0f * halfLength / dtMax(halfWidth, 0.001f)), 1, CROWD_MAX_BOX_CIRCLES);
+            const float spacing = 2.0f * halfLength / ncircles;
+            const float radius = dtMathSqrtf(dtSqr(spacing * 0.5f) + dtSqr(halfWidth));
+            for (int j = 0; j < ncircles; ++j)
+            {
+                const float offset = -halfLength + spacing * (j + 0.5f);
+                float center[3];
+                getBoxPoint(ob, alongX ? offset : 0.0f, alongX ? 0.0f : offset, center);
+                obstacleQuery->addCircle(center, radius, ob->vel, ob->vel);
+            }
+        }
+    }
+}
+
+void Crowd::destroy()
+{
+    m_threadPool.setThreadCount(1);
+    freeThreadData();
+
+    dtFree(m_pathResult);
+    dtFree(m_activeAgents);
+    dtFree(m_agentAnims);
+    dtFree(m_agentLods);
+    dtFree(m_dueAgents);
+    dtFree(m_agentEventStates);
+    m_pathResult = 0;
+    m_activeAgents = 0;
+    m_activeAgentCount = 0;
+    m_agentAnims = 0;
+    m_agentLods = 0;
+    m_dueAgents = 0;
+    m_agentEventStates = 0;
+
+    if (m_crowd)
+    {
+        dtFreeCrowd(m_crowd);
+        m_crowd = 0;
+    }
+
+    dtFreeNavMeshQuery(m_navQuery);
+    m_navQuery = 0;
+
+    dtFreeProximityGrid(m_obstacleGrid);
+    m_obstacleGrid = 0;
+    m_obstacleGridPoolSize = 0;
+    m_obstacles.clear();
+    m_freeObstacles.clear();
+    m_obstacleCount = 0;
+
+    m_agents = 0;
+    m_navMesh = 0;
+    m_maxAgents = 0;
+}
@@ -1,8 +1,17 @@
 #pragma once
 
 #include "../recastnavigation/Detour/Include/DetourCommon.h"
+#include "../recastnavigation/Detour/Include/DetourNavMeshQuery.h"
 #include "../recastnavigation/DetourCrowd/Include/DetourCrowd.h"
 
+#include <float.h>
+#include <string.h>
+#include <vector>
+
+#include "./Arrays.h"
+#include "./ObstacleAvoidance.h"
+#include "./ThreadPool.h"
+
 class CrowdUtils
 {
 public:
@@ -12,3 +21,390 @@ public:
 
     void agentTeleport(dtCrowd *crowd, int idx, const float *destination, const float *halfExtents, dtQueryFilter *filter);
 };
+
+static const int CROWD_MAX_LOD_TIERS = 4;
+static const int DEFAULT_EVENT_CAPACITY = 1024;
+static const int CROWD_MAX_OBSTACLES = 0xffff;
+// dtCrowd sizes its proximity grid pool at 4 items per agent, the grid indexes the pool with unsigned shorts
+static const int CROWD_MAX_AGENTS = 0xffff / 4;
+
+// Nearest dynamic obstacles each agent avoids, and the circles a moving box is split into
+static const int CROWD_MAX_AGENT_OBSTACLES = 8;
+static const int CROWD_MAX_BOX_CIRCLES = 8;
+static const int DEFAULT_OBSTACLE_CANDIDATES = 32;
+
+struct CrowdLodTierParams
+{
+    // Agents further than this from every focus point fall through to the next tier.
+    float distance;
+    // Number of crowd updates between updates of an agent in this tier. Skipped time is integrated in one step.
+    int updateInterval;
+    // Scales how far an agent moves before its collision boundary is refreshed.
+    float boundaryUpdateScale;
+    // Whether agents in this tier sample avoidance velocities, otherwise the desired velocity is used directly.
+    // Dynamic obstacles are only avoided while sampling, agents in tiers without it walk through them.
+    bool obstacleAvoidance;
+};
+
+struct CrowdLodTierStats
+{
+    int agentCount;
+    int updatedAgentCount;
+    // Microseconds spent in the per-agent phases of the last update.
+    float updateTime;
+};
+
+struct CrowdUpdateStats
+{
+    // Microseconds spent in each phase of the last update.
+    float totalTime;
+    float lodTime;
+    float pathValidityTime;
+    float moveRequestTime;
+    float topologyOptimizationTime;
+    float proximityGridTime;
+    float neighbourhoodTime;
+    float offMeshTriggerTime;
+    float steeringTime;
+    float velocityPlanningTime;
+    float integrationTime;
+    float collisionTime;
+    float positionTime;
+    float offMeshAnimationTime;
+
+    // Requests in the path queue after the update, and agents waiting for a free slot.
+    int pathQueueDepth;
+    int pathQueueWaiting;
+    int pathRequestsIssued;
+    int pathRequestsServed;
+    int pathRequestsFailed;
+    // Requests turned away because the path queue was full, the agents retry on the next update.
+    int pathRequestsDropped;
+    int replans;
+    int topologyOptimizations;
+
+    // Agents registered to the proximity grid, the cell entries they cover and the most agents found in one agent's cell.
+    int gridItemCount;
+    int gridCellEntries;
+    int gridMaxCellOccupancy;
+};
+
+enum CrowdEventType
+{
+    CROWD_EVENT_TARGET_REACHED,
+    CROWD_EVENT_OFFMESH_ENTERED,
+    CROWD_EVENT_OFFMESH_LEFT,
+    CROWD_EVENT_BECAME_INVALID,
+    CROWD_EVENT_PATH_PARTIAL,
+    CROWD_EVENT_REPLANNED
+};
+
+struct CrowdEvent
+{
+    int type;
+    int agentIndex;
+};
+
+// Agent state as of the previous update, events are recorded on changes
+struct CrowdAgentEventState
+{
+    unsigned char state;
+    bool partial;
+    bool arrived;
+};
+
+enum CrowdObstacleType
+{
+    CROWD_OBSTACLE_CIRCLE,
+    CROWD_OBSTACLE_BOX
+};
+
+struct CrowdObstacle
+{
+    int type;
+    bool active;
+    // Circle base position or box center
+    float pos[3];
+    float vel[3];
+    float radius;
+    float height;
+    float halfExtents[3];
+    // Cosine and sine of the box rotation around the y axis
+    float rot[2];
+};
+
+struct CrowdAgentLod
+{
+    int tier;
+    // -1 when the tier is derived from the focus points
+    int manualTier;
+    bool due;
+    float stepDt;
+    float accumulatedDt;
+};
+
+struct CrowdThreadData
+{
+    dtNavMeshQuery *navQuery;
+    dtObstacleAvoidanceQuery *obstacleQuery;
+    ObstacleAvoidanceSampler *sampler;
+    int velocitySampleCount;
+    std::vector<unsigned short> obstacleIds;
+};
+
+// Owns a dtCrowd and steps it with a reimplementation of dtCrowd::update.
+// The per-agent phases of the update are split across the thread pool, the phases that share
+// state (path queue, topology optimisation, off-mesh animations) stay serial.
+// Results do not depend on the thread count.
+class Crowd
+{
+public:
+    dtCrowd *m_crowd;
+
+    Crowd() : m_crowd(0), m_navMesh(0), m_navQuery(0), m_maxAgents(0), m_minAgents(0), m_maxAgentRadius(0), m_autoResize(false), m_agents(0), m_maxPathResult(0), m_pathResult(0), m_activeAgents(0), m_activeAgentCount(0), m_agentAnims(0), m_agentLods(0), m_dueAgents(0), m_lodTierCount(1), m_updateCount(0), m_velocitySampleCount(0), m_simdObstacleAvoidance(ObstacleAvoidanceSampler::isSimdBuild()), m_agentEventStates(0), m_eventHead(0), m_eventCount(0), m_droppedEventCount(0), m_obstacleCount(0), m_maxObstacleCandidates(DEFAULT_OBSTACLE_CANDIDATES), m_obstacleGrid(0), m_obstacleGridPoolSize(0)
+    {
+        m_crowd = dtAllocCrowd();
+
+        for (int i = 0; i < CROWD_MAX_LOD_TIERS; ++i)
+        {
+            m_lodTiers[i].distance = FLT_MAX;
+            m_lodTiers[i].updateInterval = 1;
+            m_lodTiers[i].boundaryUpdateScale = 1.0f;
+            m_lodTiers[i].obstacleAvoidance = true;
+        }
+
+        memset(m_lodTierOffsets, 0, sizeof(m_lodTierOffsets));
+        memset(m_lodTierStats, 0, sizeof(m_lodTierStats));
+        memset(&m_updateStats, 0, sizeof(m_updateStats));
+
+        m_events.resize(DEFAULT_EVENT_CAPACITY);
+    }
+
+    bool init(const int maxAgents, const float maxAgentRadius, dtNavMesh *nav);
+
+    void setObstacleAvoidanceParams(const int idx, const dtObstacleAvoidanceParams *params);
+
+    const dtObstacleAvoidanceParams *getObstacleAvoidanceParams(const int idx) const;
+
+    const dtCrowdAgent *getAgent(const int idx);
+
+    dtCrowdAgent *getEditableAgent(const int idx);
+
+    int getAgentCount() const;
+
+    int getActiveAgentCount() const;
+
+    // Changes the agent capacity, keeping agent indices. Agent pointers are invalidated.
+    // Fails when an agent has an index at or above the new capacity, or above CROWD_MAX_AGENTS.
+    bool setMaxAgents(const int maxAgents);
+
+    // Doubles the capacity when adding an agent to a full crowd, and halves it when removing agents
+    // leaves the highest agent index below a quarter of it. Never shrinks below the initial capacity,
+    // or grows above CROWD_MAX_AGENTS.
+    void setAutoResize(const bool enabled);
+
+    bool getAutoResize() const;
+
+    int addAgent(const float *pos, const dtCrowdAgentParams *params);
+
+    void updateAgentParameters(const int idx, const dtCrowdAgentParams *params);
+
+    void removeAgent(const int idx);
+
+    bool requestMoveTarget(const int idx, dtPolyRef ref, const float *pos);
+
+    bool requestMoveVelocity(const int idx, const float *vel);
+
+    bool resetMoveTarget(const int idx);
+
+    void update(const float dt, dtCrowdAgentDebugInfo *debug);
+
+    const dtQueryFilter *getFilter(const int i) const;
+
+    dtQueryFilter *getEditableFilter(const int i);
+
+    const dtNavMeshQuery *getNavMeshQuery() const;
+
+    dtCrowd *getCrowd()
+    {
+        return m_crowd;
+    }
+
+    void setThreadCount(const int threadCount);
+
+    int getThreadCount() const;
+
+    int getVelocitySampleCount() const;
+
+    // Samples avoidance velocities with ObstacleAvoidanceSampler instead of dtObstacleAvoidanceQuery.
+    // Enabled by default in SIMD builds.
+    void setSimdObstacleAvoidance(const bool enabled);
+
+    bool getSimdObstacleAvoidance() const;
+
+    void setLodTierCount(const int count);
+
+    int getLodTierCount() const;
+
+    void setLodTierParams(const int tier, const CrowdLodTierParams *params);
+
+    const CrowdLodTierParams *getLodTierParams(const int tier) const;
+
+    void setLodFocusPoints(const float *points, const int count);
+
+    // Pins an agent to a tier, or derives it from the focus points again when tier is -1.
+    void setAgentLodTier(const int idx, const int tier);
+
+    int getAgentLodTier(const int idx) const;
+
+    CrowdLodTierStats getLodTierStats(const int tier) const;
+
+    CrowdUpdateStats getUpdateStats() const;
+
+    // Events are recorded by update into a ring buffer, when it is full the oldest events are overwritten.
+    // Changing the capacity clears the buffer.
+    void setEventCapacity(const int capacity);
+
+    int getEventCapacity() const;
+
+    // Moves the recorded events into events as packed (type, agentIndex) pairs, oldest first. Returns the number of events.
+    int drainEvents(IntArray *events);
+
+    // The number of events overwritten before being drained, since the crowd was created.
+    int getDroppedEventCount() const;
+
+    // Moving obstacles that agents with obstacle avoidance steer around, without changes to the nav mesh.
+    // Circles avoid the obstacle velocity like neighbouring agents. Boxes are avoided as their outline
+    // while static, and as a chain of circles covering them while moving.
+    // Obstacles only steer agents, there is no collision response pushing agents out of them.
+    // Returns an obstacle id, or -1 when the limit of 65535 obstacles is reached.
+    int addCircleObstacle(const float *pos, const float radius, const float height, const float *vel);
+
+    int addBoxObstacle(const float *center, const float *halfExtents, const float yRadians, const float *vel);
+
+    // Moves an obstacle, yRadians is ignored for circles.
+    bool updateObstacle(const int id, const float *pos, const float yRadians, const float *vel);
+
+    bool removeObstacle(const int id);
+
+    const CrowdObstacle *getObstacle(const int id) const;
+
+    int getObstacleCount() const;
+
+    // Obstacles in range of an agent are gathered from a grid, up to this many, before the nearest CROWD_MAX_AGENT_OBSTACLES
+    // are avoided. Past the limit obstacles are dropped in grid order rather than by distance. Defaults to 32.
+    void setMaxObstacleCandidates(const int count);
+
+    int getMaxObstacleCandidates() const;
+
+    // Batch queries against the proximity grid, which holds the agents registered by the last update.
+    // Results are packed, offsets gets queryCount + 1 entries and query i found indices[offsets[i]] to indices[offsets[i + 1] - 1].
+    // Agents removed since the last update are skipped, agents added since are not found until the next update.
+    // Returns the total number of agent indices found.
+
+    // Finds agents whose position is within radii[i] of centers[i] on the xz plane. radiusCount is 1 to share a radius between queries.
+    int queryAgentsInRadius(const float *centers, const float *radii, const int radiusCount, const int queryCount, IntArray *offsets, IntArray *indices);
+
+    // Finds agents whose position is inside the box bmins[i], bmaxs[i].
+    int queryAgentsInBox(const float *bmins, const float *bmaxs, const int queryCount, IntArray *offsets, IntArray *indices);
+
+    void destroy();
+
+protected:
+    friend class CrowdExporter;
+    friend class CrowdImporter;
+
+    bool initThreadData();
+    void freeThreadData();
+
+    void updateAgentLods(dtCrowdAgent **agents, const int nagents, const float dt);
+    void forEachDueAgent(const std::function<void(dtCrowdAgent **agents, int begin, int end, int threadIndex)> &fn);
+
+    void checkPathValidity(dtCrowdAgent **agents, const int nagents, const float dt);
+    void updateMoveRequest(dtCrowdAgent **agents, const int nagents);
+    void updateTopologyOptimization(dtCrowdAgent **agents, const int nagents, const float dt);
+    void requestMoveTargetReplan(dtCrowdAgent *ag, dtPolyRef ref, const float *pos);
+
+    void updateAgentsNeighbourhood(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread);
+    void updateAgentsCorners(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread, dtCrowdAgentDebugInfo *debug, const dtCrowdAgent *debugAgent);
+    void updateAgentsSteering(dtCrowdAgent **agents, const int begin, const int end);
+    void updateAgentsVelocity(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread, dtCrowdAgentDebugInfo *debug, const dtCrowdAgent *debugAgent);
+    void integrateAgents(dtCrowdAgent **agents, const int begin, const int end);
+    void updateAgentsCollision(dtCrowdAgent **agents, const int begin, const int end);
+    void applyAgentsCollision(dtCrowdAgent **agents, const int begin, const int end);
+    void updateAgentsPosition(dtCrowdAgent **agents, const int begin, const int end, CrowdThreadData *thread);
+    void updateAgentGrid(dtCrowdAgent **agents, const int nagents);
+    void updateOffMeshConnections(dtCrowdAgent **agents, const int nagents);
+    void updateOffMeshAnimations(dtCrowdAgent **agents, const int nagents, const float dt);
+    void recordAgentEvents(dtCrowdAgent **agents, const int nagents);
+    void pushEvent(const int type, const dtCrowdAgent *agent);
+    void resetAgentEventState(const int idx);
+    int getAgentHighWaterMark() const;
+    void insertActiveAgent(dtCrowdAgent *agent);
+    void removeActiveAgent(const dtCrowdAgent *agent);
+    void rebuildActiveAgents();
+    int allocObstacle();
+    void updateObstacleGrid();
+    void addAgentObstacles(const dtCrowdAgent *ag, dtObstacleAvoidanceQuery *obstacleQuery, CrowdThreadData *thread);
+    const dtCrowdAgent *getGridAgent(const unsigned short id) const;
+    void storeQueryResults(IntArray *offsets, IntArray *indices);
+
+    inline int getAgentIndex(const dtCrowdAgent *agent) const
+    {
+        return (int)(agent - m_agents);
+    }
+
+    dtNavMesh *m_navMesh;
+    // Outlives the dtCrowd, which is replaced when the capacity changes
+    dtNavMeshQuery *m_navQuery;
+    int m_maxAgents;
+    int m_minAgents;
+    float m_maxAgentRadius;
+    bool m_autoResize;
+    dtCrowdAgent *m_agents;
+
+    // dtCrowd keeps these private, update is reimplemented here so they are owned by the wrapper
+    int m_maxPathResult;
+    dtPolyRef *m_pathResult;
+    // Active agents in index order, kept up to date as agents are added and removed
+    dtCrowdAgent **m_activeAgents;
+    int m_activeAgentCount;
+    dtCrowdAgentAnimation *m_agentAnims;
+
+    CrowdAgentLod *m_agentLods;
+    dtCrowdAgent **m_dueAgents;
+    int m_lodTierOffsets[CROWD_MAX_LOD_TIERS + 1];
+    int m_lodTierCount;
+    CrowdLodTierParams m_lodTiers[CROWD_MAX_LOD_TIERS];
+    CrowdLodTierStats m_lodTierStats[CROWD_MAX_LOD_TIERS];
+    std::vector<float> m_lodFocusPoints;
+    unsigned int m_updateCount;
+
+    ThreadPool m_threadPool;
+    std::vector<CrowdThreadData> m_threadData;
+    int m_velocitySampleCount;
+    bool m_simdObstacleAvoidance;
+    CrowdUpdateStats m_updateStats;
+
+    CrowdAgentEventState *m_agentEventStates;
+    std::vector<CrowdEvent> m_events;
+    int m_eventHead;
+    int m_eventCount;
+    int m_droppedEventCount;
+
+    std::vector<CrowdObstacle> m_obstacles;
+    std::vector<int> m_freeObstacles;
+    int m_obstacleCount;
+    int m_maxObstacleCandidates;
+    dtProximityGrid *m_obstacleGrid;
+    int m_obstacleGridPoolSize;
+    // Obstacles registered to the grid by the last update, and the obstacles too large for it that every agent checks
+    std::vector<int> m_gridObstacles;
+    std::vector<int> m_largeObstacles;
+
+    // Agent index of each proximity grid id, as registered by the last update
+    std::vector<int> m_gridAgentIndices;
+    std::vector<unsigned short> m_queryGridIds;
+    std::vector<int> m_queryOffsets;
+    std::vector<int> m_queryIndices;
+};
@@ -0,0 +1,713 @@
+#include "./CrowdSerdes.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const int CROWDSET_MAGIC = 'C' << 24 | 'S' << 16 | 'E' << 8 | 'T'; //'CSET';
+static const int CROWDSET_VERSION = 2;
+
+// Snapshots are written one field at a time, so the format doesn't depend on struct layout and padding.
+// Only measures the snapshot size when bits is null.
+struct CrowdSetWriter
+{
+    unsigned char *bits;
+    size_t size;
+
+    void write(const void *data, const size_t len)
+    {
+        if (bits)
+        {
+            memcpy(&bits[size], data, len);
+        }
+        size += len;
+    }
+
+    void writeInt(const int value) { write(&value, sizeof(value)); }
+    void writeUInt(const unsigned int value) { write(&value, sizeof(value)); }
+    void writeUShort(const unsigned short value) { write(&value, sizeof(value)); }
+    void writeByte(const unsigned char value) { write(&value, sizeof(value)); }
+    void writeFloat(const float value) { write(&value, sizeof(value)); }
+    void writeFloats(const float *values, const int count) { write(values, sizeof(float) * count); }
+    void writePolyRefs(const dtPolyRef *refs, const int count) { write(refs, sizeof(dtPolyRef) * count); }
+};
+
+// Reading past the end of the snapshot fails the reader, and zeroes the values read from then on
+struct CrowdSetReader
+{
+    const unsigned char *bits;
+    const unsigned char *end;
+    bool failed;
+
+    void read(void *data, const size_t len)
+    {
+        if (failed || (size_t)(end - bits) < len)
+        {
+            failed = true;
+            if (data)
+            {
+                memset(data, 0, len);
+            }
+            return;
+        }
+        if (data)
+        {
+            memcpy(data, bits, len);
+        }
+        bits += len;
+    }
+
+    void skip(const size_t len) { read(0, len); }
+
+    int readInt()
+    {
+        int value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    unsigned int readUInt()
+    {
+        unsigned int value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    unsigned short readUShort()
+    {
+        unsigned short value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    unsigned char readByte()
+    {
+        unsigned char value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    float readFloat()
+    {
+        float value;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    void readFloats(float *values, const int count) { read(values, sizeof(float) * count); }
+    void readPolyRefs(dtPolyRef *refs, const int count) { read(refs, sizeof(dtPolyRef) * count); }
+};
+
+struct CrowdFilterState
+{
+    float areaCost[DT_MAX_AREAS];
+    unsigned short includeFlags;
+    unsigned short excludeFlags;
+};
+
+struct CrowdObstacleRecord
+{
+    int id;
+    CrowdObstacle obstacle;
+};
+
+// Agent params are stored without userData, it is a pointer into the exporting process
+struct CrowdAgentRecord
+{
+    int idx;
+    unsigned char state;
+    unsigned char targetState;
+    bool partial;
+    bool targetReplan;
+    float topologyOptTime;
+    dtCrowdNeighbour neis[DT_CROWDAGENT_MAX_NEIGHBOURS];
+    int nneis;
+    float desiredSpeed;
+    float npos[3];
+    float disp[3];
+    float dvel[3];
+    float nvel[3];
+    float vel[3];
+    dtCrowdAgentParams params;
+    float cornerVerts[DT_CROWDAGENT_MAX_CORNERS * 3];
+    unsigned char cornerFlags[DT_CROWDAGENT_MAX_CORNERS];
+    dtPolyRef cornerPolys[DT_CROWDAGENT_MAX_CORNERS];
+    int ncorners;
+    dtPolyRef targetRef;
+    float targetPos[3];
+    float targetReplanTime;
+    float corridorPos[3];
+    float corridorTarget[3];
+    int corridorPathCount;
+    dtCrowdAgentAnimation anim;
+    CrowdAgentLod lod;
+};
+
+static const int CROWD_MAX_LOCAL_SEGS = 8;
+static const int CROWD_MAX_LOCAL_POLYS = 16;
+
+// dtLocalBoundary keeps its fields private, they are copied through this mirror of its layout to be written one at a time
+struct CrowdLocalBoundaryState
+{
+    float center[3];
+    struct
+    {
+        float s[6];
+        float d;
+    } segs[CROWD_MAX_LOCAL_SEGS];
+    int nsegs;
+    dtPolyRef polys[CROWD_MAX_LOCAL_POLYS];
+    int npolys;
+};
+
+static_assert(sizeof(CrowdLocalBoundaryState) == sizeof(dtLocalBoundary), "CrowdLocalBoundaryState must mirror dtLocalBoundary");
+
+static void writeFilterState(CrowdSetWriter &writer, const CrowdFilterState &filterState)
+{
+    writer.writeFloats(filterState.areaCost, DT_MAX_AREAS);
+    writer.writeUShort(filterState.includeFlags);
+    writer.writeUShort(filterState.excludeFlags);
+}
+
+static void readFilterState(CrowdSetReader &reader, CrowdFilterState &filterState)
+{
+    reader.readFloats(filterState.areaCost, DT_MAX_AREAS);
+    filterState.includeFlags = reader.readUShort();
+    filterState.excludeFlags = reader.readUShort();
+}
+
+static void writeAvoidanceParams(CrowdSetWriter &writer, const dtObstacleAvoidanceParams &params)
+{
+    writer.writeFloat(params.velBias);
+    writer.writeFloat(params.weightDesVel);
+    writer.writeFloat(params.weightCurVel);
+    writer.writeFloat(params.weightSide);
+    writer.writeFloat(params.weightToi);
+    writer.writeFloat(params.horizTime);
+    writer.writeByte(params.gridSize);
+    writer.writeByte(params.adaptiveDivs);
+    writer.writeByte(params.adaptiveRings);
+    writer.writeByte(params.adaptiveDepth);
+}
+
+static void readAvoidanceParams(CrowdSetReader &reader, dtObstacleAvoidanceParams &params)
+{
+    params.velBias = reader.readFloat();
+    params.weightDesVel = reader.readFloat();
+    params.weightCurVel = reader.readFloat();
+    params.weightSide = reader.readFloat();
+    params.weightToi = reader.readFloat();
+    params.horizTime = reader.readFloat();
+    params.gridSize = reader.readByte();
+    params.adaptiveDivs = reader.readByte();
+    params.adaptiveRings = reader.readByte();
+    params.adaptiveDepth = reader.readByte();
+}
+
+static void writeObstacleRecord(CrowdSetWriter &writer, const int id, const CrowdObstacle &ob)
+{
+    writer.writeInt(id);
+    writer.writeInt(ob.type);
+    writer.writeFloats(ob.pos, 3);
+    writer.writeFloats(ob.vel, 3);
+    writer.writeFloat(ob.radius);
+    writer.writeFloat(ob.height);
+    writer.writeFloats(ob.halfExtents, 3);
+    writer.writeFloats(ob.rot, 2);
+}
+
+static void readObstacleRecord(CrowdSetReader &reader, CrowdObstacleRecord &record)
+{
+    CrowdObstacle &ob = record.obstacle;
+    memset(&ob, 0, sizeof(CrowdObstacle));
+    record.id = reader.readInt();
+    ob.type = reader.readInt();
+    ob.active = true;
+    reader.readFloats(ob.pos, 3);
+    reader.readFloats(ob.vel, 3);
+    ob.radius = reader.readFloat();
+    ob.height = reader.readFloat();
+    reader.readFloats(ob.halfExtents, 3);
+    reader.readFloats(ob.rot, 2);
+}
+
+static void writeAgentRecord(CrowdSetWriter &writer, const CrowdAgentRecord &record)
+{
+    writer.writeInt(record.idx);
+    writer.writeByte(record.state);
+    writer.writeByte(record.targetState);
+    writer.writeByte(record.partial ? 1 : 0);
+    writer.writeByte(record.targetReplan ? 1 : 0);
+    writer.writeFloat(record.topologyOptTime);
+    for (int i = 0; i < DT_CROWDAGENT_MAX_NEIGHBOURS; ++i)
+    {
+        writer.writeInt(record.neis[i].idx);
+        writer.writeFloat(record.neis[i].dist);
+    }
+    writer.writeInt(record.nneis);
+    writer.writeFloat(record.desiredSpeed);
+    writer.writeFloats(record.npos, 3);
+    writer.writeFloats(record.disp, 3);
+    writer.writeFloats(record.dvel, 3);
+    writer.writeFloats(record.nvel, 3);
+    writer.writeFloats(record.vel, 3);
+
+    const dtCrowdAgentParams &params = record.params;
+    writer.writeFloat(params.radius);
+    writer.writeFloat(params.height);
+    writer.writeFloat(params.maxAcceleration);
+    writer.writeFloat(params.maxSpeed);
+    writer.writeFloat(params.collisionQueryRange);
+    writer.writeFloat(params.pathOptimizationRange);
+    writer.writeFloat(params.separationWeight);
+    writer.writeByte(params.updateFlags);
+    writer.writeByte(params.obstacleAvoidanceType);
+    writer.writeByte(params.queryFilterType);
+
+    writer.writeFloats(record.cornerVerts, DT_CROWDAGENT_MAX_CORNERS * 3);
+    writer.write(record.cornerFlags, sizeof(record.cornerFlags));
+    writer.writePolyRefs(record.cornerPolys, DT_CROWDAGENT_MAX_CORNERS);
+    writer.writeInt(record.ncorners);
+    writer.writePolyRefs(&record.targetRef, 1);
+    writer.writeFloats(record.targetPos, 3);
+    writer.writeFloat(record.targetReplanTime);
+    writer.writeFloats(record.corridorPos, 3);
+    writer.writeFloats(record.corridorTarget, 3);
+    writer.writeInt(record.corridorPathCount);
+
+    const dtCrowdAgentAnimation &anim = record.anim;
+    writer.writeByte(anim.active ? 1 : 0);
+    writer.writeFloats(anim.initPos, 3);
+    writer.writeFloats(anim.startPos, 3);
+    writer.writeFloats(anim.endPos, 3);
+    writer.writePolyRefs(&anim.polyRef, 1);
+    writer.writeFloat(anim.t);
+    writer.writeFloat(anim.tmax);
+
+    const CrowdAgentLod &lod = record.lod;
+    writer.writeInt(lod.tier);
+    writer.writeInt(lod.manualTier);
+    writer.writeByte(lod.due ? 1 : 0);
+    writer.writeFloat(lod.stepDt);
+    writer.writeFloat(lod.accumulatedDt);
+}
+
+static void readAgentRecord(CrowdSetReader &reader, CrowdAgentRecord &record)
+{
+    memset(&record, 0, sizeof(CrowdAgentRecord));
+    record.idx = reader.readInt();
+    record.state = reader.readByte();
+    record.targetState = reader.readByte();
+    record.partial = reader.readByte() != 0;
+    record.targetReplan = reader.readByte() != 0;
+    record.topologyOptTime = reader.readFloat();
+    for (int i = 0; i < DT_CROWDAGENT_MAX_NEIGHBOURS; ++i)
+    {
+        record.neis[i].idx = reader.readInt();
+        record.neis[i].dist = reader.readFloat();
+    }
+    record.nneis = reader.readInt();
+    record.desiredSpeed = reader.readFloat();
+    reader.readFloats(record.npos, 3);
+    reader.readFloats(record.disp, 3);
+    reader.readFloats(record.dvel, 3);
+    reader.readFloats(record.nvel, 3);
+    reader.readFloats(record.vel, 3);
+
+    dtCrowdAgentParams &params = record.params;
+    params.radius = reader.readFloat();
+    params.height = reader.readFloat();
+    params.maxAcceleration = reader.readFloat();
+    params.maxSpeed = reader.readFloat();
+    params.collisionQueryRange = reader.readFloat();
+    params.pathOptimizationRange = reader.readFloat();
+    params.separationWeight = reader.readFloat();
+    params.updateFlags = reader.readByte();
+    params.obstacleAvoidanceType = reader.readByte();
+    params.queryFilterType = reader.readByte();
+
+    reader.readFloats(record.cornerVerts, DT_CROWDAGENT_MAX_CORNERS * 3);
+    reader.read(record.cornerFlags, sizeof(record.cornerFlags));
+    reader.readPolyRefs(record.cornerPolys, DT_CROWDAGENT_MAX_CORNERS);
+    record.ncorners = reader.readInt();
+    reader.readPolyRefs(&record.targetRef, 1);
+    reader.readFloats(record.targetPos, 3);
+    record.targetReplanTime = reader.readFloat();
+    reader.readFloats(record.corridorPos, 3);
+    reader.readFloats(record.corridorTarget, 3);
+    record.corridorPathCount = reader.readInt();
+
+    dtCrowdAgentAnimation &anim = record.anim;
+    anim.active = reader.readByte() != 0;
+    reader.readFloats(anim.initPos, 3);
+    reader.readFloats(anim.startPos, 3);
+    reader.readFloats(anim.endPos, 3);
+    reader.readPolyRefs(&anim.polyRef, 1);
+    anim.t = reader.readFloat();
+    anim.tmax = reader.readFloat();
+
+    CrowdAgentLod &lod = record.lod;
+    lod.tier = reader.readInt();
+    lod.manualTier = reader.readInt();
+    lod.due = reader.readByte() != 0;
+    lod.stepDt = reader.readFloat();
+    lod.accumulatedDt = reader.readFloat();
+}
+
+static void writeBoundaryState(CrowdSetWriter &writer, const CrowdLocalBoundaryState &boundary)
+{
+    writer.writeFloats(boundary.center, 3);
+    writer.writeInt(boundary.nsegs);
+    for (int i = 0; i < boundary.nsegs; ++i)
+    {
+        writer.writeFloats(boundary.segs[i].s, 6);
+        writer.writeFloat(boundary.segs[i].d);
+    }
+    writer.writeInt(boundary.npolys);
+    writer.writePolyRefs(boundary.polys, boundary.npolys);
+}
+
+// Returns false when the segment or poly counts are out of range
+static bool readBoundaryState(CrowdSetReader &reader, CrowdLocalBoundaryState &boundary)
+{
+    memset(&boundary, 0, sizeof(CrowdLocalBoundaryState));
+    reader.readFloats(boundary.center, 3);
+    boundary.nsegs = reader.readInt();
+    if (boundary.nsegs < 0 || boundary.nsegs > CROWD_MAX_LOCAL_SEGS)
+        return false;
+    for (int i = 0; i < boundary.nsegs; ++i)
+    {
+        reader.readFloats(boundary.segs[i].s, 6);
+        boundary.segs[i].d = reader.readFloat();
+    }
+    boundary.npolys = reader.readInt();
+    if (boundary.npolys < 0 || boundary.npolys > CROWD_MAX_LOCAL_POLYS)
+        return false;
+    reader.readPolyRefs(boundary.polys, boundary.npolys);
+    return !reader.failed;
+}
+
+void CrowdExporter::writeCrowdSet(const Crowd *crowd, CrowdSetWriter &writer) const
+{
+    int numAgents = 0;
+    for (int i = 0; i < crowd->m_maxAgents; ++i)
+    {
+        if (crowd->m_agents[i].active)
+            numAgents++;
+    }
+
+    writer.writeInt(CROWDSET_MAGIC);
+    writer.writeInt(CROWDSET_VERSION);
+    writer.writeInt(crowd->m_maxAgents);
+    writer.writeInt(numAgents);
+    writer.writeUInt(crowd->m_updateCount);
+
+    for (int i = 0; i < DT_CROWD_MAX_QUERY_FILTER_TYPE; ++i)
+    {
+        const dtQueryFilter *filter = crowd->m_crowd->getFilter(i);
+
+        CrowdFilterState filterState;
+        for (int j = 0; j < DT_MAX_AREAS; ++j)
+            filterState.areaCost[j] = filter->getAreaCost(j);
+        filterState.includeFlags = filter->getIncludeFlags();
+        filterState.excludeFlags = filter->getExcludeFlags();
+
+        writeFilterState(writer, filterState);
+    }
+
+    for (int i = 0; i < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS; ++i)
+    {
+        writeAvoidanceParams(writer, *crowd->m_crowd->getObstacleAvoidanceParams(i));
+    }
+
+    // Obstacles keep their ids, so the slot count is stored along with the active obstacles
+    writer.writeInt((int)crowd->m_obstacles.size());
+    writer.writeInt(crowd->m_obstacleCount);
+    for (size_t i = 0; i < crowd->m_obstacles.size(); ++i)
+    {
+        if (crowd->m_obstacles[i].active)
+            writeObstacleRecord(writer, (int)i, crowd->m_obstacles[i]);
+    }
+
+    for (int i = 0; i < crowd->m_maxAgents; ++i)
+    {
+        const dtCrowdAgent *ag = &crowd->m_agents[i];
+        if (!ag->active)
+            continue;
+
+        CrowdAgentRecord agentRecord;
+        memset(&agentRecord, 0, sizeof(agentRecord));
+        agentRecord.idx = i;
+        agentRecord.state = ag->state;
+        agentRecord.targetState = ag->targetState;
+        agentRecord.partial = ag->partial;
+        agentRecord.targetReplan = ag->targetReplan;
+        agentRecord.topologyOptTime = ag->topologyOptTime;
+        memcpy(agentRecord.neis, ag->neis, sizeof(ag->neis));
+        agentRecord.nneis = ag->nneis;
+        agentRecord.desiredSpeed = ag->desiredSpeed;
+        dtVcopy(agentRecord.npos, ag->npos);
+        dtVcopy(agentRecord.disp, ag->disp);
+        dtVcopy(agentRecord.dvel, ag->dvel);
+        dtVcopy(agentRecord.nvel, ag->nvel);
+        dtVcopy(agentRecord.vel, ag->vel);
+        agentRecord.params = ag->params;
+        memcpy(agentRecord.cornerVerts, ag->cornerVerts, sizeof(ag->cornerVerts));
+        memcpy(agentRecord.cornerFlags, ag->cornerFlags, sizeof(ag->cornerFlags));
+        memcpy(agentRecord.cornerPolys, ag->cornerPolys, sizeof(ag->cornerPolys));
+        agentRecord.ncorners = ag->ncorners;
+        agentRecord.targetRef = ag->targetRef;
+        dtVcopy(agentRecord.targetPos, ag->targetPos);
+        agentRecord.targetReplanTime = ag->targetReplanTime;
+        dtVcopy(agentRecord.corridorPos, ag->corridor.getPos());
+        dtVcopy(agentRecord.corridorTarget, ag->corridor.getTarget());
+        agentRecord.corridorPathCount = ag->corridor.getPathCount();
+        agentRecord.anim = crowd->m_agentAnims[i];
+        agentRecord.lod = crowd->m_agentLods[i];
+
+        writeAgentRecord(writer, agentRecord);
+        writer.writePolyRefs(ag->corridor.getPath(), agentRecord.corridorPathCount);
+
+        CrowdLocalBoundaryState boundary;
+        memcpy(&boundary, (const void *)&ag->boundary, sizeof(dtLocalBoundary));
+        writeBoundaryState(writer, boundary);
+    }
+}
+
+CrowdExport CrowdExporter::exportCrowd(Crowd *crowd) const
+{
+    if (!crowd->m_agents)
+    {
+        return {0, 0};
+    }
+
+    // Measure the snapshot first so it is written with a single allocation
+    CrowdSetWriter sizeWriter = {0, 0};
+    writeCrowdSet(crowd, sizeWriter);
+
+    CrowdSetWriter writer = {(unsigned char *)malloc(sizeWriter.size), 0};
+    if (!writer.bits)
+    {
+        return {0, 0};
+    }
+    writeCrowdSet(crowd, writer);
+
+    CrowdExport crowdExport;
+    crowdExport.dataPointer = writer.bits;
+    crowdExport.size = int(writer.size);
+
+    return crowdExport;
+}
+
+void CrowdExporter::freeCrowdExport(CrowdExport *crowdExport)
+{
+    free(crowdExport->dataPointer);
+}
+
+bool CrowdImporter::importCrowd(Crowd *crowd, CrowdExport *crowdExport) const
+{
+    if (!crowd->m_agents)
+    {
+        return false;
+    }
+
+    const unsigned char *bits = (const unsigned char *)crowdExport->dataPointer;
+    CrowdSetReader reader = {bits, bits + crowdExport->size, false};
+
+    // Read header.
+    const int magic = reader.readInt();
+    const int version = reader.readInt();
+    const int maxAgents = reader.readInt();
+    const int numAgents = reader.readInt();
+    const unsigned int updateCount = reader.readUInt();
+
+    if (reader.failed || magic != CROWDSET_MAGIC || version != CROWDSET_VERSION)
+    {
+        return false;
+    }
+
+    if (maxAgents < 1 || numAgents < 0 || numAgents > maxAgents)
+    {
+        return false;
+    }
+
+    // Read crowd settings and obstacles, and validate agent records before touching the crowd, so a bad snapshot leaves it as it was.
+    CrowdFilterState filterStates[DT_CROWD_MAX_QUERY_FILTER_TYPE];
+    for (int i = 0; i < DT_CROWD_MAX_QUERY_FILTER_TYPE; ++i)
+    {
+        readFilterState(reader, filterStates[i]);
+    }
+
+    dtObstacleAvoidanceParams avoidanceParams[DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS];
+    for (int i = 0; i < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS; ++i)
+    {
+        readAvoidanceParams(reader, avoidanceParams[i]);
+    }
+
+    const int obstacleSlots = reader.readInt();
+    const int obstacleCount = reader.readInt();
+    if (reader.failed || obstacleSlots < 0 || obstacleSlots > CROWD_MAX_OBSTACLES || obstacleCount < 0 || obstacleCount > obstacleSlots)
+    {
+        return false;
+    }
+
+    std::vector<CrowdObstacle> obstacles(obstacleSlots);
+    memset(obstacles.data(), 0, sizeof(CrowdObstacle) * obstacleSlots);
+    for (int i = 0; i < obstacleCount; ++i)
+    {
+        CrowdObstacleRecord obstacleRecord;
+        readObstacleRecord(reader, obstacleRecord);
+
+        if (reader.failed || obstacleRecord.id < 0 || obstacleRecord.id >= obstacleSlots || obstacles[obstacleRecord.id].active)
+        {
+            return false;
+        }
+
+        if (obstacleRecord.obstacle.type != CROWD_OBSTACLE_CIRCLE && obstacleRecord.obstacle.type != CROWD_OBSTACLE_BOX)
+        {
+            return false;
+        }
+
+        obstacles[obstacleRecord.id] = obstacleRecord.obstacle;
+    }
+
+    const CrowdSetReader agentsReader = reader;
+    std::vector<unsigned char> readAgents(maxAgents, 0);
+    for (int i = 0; i < numAgents; ++i)
+    {
+        CrowdAgentRecord agentRecord;
+        readAgentRecord(reader, agentRecord);
+
+        if (reader.failed || agentRecord.idx < 0 || agentRecord.idx >= maxAgents || readAgents[agentRecord.idx])
+        {
+            return false;
+        }
+        readAgents[agentRecord.idx] = 1;
+
+        if (agentRecord.nneis < 0 || agentRecord.nneis > DT_CROWDAGENT_MAX_NEIGHBOURS || agentRecord.ncorners < 0 || agentRecord.ncorners > DT_CROWDAGENT_MAX_CORNERS)
+        {
+            return false;
+        }
+
+        // dtPathCorridor::setCorridor needs room to spare in the corridor
+        if (agentRecord.corridorPathCount < 0 || agentRecord.corridorPathCount >= crowd->m_maxPathResult)
+        {
+            return false;
+        }
+
+        reader.skip(sizeof(dtPolyRef) * agentRecord.corridorPathCount);
+
+        CrowdLocalBoundaryState boundary;
+        if (!readBoundaryState(reader, boundary))
+        {
+            return false;
+        }
+    }
+
+    if (maxAgents > crowd->m_maxAgents && !crowd->setMaxAgents(maxAgents))
+    {
+        return false;
+    }
+
+    // Apply crowd settings.
+    for (int i = 0; i < DT_CROWD_MAX_QUERY_FILTER_TYPE; ++i)
+    {
+        const CrowdFilterState &filterState = filterStates[i];
+
+        dtQueryFilter *filter = crowd->m_crowd->getEditableFilter(i);
+        for (int j = 0; j < DT_MAX_AREAS; ++j)
+            filter->setAreaCost(j, filterState.areaCost[j]);
+        filter->setIncludeFlags(filterState.includeFlags);
+        filter->setExcludeFlags(filterState.excludeFlags);
+    }
+
+    for (int i = 0; i < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS; ++i)
+    {
+        crowd->m_crowd->setObstacleAvoidanceParams(i, &avoidanceParams[i]);
+    }
+
+    // Obstacles not in the snapshot are removed, free slots are handed out lowest id first.
+    crowd->m_obstacles.swap(obstacles);
+    crowd->m_freeObstacles.clear();
+    for (int i = obstacleSlots - 1; i >= 0; --i)
+    {
+        if (!crowd->m_obstacles[i].active)
+            crowd->m_freeObstacles.push_back(i);
+    }
+    crowd->m_obstacleCount = obstacleCount;
+
+    // Agents not in the snapshot are removed. Agents that stay active keep their userData.
+    for (int i = 0; i < crowd->m_maxAgents; ++i)
+    {
+        dtCrowdAgent *ag = &crowd->m_agents[i];
+        if (!ag->active)
+            ag->params.userData = 0;
+        ag->active = false;
+        crowd->m_agentAnims[i].active = false;
+        crowd->m_agentLods[i].manualTier = -1;
+    }
+
+    // Read agents.
+    reader = agentsReader;
+    for (int i = 0; i < numAgents; ++i)
+    {
+        CrowdAgentRecord agentRecord;
+        readAgentRecord(reader, agentRecord);
+
+        // The path queue result buffer is free between updates, the path is read into it
+        dtPolyRef *path = crowd->m_pathResult;
+        reader.readPolyRefs(path, agentRecord.corridorPathCount);
+
+        dtCrowdAgent *ag = &crowd->m_agents[agentRecord.idx];
+        ag->active = true;
+        ag->state = agentRecord.state;
+        ag->partial = agentRecord.partial;
+        ag->topologyOptTime = agentRecord.topologyOptTime;
+        memcpy(ag->neis, agentRecord.neis, sizeof(ag->neis));
+        ag->nneis = agentRecord.nneis;
+        ag->desiredSpeed = agentRecord.desiredSpeed;
+        dtVcopy(ag->npos, agentRecord.npos);
+        dtVcopy(ag->disp, agentRecord.disp);
+        dtVcopy(ag->dvel, agentRecord.dvel);
+        dtVcopy(ag->nvel, agentRecord.nvel);
+        dtVcopy(ag->vel, agentRecord.vel);
+        void *userData = ag->params.userData;
+        ag->params = agentRecord.params;
+        ag->params.userData = userData;
+        memcpy(ag->cornerVerts, agentRecord.cornerVerts, sizeof(ag->cornerVerts));
+        memcpy(ag->cornerFlags, agentRecord.cornerFlags, sizeof(ag->cornerFlags));
+        memcpy(ag->cornerPolys, agentRecord.cornerPolys, sizeof(ag->cornerPolys));
+        ag->ncorners = agentRecord.ncorners;
+        ag->targetState = agentRecord.targetState;
+        ag->targetRef = agentRecord.targetRef;
+        dtVcopy(ag->targetPos, agentRecord.targetPos);
+        ag->targetReplan = agentRecord.targetReplan;
+        ag->targetReplanTime = agentRecord.targetReplanTime;
+
+        // The path queue is not part of the snapshot, queue the request again
+        ag->targetPathqRef = DT_PATHQ_INVALID;
+        if (ag->targetState == DT_CROWDAGENT_TARGET_WAITING_FOR_PATH)
+        {
+            ag->targetState = DT_CROWDAGENT_TARGET_WAITING_FOR_QUEUE;
+        }
+
+        ag->corridor.reset(agentRecord.corridorPathCount ? path[0] : 0, agentRecord.corridorPos);
+        if (agentRecord.corridorPathCount)
+        {
+            ag->corridor.setCorridor(agentRecord.corridorTarget, path, agentRecord.corridorPathCount);
+        }
+
+        CrowdLocalBoundaryState boundary;
+        readBoundaryState(reader, boundary);
+        memcpy((void *)&ag->boundary, &boundary, sizeof(dtLocalBoundary));
+
+        crowd->m_agentAnims[agentRecord.idx] = agentRecord.anim;
+        crowd->m_agentLods[agentRecord.idx] = agentRecord.lod;
+        crowd->resetAgentEventState(agentRecord.idx);
+    }
+
+    crowd->rebuildActiveAgents();
+    crowd->m_updateCount = updateCount;
+
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../recastnavigation/Detour/Include/DetourCommon.h"
+#include "../recastnavigation/DetourCrowd/Include/DetourCrowd.h"
+#include "./Crowd.h"
+
+struct CrowdSetWriter;
+
+struct CrowdExport
+{
+    void *dataPointer;
+    int size;
+};
+
+// Snapshots the state of every active agent: parameters, corridor, local boundary, target and
+// velocities, off-mesh animation and level of detail bookkeeping, along with the crowd's filters,
+// obstacle avoidance params and dynamic obstacles.
+// Agent userData is not part of the snapshot, it is a pointer into the exporting process.
+// In flight path queue requests are not part of the snapshot, agents waiting on one re-issue it on
+// the next update after an import.
+class CrowdExporter
+{
+public:
+    CrowdExporter() {}
+
+    CrowdExport exportCrowd(Crowd *crowd) const;
+    void freeCrowdExport(CrowdExport *crowdExport);
+
+protected:
+    void writeCrowdSet(const Crowd *crowd, CrowdSetWriter &writer) const;
+};
+
+class CrowdImporter
+{
+public:
+    CrowdImporter() {}
+
+    // Restores a snapshot into a crowd initialized on the same nav mesh, growing it to the exported crowd's max agents if needed.
+    // Agents and obstacles keep their ids, ones not in the snapshot are removed.
+    // Agents that were already active keep their userData, other agents have none.
+    bool importCrowd(Crowd *crowd, CrowdExport *crowdExport) const;
+};
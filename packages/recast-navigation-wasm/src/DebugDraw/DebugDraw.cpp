@@ -39,3 +39,118 @@ void DebugDraw::end()
 {
     handleEnd();
 }
+
+void DebugDrawBuffers::depthMask(bool)
+{
+}
+
+void DebugDrawBuffers::texture(bool)
+{
+}
+
+void DebugDrawBuffers::begin(duDebugDrawPrimitives prim, float)
+{
+    m_prim = prim;
+    m_quadVertexCount = 0;
+
+    if (prim == DU_DRAW_POINTS)
+        m_current = &m_points;
+    else if (prim == DU_DRAW_LINES)
+        m_current = &m_lines;
+    else
+        m_current = &m_tris;
+}
+
+void DebugDrawBuffers::vertex(const float *pos, unsigned int color)
+{
+    vertex(pos[0], pos[1], pos[2], color);
+}
+
+void DebugDrawBuffers::vertex(const float x, const float y, const float z, unsigned int color)
+{
+    if (!m_current)
+        return;
+
+    DebugDrawBuffer &buffer = *m_current;
+    const unsigned int index = (unsigned int)buffer.colors.size();
+
+    buffer.positions.push_back(x);
+    buffer.positions.push_back(y);
+    buffer.positions.push_back(z);
+    buffer.colors.push_back(color);
+
+    if (m_prim != DU_DRAW_QUADS)
+    {
+        buffer.indices.push_back(index);
+        return;
+    }
+
+    // split each completed quad into two triangles
+    if (++m_quadVertexCount < 4)
+        return;
+
+    const unsigned int first = index - 3;
+    const unsigned int quad[6] = {first, first + 1, first + 2, first, first + 2, first + 3};
+    buffer.indices.insert(buffer.indices.end(), quad, quad + 6);
+    m_quadVertexCount = 0;
+}
+
+void DebugDrawBuffers::vertex(const float *pos, unsigned int color, const float *)
+{
+    vertex(pos[0], pos[1], pos[2], color);
+}
+
+void DebugDrawBuffers::vertex(const float x, const float y, const float z, unsigned int color, const float, const float)
+{
+    vertex(x, y, z, color);
+}
+
+void DebugDrawBuffers::end()
+{
+    m_current = nullptr;
+}
+
+void DebugDrawBuffers::clear()
+{
+    DebugDrawBuffer *buffers[3] = {&m_points, &m_lines, &m_tris};
+    for (DebugDrawBuffer *buffer : buffers)
+    {
+        buffer->positions.clear();
+        buffer->colors.clear();
+        buffer->indices.clear();
+    }
+}
+
+DebugDrawBuffer &DebugDrawBuffers::getBuffer(duDebugDrawPrimitives prim)
+{
+    if (prim == DU_DRAW_POINTS)
+        return m_points;
+    if (prim == DU_DRAW_LINES)
+        return m_lines;
+    return m_tris;
+}
+
+int DebugDrawBuffers::getVertexCount(duDebugDrawPrimitives prim)
+{
+    return (int)getBuffer(prim).colors.size();
+}
+
+int DebugDrawBuffers::getIndexCount(duDebugDrawPrimitives prim)
+{
+    return (int)getBuffer(prim).indices.size();
+}
+
+float *DebugDrawBuffers::getPositions(duDebugDrawPrimitives prim)
+{
+    return getBuffer(prim).positions.data();
+}
+
+unsigned int *DebugDrawBuffers::getColors(duDebugDrawPrimitives prim)
+{
+    return getBuffer(prim).colors.data();
+}
+
+unsigned int *DebugDrawBuffers::getIndices(duDebugDrawPrimitives prim)
+{
+    return getBuffer(prim).indices.data();
+}
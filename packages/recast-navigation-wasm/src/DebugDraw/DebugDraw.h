@@ -3,6 +3,7 @@
 #include "../../recastnavigation/DebugUtils/Include/DebugDraw.h"
 #include "../../recastnavigation/DebugUtils/Include/RecastDebugDraw.h"
 #include "../../recastnavigation/DebugUtils/Include/DetourDebugDraw.h"
+#include <vector>
 
 class DebugDraw : public duDebugDraw
 {
@@ -23,3 +24,46 @@ public:
     virtual void handleVertexWithColorAndUV(const float x, const float y, const float z, unsigned int color, const float u, const float v) = 0;
     virtual void handleEnd() = 0;
 };
+
+struct DebugDrawBuffer
+{
+    std::vector<float> positions;
+    std::vector<unsigned int> colors;
+    std::vector<unsigned int> indices;
+};
+
+class DebugDrawBuffers : public duDebugDraw
+{
+public:
+    virtual void depthMask(bool state);
+    virtual void texture(bool state);
+    virtual void begin(duDebugDrawPrimitives prim, float size = 1.0f);
+    virtual void vertex(const float *pos, unsigned int color);
+    virtual void vertex(const float x, const float y, const float z, unsigned int color);
+    virtual void vertex(const float *pos, unsigned int color, const float *uv);
+    virtual void vertex(const float x, const float y, const float z, unsigned int color, const float u, const float v);
+    virtual void end();
+
+    /// Clears all buffers, keeping their capacity for the next draw.
+    void clear();
+
+    /// Quads are written to the DU_DRAW_TRIS buffer as two triangles.
+    int getVertexCount(duDebugDrawPrimitives prim);
+    int getIndexCount(duDebugDrawPrimitives prim);
+
+    /// Pointers into the buffers, valid until the next draw or clear.
+    float *getPositions(duDebugDrawPrimitives prim);
+    unsigned int *getColors(duDebugDrawPrimitives prim);
+    unsigned int *getIndices(duDebugDrawPrimitives prim);
+
+protected:
+    DebugDrawBuffer &getBuffer(duDebugDrawPrimitives prim);
+
+    DebugDrawBuffer m_points;
+    DebugDrawBuffer m_lines;
+    DebugDrawBuffer m_tris;
+
+    DebugDrawBuffer *m_current = nullptr;
+    duDebugDrawPrimitives m_prim = DU_DRAW_POINTS;
+    int m_quadVertexCount = 0;
+};
@@ -1,5 +1,73 @@
 #include "./NavMesh.h"
 
+static const int POLYSTATE_MAGIC = 'P' << 24 | 'S' << 16 | 'T' << 8 | 'A'; //'PSTA';
+static const int POLYSTATE_DIFF_MAGIC = 'P' << 24 | 'D' << 16 | 'I' << 8 | 'F'; //'PDIF';
+static const int POLYSTATE_VERSION = 1;
+
+// States have a header, tileCount tile headers, then the flags and then the areas of every poly, in tile order.
+// Diffs have a header with no tiles, then the refs, flags and areas of polyCount polys.
+struct PolyStateHeader
+{
+    int magic;
+    int version;
+    int tileCount;
+    int polyCount;
+};
+
+struct PolyStateTileHeader
+{
+    dtTileRef tileRef;
+    int polyCount;
+};
+
+static bool readPolyStateHeader(const UnsignedCharArray *state, PolyStateHeader &header)
+{
+    if (!state->data || state->size < (int)sizeof(PolyStateHeader))
+    {
+        return false;
+    }
+
+    memcpy(&header, state->data, sizeof(PolyStateHeader));
+    if (header.version != POLYSTATE_VERSION || header.tileCount < 0 || header.polyCount < 0)
+    {
+        return false;
+    }
+
+    if (header.magic == POLYSTATE_MAGIC)
+    {
+        const long long size = (long long)sizeof(PolyStateHeader) + (long long)header.tileCount * (long long)sizeof(PolyStateTileHeader) +
+                               (long long)header.polyCount * (long long)(sizeof(unsigned short) + sizeof(unsigned char));
+        if (state->size < size)
+        {
+            return false;
+        }
+
+        // The tiles' polys must add up to the polys stored, so every tile's flags and areas are in range
+        long long polyCount = 0;
+        for (int i = 0; i < header.tileCount; ++i)
+        {
+            PolyStateTileHeader tileHeader;
+            memcpy(&tileHeader, state->data + sizeof(PolyStateHeader) + i * sizeof(PolyStateTileHeader), sizeof(PolyStateTileHeader));
+            if (tileHeader.polyCount < 0)
+            {
+                return false;
+            }
+
+            polyCount += tileHeader.polyCount;
+        }
+
+        return polyCount == header.polyCount;
+    }
+
+    if (header.magic == POLYSTATE_DIFF_MAGIC)
+    {
+        const long long size = (long long)sizeof(PolyStateHeader) + (long long)header.polyCount * (long long)(sizeof(dtPolyRef) + sizeof(unsigned short) + sizeof(unsigned char));
+        return state->size >= size;
+    }
+
+    return false;
+}
+
 bool NavMesh::initSolo(UnsignedCharArray *navMeshData)
 {
     dtStatus status = m_navMesh->init(navMeshData->data, navMeshData->size, DT_TILE_FREE_DATA);
@@ -152,17 +220,439 @@ dtStatus NavMesh::getPolyArea(dtPolyRef ref, UnsignedCharRef *area) const
     return m_navMesh->getPolyArea(ref, &area->value);
 }
 
+void NavMeshPolyEditRecord::clear()
+{
+    m_refs.clear();
+    m_flags.clear();
+    m_areas.clear();
+}
+
+void NavMeshPolyEditRecord::add(const dtPolyRef ref, const unsigned short flags, const unsigned char area)
+{
+    m_refs.push_back(ref);
+    m_flags.push_back(flags);
+    m_areas.push_back(area);
+}
+
+bool NavMesh::editPoly(const dtPolyRef ref, const dtPoly *poly, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo)
+{
+    const unsigned short flags = (poly->flags & ~clearFlags) | setFlags;
+    const unsigned char newArea = area >= 0 && area < DT_MAX_AREAS ? (unsigned char)area : poly->getArea();
+    if (flags == poly->flags && newArea == poly->getArea())
+    {
+        return false;
+    }
+
+    if (undo)
+    {
+        undo->add(ref, poly->flags, poly->getArea());
+    }
+
+    m_navMesh->setPolyFlags(ref, flags);
+    m_navMesh->setPolyArea(ref, newArea);
+
+    return true;
+}
+
+int NavMesh::editPolysInBox(const float *bmin, const float *bmax, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo)
+{
+    const dtNavMesh *navMesh = m_navMesh;
+    int changed = 0;
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header || !dtOverlapBounds(bmin, bmax, tile->header->bmin, tile->header->bmax))
+            continue;
+
+        const dtPolyRef base = navMesh->getPolyRefBase(tile);
+        for (int j = 0; j < tile->header->polyCount; ++j)
+        {
+            const dtPoly *poly = &tile->polys[j];
+
+            float pmin[3], pmax[3];
+            dtVcopy(pmin, &tile->verts[poly->verts[0] * 3]);
+            dtVcopy(pmax, pmin);
+            for (int k = 1; k < poly->vertCount; ++k)
+            {
+                const float *v = &tile->verts[poly->verts[k] * 3];
+                dtVmin(pmin, v);
+                dtVmax(pmax, v);
+            }
+
+            if (dtOverlapBounds(bmin, bmax, pmin, pmax) && editPoly(base | (dtPolyRef)j, poly, setFlags, clearFlags, area, undo))
+            {
+                changed++;
+            }
+        }
+    }
+
+    return changed;
+}
+
+int NavMesh::editPolysInConvexVolume(const float *verts, const int nverts, const float minHeight, const float maxHeight, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo)
+{
+    if (nverts < 3)
+    {
+        return 0;
+    }
+
+    float bmin[3], bmax[3];
+    dtVcopy(bmin, verts);
+    dtVcopy(bmax, verts);
+    for (int i = 1; i < nverts; ++i)
+    {
+        dtVmin(bmin, &verts[i * 3]);
+        dtVmax(bmax, &verts[i * 3]);
+    }
+    bmin[1] = minHeight;
+    bmax[1] = maxHeight;
+
+    const dtNavMesh *navMesh = m_navMesh;
+    int changed = 0;
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header || !dtOverlapBounds(bmin, bmax, tile->header->bmin, tile->header->bmax))
+            continue;
+
+        const dtPolyRef base = navMesh->getPolyRefBase(tile);
+        for (int j = 0; j < tile->header->polyCount; ++j)
+        {
+            const dtPoly *poly = &tile->polys[j];
+
+            float center[3];
+            dtCalcPolyCenter(center, poly->verts, poly->vertCount, tile->verts);
+            if (center[1] < minHeight || center[1] > maxHeight || !dtPointInPolygon(center, verts, nverts))
+                continue;
+
+            if (editPoly(base | (dtPolyRef)j, poly, setFlags, clearFlags, area, undo))
+            {
+                changed++;
+            }
+        }
+    }
+
+    return changed;
+}
+
+int NavMesh::editPolysWithArea(const int matchArea, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo)
+{
+    const dtNavMesh *navMesh = m_navMesh;
+    int changed = 0;
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header)
+            continue;
+
+        const dtPolyRef base = navMesh->getPolyRefBase(tile);
+        for (int j = 0; j < tile->header->polyCount; ++j)
+        {
+            const dtPoly *poly = &tile->polys[j];
+            if (poly->getArea() == matchArea && editPoly(base | (dtPolyRef)j, poly, setFlags, clearFlags, area, undo))
+            {
+                changed++;
+            }
+        }
+    }
+
+    return changed;
+}
+
+int NavMesh::editPolys(const int *refs, const int refCount, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo)
+{
+    int changed = 0;
+
+    for (int i = 0; i < refCount; ++i)
+    {
+        const dtPolyRef ref = (dtPolyRef)(unsigned int)refs[i];
+
+        const dtMeshTile *tile = 0;
+        const dtPoly *poly = 0;
+        if (dtStatusFailed(m_navMesh->getTileAndPolyByRef(ref, &tile, &poly)))
+            continue;
+
+        if (editPoly(ref, poly, setFlags, clearFlags, area, undo))
+        {
+            changed++;
+        }
+    }
+
+    return changed;
+}
+
+int NavMesh::undoPolyEdit(NavMeshPolyEditRecord *undo)
+{
+    int restored = 0;
+
+    for (int i = undo->getPolyCount() - 1; i >= 0; --i)
+    {
+        const dtPolyRef ref = undo->m_refs[i];
+        if (dtStatusFailed(m_navMesh->setPolyFlags(ref, undo->m_flags[i])))
+            continue;
+
+        m_navMesh->setPolyArea(ref, undo->m_areas[i]);
+        restored++;
+    }
+
+    undo->clear();
+
+    return restored;
+}
+
+int NavMesh::getPolyStateSize() const
+{
+    const dtNavMesh *navMesh = m_navMesh;
+    int tileCount = 0;
+    int polyCount = 0;
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header)
+            continue;
+
+        tileCount++;
+        polyCount += tile->header->polyCount;
+    }
+
+    return (int)(sizeof(PolyStateHeader) + tileCount * sizeof(PolyStateTileHeader) + polyCount * (sizeof(unsigned short) + sizeof(unsigned char)));
+}
+
+int NavMesh::storePolyState(UnsignedCharArray *output) const
+{
+    const dtNavMesh *navMesh = m_navMesh;
+
+    PolyStateHeader header;
+    header.magic = POLYSTATE_MAGIC;
+    header.version = POLYSTATE_VERSION;
+    header.tileCount = 0;
+    header.polyCount = 0;
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header)
+            continue;
+
+        header.tileCount++;
+        header.polyCount += tile->header->polyCount;
+    }
+
+    const int size = getPolyStateSize();
+    if (output->size < size)
+    {
+        output->resize(size);
+    }
+
+    unsigned char *tileHeaders = output->data + sizeof(PolyStateHeader);
+    unsigned char *flags = tileHeaders + header.tileCount * sizeof(PolyStateTileHeader);
+    unsigned char *areas = flags + header.polyCount * sizeof(unsigned short);
+
+    memcpy(output->data, &header, sizeof(PolyStateHeader));
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header)
+            continue;
+
+        PolyStateTileHeader tileHeader;
+        tileHeader.tileRef = navMesh->getTileRef(tile);
+        tileHeader.polyCount = tile->header->polyCount;
+        memcpy(tileHeaders, &tileHeader, sizeof(PolyStateTileHeader));
+        tileHeaders += sizeof(PolyStateTileHeader);
+
+        for (int j = 0; j < tile->header->polyCount; ++j)
+        {
+            const dtPoly *poly = &tile->polys[j];
+            memcpy(flags, &poly->flags, sizeof(unsigned short));
+            flags += sizeof(unsigned short);
+            *areas++ = poly->getArea();
+        }
+    }
+
+    return size;
+}
+
+int NavMesh::diffPolyState(const UnsignedCharArray *previous, UnsignedCharArray *output) const
+{
+    PolyStateHeader previousHeader;
+    if (!readPolyStateHeader(previous, previousHeader) || previousHeader.magic != POLYSTATE_MAGIC)
+    {
+        return -1;
+    }
+
+    const dtNavMesh *navMesh = m_navMesh;
+
+    std::vector<dtPolyRef> refs;
+    std::vector<unsigned short> flags;
+    std::vector<unsigned char> areas;
+
+    // Tiles the previous state has, with where their polys start in its flags and areas
+    std::vector<int> previousPolyOffsets(navMesh->getMaxTiles(), -1);
+    std::vector<dtTileRef> previousRefs(navMesh->getMaxTiles(), 0);
+
+    const unsigned char *tileHeaders = previous->data + sizeof(PolyStateHeader);
+    const unsigned char *previousFlags = tileHeaders + previousHeader.tileCount * sizeof(PolyStateTileHeader);
+    const unsigned char *previousAreas = previousFlags + previousHeader.polyCount * sizeof(unsigned short);
+
+    int polyOffset = 0;
+    for (int i = 0; i < previousHeader.tileCount; ++i)
+    {
+        PolyStateTileHeader tileHeader;
+        memcpy(&tileHeader, tileHeaders + i * sizeof(PolyStateTileHeader), sizeof(PolyStateTileHeader));
+
+        const dtMeshTile *tile = navMesh->getTileByRef(tileHeader.tileRef);
+        if (tile && tile->header && tile->header->polyCount == tileHeader.polyCount)
+        {
+            const int tileIndex = (int)navMesh->decodePolyIdTile(tileHeader.tileRef);
+            previousPolyOffsets[tileIndex] = polyOffset;
+            previousRefs[tileIndex] = tileHeader.tileRef;
+        }
+
+        polyOffset += tileHeader.polyCount;
+    }
+
+    for (int i = 0; i < navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        if (!tile || !tile->header)
+            continue;
+
+        const dtPolyRef base = navMesh->getPolyRefBase(tile);
+        const bool hasPrevious = previousRefs[i] == navMesh->getTileRef(tile);
+
+        for (int j = 0; j < tile->header->polyCount; ++j)
+        {
+            const dtPoly *poly = &tile->polys[j];
+
+            if (hasPrevious)
+            {
+                const int index = previousPolyOffsets[i] + j;
+                unsigned short storedFlags;
+                memcpy(&storedFlags, previousFlags + index * sizeof(unsigned short), sizeof(unsigned short));
+                if (storedFlags == poly->flags && previousAreas[index] == poly->getArea())
+                    continue;
+            }
+
+            refs.push_back(base | (dtPolyRef)j);
+            flags.push_back(poly->flags);
+            areas.push_back(poly->getArea());
+        }
+    }
+
+    PolyStateHeader header;
+    header.magic = POLYSTATE_DIFF_MAGIC;
+    header.version = POLYSTATE_VERSION;
+    header.tileCount = 0;
+    header.polyCount = (int)refs.size();
+
+    const int size = (int)(sizeof(PolyStateHeader) + refs.size() * (sizeof(dtPolyRef) + sizeof(unsigned short) + sizeof(unsigned char)));
+    if (output->size < size)
+    {
+        output->resize(size);
+    }
+
+    unsigned char *bits = output->data;
+    memcpy(bits, &header, sizeof(PolyStateHeader));
+    bits += sizeof(PolyStateHeader);
+    if (!refs.empty())
+    {
+        memcpy(bits, refs.data(), refs.size() * sizeof(dtPolyRef));
+        bits += refs.size() * sizeof(dtPolyRef);
+        memcpy(bits, flags.data(), flags.size() * sizeof(unsigned short));
+        bits += flags.size() * sizeof(unsigned short);
+        memcpy(bits, areas.data(), areas.size());
+    }
+
+    return size;
+}
+
+int NavMesh::restorePolyState(const UnsignedCharArray *state)
+{
+    PolyStateHeader header;
+    if (!readPolyStateHeader(state, header))
+    {
+        return -1;
+    }
+
+    int restored = 0;
+
+    if (header.magic == POLYSTATE_DIFF_MAGIC)
+    {
+        const unsigned char *refs = state->data + sizeof(PolyStateHeader);
+        const unsigned char *flags = refs + header.polyCount * sizeof(dtPolyRef);
+        const unsigned char *areas = flags + header.polyCount * sizeof(unsigned short);
+
+        for (int i = 0; i < header.polyCount; ++i)
+        {
+            dtPolyRef ref;
+            unsigned short polyFlags;
+            memcpy(&ref, refs + i * sizeof(dtPolyRef), sizeof(dtPolyRef));
+            memcpy(&polyFlags, flags + i * sizeof(unsigned short), sizeof(unsigned short));
+
+            if (dtStatusFailed(m_navMesh->setPolyFlags(ref, polyFlags)))
+                continue;
+
+            m_navMesh->setPolyArea(ref, areas[i]);
+            restored++;
+        }
+
+        return restored;
+    }
+
+    const unsigned char *tileHeaders = state->data + sizeof(PolyStateHeader);
+    const unsigned char *flags = tileHeaders + header.tileCount * sizeof(PolyStateTileHeader);
+    const unsigned char *areas = flags + header.polyCount * sizeof(unsigned short);
+
+    int polyOffset = 0;
+    for (int i = 0; i < header.tileCount; ++i)
+    {
+        PolyStateTileHeader tileHeader;
+        memcpy(&tileHeader, tileHeaders + i * sizeof(PolyStateTileHeader), sizeof(PolyStateTileHeader));
+
+        const dtMeshTile *tile = m_navMesh->getTileByRef(tileHeader.tileRef);
+        if (tile && tile->header && tile->header->polyCount == tileHeader.polyCount)
+        {
+            const dtPolyRef base = m_navMesh->getPolyRefBase(tile);
+            for (int j = 0; j < tileHeader.polyCount; ++j)
+            {
+                const int index = polyOffset + j;
+                unsigned short polyFlags;
+                memcpy(&polyFlags, flags + index * sizeof(unsigned short), sizeof(unsigned short));
+
+                m_navMesh->setPolyFlags(base | (dtPolyRef)j, polyFlags);
+                m_navMesh->setPolyArea(base | (dtPolyRef)j, areas[index]);
+                restored++;
+            }
+        }
+
+        polyOffset += tileHeader.polyCount;
+    }
+
+    return restored;
+}
+
 int NavMesh::getTileStateSize(const dtMeshTile *tile) const
 {
     return m_navMesh->getTileStateSize(tile);
 }
 
-NavMeshStoreTileStateResult NavMesh::storeTileState(const dtMeshTile *tile, const int maxDataSize) const
+NavMeshStoreTileStateResult NavMesh::storeTileState(const dtMeshTile *tile, const int maxDataSize)
 {
     NavMeshStoreTileStateResult result;
 
-    result.status = m_navMesh->storeTileState(tile, result.data, maxDataSize);
-    result.dataSize = maxDataSize;
+    // Detour fails if maxDataSize is too small, so the buffer never needs to be larger than it
+    const int stateSize = m_navMesh->getTileStateSize(tile);
+    m_tileState.resize(dtMax(dtMin(stateSize, maxDataSize), 1));
+
+    result.status = m_navMesh->storeTileState(tile, m_tileState.data(), dtMin(stateSize, maxDataSize));
+    result.data = m_tileState.data();
+    result.dataSize = dtStatusSucceed(result.status) ? stateSize : 0;
 
     return result;
 }
@@ -175,6 +665,9 @@ dtStatus NavMesh::restoreTileState(dtMeshTile *tile, const unsigned char *data,
 void NavMesh::destroy()
 {
     dtFreeNavMesh(m_navMesh);
+
+    free(m_ownedData);
+    m_ownedData = 0;
 }
 
 const dtMeshTile *NavMesh::getTile(int i) const
@@ -8,6 +8,8 @@
 #include "./Arrays.h"
 #include "./Vec.h"
 
+#include <vector>
+
 struct NavMeshRemoveTileResult
 {
     unsigned int status;
@@ -34,6 +36,24 @@ struct NavMeshGetTileAndPolyByRefResult
     const dtPoly *poly;
 };
 
+// Previous flags and areas of the polys bulk edits changed, for undoing them.
+// Only polys whose flags or area changed are recorded.
+class NavMeshPolyEditRecord
+{
+public:
+    int getPolyCount() const { return (int)m_refs.size(); }
+
+    dtPolyRef getPolyRef(const int index) const { return m_refs[index]; }
+
+    void clear();
+
+    void add(const dtPolyRef ref, const unsigned short flags, const unsigned char area);
+
+    std::vector<dtPolyRef> m_refs;
+    std::vector<unsigned short> m_flags;
+    std::vector<unsigned char> m_areas;
+};
+
 struct NavMeshStoreTileStateResult
 {
     dtStatus status;
@@ -45,15 +65,19 @@ class NavMesh
 {
 public:
     dtNavMesh *m_navMesh;
+    // Tile data the nav mesh does not free itself, such as an in place import, freed on destroy
+    void *m_ownedData;
 
     NavMesh()
     {
         m_navMesh = dtAllocNavMesh();
+        m_ownedData = 0;
     }
 
     NavMesh(dtNavMesh *navMesh)
     {
         m_navMesh = navMesh;
+        m_ownedData = 0;
     }
 
     bool initSolo(UnsignedCharArray *navMeshData);
@@ -109,11 +133,52 @@ public:
 
     dtStatus getPolyArea(dtPolyRef ref, UnsignedCharRef *area) const;
 
+    // Bulk poly edits. Each edited poly's flags become (flags & ~clearFlags) | setFlags, and its area is set
+    // when area is 0 or more. The previous flags and areas of the polys that changed are added to undo, which may be null.
+    // Returns the number of polys that changed.
+
+    // Edits the polys whose bounds overlap the box.
+    int editPolysInBox(const float *bmin, const float *bmax, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo);
+
+    // Edits the polys whose center is inside the convex xz polygon and between minHeight and maxHeight.
+    int editPolysInConvexVolume(const float *verts, const int nverts, const float minHeight, const float maxHeight, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo);
+
+    // Edits the polys with the given area.
+    int editPolysWithArea(const int matchArea, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo);
+
+    // Edits the polys in a packed ref array, invalid refs are skipped.
+    int editPolys(const int *refs, const int refCount, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo);
+
+    // Restores the recorded flags and areas, latest edit first, and clears the record. Polys in tiles rebuilt since are skipped.
+    // Returns the number of polys restored.
+    int undoPolyEdit(NavMeshPolyEditRecord *undo);
+
+    // Size of the poly state of every tile, see storePolyState.
+    int getPolyStateSize() const;
+
+    // Packs the flags and area of every poly into the array, growing it only when it is too small. Returns the state size.
+    int storePolyState(UnsignedCharArray *output) const;
+
+    // Packs the flags and area of the polys that differ from a previous storePolyState into the array,
+    // growing it only when it is too small. Polys of tiles the previous state has no record of are all included.
+    // Returns the diff size, or -1 if the previous state is invalid.
+    int diffPolyState(const UnsignedCharArray *previous, UnsignedCharArray *output) const;
+
+    // Restores a state from storePolyState, or applies a diff from diffPolyState.
+    // Tiles that were rebuilt since the state was stored are skipped. Returns the number of polys restored, or -1 if the state is invalid.
+    int restorePolyState(const UnsignedCharArray *state);
+
     int getTileStateSize(const dtMeshTile *tile) const;
 
-    NavMeshStoreTileStateResult storeTileState(const dtMeshTile *tile, const int maxDataSize) const;
+    // The result data is owned by the nav mesh, and is valid until the next call.
+    NavMeshStoreTileStateResult storeTileState(const dtMeshTile *tile, const int maxDataSize);
 
     dtStatus restoreTileState(dtMeshTile *tile, const unsigned char *data, const int maxDataSize);
 
     void destroy();
+
+protected:
+    std::vector<unsigned char> m_tileState;
+
+    bool editPoly(const dtPolyRef ref, const dtPoly *poly, const unsigned short setFlags, const unsigned short clearFlags, const int area, NavMeshPolyEditRecord *undo);
 };
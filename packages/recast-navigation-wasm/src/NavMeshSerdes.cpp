@@ -1,9 +1,20 @@
 #include "./NavMeshSerdes.h"
 
+#include <algorithm>
+#include <limits.h>
+#include <stdint.h>
+#include <vector>
+
 static const int NAVMESHSET_MAGIC = 'M' << 24 | 'S' << 16 | 'E' << 8 | 'T'; //'MSET';
 static const int NAVMESHSET_VERSION = 1;
 static const int TILECACHESET_MAGIC = 'T' << 24 | 'S' << 16 | 'E' << 8 | 'T'; //'TSET';
-static const int TILECACHESET_VERSION = 1;
+static const int TILECACHESET_VERSION = 3;
+// Version 1 sets have no compression header and are FastLZ compressed
+static const int TILECACHESET_VERSION_FASTLZ = 1;
+// Version 2 sets have no allocator header
+static const int TILECACHESET_VERSION_COMPRESSION = 2;
+// Allocator size used when the set does not record one, the allocator grows if a tile needs more
+static const int TILECACHESET_DEFAULT_ALLOCATOR_SIZE = 32000;
 
 struct RecastHeader
 {
@@ -18,12 +29,36 @@ struct TileCacheSetHeader
     dtTileCacheParams cacheParams;
 };
 
+// Follows TileCacheSetHeader from version 2
+struct TileCacheSetCompressionHeader
+{
+    int compressorType;
+};
+
+// Follows TileCacheSetCompressionHeader from version 3
+struct TileCacheSetAllocatorHeader
+{
+    // Peak bytes a single tile build used when the set was exported
+    int allocatorSize;
+};
+
 struct TileCacheTileHeader
 {
     dtCompressedTileRef tileRef;
     int dataSize;
 };
 
+static const int NAVMESHINDEX_MAGIC = 'M' << 24 | 'I' << 16 | 'D' << 8 | 'X'; //'MIDX';
+static const int NAVMESHINDEX_VERSION = 1;
+// Indexed tiles start on this alignment, so they can be read in place
+static const int NAVMESHINDEX_ALIGNMENT = 16;
+
+static const int NAVMESHDELTA_MAGIC = 'M' << 24 | 'D' << 16 | 'L' << 8 | 'T'; //'MDLT';
+static const int NAVMESHDELTA_VERSION = 1;
+
+// Nav mesh tile data sizes are multiples of 4, so tiles in an aligned export stay aligned
+static const int TILE_DATA_ALIGNMENT = 4;
+
 struct NavMeshSetHeader
 {
     dtNavMeshParams params;
@@ -35,10 +70,415 @@ struct NavMeshTileHeader
     int dataSize;
 };
 
+// Indexed sets have a RecastHeader, a NavMeshSetHeader, a NavMeshIndexCompressionHeader,
+// then a directory of numTiles entries sorted by y, x, layer
+struct NavMeshIndexCompressionHeader
+{
+    // TILECACHE_COMPRESSOR_NONE when tiles are stored as is
+    int compressorType;
+};
+
+struct NavMeshIndexEntry
+{
+    int x;
+    int y;
+    int layer;
+    // Stored tile from the start of the export
+    int offset;
+    int size;
+    // Checksum of the stored tile
+    unsigned int checksum;
+    // Size of the tile data once decompressed
+    int dataSize;
+    dtTileRef tileRef;
+};
+
+// Delta sets have a RecastHeader, a NavMeshDeltaHeader, then numTiles tiles
+struct NavMeshDeltaHeader
+{
+    int fromSnapshotId;
+    int toSnapshotId;
+};
+
+struct NavMeshDeltaTileHeader
+{
+    // Slot the tile is removed from, then added to if it has data
+    int tileIndex;
+    // 0 when the tile is removed
+    dtTileRef tileRef;
+    int dataSize;
+};
+
+// A tile removed by applyNavMeshDelta, kept until the delta is applied so it can be added back
+struct NavMeshDeltaRemovedTile
+{
+    dtTileRef tileRef;
+    unsigned char *data;
+    int dataSize;
+    int flags;
+};
+
+static const int NAVMESHINDEX_DIRECTORY_OFFSET = int(sizeof(RecastHeader) + sizeof(NavMeshSetHeader) + sizeof(NavMeshIndexCompressionHeader));
+
+// FNV-1a
+static unsigned int navMeshIndexChecksum(const unsigned char *data, const int size)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool navMeshIndexEntryLess(const NavMeshIndexEntry &a, const NavMeshIndexEntry &b)
+{
+    if (a.y != b.y)
+        return a.y < b.y;
+    if (a.x != b.x)
+        return a.x < b.x;
+    return a.layer < b.layer;
+}
+
+struct TileCacheSetHeaders
+{
+    TileCacheSetHeader header;
+    TileCacheSetCompressionHeader compressionHeader;
+    TileCacheSetAllocatorHeader allocatorHeader;
+};
+
+// Reads the headers that follow the RecastHeader of a tile cache set, read copies the next size bytes into dest
+template <typename ReadFn>
+static bool readTileCacheSetHeaders(const RecastHeader &recastHeader, ReadFn read, TileCacheSetHeaders &headers)
+{
+    if (recastHeader.version < TILECACHESET_VERSION_FASTLZ || recastHeader.version > TILECACHESET_VERSION)
+    {
+        return false;
+    }
+
+    if (!read(&headers.header, sizeof(TileCacheSetHeader)))
+    {
+        return false;
+    }
+
+    headers.compressionHeader.compressorType = TILECACHE_COMPRESSOR_FASTLZ;
+    if (recastHeader.version >= TILECACHESET_VERSION_COMPRESSION && !read(&headers.compressionHeader, sizeof(TileCacheSetCompressionHeader)))
+    {
+        return false;
+    }
+
+    headers.allocatorHeader.allocatorSize = 0;
+    if (recastHeader.version >= TILECACHESET_VERSION && !read(&headers.allocatorHeader, sizeof(TileCacheSetAllocatorHeader)))
+    {
+        return false;
+    }
+
+    return RecastTileCacheCompressor::isValidType(headers.compressionHeader.compressorType);
+}
+
+// Creates the empty nav mesh and tile cache of a tile cache set
+static bool createTileCache(const TileCacheSetHeaders &headers, TileCacheMeshProcessJsImpl &meshProcess, NavMeshImporterResult &result)
+{
+    NavMesh *navMesh = new NavMesh;
+    if (!navMesh->initTiled(&headers.header.meshParams))
+    {
+        return false;
+    }
+
+    RecastLinearAllocator *allocator = new RecastLinearAllocator(dtMax(TILECACHESET_DEFAULT_ALLOCATOR_SIZE, headers.allocatorHeader.allocatorSize));
+    RecastTileCacheCompressor *compressor = new RecastTileCacheCompressor(headers.compressionHeader.compressorType);
+
+    TileCache *tileCache = new TileCache;
+    if (!tileCache->init(&headers.header.cacheParams, allocator, compressor, meshProcess))
+    {
+        return false;
+    }
+
+    result.navMesh = navMesh;
+    result.tileCache = tileCache;
+    result.allocator = allocator;
+    result.compressor = compressor;
+
+    return true;
+}
+
 NavMeshImporterResult NavMeshImporter::importNavMesh(NavMeshExport *navMeshExport, TileCacheMeshProcessJsImpl &meshProcess)
+{
+    return importExport(navMeshExport, &meshProcess, NAVMESH_IMPORT_COPY);
+}
+
+NavMeshImporterResult NavMeshImporter::importNavMeshInPlace(NavMeshExport *navMeshExport)
+{
+    return importExport(navMeshExport, 0, NAVMESH_IMPORT_IN_PLACE);
+}
+
+NavMeshImporterResult NavMeshImporter::importTileCacheStreaming(TileCacheStreamerSourceJsImpl &source, const int size, TileCacheMeshProcessJsImpl &meshProcess)
 {
     NavMeshImporterResult result;
     result.success = false;
+    result.streamer = 0;
+
+    int offset = 0;
+    std::vector<unsigned char> buffer;
+    UnsignedCharArray view;
+
+    // Only headers are read here, tiles are read by the streamer when they load
+    auto read = [&](void *dest, const int readSize)
+    {
+        if (readSize < 0 || size - offset < readSize)
+        {
+            return false;
+        }
+
+        buffer.resize(dtMax(readSize, 1));
+        view.view(buffer.data());
+        view.size = readSize;
+        if (!source.read(offset, readSize, &view))
+        {
+            return false;
+        }
+
+        memcpy(dest, buffer.data(), readSize);
+        offset += readSize;
+        return true;
+    };
+
+    RecastHeader recastHeader;
+    if (!read(&recastHeader, sizeof(RecastHeader)) || recastHeader.magic != TILECACHESET_MAGIC)
+    {
+        return result;
+    }
+
+    TileCacheSetHeaders headers;
+    if (!readTileCacheSetHeaders(recastHeader, read, headers) || !createTileCache(headers, meshProcess, result))
+    {
+        return result;
+    }
+
+    TileCacheStreamer *streamer = new TileCacheStreamer(result.tileCache, result.navMesh, &source);
+
+    for (int i = 0; i < recastHeader.numTiles; ++i)
+    {
+        TileCacheTileHeader tileHeader;
+        if (!read(&tileHeader, sizeof(tileHeader)) || !tileHeader.tileRef || tileHeader.dataSize < (int)sizeof(dtTileCacheLayerHeader))
+        {
+            break;
+        }
+
+        const int tileOffset = offset;
+
+        dtTileCacheLayerHeader layerHeader;
+        if (!read(&layerHeader, sizeof(dtTileCacheLayerHeader)) || size - tileOffset < tileHeader.dataSize)
+        {
+            break;
+        }
+        offset = tileOffset + tileHeader.dataSize;
+
+        if (layerHeader.magic != DT_TILECACHE_MAGIC || layerHeader.version != DT_TILECACHE_VERSION)
+        {
+            continue;
+        }
+
+        streamer->addTile(tileOffset, tileHeader.dataSize, layerHeader);
+    }
+
+    result.streamer = streamer;
+    result.success = true;
+
+    return result;
+}
+
+NavMeshDeltaApplyResult NavMeshImporter::applyNavMeshDelta(NavMesh *navMesh, NavMeshExport *delta, const int snapshotId)
+{
+    NavMeshDeltaApplyResult result;
+    result.success = false;
+    result.snapshotId = 0;
+    result.added = 0;
+    result.removed = 0;
+
+    const unsigned char *bits = (const unsigned char *)delta->dataPointer;
+    const unsigned char *end = bits + delta->size;
+    if (!bits || delta->size < int(sizeof(RecastHeader) + sizeof(NavMeshDeltaHeader)))
+    {
+        return result;
+    }
+
+    RecastHeader recastHeader;
+    memcpy(&recastHeader, bits, sizeof(RecastHeader));
+    bits += sizeof(RecastHeader);
+    if (recastHeader.magic != NAVMESHDELTA_MAGIC || recastHeader.version != NAVMESHDELTA_VERSION)
+    {
+        return result;
+    }
+
+    NavMeshDeltaHeader header;
+    memcpy(&header, bits, sizeof(NavMeshDeltaHeader));
+    bits += sizeof(NavMeshDeltaHeader);
+
+    // Changes made before fromSnapshotId are not in the delta
+    if (header.fromSnapshotId != snapshotId)
+    {
+        return result;
+    }
+
+    dtNavMesh *m_navMesh = navMesh->m_navMesh;
+    const int maxTiles = m_navMesh->getMaxTiles();
+
+    // Validate every entry before changing the nav mesh, each slot is listed once and is added back
+    // with a tile whose ref points at it
+    std::vector<unsigned char> changed(maxTiles, 0);
+    const unsigned char *tiles = bits;
+    for (int i = 0; i < recastHeader.numTiles; ++i)
+    {
+        NavMeshDeltaTileHeader tileHeader;
+        if (end - bits < (int)sizeof(NavMeshDeltaTileHeader))
+        {
+            return result;
+        }
+        memcpy(&tileHeader, bits, sizeof(NavMeshDeltaTileHeader));
+        bits += sizeof(NavMeshDeltaTileHeader);
+
+        if (tileHeader.tileIndex < 0 || tileHeader.tileIndex >= maxTiles || changed[tileHeader.tileIndex] || tileHeader.dataSize < 0 || end - bits < tileHeader.dataSize)
+        {
+            return result;
+        }
+        changed[tileHeader.tileIndex] = 1;
+
+        if (tileHeader.tileRef && tileHeader.dataSize)
+        {
+            if ((int)m_navMesh->decodePolyIdTile(tileHeader.tileRef) != tileHeader.tileIndex || tileHeader.dataSize < (int)sizeof(dtMeshHeader))
+            {
+                return result;
+            }
+
+            dtMeshHeader meshHeader;
+            memcpy(&meshHeader, bits, sizeof(dtMeshHeader));
+            if (meshHeader.magic != DT_NAVMESH_MAGIC || meshHeader.version != DT_NAVMESH_VERSION)
+            {
+                return result;
+            }
+        }
+        bits += tileHeader.dataSize;
+    }
+
+    // The location of each added tile must be free once the changed slots are emptied
+    bits = tiles;
+    for (int i = 0; i < recastHeader.numTiles; ++i)
+    {
+        NavMeshDeltaTileHeader tileHeader;
+        memcpy(&tileHeader, bits, sizeof(NavMeshDeltaTileHeader));
+        bits += sizeof(NavMeshDeltaTileHeader);
+
+        if (tileHeader.tileRef && tileHeader.dataSize)
+        {
+            dtMeshHeader meshHeader;
+            memcpy(&meshHeader, bits, sizeof(dtMeshHeader));
+
+            const dtMeshTile *occupant = m_navMesh->getTileAt(meshHeader.x, meshHeader.y, meshHeader.layer);
+            if (occupant && !changed[m_navMesh->decodePolyIdTile(m_navMesh->getTileRef(occupant))])
+            {
+                return result;
+            }
+        }
+        bits += tileHeader.dataSize;
+    }
+
+    // Remove every changed tile before adding any, a tile may have moved to another slot.
+    // The removed tiles keep their data until the delta is applied, so a failed add can restore them.
+    std::vector<NavMeshDeltaRemovedTile> removedTiles;
+    bits = tiles;
+    for (int i = 0; i < recastHeader.numTiles; ++i)
+    {
+        NavMeshDeltaTileHeader tileHeader;
+        memcpy(&tileHeader, bits, sizeof(NavMeshDeltaTileHeader));
+        bits += sizeof(NavMeshDeltaTileHeader) + tileHeader.dataSize;
+
+        dtMeshTile *tile = const_cast<dtMeshTile *>(m_navMesh->getTile(tileHeader.tileIndex));
+        if (tile && tile->header)
+        {
+            NavMeshDeltaRemovedTile removed;
+            removed.tileRef = m_navMesh->getTileRef(tile);
+            removed.flags = tile->flags;
+
+            tile->flags &= ~DT_TILE_FREE_DATA;
+            m_navMesh->removeTile(removed.tileRef, &removed.data, &removed.dataSize);
+            removedTiles.push_back(removed);
+        }
+    }
+
+    std::vector<dtTileRef> addedTiles;
+    bool failed = false;
+    bits = tiles;
+    for (int i = 0; i < recastHeader.numTiles && !failed; ++i)
+    {
+        NavMeshDeltaTileHeader tileHeader;
+        memcpy(&tileHeader, bits, sizeof(NavMeshDeltaTileHeader));
+        bits += sizeof(NavMeshDeltaTileHeader);
+
+        if (!tileHeader.tileRef || !tileHeader.dataSize)
+        {
+            bits += tileHeader.dataSize;
+            continue;
+        }
+
+        unsigned char *data = (unsigned char *)dtAlloc(tileHeader.dataSize, DT_ALLOC_PERM);
+        if (!data)
+        {
+            failed = true;
+            break;
+        }
+
+        memcpy(data, bits, tileHeader.dataSize);
+        bits += tileHeader.dataSize;
+
+        dtTileRef tileRef = 0;
+        const dtStatus status = m_navMesh->addTile(data, tileHeader.dataSize, DT_TILE_FREE_DATA, tileHeader.tileRef, &tileRef);
+        if (dtStatusFailed(status))
+        {
+            dtFree(data);
+            failed = true;
+            break;
+        }
+
+        addedTiles.push_back(tileRef);
+    }
+
+    if (failed)
+    {
+        // Put the nav mesh back as it was
+        for (size_t i = 0; i < addedTiles.size(); ++i)
+        {
+            m_navMesh->removeTile(addedTiles[i], 0, 0);
+        }
+        for (size_t i = 0; i < removedTiles.size(); ++i)
+        {
+            const NavMeshDeltaRemovedTile &removed = removedTiles[i];
+            m_navMesh->addTile(removed.data, removed.dataSize, removed.flags, removed.tileRef, 0);
+        }
+        return result;
+    }
+
+    for (size_t i = 0; i < removedTiles.size(); ++i)
+    {
+        if (removedTiles[i].flags & DT_TILE_FREE_DATA)
+        {
+            dtFree(removedTiles[i].data);
+        }
+    }
+
+    result.added = (int)addedTiles.size();
+    result.removed = (int)removedTiles.size();
+    result.success = true;
+    result.snapshotId = header.toSnapshotId;
+    return result;
+}
+
+NavMeshImporterResult NavMeshImporter::importExport(NavMeshExport *navMeshExport, TileCacheMeshProcessJsImpl *meshProcess, const NavMeshImportMode mode)
+{
+    NavMeshImporterResult result;
+    result.success = false;
+    result.streamer = 0;
 
     unsigned char *bits = (unsigned char *)navMeshExport->dataPointer;
 
@@ -79,6 +519,14 @@ NavMeshImporterResult NavMeshImporter::importNavMesh(NavMeshExport *navMeshExpor
                 break;
             }
 
+            // Tiles point into the export when it is aligned for the tile data, the nav mesh does not free them
+            if (mode == NAVMESH_IMPORT_IN_PLACE && ((uintptr_t)bits & (TILE_DATA_ALIGNMENT - 1)) == 0)
+            {
+                navMesh->m_navMesh->addTile(bits, tileHeader.dataSize, 0, tileHeader.tileRef, 0);
+                bits += tileHeader.dataSize;
+                continue;
+            }
+
             unsigned char *data = (unsigned char *)dtAlloc(tileHeader.dataSize, DT_ALLOC_PERM);
             if (!data)
             {
@@ -96,34 +544,30 @@ NavMeshImporterResult NavMeshImporter::importNavMesh(NavMeshExport *navMeshExpor
             navMesh->addTile(navMeshData, DT_TILE_FREE_DATA, tileHeader.tileRef, nullptr);
         }
 
+        if (mode == NAVMESH_IMPORT_IN_PLACE)
+        {
+            navMesh->m_ownedData = navMeshExport->dataPointer;
+        }
+
         result.navMesh = navMesh;
     }
-    else if (recastHeader.magic == TILECACHESET_MAGIC)
+    else if (recastHeader.magic == TILECACHESET_MAGIC && mode != NAVMESH_IMPORT_IN_PLACE)
     {
-        if (recastHeader.version != TILECACHESET_VERSION)
+        auto read = [&](void *dest, const int readSize)
         {
-            return result;
-        }
+            memcpy(dest, bits, readSize);
+            bits += readSize;
+            return true;
+        };
 
-        TileCacheSetHeader header;
-        readLen = sizeof(TileCacheSetHeader);
-        memcpy(&header, bits, readLen);
-        bits += readLen;
-
-        NavMesh *navMesh = new NavMesh;
-        if (!navMesh->initTiled(&header.meshParams))
+        TileCacheSetHeaders headers;
+        if (!readTileCacheSetHeaders(recastHeader, read, headers) || !createTileCache(headers, *meshProcess, result))
         {
             return result;
         }
 
-        RecastLinearAllocator *allocator = new RecastLinearAllocator(32000);
-        RecastFastLZCompressor *compressor = new RecastFastLZCompressor;
-
-        TileCache *tileCache = new TileCache;
-        if (!tileCache->init(&header.cacheParams, allocator, compressor, meshProcess))
-        {
-            return result;
-        }
+        NavMesh *navMesh = result.navMesh;
+        TileCache *tileCache = result.tileCache;
 
         // Read tiles.
         for (int i = 0; i < recastHeader.numTiles; ++i)
@@ -165,29 +609,57 @@ NavMeshImporterResult NavMeshImporter::importNavMesh(NavMeshExport *navMeshExpor
                 tileCache->buildNavMeshTile(&addTileResult.tileRef, navMesh);
             }
         }
+    }
+    else if (recastHeader.magic == NAVMESHINDEX_MAGIC && mode == NAVMESH_IMPORT_COPY)
+    {
+        NavMeshIndexedImporter indexedImporter;
+        if (!indexedImporter.init(navMeshExport))
+        {
+            return result;
+        }
+
+        NavMesh *navMesh = indexedImporter.createNavMesh();
+        if (!navMesh)
+        {
+            return result;
+        }
+
+        for (int i = 0; i < indexedImporter.getTileCount(); ++i)
+        {
+            indexedImporter.loadTile(navMesh, i);
+        }
 
         result.navMesh = navMesh;
-        result.tileCache = tileCache;
-        result.allocator = allocator;
-        result.compressor = compressor;
+    }
+    else
+    {
+        return result;
     }
 
     result.success = true;
     return result;
 }
 
-NavMeshExport NavMeshExporter::exportNavMesh(NavMesh *navMesh, TileCache *tileCache) const
+// Writes the export sequentially, or only measures it when bits is null
+struct NavMeshExportWriter
 {
-    if (!navMesh->m_navMesh)
+    unsigned char *bits;
+    size_t size;
+
+    void write(const void *data, const size_t len)
     {
-        return {0, 0};
+        if (bits)
+        {
+            memcpy(&bits[size], data, len);
+        }
+        size += len;
     }
+};
 
-    unsigned char *bits = nullptr;
-    size_t bitsSize = 0;
-
+static void writeNavMeshExport(NavMesh *navMesh, TileCache *tileCache, NavMeshExportWriter &writer)
+{
     const dtNavMesh *m_navMesh = navMesh->m_navMesh;
-    const dtTileCache *m_tileCache = tileCache->m_tileCache;
+    const dtTileCache *m_tileCache = tileCache ? tileCache->m_tileCache : 0;
 
     if (m_tileCache)
     {
@@ -208,13 +680,16 @@ NavMeshExport NavMeshExporter::exportNavMesh(NavMesh *navMesh, TileCache *tileCa
         memcpy(&header.cacheParams, m_tileCache->getParams(), sizeof(dtTileCacheParams));
         memcpy(&header.meshParams, m_navMesh->getParams(), sizeof(dtNavMeshParams));
 
-        bits = (unsigned char *)realloc(bits, bitsSize + sizeof(RecastHeader));
-        memcpy(&bits[bitsSize], &recastHeader, sizeof(RecastHeader));
-        bitsSize += sizeof(RecastHeader);
+        writer.write(&recastHeader, sizeof(RecastHeader));
+        writer.write(&header, sizeof(TileCacheSetHeader));
+
+        TileCacheSetCompressionHeader compressionHeader;
+        compressionHeader.compressorType = tileCache->getCompressorType();
+        writer.write(&compressionHeader, sizeof(TileCacheSetCompressionHeader));
 
-        bits = (unsigned char *)realloc(bits, bitsSize + sizeof(TileCacheSetHeader));
-        memcpy(&bits[bitsSize], &header, sizeof(TileCacheSetHeader));
-        bitsSize += sizeof(TileCacheSetHeader);
+        TileCacheSetAllocatorHeader allocatorHeader;
+        allocatorHeader.allocatorSize = tileCache->getAllocatorHighWaterMark();
+        writer.write(&allocatorHeader, sizeof(TileCacheSetAllocatorHeader));
 
         // Store tiles.
         for (int i = 0; i < m_tileCache->getTileCount(); ++i)
@@ -227,13 +702,8 @@ NavMeshExport NavMeshExporter::exportNavMesh(NavMesh *navMesh, TileCache *tileCa
             tileHeader.tileRef = m_tileCache->getTileRef(tile);
             tileHeader.dataSize = tile->dataSize;
 
-            bits = (unsigned char *)realloc(bits, bitsSize + sizeof(tileHeader));
-            memcpy(&bits[bitsSize], &tileHeader, sizeof(tileHeader));
-            bitsSize += sizeof(tileHeader);
-
-            bits = (unsigned char *)realloc(bits, bitsSize + tile->dataSize);
-            memcpy(&bits[bitsSize], tile->data, tile->dataSize);
-            bitsSize += tile->dataSize;
+            writer.write(&tileHeader, sizeof(tileHeader));
+            writer.write(tile->data, tile->dataSize);
         }
     }
     else
@@ -253,13 +723,9 @@ NavMeshExport NavMeshExporter::exportNavMesh(NavMesh *navMesh, TileCache *tileCa
             recastHeader.numTiles++;
         }
         memcpy(&header.params, m_navMesh->getParams(), sizeof(dtNavMeshParams));
-        bits = (unsigned char *)realloc(bits, bitsSize + sizeof(RecastHeader));
-        memcpy(&bits[bitsSize], &recastHeader, sizeof(RecastHeader));
-        bitsSize += sizeof(RecastHeader);
 
-        bits = (unsigned char *)realloc(bits, bitsSize + sizeof(NavMeshSetHeader));
-        memcpy(&bits[bitsSize], &header, sizeof(NavMeshSetHeader));
-        bitsSize += sizeof(NavMeshSetHeader);
+        writer.write(&recastHeader, sizeof(RecastHeader));
+        writer.write(&header, sizeof(NavMeshSetHeader));
 
         // Store tiles.
         for (int i = 0; i < m_navMesh->getMaxTiles(); ++i)
@@ -272,19 +738,287 @@ NavMeshExport NavMeshExporter::exportNavMesh(NavMesh *navMesh, TileCache *tileCa
             tileHeader.tileRef = m_navMesh->getTileRef(tile);
             tileHeader.dataSize = tile->dataSize;
 
-            bits = (unsigned char *)realloc(bits, bitsSize + sizeof(tileHeader));
-            memcpy(&bits[bitsSize], &tileHeader, sizeof(tileHeader));
-            bitsSize += sizeof(tileHeader);
+            writer.write(&tileHeader, sizeof(tileHeader));
+            writer.write(tile->data, tile->dataSize);
+        }
+    }
+}
+
+int NavMeshExporter::getExportSize(NavMesh *navMesh, TileCache *tileCache) const
+{
+    if (!navMesh->m_navMesh)
+    {
+        return 0;
+    }
+
+    NavMeshExportWriter writer = {0, 0};
+    writeNavMeshExport(navMesh, tileCache, writer);
+
+    return int(writer.size);
+}
+
+NavMeshExport NavMeshExporter::exportNavMesh(NavMesh *navMesh, TileCache *tileCache) const
+{
+    const int size = getExportSize(navMesh, tileCache);
+    if (!size)
+    {
+        return {0, 0};
+    }
+
+    // Sized up front, the export is written in a single pass without reallocating
+    NavMeshExportWriter writer = {(unsigned char *)malloc(size), 0};
+    if (!writer.bits)
+    {
+        return {0, 0};
+    }
+
+    writeNavMeshExport(navMesh, tileCache, writer);
+
+    NavMeshExport navMeshExport;
+    navMeshExport.dataPointer = writer.bits;
+    navMeshExport.size = int(writer.size);
+
+    return navMeshExport;
+}
+
+int NavMeshExporter::exportNavMeshInto(NavMesh *navMesh, TileCache *tileCache, UnsignedCharArray *output) const
+{
+    const int size = getExportSize(navMesh, tileCache);
+    if (!size)
+    {
+        return 0;
+    }
+
+    // Reuses the array when it is large enough, views have no known size and are replaced
+    if (output->size < size)
+    {
+        output->resize(size);
+    }
+
+    NavMeshExportWriter writer = {output->data, 0};
+    writeNavMeshExport(navMesh, tileCache, writer);
 
-            bits = (unsigned char *)realloc(bits, bitsSize + tile->dataSize);
-            memcpy(&bits[bitsSize], tile->data, tile->dataSize);
-            bitsSize += tile->dataSize;
+    return int(writer.size);
+}
+
+NavMeshDeltaTracker::NavMeshDeltaTracker(NavMesh *navMesh) : m_navMesh(navMesh), m_snapshotId(0)
+{
+    const dtNavMesh *detourNavMesh = navMesh->m_navMesh;
+    m_refs.resize(detourNavMesh->getMaxTiles(), 0);
+    m_changedAt.resize(detourNavMesh->getMaxTiles(), 0);
+
+    for (int i = 0; i < detourNavMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = detourNavMesh->getTile(i);
+        if (tile && tile->header)
+        {
+            m_refs[i] = detourNavMesh->getTileRef(tile);
+        }
+    }
+}
+
+int NavMeshDeltaTracker::snapshot()
+{
+    const dtNavMesh *navMesh = m_navMesh->m_navMesh;
+    const int nextSnapshotId = m_snapshotId + 1;
+    bool changed = false;
+
+    for (int i = 0; i < (int)m_refs.size(); ++i)
+    {
+        const dtMeshTile *tile = navMesh->getTile(i);
+        const dtTileRef ref = tile && tile->header ? navMesh->getTileRef(tile) : 0;
+        if (ref != m_refs[i])
+        {
+            m_refs[i] = ref;
+            m_changedAt[i] = nextSnapshotId;
+            changed = true;
+        }
+    }
+
+    if (changed)
+    {
+        m_snapshotId = nextSnapshotId;
+    }
+
+    return m_snapshotId;
+}
+
+int NavMeshDeltaTracker::getSnapshotId() const
+{
+    return m_snapshotId;
+}
+
+NavMeshExport NavMeshDeltaTracker::exportDelta(const int sinceSnapshotId)
+{
+    snapshot();
+
+    const dtNavMesh *navMesh = m_navMesh->m_navMesh;
+
+    RecastHeader recastHeader;
+    recastHeader.magic = NAVMESHDELTA_MAGIC;
+    recastHeader.version = NAVMESHDELTA_VERSION;
+    recastHeader.numTiles = 0;
+
+    size_t size = sizeof(RecastHeader) + sizeof(NavMeshDeltaHeader);
+    for (int i = 0; i < (int)m_refs.size(); ++i)
+    {
+        if (m_changedAt[i] <= sinceSnapshotId)
+            continue;
+
+        recastHeader.numTiles++;
+        size += sizeof(NavMeshDeltaTileHeader);
+        if (m_refs[i])
+        {
+            size += navMesh->getTile(i)->dataSize;
+        }
+    }
+
+    NavMeshExportWriter writer = {(unsigned char *)malloc(size), 0};
+    if (!writer.bits)
+    {
+        return {0, 0};
+    }
+
+    NavMeshDeltaHeader header;
+    header.fromSnapshotId = sinceSnapshotId;
+    header.toSnapshotId = m_snapshotId;
+
+    writer.write(&recastHeader, sizeof(RecastHeader));
+    writer.write(&header, sizeof(NavMeshDeltaHeader));
+
+    for (int i = 0; i < (int)m_refs.size(); ++i)
+    {
+        if (m_changedAt[i] <= sinceSnapshotId)
+            continue;
+
+        const dtMeshTile *tile = navMesh->getTile(i);
+
+        NavMeshDeltaTileHeader tileHeader;
+        tileHeader.tileIndex = i;
+        tileHeader.tileRef = m_refs[i];
+        tileHeader.dataSize = m_refs[i] ? tile->dataSize : 0;
+
+        writer.write(&tileHeader, sizeof(NavMeshDeltaTileHeader));
+        if (tileHeader.dataSize)
+        {
+            writer.write(tile->data, tile->dataSize);
         }
     }
 
+    NavMeshExport navMeshExport;
+    navMeshExport.dataPointer = writer.bits;
+    navMeshExport.size = int(writer.size);
+
+    return navMeshExport;
+}
+
+NavMeshExport NavMeshExporter::exportNavMeshIndexed(NavMesh *navMesh, RecastTileCacheCompressor *compressor) const
+{
+    const dtNavMesh *m_navMesh = navMesh->m_navMesh;
+    if (!m_navMesh)
+    {
+        return {0, 0};
+    }
+
+    const int compressorType = compressor ? compressor->getType() : int(TILECACHE_COMPRESSOR_NONE);
+
+    std::vector<NavMeshIndexEntry> entries;
+    std::vector<const unsigned char *> tileData;
+    // Compressed tiles, referenced by tileData
+    std::vector<unsigned char> compressed;
+    std::vector<int> compressedOffsets;
+
+    for (int i = 0; i < m_navMesh->getMaxTiles(); ++i)
+    {
+        const dtMeshTile *tile = m_navMesh->getTile(i);
+        if (!tile || !tile->header || !tile->dataSize)
+            continue;
+
+        NavMeshIndexEntry entry;
+        entry.x = tile->header->x;
+        entry.y = tile->header->y;
+        entry.layer = tile->header->layer;
+        entry.offset = int(entries.size());
+        entry.size = tile->dataSize;
+        entry.dataSize = tile->dataSize;
+        entry.tileRef = m_navMesh->getTileRef(tile);
+
+        if (compressorType != TILECACHE_COMPRESSOR_NONE)
+        {
+            const int compressedOffset = int(compressed.size());
+            compressed.resize(compressedOffset + compressor->maxCompressedSize(tile->dataSize));
+
+            int compressedSize = 0;
+            const dtStatus status = compressor->compress(tile->data, tile->dataSize, &compressed[compressedOffset], int(compressed.size()) - compressedOffset, &compressedSize);
+            if (dtStatusFailed(status))
+            {
+                return {0, 0};
+            }
+
+            compressed.resize(compressedOffset + compressedSize);
+            entry.size = compressedSize;
+            compressedOffsets.push_back(compressedOffset);
+        }
+
+        entries.push_back(entry);
+        tileData.push_back(tile->data);
+    }
+
+    // The compressed buffer may have moved while growing, resolve the tiles once it is complete
+    for (size_t i = 0; i < compressedOffsets.size(); ++i)
+    {
+        tileData[i] = &compressed[compressedOffsets[i]];
+    }
+
+    std::sort(entries.begin(), entries.end(), navMeshIndexEntryLess);
+
+    // Lay out the tiles after the directory, the offset held the tile's position in tileData until now
+    std::vector<const unsigned char *> tiles(entries.size());
+    int size = NAVMESHINDEX_DIRECTORY_OFFSET + int(entries.size() * sizeof(NavMeshIndexEntry));
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        tiles[i] = tileData[entries[i].offset];
+
+        size = (size + NAVMESHINDEX_ALIGNMENT - 1) & ~(NAVMESHINDEX_ALIGNMENT - 1);
+        entries[i].offset = size;
+        entries[i].checksum = navMeshIndexChecksum(tiles[i], entries[i].size);
+        size += entries[i].size;
+    }
+
+    unsigned char *bits = (unsigned char *)calloc(size, 1);
+    if (!bits)
+    {
+        return {0, 0};
+    }
+
+    RecastHeader recastHeader;
+    recastHeader.magic = NAVMESHINDEX_MAGIC;
+    recastHeader.version = NAVMESHINDEX_VERSION;
+    recastHeader.numTiles = int(entries.size());
+
+    NavMeshSetHeader header;
+    memcpy(&header.params, m_navMesh->getParams(), sizeof(dtNavMeshParams));
+
+    NavMeshIndexCompressionHeader compressionHeader;
+    compressionHeader.compressorType = compressorType;
+
+    NavMeshExportWriter writer = {bits, 0};
+    writer.write(&recastHeader, sizeof(RecastHeader));
+    writer.write(&header, sizeof(NavMeshSetHeader));
+    writer.write(&compressionHeader, sizeof(NavMeshIndexCompressionHeader));
+    if (!entries.empty())
+    {
+        writer.write(&entries[0], entries.size() * sizeof(NavMeshIndexEntry));
+    }
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        memcpy(&bits[entries[i].offset], tiles[i], entries[i].size);
+    }
+
     NavMeshExport navMeshExport;
     navMeshExport.dataPointer = bits;
-    navMeshExport.size = int(bitsSize);
+    navMeshExport.size = size;
 
     return navMeshExport;
 }
@@ -293,3 +1027,250 @@ void NavMeshExporter::freeNavMeshExport(NavMeshExport *navMeshExport)
 {
     free(navMeshExport->dataPointer);
 }
+
+bool NavMeshIndexedImporter::init(NavMeshExport *navMeshExport)
+{
+    m_data = 0;
+    m_size = 0;
+    m_tileCount = 0;
+
+    const unsigned char *bits = (const unsigned char *)navMeshExport->dataPointer;
+    if (!bits || navMeshExport->size < NAVMESHINDEX_DIRECTORY_OFFSET)
+    {
+        return false;
+    }
+
+    RecastHeader recastHeader;
+    memcpy(&recastHeader, bits, sizeof(RecastHeader));
+    if (recastHeader.magic != NAVMESHINDEX_MAGIC || recastHeader.version != NAVMESHINDEX_VERSION || recastHeader.numTiles < 0)
+    {
+        return false;
+    }
+
+    // Divided rather than multiplied, numTiles * sizeof(NavMeshIndexEntry) can overflow int
+    if ((size_t)recastHeader.numTiles > (size_t)(navMeshExport->size - NAVMESHINDEX_DIRECTORY_OFFSET) / sizeof(NavMeshIndexEntry))
+    {
+        return false;
+    }
+
+    NavMeshSetHeader header;
+    memcpy(&header, bits + sizeof(RecastHeader), sizeof(NavMeshSetHeader));
+
+    NavMeshIndexCompressionHeader compressionHeader;
+    memcpy(&compressionHeader, bits + sizeof(RecastHeader) + sizeof(NavMeshSetHeader), sizeof(NavMeshIndexCompressionHeader));
+    if (!RecastTileCacheCompressor::isValidType(compressionHeader.compressorType))
+    {
+        return false;
+    }
+
+    m_data = bits;
+    m_size = navMeshExport->size;
+    m_tileCount = recastHeader.numTiles;
+    m_params = header.params;
+    m_compressor = RecastTileCacheCompressor(compressionHeader.compressorType);
+
+    return true;
+}
+
+NavMesh *NavMeshIndexedImporter::createNavMesh() const
+{
+    if (!m_data)
+    {
+        return 0;
+    }
+
+    NavMesh *navMesh = new NavMesh;
+    if (!navMesh->initTiled(&m_params))
+    {
+        navMesh->destroy();
+        delete navMesh;
+        return 0;
+    }
+
+    return navMesh;
+}
+
+int NavMeshIndexedImporter::getTileCount() const
+{
+    return m_tileCount;
+}
+
+int NavMeshIndexedImporter::getCompressorType() const
+{
+    return m_compressor.getType();
+}
+
+static NavMeshIndexEntry readNavMeshIndexEntry(const unsigned char *data, const int index)
+{
+    NavMeshIndexEntry entry;
+    memcpy(&entry, data + NAVMESHINDEX_DIRECTORY_OFFSET + index * sizeof(NavMeshIndexEntry), sizeof(NavMeshIndexEntry));
+    return entry;
+}
+
+NavMeshIndexedTile NavMeshIndexedImporter::getTile(const int index) const
+{
+    NavMeshIndexedTile tile = {0, 0, 0, 0, 0};
+    if (index < 0 || index >= m_tileCount)
+    {
+        return tile;
+    }
+
+    const NavMeshIndexEntry entry = readNavMeshIndexEntry(m_data, index);
+    tile.x = entry.x;
+    tile.y = entry.y;
+    tile.layer = entry.layer;
+    tile.size = entry.size;
+    tile.dataSize = entry.dataSize;
+
+    return tile;
+}
+
+int NavMeshIndexedImporter::lowerBound(const int x, const int y, const int layer) const
+{
+    NavMeshIndexEntry key;
+    key.x = x;
+    key.y = y;
+    key.layer = layer;
+
+    // The directory is sorted, binary search it
+    int lo = 0;
+    int hi = m_tileCount;
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+        if (navMeshIndexEntryLess(readNavMeshIndexEntry(m_data, mid), key))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+int NavMeshIndexedImporter::findTile(const int x, const int y, const int layer) const
+{
+    const int index = lowerBound(x, y, layer);
+    if (index < m_tileCount)
+    {
+        const NavMeshIndexEntry entry = readNavMeshIndexEntry(m_data, index);
+        if (entry.x == x && entry.y == y && entry.layer == layer)
+        {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+bool NavMeshIndexedImporter::loadTile(NavMesh *navMesh, const int index)
+{
+    if (index < 0 || index >= m_tileCount)
+    {
+        return false;
+    }
+
+    const NavMeshIndexEntry entry = readNavMeshIndexEntry(m_data, index);
+    if (entry.size <= 0 || entry.dataSize <= 0 || entry.offset < 0 || entry.offset > m_size - entry.size)
+    {
+        return false;
+    }
+
+    // Uncompressed tiles are copied as they are
+    if (m_compressor.getType() == TILECACHE_COMPRESSOR_NONE && entry.size != entry.dataSize)
+    {
+        return false;
+    }
+
+    const unsigned char *tileData = m_data + entry.offset;
+    if (navMeshIndexChecksum(tileData, entry.size) != entry.checksum)
+    {
+        return false;
+    }
+
+    unsigned char *data = (unsigned char *)dtAlloc(entry.dataSize, DT_ALLOC_PERM);
+    if (!data)
+    {
+        return false;
+    }
+
+    // Tiles are only decompressed when they are loaded
+    if (m_compressor.getType() == TILECACHE_COMPRESSOR_NONE)
+    {
+        memcpy(data, tileData, entry.size);
+    }
+    else
+    {
+        int dataSize = 0;
+        const dtStatus status = m_compressor.decompress(tileData, entry.size, data, entry.dataSize, &dataSize);
+        if (dtStatusFailed(status) || dataSize != entry.dataSize)
+        {
+            dtFree(data);
+            return false;
+        }
+    }
+
+    const dtStatus status = navMesh->m_navMesh->addTile(data, entry.dataSize, DT_TILE_FREE_DATA, entry.tileRef, 0);
+    if (dtStatusFailed(status))
+    {
+        dtFree(data);
+        return false;
+    }
+
+    return true;
+}
+
+int NavMeshIndexedImporter::loadTilesInRange(NavMesh *navMesh, const int minx, const int miny, const int maxx, const int maxy)
+{
+    int loaded = 0;
+    if (!m_tileCount)
+    {
+        return loaded;
+    }
+
+    // Each row of tiles is contiguous in the directory
+    const int firstY = readNavMeshIndexEntry(m_data, 0).y;
+    const int lastY = readNavMeshIndexEntry(m_data, m_tileCount - 1).y;
+    for (int y = dtMax(miny, firstY); y <= dtMin(maxy, lastY); ++y)
+    {
+        for (int i = lowerBound(minx, y, INT_MIN); i < m_tileCount; ++i)
+        {
+            const NavMeshIndexEntry entry = readNavMeshIndexEntry(m_data, i);
+            if (entry.y != y || entry.x > maxx)
+                break;
+
+            // Skip tiles that are already loaded
+            if (navMesh->m_navMesh->getTileAt(entry.x, entry.y, entry.layer))
+                continue;
+
+            if (loadTile(navMesh, i))
+            {
+                loaded++;
+            }
+        }
+    }
+
+    return loaded;
+}
+
+int NavMeshIndexedImporter::loadTilesInBounds(NavMesh *navMesh, const float *bmin, const float *bmax)
+{
+    int minx, miny, maxx, maxy;
+    navMesh->m_navMesh->calcTileLoc(bmin, &minx, &miny);
+    navMesh->m_navMesh->calcTileLoc(bmax, &maxx, &maxy);
+
+    return loadTilesInRange(navMesh, minx, miny, maxx, maxy);
+}
+
+int NavMeshIndexedImporter::loadTilesAt(NavMesh *navMesh, const int *tileCoords, const int tileCount)
+{
+    int loaded = 0;
+
+    for (int i = 0; i < tileCount; ++i)
+    {
+        const int x = tileCoords[i * 2];
+        const int y = tileCoords[i * 2 + 1];
+        loaded += loadTilesInRange(navMesh, x, y, x, y);
+    }
+
+    return loaded;
+}
@@ -9,6 +9,9 @@
 #include "./Refs.h"
 #include "./NavMesh.h"
 #include "./TileCache.h"
+#include "./TileCacheStreamer.h"
+
+#include <vector>
 
 struct NavMeshExport
 {
@@ -21,17 +24,44 @@ class NavMeshExporter
 public:
     NavMeshExporter() {}
 
+    // Exact size of the export in bytes
+    int getExportSize(NavMesh *navMesh, TileCache *tileCache) const;
+
     NavMeshExport exportNavMesh(NavMesh *navMesh, TileCache *tileCache) const;
+
+    // Exports a nav mesh with a tile directory and aligned tiles, see NavMeshIndexedImporter.
+    // Tiles are compressed one by one with the compressor, or stored as is when it is null.
+    NavMeshExport exportNavMeshIndexed(NavMesh *navMesh, RecastTileCacheCompressor *compressor) const;
+
+    // Writes the export into the array, growing it only when it is too small. Returns the export size.
+    int exportNavMeshInto(NavMesh *navMesh, TileCache *tileCache, UnsignedCharArray *output) const;
     void freeNavMeshExport(NavMeshExport *navMeshExport);
 };
 
+struct NavMeshDeltaApplyResult
+{
+    bool success;
+    // Snapshot id the nav mesh is at after applying the delta
+    int snapshotId;
+    int added;
+    int removed;
+};
+
 struct NavMeshImporterResult
 {
     bool success;
     NavMesh *navMesh;
     TileCache *tileCache;
     RecastLinearAllocator *allocator;
-    RecastFastLZCompressor *compressor;
+    RecastTileCacheCompressor *compressor;
+    // Holds the tiles of a streamed tile cache import, otherwise null
+    TileCacheStreamer *streamer;
+};
+
+enum NavMeshImportMode
+{
+    NAVMESH_IMPORT_COPY,
+    NAVMESH_IMPORT_IN_PLACE,
 };
 
 class NavMeshImporter
@@ -40,4 +70,99 @@ public:
     NavMeshImporter() {}
 
     NavMeshImporterResult importNavMesh(NavMeshExport *navMeshExport, TileCacheMeshProcessJsImpl &meshProcess);
+
+    // Imports a nav mesh export without copying the tiles, they point into the export data.
+    // The nav mesh takes ownership of the data, which must be malloc'd, and frees it when destroyed.
+    NavMeshImporterResult importNavMeshInPlace(NavMeshExport *navMeshExport);
+
+    // Applies a delta from NavMeshDeltaTracker::exportDelta to a nav mesh with the same tile layout as the tracked one,
+    // such as an import of an export of it. Tiles keep their refs, so poly refs stay in sync.
+    // snapshotId is the snapshot the nav mesh is at, the delta must have been exported since it.
+    // The whole delta is validated first, and the nav mesh is left unchanged when it can't be applied.
+    NavMeshDeltaApplyResult applyNavMeshDelta(NavMesh *navMesh, NavMeshExport *delta, const int snapshotId);
+
+    // Imports a tile cache export of size bytes without adding any tiles, they are handed to a TileCacheStreamer that loads them on demand.
+    // Only the headers are read from the source here, it must stay alive for the streamer to read tiles from.
+    NavMeshImporterResult importTileCacheStreaming(TileCacheStreamerSourceJsImpl &source, const int size, TileCacheMeshProcessJsImpl &meshProcess);
+
+protected:
+    NavMeshImporterResult importExport(NavMeshExport *navMeshExport, TileCacheMeshProcessJsImpl *meshProcess, const NavMeshImportMode mode);
+};
+
+struct NavMeshIndexedTile
+{
+    int x;
+    int y;
+    int layer;
+    // Size of the tile in the export, compressed if the export is
+    int size;
+    // Size of the tile once loaded
+    int dataSize;
+};
+
+// Loads single tiles or regions of a nav mesh indexed export, without reading the tiles before them.
+// The export data is not copied, it must stay alive while tiles are loaded.
+class NavMeshIndexedImporter
+{
+public:
+    NavMeshIndexedImporter() : m_data(0), m_size(0), m_tileCount(0) {}
+
+    // Reads the header and tile directory.
+    bool init(NavMeshExport *navMeshExport);
+
+    // Creates an empty nav mesh with the export's params, for tiles to be loaded into.
+    NavMesh *createNavMesh() const;
+
+    int getTileCount() const;
+
+    int getCompressorType() const;
+
+    NavMeshIndexedTile getTile(const int index) const;
+
+    // Returns the directory index of a tile, or -1 if the export has no such tile.
+    int findTile(const int x, const int y, const int layer) const;
+
+    // Copies or decompresses a tile into the nav mesh. Fails if the tile fails its checksum or its location is occupied.
+    bool loadTile(NavMesh *navMesh, const int index);
+
+    // Loads every layer of the tiles overlapping the bounds on the xz plane. Returns the number of tiles loaded.
+    int loadTilesInBounds(NavMesh *navMesh, const float *bmin, const float *bmax);
+
+    // Loads every layer at tileCount xy tile coordinates. Returns the number of tiles loaded.
+    int loadTilesAt(NavMesh *navMesh, const int *tileCoords, const int tileCount);
+
+protected:
+    int lowerBound(const int x, const int y, const int layer) const;
+    int loadTilesInRange(NavMesh *navMesh, const int minx, const int miny, const int maxx, const int maxy);
+
+    const unsigned char *m_data;
+    int m_size;
+    int m_tileCount;
+    dtNavMeshParams m_params;
+    RecastTileCacheCompressor m_compressor;
+};
+
+// Tracks which nav mesh tiles change between snapshots, so clients can be sent only the tiles that changed.
+// Changes are detected by tile ref, which changes whenever a tile is removed, added, or rebuilt.
+// Poly flag and area changes don't change tile refs and are not tracked.
+class NavMeshDeltaTracker
+{
+public:
+    // The tiles the nav mesh has now are snapshot 0
+    NavMeshDeltaTracker(NavMesh *navMesh);
+
+    // Records tile changes since the last snapshot. Returns the new snapshot id, which only advances when tiles changed.
+    int snapshot();
+
+    int getSnapshotId() const;
+
+    // Takes a snapshot, then exports the tiles added, replaced, or removed after sinceSnapshotId.
+    NavMeshExport exportDelta(const int sinceSnapshotId);
+
+protected:
+    NavMesh *m_navMesh;
+    int m_snapshotId;
+    // Per tile slot, the tile ref as of the last snapshot, and the snapshot it last changed in
+    std::vector<dtTileRef> m_refs;
+    std::vector<int> m_changedAt;
 };
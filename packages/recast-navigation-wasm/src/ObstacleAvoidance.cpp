@@ -0,0 +1,430 @@
+#include "./ObstacleAvoidance.h"
+
+#include <float.h>
+#include <math.h>
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+static const float DT_PI = 3.14159265f;
+
+// Four lane float vector. Every operation is a plain IEEE float operation per lane so lanes
+// produce exactly what the scalar implementation computes for the same candidate.
+#ifdef __wasm_simd128__
+
+struct Float4
+{
+    v128_t v;
+};
+
+typedef v128_t Mask4;
+
+static inline Float4 f4(const float x) { return {wasm_f32x4_splat(x)}; }
+static inline Float4 f4load(const float *p) { return {wasm_v128_load(p)}; }
+static inline void f4store(float *p, const Float4 a) { wasm_v128_store(p, a.v); }
+static inline Float4 operator+(const Float4 a, const Float4 b) { return {wasm_f32x4_add(a.v, b.v)}; }
+static inline Float4 operator-(const Float4 a, const Float4 b) { return {wasm_f32x4_sub(a.v, b.v)}; }
+static inline Float4 operator*(const Float4 a, const Float4 b) { return {wasm_f32x4_mul(a.v, b.v)}; }
+static inline Float4 operator/(const Float4 a, const Float4 b) { return {wasm_f32x4_div(a.v, b.v)}; }
+static inline Float4 operator-(const Float4 a) { return {wasm_f32x4_neg(a.v)}; }
+static inline Float4 f4sqrt(const Float4 a) { return {wasm_f32x4_sqrt(a.v)}; }
+static inline Float4 f4abs(const Float4 a) { return {wasm_f32x4_abs(a.v)}; }
+static inline Mask4 operator<(const Float4 a, const Float4 b) { return wasm_f32x4_lt(a.v, b.v); }
+static inline Mask4 operator>(const Float4 a, const Float4 b) { return wasm_f32x4_gt(a.v, b.v); }
+static inline Mask4 operator>=(const Float4 a, const Float4 b) { return wasm_f32x4_ge(a.v, b.v); }
+static inline Mask4 operator<=(const Float4 a, const Float4 b) { return wasm_f32x4_le(a.v, b.v); }
+static inline Mask4 maskAnd(const Mask4 a, const Mask4 b) { return wasm_v128_and(a, b); }
+static inline bool maskAny(const Mask4 a) { return wasm_v128_any_true(a); }
+static inline Float4 select(const Mask4 m, const Float4 a, const Float4 b) { return {wasm_v128_bitselect(a.v, b.v, m)}; }
+
+#else
+
+struct Float4
+{
+    float v[4];
+};
+
+struct Mask4
+{
+    bool m[4];
+};
+
+#define F4_UNARY(expr)          \
+    Float4 r;                   \
+    for (int i = 0; i < 4; i++) \
+        r.v[i] = expr;          \
+    return r;
+
+#define F4_COMPARE(op)                 \
+    Mask4 r;                           \
+    for (int i = 0; i < 4; i++)        \
+        r.m[i] = a.v[i] op b.v[i];     \
+    return r;
+
+static inline Float4 f4(const float x) { F4_UNARY(x) }
+static inline Float4 f4load(const float *p) { F4_UNARY(p[i]) }
+static inline void f4store(float *p, const Float4 a)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = a.v[i];
+}
+static inline Float4 operator+(const Float4 a, const Float4 b) { F4_UNARY(a.v[i] + b.v[i]) }
+static inline Float4 operator-(const Float4 a, const Float4 b) { F4_UNARY(a.v[i] - b.v[i]) }
+static inline Float4 operator*(const Float4 a, const Float4 b) { F4_UNARY(a.v[i] * b.v[i]) }
+static inline Float4 operator/(const Float4 a, const Float4 b) { F4_UNARY(a.v[i] / b.v[i]) }
+static inline Float4 operator-(const Float4 a) { F4_UNARY(-a.v[i]) }
+static inline Float4 f4sqrt(const Float4 a) { F4_UNARY(sqrtf(a.v[i])) }
+static inline Float4 f4abs(const Float4 a) { F4_UNARY(fabsf(a.v[i])) }
+static inline Mask4 operator<(const Float4 a, const Float4 b) { F4_COMPARE(<) }
+static inline Mask4 operator>(const Float4 a, const Float4 b) { F4_COMPARE(>) }
+static inline Mask4 operator>=(const Float4 a, const Float4 b) { F4_COMPARE(>=) }
+static inline Mask4 operator<=(const Float4 a, const Float4 b) { F4_COMPARE(<=) }
+static inline Mask4 maskAnd(const Mask4 a, const Mask4 b)
+{
+    Mask4 r;
+    for (int i = 0; i < 4; i++)
+        r.m[i] = a.m[i] && b.m[i];
+    return r;
+}
+static inline bool maskAny(const Mask4 a) { return a.m[0] || a.m[1] || a.m[2] || a.m[3]; }
+static inline Float4 select(const Mask4 m, const Float4 a, const Float4 b) { F4_UNARY(m.m[i] ? a.v[i] : b.v[i]) }
+
+#undef F4_UNARY
+#undef F4_COMPARE
+
+#endif
+
+// dtMin and dtClamp, including which operand wins a tie
+static inline Float4 f4min(const Float4 a, const Float4 b) { return select(a < b, a, b); }
+static inline Float4 f4clamp01(const Float4 v) { return select(v < f4(0.0f), f4(0.0f), select(v > f4(1.0f), f4(1.0f), v)); }
+
+static void normalize2D(float *v)
+{
+    float d = dtMathSqrtf(v[0] * v[0] + v[2] * v[2]);
+    if (d == 0)
+        return;
+    d = 1.0f / d;
+    v[0] *= d;
+    v[2] *= d;
+}
+
+static void rotate2D(float *dest, const float *v, float ang)
+{
+    float c = cosf(ang);
+    float s = sinf(ang);
+    dest[0] = v[0] * c - v[2] * s;
+    dest[2] = v[0] * s + v[2] * c;
+    dest[1] = v[1];
+}
+
+bool ObstacleAvoidanceSampler::isSimdBuild()
+{
+#ifdef __wasm_simd128__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ObstacleAvoidanceSampler::prepare(dtObstacleAvoidanceQuery *query, const float *pos, const float rad, const float *dvel)
+{
+    m_ncircles = query->getObstacleCircleCount();
+    m_circleSx.resize(m_ncircles);
+    m_circleSz.resize(m_ncircles);
+    m_circleC.resize(m_ncircles);
+    m_circleVx.resize(m_ncircles);
+    m_circleVz.resize(m_ncircles);
+    m_circleDpx.resize(m_ncircles);
+    m_circleDpz.resize(m_ncircles);
+    m_circleNpx.resize(m_ncircles);
+    m_circleNpz.resize(m_ncircles);
+
+    for (int i = 0; i < m_ncircles; ++i)
+    {
+        const dtObstacleCircle *cir = query->getObstacleCircle(i);
+
+        // Side
+        const float orig[3] = {0, 0, 0};
+        float dp[3], dv[3];
+        dtVsub(dp, cir->p, pos);
+        dtVnormalize(dp);
+        dtVsub(dv, cir->dvel, dvel);
+
+        const float a = dtTriArea2D(orig, dp, dv);
+        if (a < 0.01f)
+        {
+            m_circleNpx[i] = -dp[2];
+            m_circleNpz[i] = dp[0];
+        }
+        else
+        {
+            m_circleNpx[i] = dp[2];
+            m_circleNpz[i] = -dp[0];
+        }
+        m_circleDpx[i] = dp[0];
+        m_circleDpz[i] = dp[2];
+
+        // Candidate independent terms of the circle sweep
+        float s[3];
+        dtVsub(s, cir->p, pos);
+        const float r = rad + cir->rad;
+        m_circleSx[i] = s[0];
+        m_circleSz[i] = s[2];
+        m_circleC[i] = dtVdot2D(s, s) - r * r;
+
+        m_circleVx[i] = cir->vel[0];
+        m_circleVz[i] = cir->vel[2];
+    }
+
+    m_nsegments = query->getObstacleSegmentCount();
+    m_segmentTouch.resize(m_nsegments);
+    m_segmentVx.resize(m_nsegments);
+    m_segmentVz.resize(m_nsegments);
+    m_segmentWx.resize(m_nsegments);
+    m_segmentWz.resize(m_nsegments);
+    m_segmentPerpVW.resize(m_nsegments);
+
+    for (int i = 0; i < m_nsegments; ++i)
+    {
+        const dtObstacleSegment *seg = query->getObstacleSegment(i);
+
+        // Precalc if the agent is really close to the segment.
+        const float r = 0.01f;
+        float t;
+        m_segmentTouch[i] = dtDistancePtSegSqr2D(pos, seg->p, seg->q, t) < dtSqr(r);
+
+        float v[3], w[3];
+        dtVsub(v, seg->q, seg->p);
+        dtVsub(w, pos, seg->p);
+        m_segmentVx[i] = v[0];
+        m_segmentVz[i] = v[2];
+        m_segmentWx[i] = w[0];
+        m_segmentWz[i] = w[2];
+        m_segmentPerpVW[i] = dtVperp2D(v, w);
+    }
+}
+
+void ObstacleAvoidanceSampler::processSamples(const float *vcandX, const float *vcandZ, const int count,
+                                              const float *vel, const float *dvel, const dtObstacleAvoidanceParams *params,
+                                              const float invVmax, float *penalties) const
+{
+    const float invHorizTime = 1.0f / params->horizTime;
+
+    for (int i = 0; i < count; i += 4)
+    {
+        const Float4 vcx = f4load(vcandX + i);
+        const Float4 vcz = f4load(vcandZ + i);
+
+        // penalty for straying away from the desired and current velocities
+        const Float4 ddx = f4(dvel[0]) - vcx;
+        const Float4 ddz = f4(dvel[2]) - vcz;
+        const Float4 vpen = f4(params->weightDesVel) * (f4sqrt(ddx * ddx + ddz * ddz) * f4(invVmax));
+        const Float4 dcx = f4(vel[0]) - vcx;
+        const Float4 dcz = f4(vel[2]) - vcz;
+        const Float4 vcpen = f4(params->weightCurVel) * (f4sqrt(dcx * dcx + dcz * dcz) * f4(invVmax));
+
+        // Find min time of impact and exit amongst all obstacles.
+        Float4 tmin = f4(params->horizTime);
+        Float4 side = f4(0.0f);
+
+        for (int j = 0; j < m_ncircles; ++j)
+        {
+            // RVO
+            const Float4 vabx = vcx * f4(2.0f) - f4(vel[0]) - f4(m_circleVx[j]);
+            const Float4 vabz = vcz * f4(2.0f) - f4(vel[2]) - f4(m_circleVz[j]);
+
+            // Side
+            const Float4 dpDot = f4(m_circleDpx[j]) * vabx + f4(m_circleDpz[j]) * vabz;
+            const Float4 npDot = f4(m_circleNpx[j]) * vabx + f4(m_circleNpz[j]) * vabz;
+            side = side + f4clamp01(f4min(dpDot * f4(0.5f) + f4(0.5f), npDot * f4(2.0f)));
+
+            // Sweep circle against circle
+            static const float EPS = 0.0001f;
+            const Float4 a = vabx * vabx + vabz * vabz;
+            const Float4 b = vabx * f4(m_circleSx[j]) + vabz * f4(m_circleSz[j]);
+            const Float4 d = b * b - a * f4(m_circleC[j]);
+            const Mask4 hit = maskAnd(a >= f4(EPS), d >= f4(0.0f));
+            if (!maskAny(hit))
+                continue;
+
+            const Float4 ia = f4(1.0f) / a;
+            const Float4 rd = f4sqrt(select(hit, d, f4(0.0f)));
+            Float4 htmin = (b - rd) * ia;
+            const Float4 htmax = (b + rd) * ia;
+
+            // Handle overlapping obstacles, avoid more when overlapped.
+            htmin = select(maskAnd(htmin < f4(0.0f), htmax > f4(0.0f)), -htmin * f4(0.5f), htmin);
+
+            // The closest obstacle is somewhere ahead of us, keep track of nearest obstacle.
+            tmin = select(maskAnd(hit, maskAnd(htmin >= f4(0.0f), htmin < tmin)), htmin, tmin);
+        }
+
+        for (int j = 0; j < m_nsegments; ++j)
+        {
+            Mask4 hit;
+            Float4 htmin;
+
+            if (m_segmentTouch[j])
+            {
+                // Special case when the agent is very close to the segment.
+                // If the velocity is pointing towards the segment, no collision, else immediate collision.
+                const Float4 normalDot = f4(-m_segmentVz[j]) * vcx + f4(m_segmentVx[j]) * vcz;
+                hit = normalDot >= f4(0.0f);
+                htmin = f4(0.0f);
+            }
+            else
+            {
+                // Ray against segment
+                const Float4 d = vcz * f4(m_segmentVx[j]) - vcx * f4(m_segmentVz[j]);
+                const Mask4 nonParallel = f4abs(d) >= f4(1e-6f);
+                if (!maskAny(nonParallel))
+                    continue;
+
+                const Float4 id = f4(1.0f) / select(nonParallel, d, f4(1.0f));
+                const Float4 t = f4(m_segmentPerpVW[j]) * id;
+                const Float4 s = (vcz * f4(m_segmentWx[j]) - vcx * f4(m_segmentWz[j])) * id;
+                hit = maskAnd(nonParallel, maskAnd(maskAnd(t >= f4(0.0f), t <= f4(1.0f)), maskAnd(s >= f4(0.0f), s <= f4(1.0f))));
+                htmin = t;
+            }
+
+            // Avoid less when facing walls.
+            htmin = htmin * f4(2.0f);
+
+            tmin = select(maskAnd(hit, htmin < tmin), htmin, tmin);
+        }
+
+        // Normalize side bias, to prevent it dominating too much.
+        if (m_ncircles)
+            side = side / f4((float)m_ncircles);
+
+        const Float4 spen = f4(params->weightSide) * side;
+        const Float4 tpen = f4(params->weightToi) * (f4(1.0f) / (f4(0.1f) + tmin * f4(invHorizTime)));
+
+        f4store(penalties + i, vpen + vcpen + spen + tpen);
+    }
+}
+
+int ObstacleAvoidanceSampler::sampleVelocityAdaptive(dtObstacleAvoidanceQuery *query, const float *pos, const float rad, const float vmax,
+                                                     const float *vel, const float *dvel, float *nvel,
+                                                     const dtObstacleAvoidanceParams *params, dtObstacleAvoidanceDebugData *debug)
+{
+    const int nd = dtClamp((int)params->adaptiveDivs, 1, DT_MAX_PATTERN_DIVS);
+    const int nr = dtClamp((int)params->adaptiveRings, 1, DT_MAX_PATTERN_RINGS);
+    const int depth = (int)params->adaptiveDepth;
+
+    // Debug samples are recorded by the scalar implementation, and it builds even division patterns differently
+    if (debug || (nd & 1) == 0)
+    {
+        return query->sampleVelocityAdaptive(pos, rad, vmax, vel, dvel, nvel, params, debug);
+    }
+
+    prepare(query, pos, rad, dvel);
+
+    const float invVmax = vmax > 0 ? 1.0f / vmax : FLT_MAX;
+
+    dtVset(nvel, 0, 0, 0);
+
+    // Build sampling pattern aligned to desired velocity.
+    static const int MAX_PATTERN = DT_MAX_PATTERN_DIVS * DT_MAX_PATTERN_RINGS + 1;
+    float pat[MAX_PATTERN * 2];
+    int npat = 0;
+
+    const float da = (1.0f / nd) * DT_PI * 2;
+    const float ca = cosf(da);
+    const float sa = sinf(da);
+
+    // desired direction
+    float ddir[6];
+    dtVcopy(ddir, dvel);
+    normalize2D(ddir);
+    rotate2D(ddir + 3, ddir, da * 0.5f); // rotated by da/2
+
+    // Always add sample at zero
+    pat[npat * 2 + 0] = 0;
+    pat[npat * 2 + 1] = 0;
+    npat++;
+
+    for (int j = 0; j < nr; ++j)
+    {
+        const float r = (float)(nr - j) / (float)nr;
+        pat[npat * 2 + 0] = ddir[(j % 2) * 3] * r;
+        pat[npat * 2 + 1] = ddir[(j % 2) * 3 + 2] * r;
+        float *last1 = pat + npat * 2;
+        float *last2 = last1;
+        npat++;
+
+        for (int i = 1; i < nd - 1; i += 2)
+        {
+            // get next point on the "right" (rotate CW)
+            pat[npat * 2 + 0] = last1[0] * ca + last1[1] * sa;
+            pat[npat * 2 + 1] = -last1[0] * sa + last1[1] * ca;
+            // get next point on the "left" (rotate CCW)
+            pat[npat * 2 + 2] = last2[0] * ca - last2[1] * sa;
+            pat[npat * 2 + 3] = last2[0] * sa + last2[1] * ca;
+
+            last1 = pat + npat * 2;
+            last2 = last1 + 2;
+            npat += 2;
+        }
+    }
+
+    // Candidates are scored in groups of four, pad to a multiple of the lane count
+    static const int MAX_CANDIDATES = (MAX_PATTERN + 3) & ~3;
+    float vcandX[MAX_CANDIDATES], vcandZ[MAX_CANDIDATES], penalties[MAX_CANDIDATES];
+    bool inRange[MAX_CANDIDATES];
+    const int paddedCount = (npat + 3) & ~3;
+
+    // Start sampling.
+    float cr = vmax * (1.0f - params->velBias);
+    float res[3];
+    dtVset(res, dvel[0] * params->velBias, 0, dvel[2] * params->velBias);
+    int ns = 0;
+
+    for (int k = 0; k < depth; ++k)
+    {
+        for (int i = 0; i < paddedCount; ++i)
+        {
+            if (i < npat)
+            {
+                vcandX[i] = res[0] + pat[i * 2 + 0] * cr;
+                vcandZ[i] = res[2] + pat[i * 2 + 1] * cr;
+                inRange[i] = !(dtSqr(vcandX[i]) + dtSqr(vcandZ[i]) > dtSqr(vmax + 0.001f));
+            }
+            else
+            {
+                vcandX[i] = 0;
+                vcandZ[i] = 0;
+                inRange[i] = false;
+            }
+        }
+
+        processSamples(vcandX, vcandZ, paddedCount, vel, dvel, params, invVmax, penalties);
+
+        // Pick the first lowest penalty in pattern order, as the scalar implementation does
+        float minPenalty = FLT_MAX;
+        float bvel[3];
+        dtVset(bvel, 0, 0, 0);
+
+        for (int i = 0; i < npat; ++i)
+        {
+            if (!inRange[i])
+                continue;
+
+            ns++;
+            if (penalties[i] < minPenalty)
+            {
+                minPenalty = penalties[i];
+                dtVset(bvel, vcandX[i], 0, vcandZ[i]);
+            }
+        }
+
+        dtVcopy(res, bvel);
+
+        cr *= 0.5f;
+    }
+
+    dtVcopy(nvel, res);
+
+    return ns;
+}
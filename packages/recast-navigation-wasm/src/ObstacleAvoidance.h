@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../recastnavigation/Detour/Include/DetourCommon.h"
+#include "../recastnavigation/DetourCrowd/Include/DetourObstacleAvoidance.h"
+
+#include <vector>
+
+// Reimplements dtObstacleAvoidanceQuery::sampleVelocityAdaptive, scoring four candidate velocities at a time
+// against packed copies of the query's obstacles. Uses wasm simd128 when built with -msimd128.
+// Chosen velocities match the scalar implementation, which is still used when debug data is requested
+// or for even division counts.
+class ObstacleAvoidanceSampler
+{
+public:
+    int sampleVelocityAdaptive(dtObstacleAvoidanceQuery *query, const float *pos, const float rad, const float vmax,
+                               const float *vel, const float *dvel, float *nvel,
+                               const dtObstacleAvoidanceParams *params, dtObstacleAvoidanceDebugData *debug);
+
+    static bool isSimdBuild();
+
+private:
+    void prepare(dtObstacleAvoidanceQuery *query, const float *pos, const float rad, const float *dvel);
+
+    void processSamples(const float *vcandX, const float *vcandZ, const int count,
+                        const float *vel, const float *dvel, const dtObstacleAvoidanceParams *params,
+                        const float invVmax, float *penalties) const;
+
+    // Circles, as structure of arrays with the per-circle terms precomputed
+    int m_ncircles;
+    std::vector<float> m_circleSx, m_circleSz, m_circleC;
+    std::vector<float> m_circleVx, m_circleVz;
+    std::vector<float> m_circleDpx, m_circleDpz, m_circleNpx, m_circleNpz;
+
+    // Segments, as structure of arrays
+    int m_nsegments;
+    std::vector<unsigned char> m_segmentTouch;
+    std::vector<float> m_segmentVx, m_segmentVz, m_segmentWx, m_segmentWz, m_segmentPerpVW;
+};
@@ -0,0 +1,138 @@
+#include "./ThreadPool.h"
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/threading.h>
+#endif
+
+// Worker threads spawned by all pools. Pools are only configured from the main thread.
+static int s_workerCount = 0;
+
+// Emscripten can only start threads from PTHREAD_POOL_SIZE (navigator.hardwareConcurrency) while the main thread blocks
+// in parallelFor, so all pools together must not spawn more workers than that.
+static int getMaxWorkers()
+{
+#ifdef __EMSCRIPTEN__
+    return emscripten_num_logical_cores();
+#else
+    return (int)std::thread::hardware_concurrency();
+#endif
+}
+
+ThreadPool::ThreadPool() : m_threadCount(1), m_job(0), m_jobCount(0), m_jobGeneration(0), m_pendingWorkers(0), m_stopping(false)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+}
+
+void ThreadPool::setThreadCount(int threadCount)
+{
+#ifdef RECAST_NAVIGATION_THREADS
+    if (threadCount < 1)
+        threadCount = 1;
+
+    const int availableWorkers = getMaxWorkers() - (s_workerCount - (m_threadCount - 1));
+    if (threadCount - 1 > availableWorkers)
+        threadCount = (availableWorkers > 0 ? availableWorkers : 0) + 1;
+#else
+    threadCount = 1;
+#endif
+
+    if (threadCount == m_threadCount)
+        return;
+
+    stopWorkers();
+
+    m_threadCount = threadCount;
+    s_workerCount += m_threadCount - 1;
+
+    for (int i = 1; i < m_threadCount; i++)
+    {
+        m_workers.push_back(std::thread(&ThreadPool::workerMain, this, i, m_jobGeneration));
+    }
+}
+
+void ThreadPool::parallelFor(const int count, const RangeFn &fn)
+{
+    if (count <= 0)
+        return;
+
+    // Not worth waking workers for fewer items than threads
+    if (m_threadCount == 1 || count < m_threadCount)
+    {
+        fn(0, count, 0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_jobCount = count;
+        m_pendingWorkers = m_threadCount - 1;
+        m_jobGeneration++;
+    }
+    m_workReady.notify_all();
+
+    fn(0, count / m_threadCount, 0);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workDone.wait(lock, [this]
+                    { return m_pendingWorkers == 0; });
+    m_job = 0;
+}
+
+void ThreadPool::stopWorkers()
+{
+    if (m_workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_workReady.notify_all();
+
+    for (std::thread &worker : m_workers)
+    {
+        worker.join();
+    }
+
+    m_workers.clear();
+    m_stopping = false;
+    s_workerCount -= m_threadCount - 1;
+    m_threadCount = 1;
+}
+
+void ThreadPool::workerMain(const int threadIndex, unsigned int seenGeneration)
+{
+    for (;;)
+    {
+        const RangeFn *job;
+        int count;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_workReady.wait(lock, [this, seenGeneration]
+                             { return m_stopping || m_jobGeneration != seenGeneration; });
+
+            if (m_stopping)
+                return;
+
+            seenGeneration = m_jobGeneration;
+            job = m_job;
+            count = m_jobCount;
+        }
+
+        const int begin = (int)((long long)count * threadIndex / m_threadCount);
+        const int end = (int)((long long)count * (threadIndex + 1) / m_threadCount);
+        (*job)(begin, end, threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pendingWorkers--;
+        }
+        m_workDone.notify_one();
+    }
+}
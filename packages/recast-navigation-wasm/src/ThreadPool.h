@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Splits index ranges across worker threads.
+// Worker threads are only created when built with RECAST_NAVIGATION_THREADS, otherwise all work runs on the calling thread.
+class ThreadPool
+{
+public:
+    typedef std::function<void(int begin, int end, int threadIndex)> RangeFn;
+
+    ThreadPool();
+    ~ThreadPool();
+
+    // Sets the number of threads work is split across, including the calling thread.
+    // Clamped so the workers of all pools fit in the pthread pool, check getThreadCount for the result.
+    void setThreadCount(int threadCount);
+
+    int getThreadCount() const { return m_threadCount; }
+
+    // Calls fn once per thread with a contiguous [begin, end) slice of [0, count).
+    // Slices depend only on count and the thread count, and the call blocks until every slice is done.
+    void parallelFor(const int count, const RangeFn &fn);
+
+private:
+    void stopWorkers();
+    // seenGeneration is the job generation when the worker was spawned, so a job started before it runs is not missed.
+    void workerMain(const int threadIndex, unsigned int seenGeneration);
+
+    int m_threadCount;
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workReady;
+    std::condition_variable m_workDone;
+    const RangeFn *m_job;
+    int m_jobCount;
+    unsigned int m_jobGeneration;
+    int m_pendingWorkers;
+    bool m_stopping;
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+};
@@ -1,6 +1,10 @@
 #include "./TileCache.h"
 
-bool TileCache::init(const dtTileCacheParams *params, RecastLinearAllocator *allocator, RecastFastLZCompressor *compressor, TileCacheMeshProcessJsImpl &meshProcess)
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+
+bool TileCache::init(const dtTileCacheParams *params, RecastLinearAllocator *allocator, RecastTileCacheCompressor *compressor, TileCacheMeshProcessJsImpl &meshProcess)
 {
     if (!m_tileCache)
     {
@@ -9,7 +13,9 @@ bool TileCache::init(const dtTileCacheParams *params, RecastLinearAllocator *all
 
     TileCacheMeshProcessWrapper *recastMeshProcess = new TileCacheMeshProcessWrapper(meshProcess);
 
-    dtStatus status = m_tileCache->init(params, allocator, compressor, recastMeshProcess);
+    m_compressor.compressor = compressor;
+
+    dtStatus status = m_tileCache->init(params, allocator, &m_compressor, recastMeshProcess);
     if (dtStatusFailed(status))
     {
         return false;
@@ -19,6 +25,9 @@ bool TileCache::init(const dtTileCacheParams *params, RecastLinearAllocator *all
     m_tcomp = compressor;
     m_tmproc = recastMeshProcess;
 
+    m_allocatorCapacity = allocator->capacity;
+    initThreadAllocators();
+
     return true;
 };
 
@@ -33,83 +42,1081 @@ TileCacheAddTileResult TileCache::addTile(UnsignedCharArray *tileCacheData, unsi
 
 dtStatus TileCache::buildNavMeshTile(const dtCompressedTileRef *ref, NavMesh *navMesh)
 {
-    return m_tileCache->buildNavMeshTile(*ref, navMesh->getNavMesh());
+    if (!m_tileCache->getTileByRef(*ref))
+    {
+        return DT_FAILURE | DT_INVALID_PARAM;
+    }
+
+    // Built like update builds tiles, so convex obstacles are marked too
+    m_rebuildRefs.clear();
+    m_rebuildTileSet.clear();
+    addRebuild(*ref);
+
+    return rebuildTiles(navMesh);
 };
 
 dtStatus TileCache::buildNavMeshTilesAt(const int tx, const int ty, NavMesh *navMesh)
 {
-    return m_tileCache->buildNavMeshTilesAt(tx, ty, navMesh->getNavMesh());
+    const int MAX_TILES = 32;
+    dtCompressedTileRef tiles[MAX_TILES];
+    const int ntiles = m_tileCache->getTilesAt(tx, ty, tiles, MAX_TILES);
+
+    m_rebuildRefs.clear();
+    m_rebuildTileSet.clear();
+    for (int i = 0; i < ntiles; ++i)
+    {
+        addRebuild(tiles[i]);
+    }
+
+    return rebuildTiles(navMesh);
 };
 
+dtStatus TileCache::removeTile(const dtCompressedTileRef *ref, NavMesh *navMesh)
+{
+    const dtCompressedTile *tile = m_tileCache->getTileByRef(*ref);
+    if (!tile)
+    {
+        return DT_FAILURE | DT_INVALID_PARAM;
+    }
+
+    const int tx = tile->header->tx;
+    const int ty = tile->header->ty;
+    const int tlayer = tile->header->tlayer;
+
+    // Frees the data if the tile owns it
+    const dtStatus status = m_tileCache->removeTile(*ref, 0, 0);
+    if (dtStatusFailed(status))
+    {
+        return status;
+    }
+
+    dtNavMesh *nav = navMesh->getNavMesh();
+    nav->removeTile(nav->getTileRefAt(tx, ty, tlayer), 0, 0);
+
+    return status;
+}
+
+static void getConvexObstacleBounds(const TileCacheObstacleHandle *handle, float *bmin, float *bmax)
+{
+    const float *pos = &handle->obstacle[1];
+    const float height = handle->obstacle[4];
+
+    dtVcopy(bmin, pos);
+    dtVcopy(bmax, pos);
+    bmax[1] += height;
+
+    const float *verts = handle->verts.data();
+    const int nverts = (int)handle->verts.size() / 3;
+    for (int i = 0; i < nverts; ++i)
+    {
+        bmin[0] = dtMin(bmin[0], pos[0] + verts[i * 3 + 0]);
+        bmin[2] = dtMin(bmin[2], pos[2] + verts[i * 3 + 2]);
+        bmax[0] = dtMax(bmax[0], pos[0] + verts[i * 3 + 0]);
+        bmax[2] = dtMax(bmax[2], pos[2] + verts[i * 3 + 2]);
+    }
+}
+
+// As dtMarkBoxArea, marking the cells whose center is inside the convex footprint
+static void markConvexArea(dtTileCacheLayer &layer, const float *orig, const float cs, const float ch,
+                           const TileCacheObstacleHandle *handle, const unsigned char areaId)
+{
+    float bmin[3], bmax[3];
+    getConvexObstacleBounds(handle, bmin, bmax);
+
+    const int w = (int)layer.header->width;
+    const int h = (int)layer.header->height;
+    const float ics = 1.0f / cs;
+    const float ich = 1.0f / ch;
+
+    int minx = (int)dtMathFloorf((bmin[0] - orig[0]) * ics);
+    const int miny = (int)dtMathFloorf((bmin[1] - orig[1]) * ich);
+    int minz = (int)dtMathFloorf((bmin[2] - orig[2]) * ics);
+    int maxx = (int)dtMathFloorf((bmax[0] - orig[0]) * ics);
+    const int maxy = (int)dtMathFloorf((bmax[1] - orig[1]) * ich);
+    int maxz = (int)dtMathFloorf((bmax[2] - orig[2]) * ics);
+
+    if (maxx < 0 || minx >= w || maxz < 0 || minz >= h)
+        return;
+
+    minx = dtMax(minx, 0);
+    maxx = dtMin(maxx, w - 1);
+    minz = dtMax(minz, 0);
+    maxz = dtMin(maxz, h - 1);
+
+    const float *pos = &handle->obstacle[1];
+    const float *verts = handle->verts.data();
+    const int nverts = (int)handle->verts.size() / 3;
+
+    for (int z = minz; z <= maxz; ++z)
+    {
+        for (int x = minx; x <= maxx; ++x)
+        {
+            const int y = layer.heights[x + z * w];
+            if (y < miny || y > maxy)
+                continue;
+
+            // Relative to pos, like the verts
+            const float p[3] = {orig[0] + (x + 0.5f) * cs - pos[0], 0, orig[2] + (z + 0.5f) * cs - pos[2]};
+            if (dtPointInPolygon(p, verts, nverts))
+                layer.areas[x + z * w] = areaId;
+        }
+    }
+}
+
+static double getTimeUs()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TileCache::updateStep(NavMesh *navMesh, TileCacheUpdateResult *result)
+{
+    if (m_threadPool.getThreadCount() > 1)
+    {
+        updateStepParallel(navMesh, result);
+        return;
+    }
+
+    flushObstacleRequests();
+
+    // The update processes obstacle requests, the tile it would rebuild is skipped and rebuilt from the obstacle index
+    m_rebuildRefs.clear();
+    m_rebuildTileSet.clear();
+    updateSkipped(navMesh, &result->upToDate);
+
+    // The update made room for queued requests, they are processed by the next one
+    const int flushed = flushObstacleRequests();
+
+    if (!m_dirtyTiles.empty())
+    {
+        const dtCompressedTileRef ref = m_dirtyTiles.front();
+        m_dirtyTiles.pop_front();
+        m_dirtyTileSet.erase(ref);
+
+        addRebuild(ref);
+    }
+
+    // Tiles removed since they were marked fail to build and are skipped
+    result->status = rebuildTiles(navMesh);
+
+    result->upToDate = result->upToDate && !flushed && m_obstacleRequests.empty() && m_dirtyTiles.empty();
+}
+
+void TileCache::updateStepParallel(NavMesh *navMesh, TileCacheUpdateResult *result)
+{
+    m_rebuildRefs.clear();
+    m_rebuildTileSet.clear();
+
+    // Takes up to a tile per thread off the tile cache's update list, and as many dirty tiles, so a step
+    // costs about one rebuild per thread and the budget is checked between steps.
+    // The update processes obstacle requests, the tiles it would rebuild are skipped and rebuilt together.
+    const int batchSize = m_threadPool.getThreadCount();
+    for (int i = 0; i < batchSize; ++i)
+    {
+        flushObstacleRequests();
+        updateSkipped(navMesh, &result->upToDate);
+
+        if (result->upToDate)
+            break;
+    }
+
+    for (int i = 0; i < batchSize && !m_dirtyTiles.empty(); ++i)
+    {
+        const dtCompressedTileRef ref = m_dirtyTiles.front();
+        m_dirtyTiles.pop_front();
+        m_dirtyTileSet.erase(ref);
+
+        addRebuild(ref);
+    }
+
+    result->status = rebuildTiles(navMesh);
+
+    const int flushed = flushObstacleRequests();
+
+    result->upToDate = result->upToDate && !flushed && m_obstacleRequests.empty() && m_dirtyTiles.empty();
+}
+
+void TileCache::updateSkipped(NavMesh *navMesh, bool *upToDate)
+{
+    // dtTileCache only processes requests once its update list is empty
+    const bool processRequests = m_updateTileSet.empty();
+
+    m_compressor.skip = true;
+    m_compressor.skipped = 0;
+    m_tileCache->update(0, navMesh->getNavMesh(), upToDate);
+    m_compressor.skip = false;
+
+    dtCompressedTileRef skippedRef = 0;
+    for (int i = 0; m_compressor.skipped && i < m_tileCache->getTileCount(); ++i)
+    {
+        const dtCompressedTile *tile = m_tileCache->getTile(i);
+        if (tile->compressed == m_compressor.skipped)
+        {
+            skippedRef = m_tileCache->getTileRef(tile);
+            addRebuild(skippedRef);
+            break;
+        }
+    }
+
+    if (processRequests)
+    {
+        // The update list is the pending tiles of the processed obstacles, less the one this update took
+        for (size_t i = 0; i < m_requestedObstacles.size(); ++i)
+        {
+            const dtTileCacheObstacle *ob = m_tileCache->getObstacle(m_tileCache->decodeObstacleIdObstacle(m_requestedObstacles[i]));
+            for (int j = 0; j < ob->npending; ++j)
+                m_updateTileSet.insert(ob->pending[j]);
+        }
+        m_requestedObstacles.clear();
+    }
+    else if (!m_updateTileSet.erase(skippedRef))
+    {
+        // The tile taken was removed from the tile cache since it was listed, drop any stale ref
+        for (std::unordered_set<dtCompressedTileRef>::iterator it = m_updateTileSet.begin(); it != m_updateTileSet.end(); ++it)
+        {
+            if (!m_tileCache->getTileByRef(*it))
+            {
+                m_updateTileSet.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (*upToDate)
+        m_updateTileSet.clear();
+}
+
+void TileCache::addRebuild(const dtCompressedTileRef ref)
+{
+    if (m_rebuildTileSet.insert(ref).second)
+    {
+        m_rebuildRefs.push_back(ref);
+    }
+}
+
+dtStatus TileCache::rebuildTiles(NavMesh *navMesh)
+{
+    const int count = (int)m_rebuildRefs.size();
+    if ((int)m_rebuilds.size() < count)
+    {
+        m_rebuilds.resize(count);
+    }
+
+    m_threadPool.parallelFor(count, [&](int begin, int end, int threadIndex)
+                             {
+        for (int i = begin; i < end; ++i)
+        {
+            RecastLinearAllocator *alloc = getThreadAllocator(threadIndex);
+            m_rebuilds[i].ref = m_rebuildRefs[i];
+            buildTilePolyMesh(alloc, &m_rebuilds[i]);
+            if (m_rebuilds[i].valid)
+                alloc->recordUsage();
+        } });
+
+    // The mesh process calls into JS, it has to run on the calling thread
+    for (int i = 0; i < count; ++i)
+    {
+        TileCacheTileRebuild &rebuild = m_rebuilds[i];
+        if (rebuild.valid && dtStatusSucceed(rebuild.status) && rebuild.params.polyCount && m_tmproc)
+        {
+            m_tmproc->process(&rebuild.params, rebuild.areas.data(), rebuild.flags.data());
+        }
+    }
+
+    m_threadPool.parallelFor(count, [&](int begin, int end, int)
+                             {
+        for (int i = begin; i < end; ++i)
+        {
+            TileCacheTileRebuild &rebuild = m_rebuilds[i];
+            if (!rebuild.valid || dtStatusFailed(rebuild.status) || !rebuild.params.polyCount)
+                continue;
+
+            if (!dtCreateNavMeshData(&rebuild.params, &rebuild.navData, &rebuild.navDataSize))
+                rebuild.status = DT_FAILURE;
+        } });
+
+    dtNavMesh *nav = navMesh->getNavMesh();
+    dtStatus status = DT_SUCCESS;
+
+    for (int i = 0; i < count; ++i)
+    {
+        TileCacheTileRebuild &rebuild = m_rebuilds[i];
+        if (!rebuild.valid)
+            continue;
+
+        if (dtStatusFailed(rebuild.status))
+        {
+            if (dtStatusSucceed(status))
+                status = rebuild.status;
+            continue;
+        }
+
+        const dtNavMeshCreateParams &params = rebuild.params;
+        nav->removeTile(nav->getTileRefAt(params.tileX, params.tileY, params.tileLayer), 0, 0);
+
+        // An empty tile leaves the location empty
+        if (rebuild.navData)
+        {
+            const dtStatus addStatus = nav->addTile(rebuild.navData, rebuild.navDataSize, DT_TILE_FREE_DATA, 0, 0);
+            if (dtStatusFailed(addStatus))
+            {
+                dtFree(rebuild.navData);
+                if (dtStatusSucceed(status))
+                    status = addStatus;
+            }
+            rebuild.navData = 0;
+            rebuild.navDataSize = 0;
+        }
+    }
+
+    return status;
+}
+
+// Mirrors dtTileCache::buildNavMeshTile up to the poly mesh, with the worker's allocator
+void TileCache::buildTilePolyMesh(RecastLinearAllocator *alloc, TileCacheTileRebuild *rebuild)
+{
+    rebuild->navData = 0;
+    rebuild->navDataSize = 0;
+    rebuild->status = DT_SUCCESS;
+    memset(&rebuild->params, 0, sizeof(rebuild->params));
+
+    const dtCompressedTile *tile = m_tileCache->getTileByRef(rebuild->ref);
+    rebuild->valid = tile != 0;
+    if (!tile)
+        return;
+
+    const dtTileCacheParams *params = m_tileCache->getParams();
+    const int walkableClimbVx = (int)(params->walkableClimb / params->ch);
+
+    alloc->reset();
+
+    dtTileCacheLayer *layer = 0;
+    dtStatus status = dtDecompressTileCacheLayer(alloc, m_compressor.compressor, tile->data, tile->dataSize, &layer);
+    if (dtStatusFailed(status))
+    {
+        rebuild->status = status;
+        return;
+    }
+
+    std::unordered_map<long long, std::vector<TileCacheObstacleHandle *>>::const_iterator tileObstacles = m_tileObstacles.find(tileLocationKey(tile->header->tx, tile->header->ty));
+    const int obstacleCount = tileObstacles != m_tileObstacles.end() ? (int)tileObstacles->second.size() : 0;
+
+    float tileBmin[3], tileBmax[3];
+    m_tileCache->calcTightTileBounds(tile->header, tileBmin, tileBmax);
+
+    for (int i = 0; i < obstacleCount; ++i)
+    {
+        const TileCacheObstacleHandle *handle = tileObstacles->second[i];
+        if (!dtOverlapBounds(handle->bmin, handle->bmax, tileBmin, tileBmax))
+            continue;
+
+        const dtTileCacheObstacle *ob = m_tileCache->getObstacleByRef(handle->ref);
+        if (!ob || ob->state == DT_OBSTACLE_EMPTY || ob->state == DT_OBSTACLE_REMOVING)
+            continue;
+
+        if ((int)handle->obstacle[0] == TILECACHE_OBSTACLE_CONVEX)
+        {
+            markConvexArea(*layer, tile->header->bmin, params->cs, params->ch, handle, 0);
+        }
+        else if (ob->type == DT_OBSTACLE_CYLINDER)
+        {
+            dtMarkCylinderArea(*layer, tile->header->bmin, params->cs, params->ch,
+                               ob->cylinder.pos, ob->cylinder.radius, ob->cylinder.height, 0);
+        }
+        else if (ob->type == DT_OBSTACLE_BOX)
+        {
+            dtMarkBoxArea(*layer, tile->header->bmin, params->cs, params->ch,
+                          ob->box.bmin, ob->box.bmax, 0);
+        }
+        else if (ob->type == DT_OBSTACLE_ORIENTED_BOX)
+        {
+            dtMarkBoxArea(*layer, tile->header->bmin, params->cs, params->ch,
+                          ob->orientedBox.center, ob->orientedBox.halfExtents, ob->orientedBox.rotAux, 0);
+        }
+    }
+
+    status = dtBuildTileCacheRegions(alloc, *layer, walkableClimbVx);
+    if (dtStatusFailed(status))
+    {
+        rebuild->status = status;
+        return;
+    }
+
+    dtTileCacheContourSet *lcset = dtAllocTileCacheContourSet(alloc);
+    if (!lcset)
+    {
+        rebuild->status = DT_FAILURE | DT_OUT_OF_MEMORY;
+        return;
+    }
+
+    status = dtBuildTileCacheContours(alloc, *layer, walkableClimbVx, params->maxSimplificationError, *lcset);
+    if (dtStatusFailed(status))
+    {
+        rebuild->status = status;
+        return;
+    }
+
+    dtTileCachePolyMesh *lmesh = dtAllocTileCachePolyMesh(alloc);
+    if (!lmesh)
+    {
+        rebuild->status = DT_FAILURE | DT_OUT_OF_MEMORY;
+        return;
+    }
+
+    status = dtBuildTileCachePolyMesh(alloc, *lcset, *lmesh);
+    if (dtStatusFailed(status))
+    {
+        rebuild->status = status;
+        return;
+    }
+
+    rebuild->verts.assign(lmesh->verts, lmesh->verts + lmesh->nverts * 3);
+    rebuild->polys.assign(lmesh->polys, lmesh->polys + lmesh->npolys * lmesh->nvp * 2);
+    rebuild->flags.assign(lmesh->flags, lmesh->flags + lmesh->npolys);
+    rebuild->areas.assign(lmesh->areas, lmesh->areas + lmesh->npolys);
+
+    dtNavMeshCreateParams &createParams = rebuild->params;
+    createParams.verts = rebuild->verts.data();
+    createParams.vertCount = lmesh->nverts;
+    createParams.polys = rebuild->polys.data();
+    createParams.polyAreas = rebuild->areas.data();
+    createParams.polyFlags = rebuild->flags.data();
+    createParams.polyCount = lmesh->npolys;
+    createParams.nvp = DT_VERTS_PER_POLYGON;
+    createParams.walkableHeight = params->walkableHeight;
+    createParams.walkableRadius = params->walkableRadius;
+    createParams.walkableClimb = params->walkableClimb;
+    createParams.tileX = tile->header->tx;
+    createParams.tileY = tile->header->ty;
+    createParams.tileLayer = tile->header->tlayer;
+    createParams.cs = params->cs;
+    createParams.ch = params->ch;
+    createParams.buildBvTree = false;
+    dtVcopy(createParams.bmin, tile->header->bmin);
+    dtVcopy(createParams.bmax, tile->header->bmax);
+}
+
+RecastLinearAllocator *TileCache::getThreadAllocator(const int threadIndex)
+{
+    // The calling thread uses the tile cache's allocator when there is only one thread
+    return m_threadAllocators.empty() ? m_talloc : m_threadAllocators[threadIndex];
+}
+
+void TileCache::initThreadAllocators()
+{
+    if (!m_allocatorCapacity)
+        return;
+
+    // The calling thread keeps using the tile cache's allocator when there is only one thread
+    const int threadCount = m_threadPool.getThreadCount();
+    const int allocatorCount = threadCount > 1 ? threadCount : 0;
+
+    while ((int)m_threadAllocators.size() > allocatorCount)
+    {
+        delete m_threadAllocators.back();
+        m_threadAllocators.pop_back();
+    }
+
+    while ((int)m_threadAllocators.size() < allocatorCount)
+    {
+        m_threadAllocators.push_back(new RecastLinearAllocator(m_allocatorCapacity));
+    }
+}
+
+void TileCache::freeThreadAllocators()
+{
+    for (size_t i = 0; i < m_threadAllocators.size(); ++i)
+    {
+        delete m_threadAllocators[i];
+    }
+    m_threadAllocators.clear();
+}
+
+void TileCache::setThreadCount(const int threadCount)
+{
+    m_threadPool.setThreadCount(threadCount);
+    initThreadAllocators();
+}
+
+int TileCache::getThreadCount() const
+{
+    return m_threadPool.getThreadCount();
+}
+
+void TileCache::countPendingWork(TileCacheUpdateResult *result)
+{
+    int pendingTiles = (int)m_updateTileSet.size();
+    for (size_t i = 0; i < m_dirtyTiles.size(); ++i)
+    {
+        if (!m_updateTileSet.count(m_dirtyTiles[i]))
+            pendingTiles++;
+    }
+
+    result->pendingTiles = pendingTiles;
+    result->queuedRequests = (int)m_obstacleRequests.size();
+}
+
 TileCacheUpdateResult TileCache::update(NavMesh *navMesh)
 {
     TileCacheUpdateResult result;
 
-    result.status = m_tileCache->update(0, navMesh->getNavMesh(), &result.upToDate);
+    updateStep(navMesh, &result);
+    countPendingWork(&result);
 
     return result;
 }
 
-TileCacheAddObstacleResult TileCache::addCylinderObstacle(const Vec3 &position, float radius, float height)
+TileCacheUpdateResult TileCache::updateWithBudget(NavMesh *navMesh, const float maxTimeUs)
 {
-    dtObstacleRef ref(-1);
+    TileCacheUpdateResult result;
 
-    TileCacheAddObstacleResult result;
+    const double startTime = getTimeUs();
+    do
+    {
+        updateStep(navMesh, &result);
+    } while (!result.upToDate && dtStatusSucceed(result.status) && getTimeUs() - startTime < maxTimeUs);
+
+    countPendingWork(&result);
+
+    return result;
+}
+
+TileCacheObstacleHandle *TileCache::allocObstacleHandle()
+{
+    TileCacheObstacleHandle *handle;
+    if (!m_freeObstacleHandles.empty())
+    {
+        handle = m_freeObstacleHandles.back();
+        m_freeObstacleHandles.pop_back();
+    }
+    else if ((int)m_obstacleHandles.size() < TILECACHE_MAX_OBSTACLE_HANDLES)
+    {
+        m_obstacleHandles.push_back(TileCacheObstacleHandle());
+        handle = &m_obstacleHandles.back();
+        handle->index = (int)m_obstacleHandles.size() - 1;
+        handle->salt = 0;
+    }
+    else
+    {
+        return 0;
+    }
+
+    handle->ref = (dtObstacleRef)-1;
+    handle->active = true;
+    handle->queued = false;
+    handle->locations.clear();
+    handle->verts.clear();
+    m_obstacleCount++;
+
+    return handle;
+}
+
+void TileCache::freeObstacleHandle(TileCacheObstacleHandle *handle)
+{
+    handle->salt = (handle->salt + 1) & TILECACHE_OBSTACLE_SALT_MASK;
+    handle->active = false;
+    handle->queued = false;
+    m_freeObstacleHandles.push_back(handle);
+    m_obstacleCount--;
+}
+
+dtStatus TileCache::requestAddObstacle(TileCacheObstacleHandle *handle)
+{
+    const float *obstacle = handle->obstacle;
+
+    dtStatus status;
+    switch ((int)obstacle[0])
+    {
+    case DT_OBSTACLE_CYLINDER:
+        status = m_tileCache->addObstacle(&obstacle[1], obstacle[4], obstacle[5], &handle->ref);
+        break;
+    case DT_OBSTACLE_BOX:
+        status = m_tileCache->addBoxObstacle(&obstacle[1], &obstacle[4], &handle->ref);
+        break;
+    case TILECACHE_OBSTACLE_CONVEX:
+    {
+        float bmin[3], bmax[3];
+        getConvexObstacleBounds(handle, bmin, bmax);
+        status = m_tileCache->addBoxObstacle(bmin, bmax, &handle->ref);
+        break;
+    }
+    default:
+        status = m_tileCache->addBoxObstacle(&obstacle[1], &obstacle[4], obstacle[7], &handle->ref);
+        break;
+    }
+
+    const dtTileCacheObstacle *ob = dtStatusSucceed(status) ? m_tileCache->getObstacleByRef(handle->ref) : 0;
+    if (ob)
+    {
+        m_requestedObstacles.push_back(handle->ref);
+
+        float bmin[3], bmax[3];
+        m_tileCache->getObstacleBounds(ob, bmin, bmax);
+        indexObstacle(handle, bmin, bmax);
+    }
+
+    return status;
+}
+
+dtStatus TileCache::addObstacle(const float *obstacle, TileCacheObstacleHandle **result, const float *verts, const int nverts)
+{
+    *result = 0;
 
     if (!m_tileCache)
     {
-        result.status = DT_FAILURE;
-        return result;
+        return DT_FAILURE;
+    }
+
+    const int type = (int)obstacle[0];
+    if (type != DT_OBSTACLE_CYLINDER && type != DT_OBSTACLE_BOX && type != DT_OBSTACLE_ORIENTED_BOX && type != TILECACHE_OBSTACLE_CONVEX)
+    {
+        return DT_FAILURE | DT_INVALID_PARAM;
+    }
+
+    if (type == TILECACHE_OBSTACLE_CONVEX && (!verts || nverts < 3))
+    {
+        return DT_FAILURE | DT_INVALID_PARAM;
+    }
+
+    if (m_obstacleCount >= m_tileCache->getParams()->maxObstacles)
+    {
+        return DT_FAILURE | DT_OUT_OF_MEMORY;
+    }
+
+    TileCacheObstacleHandle *handle = allocObstacleHandle();
+    if (!handle)
+    {
+        return DT_FAILURE | DT_OUT_OF_MEMORY;
+    }
+
+    memcpy(handle->obstacle, obstacle, sizeof(handle->obstacle));
+    if (type == TILECACHE_OBSTACLE_CONVEX)
+    {
+        handle->verts.assign(verts, verts + nverts * 3);
+    }
+
+    // Requests stay in order once some are queued
+    dtStatus status = DT_FAILURE | DT_BUFFER_TOO_SMALL;
+    if (m_obstacleRequests.empty())
+    {
+        status = requestAddObstacle(handle);
+    }
+
+    // The request queue is full, or removed obstacles still hold their slots until the next update
+    if (dtStatusDetail(status, DT_BUFFER_TOO_SMALL) || dtStatusDetail(status, DT_OUT_OF_MEMORY))
+    {
+        handle->queued = true;
+        m_obstacleRequests.push_back({handle, 0});
+        status = DT_SUCCESS | DT_IN_PROGRESS;
+    }
+    else if (dtStatusFailed(status))
+    {
+        freeObstacleHandle(handle);
+        return status;
+    }
+
+    *result = handle;
+
+    return status;
+}
+
+dtStatus TileCache::requestRemoveObstacle(const dtObstacleRef ref)
+{
+    const dtStatus status = m_tileCache->removeObstacle(ref);
+    if (dtStatusSucceed(status))
+    {
+        m_requestedObstacles.push_back(ref);
+    }
+
+    return status;
+}
+
+int TileCache::flushObstacleRequests()
+{
+    int flushed = 0;
+
+    while (!m_obstacleRequests.empty())
+    {
+        const TileCacheObstacleRequest &request = m_obstacleRequests.front();
+        TileCacheObstacleHandle *handle = request.handle;
+
+        if (handle && !handle->active)
+        {
+            // Removed before it was added
+            handle->queued = false;
+            m_freeObstacleHandles.push_back(handle);
+            m_obstacleRequests.pop_front();
+            continue;
+        }
+
+        const dtStatus status = handle ? requestAddObstacle(handle) : requestRemoveObstacle(request.ref);
+        if (dtStatusDetail(status, DT_BUFFER_TOO_SMALL) || dtStatusDetail(status, DT_OUT_OF_MEMORY))
+        {
+            break;
+        }
+
+        if (handle)
+        {
+            handle->queued = false;
+        }
+
+        m_obstacleRequests.pop_front();
+        flushed++;
+    }
+
+    return flushed;
+}
+
+void TileCache::indexObstacle(TileCacheObstacleHandle *handle, const float *bmin, const float *bmax)
+{
+    // The locations dtTileCache::queryTiles looks at, whether or not tiles are loaded there
+    const dtTileCacheParams *params = m_tileCache->getParams();
+    const float tw = params->width * params->cs;
+    const float th = params->height * params->cs;
+    const int tx0 = (int)dtMathFloorf((bmin[0] - params->orig[0]) / tw);
+    const int tx1 = (int)dtMathFloorf((bmax[0] - params->orig[0]) / tw);
+    const int ty0 = (int)dtMathFloorf((bmin[2] - params->orig[2]) / th);
+    const int ty1 = (int)dtMathFloorf((bmax[2] - params->orig[2]) / th);
+
+    dtVcopy(handle->bmin, bmin);
+    dtVcopy(handle->bmax, bmax);
+    handle->locations.clear();
+    for (int ty = ty0; ty <= ty1; ++ty)
+    {
+        for (int tx = tx0; tx <= tx1; ++tx)
+        {
+            const long long key = tileLocationKey(tx, ty);
+            handle->locations.push_back(key);
+            m_tileObstacles[key].push_back(handle);
+        }
+    }
+}
+
+void TileCache::unindexObstacle(TileCacheObstacleHandle *handle)
+{
+    for (size_t i = 0; i < handle->locations.size(); ++i)
+    {
+        std::unordered_map<long long, std::vector<TileCacheObstacleHandle *>>::iterator it = m_tileObstacles.find(handle->locations[i]);
+        if (it == m_tileObstacles.end())
+            continue;
+
+        std::vector<TileCacheObstacleHandle *> &obstacles = it->second;
+        for (size_t j = 0; j < obstacles.size(); ++j)
+        {
+            if (obstacles[j] == handle)
+            {
+                obstacles[j] = obstacles.back();
+                obstacles.pop_back();
+                break;
+            }
+        }
+
+        if (obstacles.empty())
+            m_tileObstacles.erase(it);
+    }
+
+    handle->locations.clear();
+}
+
+void TileCache::markTilesDirty(const dtCompressedTileRef *tiles, const int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (m_dirtyTileSet.insert(tiles[i]).second)
+        {
+            m_dirtyTiles.push_back(tiles[i]);
+        }
+    }
+}
+
+void TileCache::markObstacleTilesDirty(const TileCacheObstacleHandle *handle, const dtTileCacheObstacle *ob)
+{
+    // ob->touched goes stale when tiles are removed and added again, the location index does not
+    const int MAX_TILES = 32;
+    dtCompressedTileRef tiles[MAX_TILES];
+
+    for (size_t i = 0; i < handle->locations.size(); ++i)
+    {
+        const long long key = handle->locations[i];
+        const int tx = (int)(unsigned int)(key & 0xffffffff);
+        const int ty = (int)(key >> 32);
+        const int ntiles = m_tileCache->getTilesAt(tx, ty, tiles, MAX_TILES);
+
+        for (int j = 0; j < ntiles; ++j)
+        {
+            // Other layers at the location are left alone
+            float tileBmin[3], tileBmax[3];
+            m_tileCache->calcTightTileBounds(m_tileCache->getTileByRef(tiles[j])->header, tileBmin, tileBmax);
+            if (!dtOverlapBounds(handle->bmin, handle->bmax, tileBmin, tileBmax))
+                continue;
+
+            // Tiles the tile cache still knows the obstacle touches are rebuilt by its own update
+            bool touched = false;
+            for (int k = 0; ob && k < ob->ntouched; ++k)
+            {
+                touched = touched || ob->touched[k] == tiles[j];
+            }
+
+            if (!touched)
+                markTilesDirty(&tiles[j], 1);
+        }
     }
+}
+
+static dtObstacleRef *encodeObstacleRef(const TileCacheObstacleHandle *handle)
+{
+    const uintptr_t ref = ((uintptr_t)handle->salt << TILECACHE_OBSTACLE_INDEX_BITS) | (uintptr_t)(handle->index + 1);
+    return reinterpret_cast<dtObstacleRef *>(ref);
+}
+
+TileCacheAddObstacleResult TileCache::addCylinderObstacle(const Vec3 &position, float radius, float height)
+{
+    const float obstacle[TILECACHE_OBSTACLE_STRIDE] = {DT_OBSTACLE_CYLINDER, position.x, position.y, position.z, radius, height, 0, 0};
 
-    result.status = m_tileCache->addObstacle(&position.x, radius, height, &ref);
-    
-    m_obstacles.push_back(ref);
+    TileCacheObstacleHandle *handle;
 
-    result.ref = &m_obstacles.back();
+    TileCacheAddObstacleResult result;
+    result.status = addObstacle(obstacle, &handle);
+    result.ref = handle ? encodeObstacleRef(handle) : 0;
 
     return result;
 }
 
 TileCacheAddObstacleResult TileCache::addBoxObstacle(const Vec3 &position, const Vec3 &extent, float angle)
 {
-    dtObstacleRef ref(-1);
+    const float obstacle[TILECACHE_OBSTACLE_STRIDE] = {DT_OBSTACLE_ORIENTED_BOX, position.x, position.y, position.z, extent.x, extent.y, extent.z, angle};
+
+    TileCacheObstacleHandle *handle;
 
     TileCacheAddObstacleResult result;
+    result.status = addObstacle(obstacle, &handle);
+    result.ref = handle ? encodeObstacleRef(handle) : 0;
 
-    if (!m_tileCache)
-    {
-        result.status = DT_FAILURE; 
-        return result;
-    }
+    return result;
+}
 
-    result.status = m_tileCache->addBoxObstacle(&position.x, &extent.x, angle, &ref);
+TileCacheAddObstacleResult TileCache::addConvexObstacle(const float *verts, const int nverts, const Vec3 &position, float height)
+{
+    const float obstacle[TILECACHE_OBSTACLE_STRIDE] = {TILECACHE_OBSTACLE_CONVEX, position.x, position.y, position.z, height, 0, 0, 0};
 
-    m_obstacles.push_back(ref);
+    TileCacheObstacleHandle *handle;
 
-    result.ref = &m_obstacles.back();
+    TileCacheAddObstacleResult result;
+    result.status = addObstacle(obstacle, &handle, verts, nverts);
+    result.ref = handle ? encodeObstacleRef(handle) : 0;
 
     return result;
 }
 
+TileCacheObstacleHandle *TileCache::getObstacleHandle(const dtObstacleRef *obstacle)
+{
+    const uintptr_t ref = reinterpret_cast<uintptr_t>(obstacle);
+    const int index = (int)(ref & TILECACHE_MAX_OBSTACLE_HANDLES) - 1;
+    const unsigned int salt = (unsigned int)(ref >> TILECACHE_OBSTACLE_INDEX_BITS);
+    if (index < 0 || index >= (int)m_obstacleHandles.size())
+    {
+        return 0;
+    }
+
+    TileCacheObstacleHandle *handle = &m_obstacleHandles[index];
+    return handle->active && handle->salt == salt ? handle : 0;
+}
+
 dtStatus TileCache::removeObstacle(dtObstacleRef *obstacle)
 {
-    if (!m_tileCache || !obstacle || *obstacle == -1)
+    TileCacheObstacleHandle *handle = m_tileCache ? getObstacleHandle(obstacle) : 0;
+    return handle ? removeObstacleHandle(handle) : DT_FAILURE;
+}
+
+dtStatus TileCache::removeObstacleHandle(TileCacheObstacleHandle *handle)
+{
+    if (handle->queued)
     {
-        return DT_FAILURE;
+        // Never reached the tile cache, the queued request is dropped when flushed
+        handle->salt = (handle->salt + 1) & TILECACHE_OBSTACLE_SALT_MASK;
+        handle->active = false;
+        m_obstacleCount--;
+        return DT_SUCCESS;
     }
 
-    dtStatus status = m_tileCache->removeObstacle(*obstacle);
+    // The remove request rebuilds the tiles in ob->touched, mark any loaded since the obstacle was added
+    const dtTileCacheObstacle *ob = m_tileCache->getObstacleByRef(handle->ref);
+    markObstacleTilesDirty(handle, ob);
 
-    auto iter = std::find(m_obstacles.begin(), m_obstacles.end(), *obstacle);
-    if (iter != m_obstacles.end())
+    dtStatus status = DT_FAILURE | DT_BUFFER_TOO_SMALL;
+    if (m_obstacleRequests.empty())
     {
-        m_obstacles.erase(iter);
+        status = requestRemoveObstacle(handle->ref);
     }
 
+    if (dtStatusDetail(status, DT_BUFFER_TOO_SMALL))
+    {
+        m_obstacleRequests.push_back({0, handle->ref});
+        status = DT_SUCCESS | DT_IN_PROGRESS;
+    }
+
+    unindexObstacle(handle);
+    freeObstacleHandle(handle);
+
     return status;
 }
 
+dtStatus TileCache::moveObstacle(dtObstacleRef *obstacle, const Vec3 &position, float angle)
+{
+    TileCacheObstacleHandle *handle = m_tileCache ? getObstacleHandle(obstacle) : 0;
+    return handle ? moveObstacleHandle(handle, position, angle) : DT_FAILURE;
+}
+
+dtStatus TileCache::moveObstacleHandle(TileCacheObstacleHandle *handle, const Vec3 &position, float angle)
+{
+    float *desc = handle->obstacle;
+    const float pos[3] = {position.x, position.y, position.z};
+    switch ((int)desc[0])
+    {
+    case DT_OBSTACLE_CYLINDER:
+    case TILECACHE_OBSTACLE_CONVEX:
+        dtVcopy(&desc[1], pos);
+        break;
+    case DT_OBSTACLE_BOX:
+    {
+        float halfExtents[3];
+        dtVsub(halfExtents, &desc[4], &desc[1]);
+        dtVscale(halfExtents, halfExtents, 0.5f);
+        dtVsub(&desc[1], pos, halfExtents);
+        dtVadd(&desc[4], pos, halfExtents);
+        break;
+    }
+    default:
+        dtVcopy(&desc[1], pos);
+        desc[7] = angle;
+        break;
+    }
+
+    if (handle->queued)
+    {
+        // Added where it is when the request is flushed
+        return DT_SUCCESS;
+    }
+
+    // Obstacles are plain structs, move it in place rather than through a remove and add request
+    dtTileCacheObstacle *ob = const_cast<dtTileCacheObstacle *>(m_tileCache->getObstacleByRef(handle->ref));
+    if (!ob || (ob->state != DT_OBSTACLE_PROCESSING && ob->state != DT_OBSTACLE_PROCESSED))
+    {
+        return DT_FAILURE;
+    }
+
+    // Rebuild the tiles the obstacle leaves, including tiles loaded at its locations after ob->touched was set
+    markTilesDirty(ob->touched, ob->ntouched);
+    markObstacleTilesDirty(handle, 0);
+    unindexObstacle(handle);
+
+    switch (ob->type)
+    {
+    case DT_OBSTACLE_CYLINDER:
+        dtVcopy(ob->cylinder.pos, &desc[1]);
+        break;
+    case DT_OBSTACLE_BOX:
+        if ((int)desc[0] == TILECACHE_OBSTACLE_CONVEX)
+        {
+            getConvexObstacleBounds(handle, ob->box.bmin, ob->box.bmax);
+            break;
+        }
+        dtVcopy(ob->box.bmin, &desc[1]);
+        dtVcopy(ob->box.bmax, &desc[4]);
+        break;
+    default:
+    {
+        // As computed by dtTileCache::addBoxObstacle
+        const float coshalf = dtMathCosf(0.5f * angle);
+        const float sinhalf = dtMathSinf(-0.5f * angle);
+        dtVcopy(ob->orientedBox.center, &desc[1]);
+        ob->orientedBox.rotAux[0] = coshalf * sinhalf;
+        ob->orientedBox.rotAux[1] = coshalf * coshalf - 0.5f;
+        break;
+    }
+    }
+
+    // And the tiles it enters
+    float bmin[3], bmax[3];
+    m_tileCache->getObstacleBounds(ob, bmin, bmax);
+    int ntouched = 0;
+    m_tileCache->queryTiles(bmin, bmax, ob->touched, &ntouched, DT_MAX_TOUCHED_TILES);
+    ob->ntouched = (unsigned char)ntouched;
+    indexObstacle(handle, bmin, bmax);
+    markTilesDirty(ob->touched, ob->ntouched);
+
+    return DT_SUCCESS;
+}
+
+int TileCache::addObstacles(const float *obstacles, const int count, IntArray *refs)
+{
+    refs->resize(count);
+
+    int added = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        TileCacheObstacleHandle *handle;
+        addObstacle(&obstacles[i * TILECACHE_OBSTACLE_STRIDE], &handle);
+
+        refs->data[i] = handle ? (int)reinterpret_cast<uintptr_t>(encodeObstacleRef(handle)) : 0;
+        if (handle)
+        {
+            added++;
+        }
+    }
+
+    return added;
+}
+
+int TileCache::removeObstacles(const int *refs, const int count, IntArray *results)
+{
+    results->resize(count);
+
+    int removed = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        results->data[i] = dtStatusSucceed(removeObstacle(reinterpret_cast<dtObstacleRef *>((uintptr_t)(unsigned int)refs[i])));
+        removed += results->data[i];
+    }
+
+    return removed;
+}
+
+int TileCache::moveObstacles(const int *refs, const float *positions, const float *angles, const int count, IntArray *results)
+{
+    results->resize(count);
+
+    int moved = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        const Vec3 position(positions[i * 3 + 0], positions[i * 3 + 1], positions[i * 3 + 2]);
+        results->data[i] = dtStatusSucceed(moveObstacle(reinterpret_cast<dtObstacleRef *>((uintptr_t)(unsigned int)refs[i]), position, angles[i]));
+        moved += results->data[i];
+    }
+
+    return moved;
+}
+
+int TileCache::getObstacleCount() const
+{
+    return m_obstacleCount;
+}
+
+int TileCache::getAllocatorHighWaterMark() const
+{
+    size_t highWaterMark = m_talloc ? m_talloc->getHighWaterMark() : 0;
+    for (size_t i = 0; i < m_threadAllocators.size(); ++i)
+    {
+        highWaterMark = dtMax(highWaterMark, m_threadAllocators[i]->getHighWaterMark());
+    }
+
+    return (int)highWaterMark;
+}
+
+int TileCache::getCompressorType() const
+{
+    return m_tcomp ? m_tcomp->getType() : TILECACHE_COMPRESSOR_FASTLZ;
+}
+
 void TileCache::destroy()
 {
     if (m_tileCache)
@@ -117,8 +1124,23 @@ void TileCache::destroy()
         dtFreeTileCache(m_tileCache);
     }
 
+    m_obstacleHandles.clear();
+    m_freeObstacleHandles.clear();
+    m_obstacleCount = 0;
+    m_obstacleRequests.clear();
+    m_dirtyTiles.clear();
+    m_dirtyTileSet.clear();
+    m_tileObstacles.clear();
+
+    m_threadPool.setThreadCount(1);
+    freeThreadAllocators();
+    m_allocatorCapacity = 0;
+    m_rebuildRefs.clear();
+    m_rebuilds.clear();
+
     m_talloc->reset();
     m_talloc = 0;
     m_tcomp = 0;
+    m_compressor.compressor = 0;
     m_tmproc = 0;
 }
@@ -8,51 +8,56 @@
 #include "../recastnavigation/DetourCrowd/Include/DetourCrowd.h"
 #include "../recastnavigation/DetourTileCache/Include/DetourTileCache.h"
 #include "../recastnavigation/DetourTileCache/Include/DetourTileCacheBuilder.h"
-#include "../recastnavigation/RecastDemo/Contrib/fastlz/fastlz.h"
 #include "../recastnavigation/RecastDemo/Include/ChunkyTriMesh.h"
 
-#include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "./Arrays.h"
 #include "./Vec.h"
 #include "./NavMesh.h"
+#include "./ThreadPool.h"
+#include "./TileCacheCompressor.h"
 
-struct RecastFastLZCompressor : public dtTileCacheCompressor
+// FastLZ compressor, kept for existing callers
+struct RecastFastLZCompressor : public RecastTileCacheCompressor
 {
-    virtual int maxCompressedSize(const int bufferSize)
-    {
-        return (int)(bufferSize * 1.05f);
-    }
-
-    virtual dtStatus compress(const unsigned char *buffer, const int bufferSize,
-                              unsigned char *compressed, const int /*maxCompressedSize*/, int *compressedSize)
-    {
-        *compressedSize = fastlz_compress((const void *const)buffer, bufferSize, compressed);
-        return DT_SUCCESS;
-    }
-
-    virtual dtStatus decompress(const unsigned char *compressed, const int compressedSize,
-                                unsigned char *buffer, const int maxBufferSize, int *bufferSize)
-    {
-        *bufferSize = fastlz_decompress(compressed, compressedSize, buffer, maxBufferSize);
-        return *bufferSize < 0 ? DT_FAILURE : DT_SUCCESS;
-    }
+    RecastFastLZCompressor() : RecastTileCacheCompressor(TILECACHE_COMPRESSOR_FASTLZ) {}
 };
 
+// Linear allocator for tile builds, everything is released at once by reset.
+// When a chunk is full another chunk is added, so allocations made earlier in the build stay valid.
+// reset merges the chunks into a single buffer sized for the largest build so far.
 struct RecastLinearAllocator : public dtTileCacheAlloc
 {
     unsigned char *buffer;
     size_t capacity;
     size_t top;
+    // Peak bytes used by a single build
     size_t high;
 
-    RecastLinearAllocator(const size_t cap) : buffer(0), capacity(0), top(0), high(0)
+    // Chunks added since the last reset
+    std::vector<unsigned char *> chunks;
+    unsigned char *chunk;
+    size_t chunkCapacity;
+    size_t chunkTop;
+    // Bytes used since the last reset, across chunks
+    size_t used;
+    // Bytes used by the last completed build, see recordUsage
+    size_t lastUsed;
+    int growCount;
+
+    RecastLinearAllocator(const size_t cap) : buffer(0), capacity(0), top(0), high(0), chunk(0), chunkCapacity(0), chunkTop(0), used(0), lastUsed(0), growCount(0)
     {
         resize(cap);
     }
 
     ~RecastLinearAllocator()
     {
+        freeChunks();
+
         if (buffer)
         {
             dtFree(buffer);
@@ -61,6 +66,8 @@ struct RecastLinearAllocator : public dtTileCacheAlloc
 
     void resize(const size_t cap)
     {
+        freeChunks();
+
         if (buffer)
         {
             dtFree(buffer);
@@ -68,12 +75,42 @@ struct RecastLinearAllocator : public dtTileCacheAlloc
 
         buffer = (unsigned char *)dtAlloc(cap, DT_ALLOC_PERM);
         capacity = cap;
+        top = 0;
+        used = 0;
+    }
+
+    void freeChunks()
+    {
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            dtFree(chunks[i]);
+        }
+        chunks.clear();
+        chunk = 0;
+        chunkCapacity = 0;
+        chunkTop = 0;
+    }
+
+    // Called once a build is done. Not done by reset, as skipped builds reset and allocate too.
+    void recordUsage()
+    {
+        high = dtMax(high, used);
+        lastUsed = used;
     }
 
     virtual void reset()
     {
-        high = dtMax(high, top);
+        high = dtMax(high, used);
+
+        // Only merge between builds, nothing allocated before the reset is used after it
+        if (!chunks.empty())
+        {
+            resize(high);
+            growCount++;
+        }
+
         top = 0;
+        used = 0;
     }
 
     virtual void *alloc(const size_t size)
@@ -83,13 +120,34 @@ struct RecastLinearAllocator : public dtTileCacheAlloc
             return 0;
         }
 
-        if (top + size > capacity)
+        unsigned char *mem;
+        if (!chunk && top + size <= capacity)
         {
-            return 0;
+            mem = &buffer[top];
+            top += size;
+        }
+        else
+        {
+            if (!chunk || chunkTop + size > chunkCapacity)
+            {
+                const size_t cap = dtMax(size, dtMax(capacity, chunkCapacity * 2));
+                unsigned char *next = (unsigned char *)dtAlloc(cap, DT_ALLOC_TEMP);
+                if (!next)
+                {
+                    return 0;
+                }
+
+                chunks.push_back(next);
+                chunk = next;
+                chunkCapacity = cap;
+                chunkTop = 0;
+            }
+
+            mem = &chunk[chunkTop];
+            chunkTop += size;
         }
 
-        unsigned char *mem = &buffer[top];
-        top += size;
+        used += size;
         return mem;
     }
 
@@ -97,6 +155,49 @@ struct RecastLinearAllocator : public dtTileCacheAlloc
     {
         // Empty
     }
+
+    size_t getCapacity() const { return capacity; }
+
+    size_t getHighWaterMark() const { return dtMax(high, used); }
+
+    size_t getLastUsage() const { return lastUsed; }
+
+    int getGrowCount() const { return growCount; }
+};
+
+// Forwards to the tile cache's compressor.
+// While skipping, decompress fails straight away and records the data it was asked for, so dtTileCache::update
+// retires tiles that were already rebuilt concurrently without building them again.
+struct TileCacheCompressorProxy : public dtTileCacheCompressor
+{
+    dtTileCacheCompressor *compressor;
+    bool skip;
+    const unsigned char *skipped;
+
+    TileCacheCompressorProxy() : compressor(0), skip(false), skipped(0) {}
+
+    virtual int maxCompressedSize(const int bufferSize)
+    {
+        return compressor->maxCompressedSize(bufferSize);
+    }
+
+    virtual dtStatus compress(const unsigned char *buffer, const int bufferSize,
+                              unsigned char *compressed, const int maxCompressedSize, int *compressedSize)
+    {
+        return compressor->compress(buffer, bufferSize, compressed, maxCompressedSize, compressedSize);
+    }
+
+    virtual dtStatus decompress(const unsigned char *compressed, const int compressedSize,
+                                unsigned char *buffer, const int maxBufferSize, int *bufferSize)
+    {
+        if (skip)
+        {
+            skipped = compressed;
+            return DT_FAILURE;
+        }
+
+        return compressor->decompress(compressed, compressedSize, buffer, maxBufferSize, bufferSize);
+    }
 };
 
 struct TileCacheMeshProcessJsImpl
@@ -140,6 +241,9 @@ struct TileCacheUpdateResult
 {
     unsigned int status;
     bool upToDate;
+    // Tiles still waiting to be rebuilt, and obstacle requests waiting for room in the tile cache's request queue
+    int pendingTiles;
+    int queuedRequests;
 };
 
 struct TileCacheAddObstacleResult
@@ -148,17 +252,87 @@ struct TileCacheAddObstacleResult
     dtObstacleRef *ref;
 };
 
+// Packed obstacle descriptor: type (ObstacleType or TILECACHE_OBSTACLE_CONVEX) followed by
+// cylinder: pos[3], radius, height
+// box: bmin[3], bmax[3]
+// oriented box: center[3], halfExtents[3], yRadians
+// convex: pos[3], height, the footprint is stored separately
+static const int TILECACHE_OBSTACLE_STRIDE = 8;
+
+// Convex footprint extruded upwards from pos by height. Added to dtTileCache as a box around the footprint,
+// so it goes through the obstacle request queue, and marked by its footprint when tiles are rebuilt.
+static const int TILECACHE_OBSTACLE_CONVEX = DT_OBSTACLE_ORIENTED_BOX + 1;
+
+// Obstacles are passed to JS as dtObstacleRef pointers that encode a handle's index and salt rather than
+// point at anything, (salt << TILECACHE_OBSTACLE_INDEX_BITS) | (index + 1). They are decoded and checked
+// against the handle table, so refs to removed obstacles fail even once their handle is reused.
+static const int TILECACHE_OBSTACLE_INDEX_BITS = 16;
+static const int TILECACHE_MAX_OBSTACLE_HANDLES = (1 << TILECACHE_OBSTACLE_INDEX_BITS) - 1;
+static const unsigned int TILECACHE_OBSTACLE_SALT_MASK = (1u << (31 - TILECACHE_OBSTACLE_INDEX_BITS)) - 1;
+
+struct TileCacheObstacleHandle
+{
+    dtObstacleRef ref;
+    int index;
+    // Incremented when the handle is freed, handles are reused so refs to removed obstacles are rejected
+    unsigned int salt;
+    bool active;
+    // Waiting for room in the tile cache request queue, ref is not assigned yet
+    bool queued;
+    float obstacle[TILECACHE_OBSTACLE_STRIDE];
+    // Convex footprint verts relative to pos, y is ignored
+    std::vector<float> verts;
+    // Tile locations the obstacle is indexed under, and the bounds it was indexed with
+    std::vector<long long> locations;
+    float bmin[3];
+    float bmax[3];
+};
+
+// Key of a tile location in the tile cache grid, shared by every layer at the location.
+// Obstacles only apply to the layers whose tight bounds they overlap, as with dtTileCache::queryTiles.
+inline long long tileLocationKey(const int tx, const int ty)
+{
+    return ((long long)ty << 32) | (unsigned int)tx;
+}
+
+struct TileCacheObstacleRequest
+{
+    // Adds the handle's obstacle, or removes ref when null
+    TileCacheObstacleHandle *handle;
+    dtObstacleRef ref;
+};
+
+// A tile rebuilt on a worker thread. The poly mesh is copied out of the worker's allocator so the
+// mesh process can run on the calling thread before the nav mesh data is created.
+struct TileCacheTileRebuild
+{
+    dtCompressedTileRef ref;
+    // false when the tile was removed from the tile cache since it was marked for rebuilding
+    bool valid;
+    dtStatus status;
+    std::vector<unsigned short> verts;
+    std::vector<unsigned short> polys;
+    std::vector<unsigned short> flags;
+    std::vector<unsigned char> areas;
+    dtNavMeshCreateParams params;
+    unsigned char *navData;
+    int navDataSize;
+};
+
+// Wraps dtTileCache. Tiles are rebuilt from a per-location obstacle index rather than by dtTileCache, which scans
+// every obstacle for each tile. With more than one thread, update rebuilds every pending tile concurrently,
+// only the mesh process and the nav mesh tile swap stay on the calling thread.
 class TileCache
 {
 public:
     dtTileCache *m_tileCache;
 
-    TileCache() : m_tileCache(0)
+    TileCache() : m_tileCache(0), m_obstacleCount(0), m_allocatorCapacity(0), m_talloc(0), m_tcomp(0), m_tmproc(0)
     {
         m_tileCache = dtAllocTileCache();
     }
 
-    bool init(const dtTileCacheParams *params, RecastLinearAllocator *allocator, RecastFastLZCompressor *compressor, TileCacheMeshProcessJsImpl &meshProcess);
+    bool init(const dtTileCacheParams *params, RecastLinearAllocator *allocator, RecastTileCacheCompressor *compressor, TileCacheMeshProcessJsImpl &meshProcess);
 
     TileCacheAddTileResult addTile(UnsignedCharArray *data, unsigned char flags);
 
@@ -166,20 +340,119 @@ public:
 
     dtStatus buildNavMeshTilesAt(const int tx, const int ty, NavMesh *navMesh);
 
+    // Removes a tile from the tile cache and its nav mesh tile from navMesh. Obstacles stay indexed at the tile's
+    // location, so they apply again when a tile is added back there.
+    dtStatus removeTile(const dtCompressedTileRef *ref, NavMesh *navMesh);
+
     TileCacheUpdateResult update(NavMesh *navMesh);
 
+    // Keeps updating until up to date or maxTimeUs microseconds have passed, stopping between tile rebuilds,
+    // or between batches of rebuilds with more than one thread.
+    // Always runs at least one update.
+    TileCacheUpdateResult updateWithBudget(NavMesh *navMesh, const float maxTimeUs);
+
     TileCacheAddObstacleResult addCylinderObstacle(const Vec3 &position, float radius, float height);
 
     TileCacheAddObstacleResult addBoxObstacle(const Vec3 &position, const Vec3 &extent, float angle);
 
+    // Adds an obstacle with a convex footprint of nverts xyz verts relative to position, extruded upwards by height.
+    TileCacheAddObstacleResult addConvexObstacle(const float *verts, const int nverts, const Vec3 &position, float height);
+
     dtStatus removeObstacle(dtObstacleRef *obstacle);
 
+    // Moves an obstacle without removing and adding it again, the tiles it left and entered are rebuilt by update.
+    // angle only applies to oriented boxes, box obstacles keep their size and are centered on position.
+    dtStatus moveObstacle(dtObstacleRef *obstacle, const Vec3 &position, float angle);
+
+    // Adds count packed obstacle descriptors, writing the ref of each to refs, or 0 for obstacles that could not be added.
+    // Obstacles beyond the tile cache's request queue are queued and passed on by later updates. Returns the number added.
+    int addObstacles(const float *obstacles, const int count, IntArray *refs);
+
+    // The batch calls skip refs to removed obstacles, and write 1 to results[i] for each obstacle
+    // removed or moved, 0 otherwise.
+
+    // Returns the number of obstacles removed.
+    int removeObstacles(const int *refs, const int count, IntArray *results);
+
+    // Moves each obstacle to positions[i * 3] with angles[i]. Returns the number of obstacles moved.
+    int moveObstacles(const int *refs, const float *positions, const float *angles, const int count, IntArray *results);
+
+    int getObstacleCount() const;
+
+    // The TileCacheCompressorType of the compressor the tile cache was initialised with.
+    int getCompressorType() const;
+
+    // Peak bytes a single tile build has used, across the tile cache's allocator and the worker thread allocators.
+    int getAllocatorHighWaterMark() const;
+
+    // Sets the number of threads tile rebuilds are spread across, including the calling thread.
+    // Each update then rebuilds up to a tile per thread from the update list and as many dirty tiles.
+    // Always 1 unless built with RECAST_NAVIGATION_THREADS. The compressor must be safe to call from several threads.
+    void setThreadCount(const int threadCount);
+
+    int getThreadCount() const;
+
     void destroy();
 
 protected:
-    std::list<dtObstacleRef> m_obstacles;
-
-    dtTileCacheAlloc *m_talloc;
-    RecastFastLZCompressor *m_tcomp;
+    void updateStep(NavMesh *navMesh, TileCacheUpdateResult *result);
+    void updateStepParallel(NavMesh *navMesh, TileCacheUpdateResult *result);
+    // Runs dtTileCache::update with the tile it builds skipped and added to the rebuilds instead
+    void updateSkipped(NavMesh *navMesh, bool *upToDate);
+    void addRebuild(const dtCompressedTileRef ref);
+    RecastLinearAllocator *getThreadAllocator(const int threadIndex);
+    dtStatus rebuildTiles(NavMesh *navMesh);
+    void buildTilePolyMesh(RecastLinearAllocator *alloc, TileCacheTileRebuild *rebuild);
+    void initThreadAllocators();
+    void freeThreadAllocators();
+    void countPendingWork(TileCacheUpdateResult *result);
+
+    TileCacheObstacleHandle *allocObstacleHandle();
+    void freeObstacleHandle(TileCacheObstacleHandle *handle);
+    // The active handle a ref encodes, or null for refs to removed obstacles or that are not refs at all
+    TileCacheObstacleHandle *getObstacleHandle(const dtObstacleRef *obstacle);
+    dtStatus removeObstacleHandle(TileCacheObstacleHandle *handle);
+    dtStatus moveObstacleHandle(TileCacheObstacleHandle *handle, const Vec3 &position, float angle);
+    dtStatus addObstacle(const float *obstacle, TileCacheObstacleHandle **result, const float *verts = 0, const int nverts = 0);
+    dtStatus requestAddObstacle(TileCacheObstacleHandle *handle);
+    dtStatus requestRemoveObstacle(const dtObstacleRef ref);
+    int flushObstacleRequests();
+    void markTilesDirty(const dtCompressedTileRef *tiles, const int count);
+    // Marks the tiles at the obstacle's indexed locations dirty, other than those in ob's touched list when ob is given
+    void markObstacleTilesDirty(const TileCacheObstacleHandle *handle, const dtTileCacheObstacle *ob);
+    void indexObstacle(TileCacheObstacleHandle *handle, const float *bmin, const float *bmax);
+    void unindexObstacle(TileCacheObstacleHandle *handle);
+
+    // deque keeps handle addresses stable as it grows
+    std::deque<TileCacheObstacleHandle> m_obstacleHandles;
+    std::vector<TileCacheObstacleHandle *> m_freeObstacleHandles;
+    int m_obstacleCount;
+
+    std::deque<TileCacheObstacleRequest> m_obstacleRequests;
+
+    // Tiles touched by moved obstacles, rebuilt by update alongside the tile cache's own update list
+    std::deque<dtCompressedTileRef> m_dirtyTiles;
+    std::unordered_set<dtCompressedTileRef> m_dirtyTileSet;
+
+    // dtTileCache keeps its update list private, it is tracked from the pending tiles of the obstacles whose
+    // requests an update processes, and the tiles each update takes off it
+    std::unordered_set<dtCompressedTileRef> m_updateTileSet;
+    // Obstacles whose requests the tile cache has not processed yet
+    std::vector<dtObstacleRef> m_requestedObstacles;
+
+    // Obstacles overlapping each tile location, kept up to date as obstacles are added, removed and moved.
+    // Keyed by location rather than tile ref, so tiles that are removed and added again keep their obstacles.
+    std::unordered_map<long long, std::vector<TileCacheObstacleHandle *>> m_tileObstacles;
+
+    ThreadPool m_threadPool;
+    std::vector<RecastLinearAllocator *> m_threadAllocators;
+    size_t m_allocatorCapacity;
+    std::vector<dtCompressedTileRef> m_rebuildRefs;
+    std::unordered_set<dtCompressedTileRef> m_rebuildTileSet;
+    std::vector<TileCacheTileRebuild> m_rebuilds;
+
+    RecastLinearAllocator *m_talloc;
+    RecastTileCacheCompressor *m_tcomp;
+    TileCacheCompressorProxy m_compressor;
     TileCacheMeshProcessWrapper *m_tmproc;
 };
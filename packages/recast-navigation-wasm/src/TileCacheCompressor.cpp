@@ -0,0 +1,291 @@
+#include "./TileCacheCompressor.h"
+
+#include "../recastnavigation/RecastDemo/Contrib/fastlz/fastlz.h"
+
+#include <string.h>
+
+// LZ4 block format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+static const int LZ4_MIN_MATCH = 4;
+static const int LZ4_LAST_LITERALS = 5;
+static const int LZ4_MF_LIMIT = 12;
+static const int LZ4_MAX_OFFSET = 65535;
+static const int LZ4_HASH_LOG = 12;
+
+static inline unsigned int lz4Read32(const unsigned char *p)
+{
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline unsigned int lz4Hash(const unsigned int sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4WriteLength(unsigned char *op, int length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        *op++ = 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+static int lz4MaxCompressedSize(const int size)
+{
+    return size + size / 255 + 16;
+}
+
+static int lz4Compress(const unsigned char *src, const int srcSize, unsigned char *dst)
+{
+    int hashTable[1 << LZ4_HASH_LOG];
+    for (int i = 0; i < (1 << LZ4_HASH_LOG); ++i)
+    {
+        hashTable[i] = -1;
+    }
+
+    unsigned char *op = dst;
+    int ip = 0;
+    int anchor = 0;
+
+    // Matches must start at least 12 bytes and end at least 5 bytes before the end of the input
+    const int matchLimit = srcSize - LZ4_LAST_LITERALS;
+    const int inputLimit = srcSize - LZ4_MF_LIMIT;
+
+    while (ip < inputLimit)
+    {
+        const unsigned int sequence = lz4Read32(src + ip);
+        const unsigned int h = lz4Hash(sequence);
+        int ref = hashTable[h];
+        hashTable[h] = ip;
+
+        if (ref < 0 || ip - ref > LZ4_MAX_OFFSET || lz4Read32(src + ref) != sequence)
+        {
+            ip++;
+            continue;
+        }
+
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+        {
+            ip--;
+            ref--;
+        }
+
+        int matchLength = LZ4_MIN_MATCH;
+        while (ip + matchLength < matchLimit && src[ip + matchLength] == src[ref + matchLength])
+        {
+            matchLength++;
+        }
+
+        const int literalLength = ip - anchor;
+        unsigned char *token = op++;
+        *token = (unsigned char)((literalLength >= 15 ? 15 : literalLength) << 4);
+        if (literalLength >= 15)
+        {
+            op = lz4WriteLength(op, literalLength - 15);
+        }
+        memcpy(op, src + anchor, literalLength);
+        op += literalLength;
+
+        const int offset = ip - ref;
+        *op++ = (unsigned char)(offset & 0xff);
+        *op++ = (unsigned char)(offset >> 8);
+
+        const int extraLength = matchLength - LZ4_MIN_MATCH;
+        *token |= (unsigned char)(extraLength >= 15 ? 15 : extraLength);
+        if (extraLength >= 15)
+        {
+            op = lz4WriteLength(op, extraLength - 15);
+        }
+
+        ip += matchLength;
+        anchor = ip;
+    }
+
+    const int literalLength = srcSize - anchor;
+    *op++ = (unsigned char)((literalLength >= 15 ? 15 : literalLength) << 4);
+    if (literalLength >= 15)
+    {
+        op = lz4WriteLength(op, literalLength - 15);
+    }
+    memcpy(op, src + anchor, literalLength);
+    op += literalLength;
+
+    return (int)(op - dst);
+}
+
+static int lz4Decompress(const unsigned char *src, const int srcSize, unsigned char *dst, const int dstCapacity)
+{
+    int ip = 0;
+    int op = 0;
+
+    while (ip < srcSize)
+    {
+        const unsigned char token = src[ip++];
+
+        int literalLength = token >> 4;
+        if (literalLength == 15)
+        {
+            unsigned char b;
+            do
+            {
+                if (ip >= srcSize)
+                    return -1;
+                b = src[ip++];
+                literalLength += b;
+            } while (b == 255);
+        }
+
+        if (literalLength > srcSize - ip || literalLength > dstCapacity - op)
+            return -1;
+
+        memcpy(dst + op, src + ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        // The last sequence only has literals
+        if (ip >= srcSize)
+            break;
+
+        if (srcSize - ip < 2)
+            return -1;
+
+        const int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op)
+            return -1;
+
+        int matchLength = token & 15;
+        if (matchLength == 15)
+        {
+            unsigned char b;
+            do
+            {
+                if (ip >= srcSize)
+                    return -1;
+                b = src[ip++];
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += LZ4_MIN_MATCH;
+
+        if (matchLength > dstCapacity - op)
+            return -1;
+
+        // Overlapping matches repeat the last offset bytes
+        const unsigned char *match = dst + op - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(dst + op, match, matchLength);
+        }
+        else
+        {
+            for (int i = 0; i < matchLength; ++i)
+            {
+                dst[op + i] = match[i];
+            }
+        }
+        op += matchLength;
+    }
+
+    return op;
+}
+
+RecastTileCacheCompressor::RecastTileCacheCompressor(const int compressorType)
+    : type(isValidType(compressorType) ? compressorType : TILECACHE_COMPRESSOR_FASTLZ)
+{
+}
+
+bool RecastTileCacheCompressor::isValidType(const int compressorType)
+{
+    return compressorType >= TILECACHE_COMPRESSOR_FASTLZ && compressorType <= TILECACHE_COMPRESSOR_NONE;
+}
+
+int RecastTileCacheCompressor::maxCompressedSize(const int bufferSize)
+{
+    switch (type)
+    {
+    case TILECACHE_COMPRESSOR_LZ4:
+        return lz4MaxCompressedSize(bufferSize);
+    case TILECACHE_COMPRESSOR_NONE:
+        return bufferSize;
+    default:
+        // FastLZ needs 5% more than the input and at least 66 bytes
+        return bufferSize + bufferSize / 20 + 66;
+    }
+}
+
+dtStatus RecastTileCacheCompressor::compress(const unsigned char *buffer, const int bufferSize,
+                                             unsigned char *compressed, const int maxCompressedSize, int *compressedSize)
+{
+    if (maxCompressedSize < this->maxCompressedSize(bufferSize))
+        return DT_FAILURE | DT_BUFFER_TOO_SMALL;
+
+    switch (type)
+    {
+    case TILECACHE_COMPRESSOR_FASTLZ_HIGH:
+        *compressedSize = fastlz_compress_level(2, (const void *const)buffer, bufferSize, compressed);
+        break;
+    case TILECACHE_COMPRESSOR_LZ4:
+        *compressedSize = lz4Compress(buffer, bufferSize, compressed);
+        break;
+    case TILECACHE_COMPRESSOR_NONE:
+        memcpy(compressed, buffer, bufferSize);
+        *compressedSize = bufferSize;
+        break;
+    default:
+        // Picks level 2 for inputs of 64KB and over, as before codecs were selectable
+        *compressedSize = fastlz_compress((const void *const)buffer, bufferSize, compressed);
+        break;
+    }
+
+    return DT_SUCCESS;
+}
+
+dtStatus RecastTileCacheCompressor::decompress(const unsigned char *compressed, const int compressedSize,
+                                               unsigned char *buffer, const int maxBufferSize, int *bufferSize)
+{
+    switch (type)
+    {
+    case TILECACHE_COMPRESSOR_LZ4:
+        *bufferSize = lz4Decompress(compressed, compressedSize, buffer, maxBufferSize);
+        break;
+    case TILECACHE_COMPRESSOR_NONE:
+        if (compressedSize > maxBufferSize)
+        {
+            *bufferSize = -1;
+            break;
+        }
+        memcpy(buffer, compressed, compressedSize);
+        *bufferSize = compressedSize;
+        break;
+    default:
+        // FastLZ reads the level from the compressed data
+        *bufferSize = fastlz_decompress(compressed, compressedSize, buffer, maxBufferSize);
+        break;
+    }
+
+    return *bufferSize < 0 ? DT_FAILURE : DT_SUCCESS;
+}
+
+dtStatus RecastTileCacheCompressor::compressBuffer(const UnsignedCharArray *input, UnsignedCharArray *output)
+{
+    output->resize(maxCompressedSize(input->size));
+
+    int size = 0;
+    const dtStatus status = compress(input->data, input->size, output->data, output->size, &size);
+    output->size = dtStatusSucceed(status) ? size : 0;
+
+    return status;
+}
+
+int RecastTileCacheCompressor::decompressBuffer(const UnsignedCharArray *input, UnsignedCharArray *output)
+{
+    int size = 0;
+    const dtStatus status = decompress(input->data, input->size, output->data, output->size, &size);
+
+    return dtStatusSucceed(status) ? size : -1;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "../recastnavigation/Detour/Include/DetourStatus.h"
+#include "../recastnavigation/DetourTileCache/Include/DetourTileCacheBuilder.h"
+
+#include "./Arrays.h"
+
+enum TileCacheCompressorType
+{
+    // FastLZ level 1
+    TILECACHE_COMPRESSOR_FASTLZ,
+    // FastLZ level 2, a better ratio for shipped assets, decompresses as fast as level 1
+    TILECACHE_COMPRESSOR_FASTLZ_HIGH,
+    // LZ4 block format, the fastest to decompress
+    TILECACHE_COMPRESSOR_LZ4,
+    // Layers are stored as is, the lowest rebuild latency at the cost of memory
+    TILECACHE_COMPRESSOR_NONE,
+};
+
+// Tile cache compressor using the codec it was created with.
+// The codec is recorded in tile cache exports, tiles can only be decompressed with the codec that compressed them.
+struct RecastTileCacheCompressor : public dtTileCacheCompressor
+{
+    int type;
+
+    RecastTileCacheCompressor(const int compressorType = TILECACHE_COMPRESSOR_FASTLZ);
+
+    static bool isValidType(const int compressorType);
+
+    int getType() const { return type; }
+
+    virtual int maxCompressedSize(const int bufferSize);
+
+    virtual dtStatus compress(const unsigned char *buffer, const int bufferSize,
+                              unsigned char *compressed, const int maxCompressedSize, int *compressedSize);
+
+    virtual dtStatus decompress(const unsigned char *compressed, const int compressedSize,
+                                unsigned char *buffer, const int maxBufferSize, int *bufferSize);
+
+    // Compresses input into output, for measuring codecs outside of a tile cache.
+    dtStatus compressBuffer(const UnsignedCharArray *input, UnsignedCharArray *output);
+
+    // Decompresses input into output, which must already be sized to hold the result.
+    // Returns the decompressed size, or -1 on failure. Does not allocate, so it can be timed on its own.
+    int decompressBuffer(const UnsignedCharArray *input, UnsignedCharArray *output);
+};
@@ -0,0 +1,234 @@
+#include "./TileCacheStreamer.h"
+
+#include <algorithm>
+#include <float.h>
+#include <string.h>
+
+void TileCacheStreamer::addTile(const int offset, const int size, const dtTileCacheLayerHeader &header)
+{
+    TileCacheStreamerTile tile;
+    tile.offset = offset;
+    tile.size = size;
+    tile.tx = header.tx;
+    tile.ty = header.ty;
+    tile.tlayer = header.tlayer;
+    dtVcopy(tile.bmin, header.bmin);
+    dtVcopy(tile.bmax, header.bmax);
+    tile.ref = 0;
+    tile.navDataSize = 0;
+    tile.distance = FLT_MAX;
+
+    m_tiles.push_back(tile);
+}
+
+void TileCacheStreamer::setMemoryBudget(const int bytes)
+{
+    m_memoryBudget = bytes;
+}
+
+int TileCacheStreamer::getMemoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+bool TileCacheStreamer::overBudget(const int extraBytes) const
+{
+    return m_memoryBudget > 0 && m_loadedBytes + extraBytes > m_memoryBudget;
+}
+
+TileCacheStreamerUpdateResult TileCacheStreamer::update(const float *focusPoints, const int focusPointCount, const float radius, const int maxLoads)
+{
+    TileCacheStreamerUpdateResult result;
+    result.loaded = 0;
+    result.evicted = 0;
+    result.pending = 0;
+
+    m_loads.clear();
+    m_evictions.clear();
+
+    for (int i = 0; i < (int)m_tiles.size(); ++i)
+    {
+        TileCacheStreamerTile &tile = m_tiles[i];
+
+        if (tile.ref)
+        {
+            refreshNavDataSize(tile);
+        }
+
+        // Distance on the xz plane from the nearest focus point to the tile bounds
+        tile.distance = FLT_MAX;
+        for (int j = 0; j < focusPointCount; ++j)
+        {
+            const float *p = &focusPoints[j * 3];
+            const float dx = dtMax(dtMax(tile.bmin[0] - p[0], p[0] - tile.bmax[0]), 0.0f);
+            const float dz = dtMax(dtMax(tile.bmin[2] - p[2], p[2] - tile.bmax[2]), 0.0f);
+            tile.distance = dtMin(tile.distance, dtMathSqrtf(dx * dx + dz * dz));
+        }
+
+        const bool inRange = tile.distance <= radius;
+        if (inRange && !tile.ref)
+        {
+            m_loads.push_back(i);
+        }
+        else if (!inRange && tile.ref)
+        {
+            m_evictions.push_back(i);
+        }
+    }
+
+    // Nearest tiles load first, farthest tiles are evicted first
+    std::sort(m_loads.begin(), m_loads.end(), [&](const int a, const int b)
+              { return m_tiles[a].distance < m_tiles[b].distance; });
+    std::sort(m_evictions.begin(), m_evictions.end(), [&](const int a, const int b)
+              { return m_tiles[a].distance > m_tiles[b].distance; });
+
+    size_t nextEviction = 0;
+    size_t nextLoad = 0;
+
+    for (; nextLoad < m_loads.size(); ++nextLoad)
+    {
+        if (maxLoads > 0 && result.loaded >= maxLoads)
+            break;
+
+        TileCacheStreamerTile &tile = m_tiles[m_loads[nextLoad]];
+
+        // The nav mesh tile size is only known once built, make room for the compressed tile
+        while (overBudget(tile.size) && nextEviction < m_evictions.size())
+        {
+            unloadTile(m_tiles[m_evictions[nextEviction++]]);
+            result.evicted++;
+        }
+
+        if (overBudget(tile.size))
+            break;
+
+        if (!loadTile(tile))
+            break;
+
+        result.loaded++;
+    }
+
+    // Built nav mesh tiles can take the loaded tiles over the budget
+    while (overBudget(0) && nextEviction < m_evictions.size())
+    {
+        unloadTile(m_tiles[m_evictions[nextEviction++]]);
+        result.evicted++;
+    }
+
+    result.pending = (int)(m_loads.size() - nextLoad);
+    result.loadedTiles = m_loadedTiles;
+    result.loadedBytes = m_loadedBytes;
+
+    return result;
+}
+
+bool TileCacheStreamer::loadTile(TileCacheStreamerTile &tile)
+{
+    unsigned char *data = (unsigned char *)dtAlloc(tile.size, DT_ALLOC_PERM);
+    if (!data)
+    {
+        return false;
+    }
+
+    UnsignedCharArray view;
+    view.view(data);
+    view.size = tile.size;
+
+    // The tile cache frees the data when the tile is removed
+    dtCompressedTileRef ref = 0;
+    if (!m_source->read(tile.offset, tile.size, &view) ||
+        dtStatusFailed(m_tileCache->m_tileCache->addTile(data, tile.size, DT_COMPRESSEDTILE_FREE_DATA, &ref)))
+    {
+        dtFree(data);
+        return false;
+    }
+
+    tile.ref = ref;
+    m_tileCache->buildNavMeshTile(&tile.ref, m_navMesh);
+
+    m_loadedBytes += tile.size;
+    m_loadedTiles++;
+    refreshNavDataSize(tile);
+
+    return true;
+}
+
+void TileCacheStreamer::unloadTile(TileCacheStreamerTile &tile)
+{
+    refreshNavDataSize(tile);
+    m_tileCache->removeTile(&tile.ref, m_navMesh);
+
+    m_loadedBytes -= tile.size + tile.navDataSize;
+    m_loadedTiles--;
+
+    tile.ref = 0;
+    tile.navDataSize = 0;
+}
+
+void TileCacheStreamer::refreshNavDataSize(TileCacheStreamerTile &tile)
+{
+    const dtMeshTile *meshTile = m_navMesh->getNavMesh()->getTileAt(tile.tx, tile.ty, tile.tlayer);
+    const int navDataSize = meshTile ? meshTile->dataSize : 0;
+
+    m_loadedBytes += navDataSize - tile.navDataSize;
+    tile.navDataSize = navDataSize;
+}
+
+void TileCacheStreamer::unloadAll()
+{
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].ref)
+        {
+            unloadTile(m_tiles[i]);
+        }
+    }
+}
+
+int TileCacheStreamer::getTileCount() const
+{
+    return (int)m_tiles.size();
+}
+
+int TileCacheStreamer::getLoadedTileCount() const
+{
+    return m_loadedTiles;
+}
+
+int TileCacheStreamer::getLoadedBytes()
+{
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        if (m_tiles[i].ref)
+        {
+            refreshNavDataSize(m_tiles[i]);
+        }
+    }
+
+    return m_loadedBytes;
+}
+
+bool TileCacheStreamer::isTileLoaded(const int tx, const int ty) const
+{
+    for (size_t i = 0; i < m_tiles.size(); ++i)
+    {
+        const TileCacheStreamerTile &tile = m_tiles[i];
+        if (tile.ref && tile.tx == tx && tile.ty == ty)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TileCacheStreamer::destroy()
+{
+    unloadAll();
+
+    m_tiles.clear();
+    m_loads.clear();
+    m_evictions.clear();
+    m_loadedBytes = 0;
+    m_loadedTiles = 0;
+}
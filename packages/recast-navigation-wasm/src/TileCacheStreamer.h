@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../recastnavigation/Detour/Include/DetourNavMesh.h"
+#include "../recastnavigation/DetourTileCache/Include/DetourTileCache.h"
+
+#include <vector>
+
+#include "./Arrays.h"
+#include "./NavMesh.h"
+#include "./TileCache.h"
+
+// Reads streamed tiles from the caller's copy of the export, so only loaded tiles are held in wasm memory
+struct TileCacheStreamerSourceJsImpl
+{
+    TileCacheStreamerSourceJsImpl()
+    {
+    }
+
+    virtual ~TileCacheStreamerSourceJsImpl()
+    {
+    }
+
+    // Copies size bytes at offset in the export into output, a view of size bytes. Returns false if out of range.
+    virtual bool read(int offset, int size, UnsignedCharArray *output) = 0;
+};
+
+struct TileCacheStreamerTile
+{
+    // Compressed tile data in the export
+    int offset;
+    int size;
+    int tx;
+    int ty;
+    int tlayer;
+    float bmin[3];
+    float bmax[3];
+    // 0 while the tile is not loaded
+    dtCompressedTileRef ref;
+    // Size of the nav mesh tile as of the last refresh, obstacle rebuilds replace it with one of a different size
+    int navDataSize;
+    // Distance to the nearest focus point as of the last update
+    float distance;
+};
+
+struct TileCacheStreamerUpdateResult
+{
+    int loaded;
+    int evicted;
+    // Tiles in range of a focus point that are not loaded, because of the memory budget or maxLoads
+    int pending;
+    int loadedTiles;
+    int loadedBytes;
+};
+
+// Loads tile cache tiles from a tile cache export around focus points, rather than all of them up front.
+// Tiles are read from the source when loaded, and their data is freed when they are evicted, so wasm memory only
+// holds loaded tiles. Far tiles are evicted from the tile cache and nav mesh when the loaded tiles go over the memory budget.
+// Obstacles over tiles that are not loaded apply when the tiles are loaded again.
+class TileCacheStreamer
+{
+public:
+    TileCacheStreamer(TileCache *tileCache, NavMesh *navMesh, TileCacheStreamerSourceJsImpl *source) : m_tileCache(tileCache), m_navMesh(navMesh), m_source(source), m_memoryBudget(0), m_loadedBytes(0), m_loadedTiles(0) {}
+
+    // Adds a compressed tile at offset in the source, it is not loaded until an update brings it in range.
+    void addTile(const int offset, const int size, const dtTileCacheLayerHeader &header);
+
+    // Bytes the loaded compressed tiles and nav mesh tiles may use, 0 for no limit.
+    void setMemoryBudget(const int bytes);
+
+    int getMemoryBudget() const;
+
+    // Loads tiles within radius of the focus points, nearest first, loading at most maxLoads tiles when maxLoads > 0.
+    // focusPoints holds focusPointCount xyz points. Tiles out of range stay loaded until their memory is needed.
+    TileCacheStreamerUpdateResult update(const float *focusPoints, const int focusPointCount, const float radius, const int maxLoads);
+
+    void unloadAll();
+
+    int getTileCount() const;
+
+    int getLoadedTileCount() const;
+
+    // Re-reads the size of the loaded nav mesh tiles, which change as obstacles rebuild them.
+    int getLoadedBytes();
+
+    // Whether any layer at the tile location is loaded.
+    bool isTileLoaded(const int tx, const int ty) const;
+
+    // Unloads every tile. Call this before destroying the streamer, while the tile cache and nav mesh are still alive.
+    void destroy();
+
+protected:
+    bool loadTile(TileCacheStreamerTile &tile);
+    void unloadTile(TileCacheStreamerTile &tile);
+    void refreshNavDataSize(TileCacheStreamerTile &tile);
+    bool overBudget(const int extraBytes) const;
+
+    TileCache *m_tileCache;
+    NavMesh *m_navMesh;
+    TileCacheStreamerSourceJsImpl *m_source;
+
+    std::vector<TileCacheStreamerTile> m_tiles;
+    std::vector<int> m_loads;
+    std::vector<int> m_evictions;
+
+    int m_memoryBudget;
+    int m_loadedBytes;
+    int m_loadedTiles;
+};
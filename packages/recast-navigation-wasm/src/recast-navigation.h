@@ -8,6 +8,7 @@
 #include "./NavMeshQuery.h"
 #include "./Crowd.h"
 #include "./NavMeshSerdes.h"
+#include "./CrowdSerdes.h"
 #include "./Recast.h"
 #include "./Detour.h"
 #include "./ChunkyTriMesh.h"
@@ -1,4 +1,10 @@
-import { Crowd, NavMesh, init } from 'recast-navigation';
+import {
+  Crowd,
+  NavMesh,
+  exportCrowd,
+  importCrowd,
+  init,
+} from 'recast-navigation';
 import { generateSoloNavMesh } from 'recast-navigation/generators';
 import { BoxGeometry, BufferAttribute, Mesh } from 'three';
 import { beforeEach, describe, expect, test } from 'vitest';
@@ -78,4 +84,414 @@ describe('Crowd', () => {
 
     expect(agent.radius).toBeCloseTo(0.2);
   });
+
+  test('level of detail tiers', () => {
+    crowd.setLodTiers([
+      { distance: 1 },
+      { updateInterval: 4, obstacleAvoidance: false },
+    ]);
+    crowd.setLodFocusPoints([{ x: 0, y: 0, z: 0 }]);
+
+    const near = crowd.addAgent({ x: 0, y: 0, z: 0 }, { radius: 0.2 });
+    const far = crowd.addAgent({ x: 2, y: 0, z: 2 }, { radius: 0.2 });
+
+    far.requestMoveTarget({ x: -2, y: 0, z: 2 });
+
+    let farUpdates = 0;
+    for (let i = 0; i < 4; i++) {
+      crowd.update(1 / 60);
+
+      const stats = crowd.getLodTierStats();
+      expect(stats[0].agentCount).toBe(1);
+      expect(stats[0].updatedAgentCount).toBe(1);
+      farUpdates += stats[1].updatedAgentCount;
+    }
+
+    expect(near.lodTier()).toBe(0);
+    expect(far.lodTier()).toBe(1);
+    expect(farUpdates).toBe(1);
+
+    for (let i = 0; i < 240; i++) {
+      crowd.update(1 / 60);
+    }
+
+    expectVectorToBeCloseTo(far.position(), { x: -2, y: 0, z: 2 }, 0.3);
+  });
+
+  test('update stats', () => {
+    const agent = crowd.addAgent({ x: -2, y: 0, z: -2 }, { radius: 0.3 });
+    crowd.addAgent({ x: -1.8, y: 0, z: -2 }, { radius: 0.3 });
+
+    agent.requestMoveTarget({ x: 2, y: 0, z: 2 });
+
+    crowd.update(1 / 60);
+
+    const stats = crowd.getUpdateStats();
+
+    expect(stats.gridItemCount).toBe(2);
+    expect(stats.gridCellEntries).toBeGreaterThanOrEqual(2);
+    expect(stats.gridMaxCellOccupancy).toBe(2);
+    expect(stats.totalTime).toBeGreaterThanOrEqual(0);
+    expect(stats.totalTime).toBeGreaterThanOrEqual(stats.velocityPlanningTime);
+    expect(stats.pathRequestsDropped).toBe(0);
+  });
+
+  test('batched spatial queries', () => {
+    crowd.addAgent({ x: -2, y: 0, z: -2 }, { radius: 0.2 });
+    crowd.addAgent({ x: -1.5, y: 0, z: -2 }, { radius: 0.2 });
+    crowd.addAgent({ x: 2, y: 0, z: 2 }, { radius: 0.2 });
+
+    crowd.update(1 / 60);
+
+    const radius = crowd.queryAgentsInRadius(
+      [
+        { x: -2, y: 0, z: -2 },
+        { x: 2, y: 0, z: 2 },
+        { x: 0, y: 0, z: 0 },
+      ],
+      [1, 0.5, 0.5]
+    );
+
+    expect([...radius.offsets]).toEqual([0, 2, 3, 3]);
+    expect([...radius.indices.subarray(0, 2)].sort()).toEqual([0, 1]);
+    expect(radius.indices[2]).toBe(2);
+
+    const box = crowd.queryAgentsInBox([
+      { min: { x: 1, y: -1, z: 1 }, max: { x: 3, y: 1, z: 3 } },
+      { min: { x: -3, y: 1, z: -3 }, max: { x: 3, y: 2, z: 3 } },
+    ]);
+
+    expect([...box.offsets]).toEqual([0, 1, 1]);
+    expect([...box.indices]).toEqual([2]);
+
+    // grid ids still map to the right agents after removing one
+    crowd.removeAgent(0);
+
+    const afterRemove = crowd.queryAgentsInRadius([{ x: 2, y: 0, z: 2 }], 0.5);
+
+    expect([...afterRemove.indices]).toEqual([2]);
+  });
+
+  test('growable capacity', () => {
+    const growable = new Crowd(navMesh, {
+      maxAgents: 2,
+      maxAgentRadius: 0.5,
+      autoResize: true,
+    });
+
+    const agents = [];
+    for (let i = 0; i < 5; i++) {
+      agents.push(
+        growable.addAgent({ x: i - 2, y: 0, z: 0 }, { radius: 0.2 })
+      );
+    }
+
+    expect(agents.map((agent) => agent.agentIndex)).toEqual([0, 1, 2, 3, 4]);
+    expect(growable.getAgentCount()).toBe(8);
+
+    agents[0].requestMoveTarget({ x: -2, y: 0, z: 2 });
+
+    for (let i = 2; i < 5; i++) {
+      growable.removeAgent(agents[i]);
+    }
+
+    expect(growable.getAgentCount()).toBe(4);
+    expect(growable.setMaxAgents(1)).toBe(false);
+
+    for (let i = 0; i < 120; i++) {
+      growable.update(1 / 60);
+    }
+
+    expectVectorToBeCloseTo(agents[0].position(), { x: -2, y: 0, z: 2 }, 0.3);
+    expectVectorToBeCloseTo(agents[1].position(), { x: -1, y: 0, z: 0 }, 0.3);
+
+    const filter = growable.getFilter(0);
+    filter.includeFlags = 0x3;
+
+    expect(growable.setMaxAgents(16)).toBe(true);
+    expect(growable.getAgentCount()).toBe(16);
+    expect(agents[1].radius).toBeCloseTo(0.2);
+
+    // filters and the proximity grid carry over to the resized crowd
+    expect(filter.includeFlags).toBe(0x3);
+    expect(growable.getFilter(0)).toBe(filter);
+
+    const found = growable.queryAgentsInRadius([agents[1].position()], 0.1);
+    expect([...found.indices]).toEqual([1]);
+
+    growable.destroy();
+  });
+
+  test('capacity limit', () => {
+    // the proximity grid indexes 4 items per agent with unsigned shorts
+    expect(crowd.setMaxAgents(16384)).toBe(false);
+    expect(crowd.getAgentCount()).toBe(10);
+
+    expect(crowd.setMaxAgents(16383)).toBe(true);
+    expect(crowd.getAgentCount()).toBe(16383);
+
+    const a = crowd.addAgent({ x: -2, y: 0, z: 0 }, { radius: 0.3 });
+    const b = crowd.addAgent({ x: 2, y: 0, z: 0 }, { radius: 0.3 });
+    expect(crowd.getActiveAgentCount()).toBe(2);
+
+    crowd.update(1 / 60);
+
+    crowd.removeAgent(b);
+    expect(crowd.getActiveAgentCount()).toBe(1);
+    expect(crowd.setMaxAgents(1)).toBe(true);
+    expect(a.position().x).toBeCloseTo(-2, 1);
+  });
+
+  test('dynamic obstacles', () => {
+    const agent = crowd.addAgent({ x: -2, y: 0, z: 0 }, { radius: 0.3 });
+    agent.requestMoveTarget({ x: 2, y: 0, z: 0 });
+
+    const circle = crowd.addCircleObstacle({ x: 0, y: 0, z: 0 }, 0.5, 1);
+    const box = crowd.addBoxObstacle(
+      { x: 0, y: 0.5, z: -2 },
+      { x: 0.5, y: 0.5, z: 0.5 },
+      0,
+      { x: 0, y: 0, z: 1 }
+    );
+
+    expect(crowd.getObstacleCount()).toBe(2);
+
+    let maxOffset = 0;
+    for (let i = 0; i < 180; i++) {
+      crowd.update(1 / 60);
+      maxOffset = Math.max(maxOffset, Math.abs(agent.position().z));
+    }
+
+    expect(maxOffset).toBeGreaterThan(0.2);
+    expectVectorToBeCloseTo(agent.position(), { x: 2, y: 0, z: 0 }, 0.3);
+
+    expect(
+      crowd.updateObstacle(box, { x: 1, y: 0.5, z: -2 }, Math.PI / 4)
+    ).toBe(true);
+    expect(crowd.removeObstacle(circle)).toBe(true);
+    expect(crowd.removeObstacle(circle)).toBe(false);
+    expect(crowd.getObstacleCount()).toBe(1);
+  });
+
+  test('more dynamic obstacles in range than the default candidates', () => {
+    crowd.setMaxObstacleCandidates(64);
+    expect(crowd.getMaxObstacleCandidates()).toBe(64);
+
+    const agent = crowd.addAgent({ x: -2, y: 0, z: 0 }, { radius: 0.3 });
+    agent.requestMoveTarget({ x: 2, y: 0, z: 0 });
+
+    // off the agent's path, but within its collision query range
+    for (let i = 0; i < 40; i++) {
+      crowd.addCircleObstacle({ x: -2 + i * 0.1, y: 0, z: 1.6 }, 0.02, 1);
+    }
+    crowd.addCircleObstacle({ x: 0, y: 0, z: 0 }, 0.5, 1);
+
+    expect(crowd.getObstacleCount()).toBe(41);
+
+    let maxOffset = 0;
+    for (let i = 0; i < 180; i++) {
+      crowd.update(1 / 60);
+      maxOffset = Math.max(maxOffset, Math.abs(agent.position().z));
+    }
+
+    expect(maxOffset).toBeGreaterThan(0.2);
+    expectVectorToBeCloseTo(agent.position(), { x: 2, y: 0, z: 0 }, 0.3);
+  });
+
+  test('dynamic obstacles covering more cells than the grid holds', () => {
+    const agent = crowd.addAgent({ x: -2, y: 0, z: 0 }, { radius: 0.3 });
+    agent.requestMoveTarget({ x: 2, y: 0, z: 0 });
+
+    // far more grid cells than the 65535 the obstacle grid can index
+    for (const x of [-105, 105]) {
+      for (const z of [-105, 105]) {
+        crowd.addBoxObstacle(
+          { x, y: 0.5, z },
+          { x: 100, y: 0.5, z: 100 },
+          0
+        );
+      }
+    }
+    crowd.addCircleObstacle({ x: 0, y: 0, z: 0 }, 0.5, 1);
+
+    let maxOffset = 0;
+    for (let i = 0; i < 180; i++) {
+      crowd.update(1 / 60);
+      maxOffset = Math.max(maxOffset, Math.abs(agent.position().z));
+    }
+
+    expect(maxOffset).toBeGreaterThan(0.2);
+    expectVectorToBeCloseTo(agent.position(), { x: 2, y: 0, z: 0 }, 0.3);
+  });
+
+  test('event stream', () => {
+    const agent = crowd.addAgent({ x: -1, y: 0, z: -1 }, { radius: 0.3 });
+
+    expect(crowd.drainEvents()).toEqual([]);
+
+    agent.requestMoveTarget({ x: 1, y: 0, z: 1 });
+
+    const events = [];
+    for (let i = 0; i < 180; i++) {
+      crowd.update(1 / 60);
+      events.push(...crowd.drainEvents());
+    }
+
+    expect(events).toEqual([
+      { type: 'targetReached', agentIndex: agent.agentIndex },
+    ]);
+    expect(crowd.drainEvents()).toEqual([]);
+    expect(crowd.getDroppedEventCount()).toBe(0);
+  });
+
+  test('packed obstacle avoidance sampling matches scalar sampling', () => {
+    const scalarCrowd = new Crowd(navMesh, {
+      maxAgents: 10,
+      maxAgentRadius: 0.5,
+    });
+
+    crowd.setSimdObstacleAvoidance(true);
+    scalarCrowd.setSimdObstacleAvoidance(false);
+
+    expect(crowd.getSimdObstacleAvoidance()).toBe(true);
+    expect(scalarCrowd.getSimdObstacleAvoidance()).toBe(false);
+
+    const starts = [
+      { x: -2, y: 0, z: 0 },
+      { x: 2, y: 0, z: 0.1 },
+      { x: 0, y: 0, z: -2 },
+      { x: 0.1, y: 0, z: 2 },
+    ];
+
+    const agents = starts.map((start) => [
+      crowd.addAgent(start, { radius: 0.3 }),
+      scalarCrowd.addAgent(start, { radius: 0.3 }),
+    ]);
+
+    agents.forEach(([packed, scalar], i) => {
+      const target = { x: -starts[i].x, y: 0, z: -starts[i].z };
+      packed.requestMoveTarget(target);
+      scalar.requestMoveTarget(target);
+    });
+
+    for (let i = 0; i < 120; i++) {
+      crowd.update(1 / 60);
+      scalarCrowd.update(1 / 60);
+
+      for (const [packed, scalar] of agents) {
+        expectVectorToBeCloseTo(packed.velocity(), scalar.velocity(), 3);
+        expectVectorToBeCloseTo(packed.position(), scalar.position(), 3);
+      }
+    }
+
+    scalarCrowd.destroy();
+  });
+
+  // setThreadCount clamps to 1 unless @recast-navigation/wasm was built with
+  // THREADS=ON, both crowds would take the same serial path
+  test.runIf(process.env.THREADS === 'ON')(
+    'threaded update matches single threaded update',
+    () => {
+      const threadedCrowd = new Crowd(navMesh, {
+        maxAgents: 10,
+        maxAgentRadius: 0.5,
+        threads: 4,
+      });
+
+      expect(crowd.getThreadCount()).toBe(1);
+      expect(threadedCrowd.getThreadCount()).toBeGreaterThan(1);
+
+      const starts = [
+        { x: -2, y: 0, z: 0 },
+        { x: 2, y: 0, z: 0.1 },
+        { x: 0, y: 0, z: -2 },
+        { x: 0.1, y: 0, z: 2 },
+        { x: -1.5, y: 0, z: -1.5 },
+        { x: 1.5, y: 0, z: 1.5 },
+      ];
+
+      const agents = starts.map((start) => [
+        crowd.addAgent(start, { radius: 0.3 }),
+        threadedCrowd.addAgent(start, { radius: 0.3 }),
+      ]);
+
+      agents.forEach(([single, threaded], i) => {
+        const target = { x: -starts[i].x, y: 0, z: -starts[i].z };
+        single.requestMoveTarget(target);
+        threaded.requestMoveTarget(target);
+      });
+
+      for (let i = 0; i < 120; i++) {
+        crowd.update(1 / 60);
+        threadedCrowd.update(1 / 60);
+
+        for (const [single, threaded] of agents) {
+          expect(threaded.position()).toEqual(single.position());
+          expect(threaded.velocity()).toEqual(single.velocity());
+        }
+      }
+
+      threadedCrowd.destroy();
+    }
+  );
+
+  test('snapshot and restore', () => {
+    const a = crowd.addAgent({ x: -2, y: 0, z: -2 }, { radius: 0.3 });
+    const b = crowd.addAgent({ x: 2, y: 0, z: 2 }, { radius: 0.3 });
+
+    a.requestMoveTarget({ x: 2, y: 0, z: 2 });
+    b.requestMoveTarget({ x: -2, y: 0, z: -2 });
+
+    const obstacle = crowd.addCircleObstacle({ x: 0, y: 0, z: 4 }, 0.5, 1);
+
+    for (let i = 0; i < 30; i++) {
+      crowd.update(1 / 60);
+    }
+
+    const snapshot = exportCrowd(crowd);
+
+    const expected = [];
+    for (let i = 0; i < 30; i++) {
+      crowd.update(1 / 60);
+      expected.push([a.position(), b.position()]);
+    }
+
+    crowd.removeAgent(b);
+    crowd.addAgent({ x: 0, y: 0, z: 0 }, { radius: 0.3 });
+    const added = crowd.addBoxObstacle(
+      { x: 4, y: 0.5, z: 0 },
+      { x: 0.5, y: 0.5, z: 0.5 },
+      0
+    );
+    crowd.removeObstacle(obstacle);
+
+    expect(importCrowd(crowd, snapshot)).toBe(true);
+    expect(crowd.getActiveAgentCount()).toBe(2);
+    expect(crowd.getObstacleCount()).toBe(1);
+    expect(crowd.updateObstacle(obstacle, { x: 0, y: 0, z: 4 }, 0)).toBe(true);
+    expect(crowd.removeObstacle(added)).toBe(false);
+    expect(crowd.getAgents().map((agent) => agent.agentIndex)).toEqual([0, 1]);
+
+    const restoredB = crowd.getAgent(1)!;
+
+    for (let i = 0; i < 30; i++) {
+      crowd.update(1 / 60);
+      expectVectorToBeCloseTo(a.position(), expected[i][0], 5);
+      expectVectorToBeCloseTo(restoredB.position(), expected[i][1], 5);
+    }
+
+    const restored = new Crowd(navMesh, {
+      maxAgents: 10,
+      maxAgentRadius: 0.5,
+    });
+
+    expect(importCrowd(restored, snapshot)).toBe(true);
+    expect(restored.getActiveAgentCount()).toBe(2);
+    expect(restored.getObstacleCount()).toBe(1);
+
+    expect(importCrowd(restored, snapshot.subarray(0, 16))).toBe(false);
+    expect(restored.getActiveAgentCount()).toBe(2);
+
+    restored.destroy();
+  });
 });
@@ -1,5 +1,21 @@
-import { NavMesh, NavMeshQuery, init } from 'recast-navigation';
-import { generateSoloNavMesh } from 'recast-navigation/generators';
+import {
+  DebugDrawerBufferUtils,
+  DebugDrawerUtils,
+  IndexedNavMeshImporter,
+  NavMesh,
+  NavMeshPolyEditRecord,
+  NavMeshQuery,
+  exportNavMesh,
+  exportNavMeshIndexed,
+  importNavMesh,
+  importNavMeshInPlace,
+  init,
+  statusSucceed,
+} from 'recast-navigation';
+import {
+  generateSoloNavMesh,
+  generateTiledNavMesh,
+} from 'recast-navigation/generators';
 import { BoxGeometry, BufferAttribute, Mesh } from 'three';
 import { beforeEach, describe, test, expect } from 'vitest';
 import { expectVectorToBeCloseTo } from './utils';
@@ -60,4 +76,254 @@ describe('NavMeshQuery', () => {
 
     expectVectorToBeCloseTo(path[path.length - 1], end, 0.01);
   });
+
+  test('in place import', () => {
+    const data = exportNavMesh(navMesh);
+    const imported = importNavMeshInPlace(data);
+
+    expect(imported.navMesh.getMaxTiles()).toBe(navMesh.getMaxTiles());
+    expect(exportNavMesh(imported.navMesh).length).toBe(data.length);
+
+    const query = new NavMeshQuery(imported.navMesh);
+    const { point } = query.findClosestPoint({ x: 2, y: 1, z: 2 });
+    expectVectorToBeCloseTo(point, { x: 2, y: 0.15, z: 2 }, 0.01);
+
+    query.destroy();
+    imported.navMesh.destroy();
+
+    expect(() => importNavMeshInPlace(new Uint8Array(64))).toThrow();
+  });
+
+  test('indexed export', () => {
+    const mesh = new Mesh(new BoxGeometry(20, 0.1, 20));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const result = generateTiledNavMesh(positions, indices, { tileSize: 16 });
+    if (!result.success) throw new Error('nav mesh generation failed');
+
+    const data = exportNavMeshIndexed(result.navMesh);
+    const importer = new IndexedNavMeshImporter(data);
+    const tileCount = importer.getTileCount();
+    expect(tileCount).toBeGreaterThan(4);
+
+    const partial = importer.createNavMesh();
+
+    const index = importer.findTile(0, 0);
+    expect(importer.getTile(index)).toMatchObject({ x: 0, y: 0, layer: 0 });
+    expect(importer.findTile(1000, 0)).toBe(-1);
+
+    expect(importer.loadTile(partial, index)).toBe(true);
+    expect(importer.loadTile(partial, index)).toBe(false);
+    expect(partial.getTileAt(0, 0, 0)).not.toBeNull();
+    expect(partial.getTileAt(1, 0, 0)).toBeNull();
+
+    expect(importer.loadTilesAt(partial, [{ x: 1, y: 0 }])).toBe(1);
+    expect(partial.getTileAt(1, 0, 0)).not.toBeNull();
+
+    const min = { x: -10, y: 0, z: -10 };
+    const max = { x: 10, y: 0, z: 10 };
+    expect(importer.loadTilesInBounds(partial, min, max)).toBe(tileCount - 2);
+
+    // importNavMesh loads every tile of an indexed export
+    const { navMesh: full } = importNavMesh(data);
+    expect(exportNavMesh(full).length).toBe(
+      exportNavMesh(result.navMesh).length
+    );
+
+    // an uncompressed tile is rejected unless stored at its full size
+    const tile = importer.getTile(0);
+    const corrupt = data.slice();
+    const view = new DataView(corrupt.buffer);
+    let found = false;
+    for (let i = 0; i + 28 <= corrupt.length && !found; i += 4) {
+      found =
+        view.getInt32(i, true) === tile.x &&
+        view.getInt32(i + 4, true) === tile.y &&
+        view.getInt32(i + 8, true) === tile.layer &&
+        view.getInt32(i + 16, true) === tile.size &&
+        view.getInt32(i + 24, true) === tile.dataSize;
+      if (found) view.setInt32(i + 24, tile.dataSize + 64, true);
+    }
+    expect(found).toBe(true);
+
+    const corruptImporter = new IndexedNavMeshImporter(corrupt);
+    const corruptNavMesh = corruptImporter.createNavMesh();
+    expect(corruptImporter.loadTile(corruptNavMesh, 0)).toBe(false);
+    corruptImporter.destroy();
+    corruptNavMesh.destroy();
+
+    // a tile count whose directory size overflows
+    const overflow = data.slice();
+    new DataView(overflow.buffer).setInt32(8, 0x7fffffff, true);
+    expect(() => new IndexedNavMeshImporter(overflow)).toThrow();
+
+    importer.destroy();
+    partial.destroy();
+    full.destroy();
+  });
+
+  test('compressed indexed export', () => {
+    const mesh = new Mesh(new BoxGeometry(20, 0.1, 20));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const result = generateTiledNavMesh(positions, indices, { tileSize: 16 });
+    if (!result.success) throw new Error('nav mesh generation failed');
+
+    const data = exportNavMeshIndexed(result.navMesh);
+    const compressed = exportNavMeshIndexed(result.navMesh, 'lz4');
+    expect(compressed.length).toBeLessThan(data.length);
+
+    const importer = new IndexedNavMeshImporter(compressed);
+    expect(importer.getCompressorType()).toBe('lz4');
+
+    const tile = importer.getTile(0);
+    expect(tile.size).toBeLessThan(tile.dataSize);
+
+    const partial = importer.createNavMesh();
+    expect(importer.loadTile(partial, 0)).toBe(true);
+    expect(partial.getTileAt(tile.x, tile.y, tile.layer)).not.toBeNull();
+
+    // every tile decompresses to its original size
+    const { navMesh: full } = importNavMesh(compressed);
+    expect(exportNavMeshIndexed(full).length).toBe(data.length);
+
+    importer.destroy();
+    partial.destroy();
+    full.destroy();
+  });
+
+  test('bulk poly edits', () => {
+    const { polyRef } = navMeshQuery.findClosestPoint({ x: 0, y: 0, z: 0 });
+    const { flags } = navMesh.getPolyFlags(polyRef);
+    const { area } = navMesh.getPolyArea(polyRef);
+
+    const min = { x: -3, y: -1, z: -3 };
+    const max = { x: 3, y: 1, z: 3 };
+    const undo = new NavMeshPolyEditRecord();
+
+    const changed = navMesh.editPolysInBox(
+      min,
+      max,
+      { clearFlags: 1, area: 5 },
+      undo
+    );
+    expect(changed).toBeGreaterThan(0);
+    expect(undo.polyCount).toBe(changed);
+    expect(undo.getPolyRefs()).toContain(polyRef);
+    expect(navMesh.getPolyFlags(polyRef).flags).toBe(flags & ~1);
+    expect(navMesh.getPolyArea(polyRef).area).toBe(5);
+
+    // polys that already match are not changed or recorded
+    expect(navMesh.editPolysInBox(min, max, { clearFlags: 1 }, undo)).toBe(0);
+
+    expect(navMesh.editPolysWithArea(5, { setFlags: 4 }, undo)).toBe(changed);
+    expect(navMesh.editPolys([polyRef, 0], { setFlags: 8 }, undo)).toBe(1);
+    expect(navMesh.getPolyFlags(polyRef).flags).toBe((flags & ~1) | 12);
+
+    expect(navMesh.undoPolyEdit(undo)).toBe(changed * 2 + 1);
+    expect(undo.polyCount).toBe(0);
+    expect(navMesh.getPolyFlags(polyRef).flags).toBe(flags);
+    expect(navMesh.getPolyArea(polyRef).area).toBe(area);
+
+    // every poly center is in a volume around the whole nav mesh
+    const square = [
+      { x: -3, y: 0, z: -3 },
+      { x: 3, y: 0, z: -3 },
+      { x: 3, y: 0, z: 3 },
+      { x: -3, y: 0, z: 3 },
+    ];
+    const inVolume = navMesh.editPolysInConvexVolume(square, -1, 1, {
+      setFlags: 2,
+    });
+    expect(inVolume).toBe(changed);
+
+    undo.destroy();
+  });
+
+  test('poly state', () => {
+    const { navMesh: client } = importNavMesh(exportNavMesh(navMesh));
+
+    const { polyRef } = navMeshQuery.findClosestPoint({ x: 0, y: 0, z: 0 });
+    const { flags } = navMesh.getPolyFlags(polyRef);
+    const { area } = navMesh.getPolyArea(polyRef);
+
+    const state = navMesh.storePolyState();
+
+    // nothing has changed yet
+    expect(navMesh.restorePolyState(navMesh.diffPolyState(state))).toBe(0);
+
+    navMesh.setPolyFlags(polyRef, 0);
+    navMesh.setPolyArea(polyRef, 5);
+
+    // only the changed poly is in the diff
+    const diff = navMesh.diffPolyState(state);
+    expect(diff.length).toBeLessThan(state.length);
+    expect(client.restorePolyState(diff)).toBe(1);
+    expect(client.getPolyFlags(polyRef).flags).toBe(0);
+    expect(client.getPolyArea(polyRef).area).toBe(5);
+
+    // restoring the stored state undoes the change
+    expect(navMesh.restorePolyState(state)).toBeGreaterThan(0);
+    expect(navMesh.getPolyFlags(polyRef).flags).toBe(flags);
+    expect(navMesh.getPolyArea(polyRef).area).toBe(area);
+
+    expect(() => navMesh.restorePolyState(new Uint8Array(4))).toThrow();
+
+    // tile poly counts must add up to the stored polys, the first tile's
+    // count follows the 16 byte header and its tile ref
+    const corrupt = state.slice();
+    const view = new DataView(corrupt.buffer);
+    view.setInt32(20, view.getInt32(20, true) + 1, true);
+    expect(() => navMesh.restorePolyState(corrupt)).toThrow();
+    expect(() => navMesh.diffPolyState(corrupt)).toThrow();
+
+    // single tile state
+    const tile = navMesh.getTile(0);
+    const tileStateSize = navMesh.getTileStateSize(tile);
+    const tileState = navMesh.storeTileState(tile, tileStateSize);
+    expect(statusSucceed(tileState.raw.status)).toBe(true);
+    expect(tileState.dataSize()).toBe(tileStateSize);
+
+    client.destroy();
+  });
+
+  test('debug draw buffers', () => {
+    const debugDrawerUtils = new DebugDrawerUtils();
+    const debugDrawerBufferUtils = new DebugDrawerBufferUtils();
+
+    const primitives = debugDrawerUtils.drawNavMesh(navMesh);
+    const buffers = debugDrawerBufferUtils.drawNavMesh(navMesh);
+
+    const countVertices = (type: string) =>
+      primitives
+        .filter((primitive) => primitive.type === type)
+        .reduce((count, primitive) => count + primitive.vertices.length, 0);
+
+    expect(buffers.tris.indices.length).toBeGreaterThan(0);
+
+    for (const type of ['points', 'lines', 'tris'] as const) {
+      const buffer = buffers[type];
+      const vertexCount = countVertices(type);
+
+      expect(buffer.indices.length).toBe(vertexCount);
+      expect(buffer.positions.length).toBe(vertexCount * 3);
+      expect(buffer.colors.length).toBe(vertexCount * 4);
+    }
+
+    const [x, y, z] = primitives.find((p) => p.type === 'tris')!.vertices[0];
+    expect([...buffers.tris.positions.subarray(0, 3)]).toEqual([x, y, z]);
+
+    // buffers are reused between draws
+    const again = debugDrawerBufferUtils.drawNavMesh(navMesh);
+    expect(again.tris.indices.length).toBe(buffers.tris.indices.length);
+
+    debugDrawerUtils.dispose();
+    debugDrawerBufferUtils.dispose();
+  });
 });
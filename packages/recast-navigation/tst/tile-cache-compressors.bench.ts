@@ -0,0 +1,105 @@
+import {
+  Raw,
+  TileCacheCompressorType,
+  UnsignedCharArray,
+  createTileCacheCompressor,
+  getHeightfieldLayerAreas,
+  getHeightfieldLayerCons,
+  getHeightfieldLayerHeights,
+  init,
+} from 'recast-navigation';
+import { generateTileCache } from 'recast-navigation/generators';
+import { BoxGeometry, BufferAttribute } from 'three';
+import { mergeGeometries } from 'three/addons/utils/BufferGeometryUtils.js';
+import { bench, describe } from 'vitest';
+
+await init();
+
+/**
+ * Uncompressed tile cache layers, heights, areas and cons as dtBuildTileCacheLayer compresses them
+ */
+const createLayers = () => {
+  const geometries = [new BoxGeometry(40, 0.1, 40)];
+  for (let i = 0; i < 40; i++) {
+    const box = new BoxGeometry(1 + (i % 3), 0.5 + (i % 4) * 0.5, 2);
+    box.translate(((i * 7) % 36) - 18, 0.25, ((i * 13) % 36) - 18);
+    geometries.push(box);
+  }
+  const geometry = mergeGeometries(geometries);
+
+  const positions = (geometry.getAttribute('position') as BufferAttribute)
+    .array;
+  const indices = geometry.getIndex()!.array;
+
+  const { success, intermediates } = generateTileCache(
+    positions,
+    indices,
+    { tileSize: 32 },
+    true
+  );
+  if (!success) throw new Error('tile cache generation failed');
+
+  const layers: UnsignedCharArray[] = [];
+
+  for (const tile of intermediates.tileIntermediates) {
+    const layerSet = tile.heightfieldLayerSet!;
+
+    for (let i = 0; i < layerSet.nlayers(); i++) {
+      const layer = layerSet.layers(i);
+      const gridSize = layer.width() * layer.height();
+
+      const data = new Uint8Array(gridSize * 3);
+      [
+        getHeightfieldLayerHeights(layer),
+        getHeightfieldLayerAreas(layer),
+        getHeightfieldLayerCons(layer),
+      ].forEach((array, j) => {
+        const ptr = array.raw.getDataPointer();
+        data.set(Raw.Module.HEAPU8.subarray(ptr, ptr + gridSize), j * gridSize);
+      });
+
+      const layerData = new UnsignedCharArray();
+      layerData.copy(data);
+      layers.push(layerData);
+    }
+  }
+
+  return layers;
+};
+
+const layers = createLayers();
+const totalSize = layers.reduce((size, layer) => size + layer.size, 0);
+
+const types: TileCacheCompressorType[] = [
+  'fastlz',
+  'fastlz-high',
+  'lz4',
+  'none',
+];
+
+describe(`decompress ${layers.length} layers, ${totalSize} bytes`, () => {
+  for (const type of types) {
+    const compressor = createTileCacheCompressor(type);
+
+    const compressed = layers.map((layer) => {
+      const data = new UnsignedCharArray();
+      compressor.compressBuffer(layer.raw, data.raw);
+      return data;
+    });
+
+    const output = new UnsignedCharArray();
+    output.resize(Math.max(...layers.map((layer) => layer.size)));
+
+    const compressedSize = compressed.reduce((size, c) => size + c.size, 0);
+    const ratio = (totalSize / compressedSize).toFixed(2);
+    console.log(`${type}: ${compressedSize} bytes, ratio ${ratio}`);
+
+    bench(type, () => {
+      for (const data of compressed) {
+        if (compressor.decompressBuffer(data.raw, output.raw) < 0) {
+          throw new Error(`${type} decompression failed`);
+        }
+      }
+    });
+  }
+});
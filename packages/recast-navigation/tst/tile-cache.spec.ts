@@ -0,0 +1,711 @@
+import {
+  NavMesh,
+  NavMeshDeltaTracker,
+  NavMeshQuery,
+  Raw,
+  TileCache,
+  TileCacheCompressorType,
+  UnsignedCharArray,
+  applyNavMeshDelta,
+  createTileCacheCompressor,
+  exportNavMesh,
+  exportTileCache,
+  exportTileCacheInto,
+  getNavMeshExportSize,
+  importNavMesh,
+  importTileCache,
+  importTileCacheStreaming,
+  init,
+} from 'recast-navigation';
+import {
+  createDefaultTileCacheMeshProcess,
+  generateTileCache,
+} from 'recast-navigation/generators';
+import { BoxGeometry, BufferAttribute, Mesh } from 'three';
+import { mergeGeometries } from 'three/addons/utils/BufferGeometryUtils.js';
+import { beforeEach, describe, expect, test } from 'vitest';
+
+describe('TileCache', () => {
+  let navMesh: NavMesh;
+  let tileCache: TileCache;
+
+  beforeEach(async () => {
+    await init();
+
+    const mesh = new Mesh(new BoxGeometry(10, 0.1, 10));
+
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const result = generateTileCache(positions, indices, {
+      tileSize: 16,
+      maxObstacles: 256,
+    });
+
+    if (!result.success) throw new Error('tile cache generation failed');
+
+    navMesh = result.navMesh;
+    tileCache = result.tileCache;
+  });
+
+  const updateUntilUpToDate = () => {
+    for (let i = 0; i < 1000; i++) {
+      if (tileCache.update(navMesh).upToDate) return true;
+    }
+
+    return false;
+  };
+
+  test('batch obstacles', () => {
+    const navMeshQuery = new NavMeshQuery(navMesh);
+    const origin = { x: 0, y: 0.2, z: 0 };
+
+    const { success, obstacles } = tileCache.addObstacles([
+      {
+        type: 'box',
+        position: { x: 0, y: 0, z: 0 },
+        halfExtents: { x: 1, y: 1, z: 1 },
+        angle: 0,
+      },
+      ...Array.from({ length: 99 }, (_, i) => ({
+        type: 'cylinder' as const,
+        position: {
+          x: -4.5 + (i % 10) * 0.2,
+          y: 0,
+          z: -4.5 + Math.floor(i / 10) * 0.2,
+        },
+        radius: 0.05,
+        height: 1,
+      })),
+    ]);
+
+    expect(success).toBe(true);
+    expect(tileCache.getObstacleCount()).toBe(100);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    const blocked = navMeshQuery.findClosestPoint(origin).point;
+    expect(Math.hypot(blocked.x, blocked.z)).toBeGreaterThan(0.9);
+
+    const box = obstacles[0]!;
+    expect(
+      tileCache.moveObstacle(box, { x: 3, y: 0, z: 3 }, Math.PI / 4).success
+    ).toBe(true);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    const cleared = navMeshQuery.findClosestPoint(origin).point;
+    expect(Math.hypot(cleared.x, cleared.z)).toBeLessThan(0.1);
+
+    const moves = [{ obstacle: box, position: origin }];
+    expect(tileCache.moveObstacles(moves)).toBe(1);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    const blockedAgain = navMeshQuery.findClosestPoint(origin).point;
+    expect(Math.hypot(blockedAgain.x, blockedAgain.z)).toBeGreaterThan(0.9);
+
+    expect(tileCache.removeObstacles(obstacles.map((o) => o!))).toBe(100);
+    expect(tileCache.getObstacleCount()).toBe(0);
+    expect(tileCache.obstacles.size).toBe(0);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    navMeshQuery.destroy();
+  });
+
+  test('removed obstacles are not confused with reused refs', () => {
+    const { obstacle: a } = tileCache.addCylinderObstacle(
+      { x: -2, y: 0, z: -2 },
+      0.5,
+      1
+    );
+    expect(tileCache.removeObstacle(a!).success).toBe(true);
+
+    const { obstacle: b } = tileCache.addCylinderObstacle(
+      { x: 2, y: 0, z: 2 },
+      0.5,
+      1
+    );
+    expect(b!.ref).not.toBe(a!.ref);
+
+    for (const stale of [a!, a!.ref]) {
+      expect(tileCache.removeObstacle(stale).success).toBe(false);
+      expect(
+        tileCache.moveObstacle(stale, { x: 0, y: 0, z: 0 }).success
+      ).toBe(false);
+      expect(tileCache.removeObstacles([stale])).toBe(0);
+      const moves = [{ obstacle: stale, position: { x: 0, y: 0, z: 0 } }];
+      expect(tileCache.moveObstacles(moves)).toBe(0);
+    }
+
+    // Refs go through the handle table, not memory
+    const bogus = Raw.Module.wrapPointer(0x7fff1234, Raw.Module.dtObstacleRef);
+    expect(tileCache.removeObstacle(bogus).success).toBe(false);
+    expect(tileCache.removeObstacles([bogus])).toBe(0);
+
+    expect(tileCache.getObstacleCount()).toBe(1);
+    expect(tileCache.obstacles.get(b!.ref)).toBe(b);
+    expect(b!.position).toEqual({ x: 2, y: 0, z: 2 });
+
+    expect(tileCache.removeObstacles([b!])).toBe(1);
+    expect(tileCache.obstacles.size).toBe(0);
+  });
+
+  test('obstacles across many tiles', () => {
+    const mesh = new Mesh(new BoxGeometry(20, 0.1, 20));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const result = generateTileCache(positions, indices, {
+      tileSize: 16,
+      maxObstacles: 4096,
+    });
+    if (!result.success) throw new Error('tile cache generation failed');
+
+    navMesh = result.navMesh;
+    tileCache = result.tileCache;
+
+    const navMeshQuery = new NavMeshQuery(navMesh);
+    const a = { x: -6, y: 0.2, z: -6 };
+    const b = { x: 6, y: 0.2, z: 6 };
+
+    // a row of small obstacles along one edge, away from a and b
+    const { success } = tileCache.addObstacles(
+      Array.from({ length: 2000 }, (_, i) => ({
+        type: 'cylinder' as const,
+        position: { x: -9.5 + (i % 200) * 0.095, y: 0, z: 9.5 },
+        radius: 0.02,
+        height: 1,
+      }))
+    );
+    expect(success).toBe(true);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    // distance from a position to the closest point on the nav mesh
+    const blocked = (position: typeof a) => {
+      const { point } = navMeshQuery.findClosestPoint(position);
+      return Math.hypot(point.x - position.x, point.z - position.z);
+    };
+
+    const { obstacle } = tileCache.addBoxObstacle(a, { x: 1, y: 1, z: 1 }, 0);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    expect(blocked(a)).toBeGreaterThan(0.9);
+    expect(blocked(b)).toBeLessThan(0.1);
+
+    // into tiles the obstacle did not touch before
+    expect(tileCache.moveObstacle(obstacle!, b, 0).success).toBe(true);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    expect(blocked(a)).toBeLessThan(0.1);
+    expect(blocked(b)).toBeGreaterThan(0.9);
+
+    tileCache.removeObstacle(obstacle!);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    expect(blocked(b)).toBeLessThan(0.1);
+
+    navMeshQuery.destroy();
+  });
+
+  test('obstacles only rebuild the layers they overlap', () => {
+    const lower = new BoxGeometry(10, 0.1, 10);
+    const upper = new BoxGeometry(10, 0.1, 10);
+    upper.translate(0, 4, 0);
+    const geometry = mergeGeometries([lower, upper]);
+
+    const positions = (geometry.getAttribute('position') as BufferAttribute)
+      .array;
+    const indices = geometry.getIndex()!.array;
+
+    const result = generateTileCache(positions, indices, {
+      tileSize: 16,
+      maxObstacles: 256,
+    });
+    if (!result.success) throw new Error('tile cache generation failed');
+
+    navMesh = result.navMesh;
+    tileCache = result.tileCache;
+
+    const navMeshQuery = new NavMeshQuery(navMesh);
+    const onLower = { x: 0, y: 0.2, z: 0 };
+    const onUpper = { x: 0, y: 4.2, z: 0 };
+
+    const upperRef = navMeshQuery.findClosestPoint(onUpper).polyRef;
+    const lowerRef = navMeshQuery.findClosestPoint(onLower).polyRef;
+
+    const { obstacle } = tileCache.addCylinderObstacle(
+      { x: 0, y: 0, z: 0 },
+      0.5,
+      1
+    );
+    expect(updateUntilUpToDate()).toBe(true);
+
+    // rebuilt tiles get new poly refs
+    expect(navMeshQuery.findClosestPoint(onLower).polyRef).not.toBe(lowerRef);
+    expect(navMeshQuery.findClosestPoint(onUpper).polyRef).toBe(upperRef);
+
+    const moved = tileCache.moveObstacle(obstacle!, { x: 1, y: 0, z: 0 });
+    expect(moved.success).toBe(true);
+    expect(updateUntilUpToDate()).toBe(true);
+    expect(navMeshQuery.findClosestPoint(onUpper).polyRef).toBe(upperRef);
+
+    navMeshQuery.destroy();
+  });
+
+  test('convex obstacles', () => {
+    const navMeshQuery = new NavMeshQuery(navMesh);
+
+    const distance = (position: { x: number; y: number; z: number }) => {
+      const { point } = navMeshQuery.findClosestPoint(position);
+      return Math.hypot(point.x - position.x, point.z - position.z);
+    };
+
+    const inside = { x: 0, y: 0.2, z: -1 };
+    // inside the footprint's bounds, outside the footprint
+    const outside = { x: 1.8, y: 0.2, z: 1.8 };
+
+    const { success, obstacle } = tileCache.addConvexObstacle(
+      { x: 0, y: 0, z: 0 },
+      [
+        { x: -2, y: 0, z: -2 },
+        { x: 2, y: 0, z: -2 },
+        { x: 0, y: 0, z: 2 },
+      ],
+      1
+    );
+    expect(success).toBe(true);
+    expect(obstacle!.type).toBe('convex');
+    expect(tileCache.getObstacleCount()).toBe(1);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    expect(distance(inside)).toBeGreaterThan(0.5);
+    expect(distance(outside)).toBeLessThan(0.1);
+
+    const moved = tileCache.moveObstacle(obstacle!, { x: 0, y: 0, z: 2 });
+    expect(moved.success).toBe(true);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    expect(distance(inside)).toBeLessThan(0.1);
+
+    tileCache.removeObstacle(obstacle!);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    expect(distance({ x: 0, y: 0.2, z: 1 })).toBeLessThan(0.1);
+
+    expect(
+      tileCache.addConvexObstacle({ x: 0, y: 0, z: 0 }, [], 1).success
+    ).toBe(false);
+
+    navMeshQuery.destroy();
+  });
+
+  test('time budgeted update', () => {
+    for (let i = 0; i < 16; i++) {
+      const position = {
+        x: -4 + (i % 4) * 2.5,
+        y: 0,
+        z: -4 + Math.floor(i / 4) * 2.5,
+      };
+      tileCache.addCylinderObstacle(position, 0.2, 1);
+    }
+
+    const first = tileCache.updateWithBudget(navMesh, 0);
+    expect(first.success).toBe(true);
+    expect(first.upToDate).toBe(false);
+    expect(first.pendingTiles).toBeGreaterThan(1);
+    expect(first.queuedRequests).toBe(0);
+
+    // each single threaded update finishes one pending tile
+    const second = tileCache.update(navMesh);
+    expect(second.pendingTiles).toBe(first.pendingTiles - 1);
+
+    const rest = tileCache.updateWithBudget(navMesh, 1e7);
+    expect(rest.upToDate).toBe(true);
+    expect(rest.pendingTiles).toBe(0);
+    expect(rest.queuedRequests).toBe(0);
+
+    const idle = tileCache.update(navMesh);
+    expect(idle.upToDate).toBe(true);
+    expect(idle.pendingTiles).toBe(0);
+  });
+
+  test('threaded tile rebuilds', () => {
+    const navMeshQuery = new NavMeshQuery(navMesh);
+    const origin = { x: 0, y: 0.2, z: 0 };
+
+    tileCache.setThreadCount(4);
+    expect(tileCache.getThreadCount()).toBeGreaterThanOrEqual(1);
+
+    const { obstacle } = tileCache.addBoxObstacle(
+      { x: 0, y: 0, z: 0 },
+      { x: 3, y: 1, z: 3 },
+      0
+    );
+
+    // an update rebuilds a batch of tiles rather than every pending tile
+    const first = tileCache.update(navMesh);
+    expect(first.upToDate).toBe(false);
+    expect(first.pendingTiles).toBeGreaterThan(0);
+
+    expect(updateUntilUpToDate()).toBe(true);
+
+    const blocked = navMeshQuery.findClosestPoint(origin).point;
+    expect(Math.hypot(blocked.x, blocked.z)).toBeGreaterThan(2.9);
+
+    tileCache.removeObstacle(obstacle!);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    const cleared = navMeshQuery.findClosestPoint(origin).point;
+    expect(Math.hypot(cleared.x, cleared.z)).toBeLessThan(0.1);
+
+    tileCache.setThreadCount(1);
+    expect(tileCache.getThreadCount()).toBe(1);
+
+    navMeshQuery.destroy();
+  });
+
+  test('compressors', () => {
+    const mesh = new Mesh(new BoxGeometry(10, 0.1, 10));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const types: TileCacheCompressorType[] = [
+      'fastlz',
+      'fastlz-high',
+      'lz4',
+      'none',
+    ];
+
+    for (const type of types) {
+      const result = generateTileCache(positions, indices, {
+        tileSize: 16,
+        compressor: type,
+      });
+      if (!result.success) throw new Error('tile cache generation failed');
+
+      expect(result.tileCache.getCompressorType()).toBe(type);
+
+      const data = exportTileCache(result.navMesh, result.tileCache);
+      const imported = importTileCache(
+        data,
+        createDefaultTileCacheMeshProcess()
+      );
+
+      expect(imported.tileCache.getCompressorType()).toBe(type);
+
+      const query = new NavMeshQuery(imported.navMesh);
+      const { success, point } = query.findClosestPoint({ x: 1, y: 0, z: 1 });
+      expect(success).toBe(true);
+      expect(Math.hypot(point.x - 1, point.z - 1)).toBeLessThan(0.1);
+      query.destroy();
+
+      // version 1 exports have no compression or allocator header
+      // and are always fastlz
+      if (type === 'fastlz') {
+        const v1 = new Uint8Array(data.length - 8);
+        v1.set(data.subarray(0, 92));
+        v1.set(data.subarray(100), 92);
+        new DataView(v1.buffer).setInt32(4, 1, true);
+
+        const legacy = importTileCache(v1, createDefaultTileCacheMeshProcess());
+        expect(legacy.tileCache.getCompressorType()).toBe('fastlz');
+        expect(legacy.navMesh.getMaxTiles()).toBe(
+          result.navMesh.getMaxTiles()
+        );
+      }
+    }
+
+    const input = new UnsignedCharArray();
+    input.copy(Array.from({ length: 4096 }, (_, i) => (i >> 6) & 3));
+
+    for (const type of types) {
+      const compressor = createTileCacheCompressor(type);
+      const compressed = new UnsignedCharArray();
+      const output = new UnsignedCharArray();
+      output.resize(input.size);
+
+      compressor.compressBuffer(input.raw, compressed.raw);
+      if (type !== 'none') expect(compressed.size).toBeLessThan(input.size);
+
+      expect(compressor.decompressBuffer(compressed.raw, output.raw)).toBe(
+        input.size
+      );
+      expect([...output.toTypedArray()]).toEqual([...input.toTypedArray()]);
+
+      compressed.destroy();
+      output.destroy();
+    }
+
+    input.destroy();
+  });
+
+  test('growable allocator', () => {
+    const mesh = new Mesh(new BoxGeometry(10, 0.1, 10));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const result = generateTileCache(positions, indices, {
+      tileSize: 16,
+      allocatorSize: 64,
+    });
+    if (!result.success) throw new Error('tile cache generation failed');
+
+    const highWaterMark = result.tileCache.getAllocatorHighWaterMark();
+    expect(highWaterMark).toBeGreaterThan(64);
+
+    const query = new NavMeshQuery(result.navMesh);
+    expect(query.findClosestPoint({ x: 1, y: 0, z: 1 }).success).toBe(true);
+    query.destroy();
+
+    const data = exportTileCache(result.navMesh, result.tileCache);
+    const imported = importTileCache(
+      data,
+      createDefaultTileCacheMeshProcess()
+    );
+
+    expect(imported.allocator.getCapacity()).toBeGreaterThanOrEqual(
+      highWaterMark
+    );
+    expect(imported.allocator.getGrowCount()).toBe(0);
+  });
+
+  test('allocator last usage is the last completed build', () => {
+    const mesh = new Mesh(new BoxGeometry(10, 0.1, 10));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    // a single tile
+    const result = generateTileCache(positions, indices, {
+      cs: 0.2,
+      tileSize: 64,
+    });
+    if (!result.success) throw new Error('tile cache generation failed');
+
+    const imported = importTileCache(
+      exportTileCache(result.navMesh, result.tileCache),
+      createDefaultTileCacheMeshProcess()
+    );
+
+    imported.tileCache.addCylinderObstacle({ x: 2, y: 0, z: 2 }, 0.5, 1);
+    while (!imported.tileCache.update(imported.navMesh).upToDate);
+
+    // updates skip the tile cache's own build of the tile, which is aborted
+    // after allocating, and build it themselves
+    const updateUsage = imported.allocator.getLastUsage();
+
+    imported.tileCache.buildNavMeshTilesAt(0, 0, imported.navMesh);
+    expect(imported.allocator.getLastUsage()).toBe(updateUsage);
+  });
+
+  test('pre-sized export', () => {
+    const size = getNavMeshExportSize(navMesh, tileCache);
+    const data = exportTileCache(navMesh, tileCache);
+    expect(data.length).toBe(size);
+    expect(data.byteLength).toBe(data.buffer.byteLength);
+
+    // exporting into an array reuses it while it is large enough
+    const output = new UnsignedCharArray();
+    output.resize(size + 64);
+
+    const view = exportTileCacheInto(navMesh, tileCache, output);
+    expect(view.length).toBe(size);
+    expect(output.size).toBe(size + 64);
+    expect(Array.from(view)).toEqual(Array.from(data));
+
+    // the view points into the wasm heap, copy it before the import allocates
+    const imported = importTileCache(
+      view.slice(),
+      createDefaultTileCacheMeshProcess()
+    );
+    expect(imported.navMesh.getMaxTiles()).toBe(navMesh.getMaxTiles());
+
+    output.destroy();
+  });
+
+  test('streaming', () => {
+    const mesh = new Mesh(new BoxGeometry(20, 0.1, 20));
+    const positions = (
+      mesh.geometry.getAttribute('position') as BufferAttribute
+    ).array;
+    const indices = mesh.geometry.getIndex()!.array;
+
+    const result = generateTileCache(positions, indices, { tileSize: 16 });
+    if (!result.success) throw new Error('tile cache generation failed');
+
+    const data = exportTileCache(result.navMesh, result.tileCache);
+    const streamed = importTileCacheStreaming(
+      data,
+      createDefaultTileCacheMeshProcess()
+    );
+    const { streamer } = streamed;
+
+    navMesh = streamed.navMesh;
+    tileCache = streamed.tileCache;
+
+    expect(streamer.getTileCount()).toBeGreaterThan(4);
+    expect(streamer.getLoadedTileCount()).toBe(0);
+
+    const navMeshQuery = new NavMeshQuery(navMesh);
+    const a = { x: -8, y: 0.2, z: -8 };
+    const b = { x: 8, y: 0.2, z: 8 };
+
+    // distance from a position to the closest point on the nav mesh
+    const distance = (position: typeof a) => {
+      const { success, point } = navMeshQuery.findClosestPoint(position);
+      if (!success) return Infinity;
+      return Math.hypot(point.x - position.x, point.z - position.z);
+    };
+
+    const first = streamer.update([a], 2);
+    expect(first.loaded).toBeGreaterThan(0);
+    expect(first.pending).toBe(0);
+    expect(first.loadedTiles).toBe(streamer.getLoadedTileCount());
+    expect(streamer.isTileLoaded(0, 0)).toBe(true);
+    expect(distance(a)).toBeLessThan(0.1);
+    expect(distance(b)).toBeGreaterThan(1);
+
+    // room for about as many tiles as are loaded, moving away evicts the farthest
+    streamer.setMemoryBudget(first.loadedBytes);
+    const second = streamer.update([b], 2);
+    expect(second.evicted).toBeGreaterThan(0);
+    expect(second.loaded).toBeGreaterThan(0);
+    expect(streamer.isTileLoaded(0, 0)).toBe(false);
+    expect(distance(b)).toBeLessThan(0.1);
+
+    // an obstacle over tiles that are not loaded applies once they are
+    const { obstacle } = tileCache.addBoxObstacle(a, { x: 1, y: 1, z: 1 }, 0);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    streamer.setMemoryBudget(0);
+    const third = streamer.update([a, b], 2);
+    expect(third.pending).toBe(0);
+    expect(streamer.isTileLoaded(0, 0)).toBe(true);
+    expect(distance(a)).toBeGreaterThan(0.9);
+    expect(distance(b)).toBeLessThan(0.1);
+
+    // evicted and loaded again, the tiles under the obstacle have new refs
+    streamer.setMemoryBudget(first.loadedBytes);
+    streamer.update([b], 2);
+    expect(streamer.isTileLoaded(0, 0)).toBe(false);
+    streamer.update([a], 2);
+    expect(streamer.isTileLoaded(0, 0)).toBe(true);
+    expect(distance(a)).toBeGreaterThan(0.9);
+
+    const navMeshBytes = () => {
+      let bytes = 0;
+      for (let i = 0; i < navMesh.getMaxTiles(); i++) {
+        const tile = navMesh.getTile(i);
+        if (tile.header()) bytes += tile.dataSize();
+      }
+      return bytes;
+    };
+    const loadedBytes = streamer.getLoadedBytes();
+    const navBytes = navMeshBytes();
+
+    // removing the obstacle rebuilds the reloaded tiles
+    expect(tileCache.removeObstacle(obstacle!).success).toBe(true);
+    expect(updateUntilUpToDate()).toBe(true);
+    expect(distance(a)).toBeLessThan(0.1);
+
+    // the rebuilt nav mesh tiles have a different size, loaded bytes follow
+    expect(navMeshBytes()).not.toBe(navBytes);
+    expect(streamer.getLoadedBytes() - loadedBytes).toBe(
+      navMeshBytes() - navBytes
+    );
+    expect(streamer.update([a], 2).loadedBytes).toBe(
+      streamer.getLoadedBytes()
+    );
+
+    streamer.unloadAll();
+    expect(streamer.getLoadedTileCount()).toBe(0);
+    expect(streamer.getLoadedBytes()).toBe(0);
+
+    navMeshQuery.destroy();
+    streamer.destroy();
+  });
+
+  test('delta export', () => {
+    const tracker = new NavMeshDeltaTracker(navMesh);
+    const { navMesh: client } = importNavMesh(exportNavMesh(navMesh));
+
+    const empty = applyNavMeshDelta(client, tracker.exportDelta(0), 0);
+    expect(empty).toEqual({ snapshotId: 0, added: 0, removed: 0 });
+
+    const position = { x: -4, y: 0.2, z: -4 };
+    tileCache.addBoxObstacle(position, { x: 0.3, y: 1, z: 0.3 }, 0);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    // only the rebuilt tiles are sent
+    const delta = tracker.exportDelta(0);
+    expect(delta.length).toBeLessThan(exportNavMesh(navMesh).length / 2);
+
+    const { snapshotId, added, removed } = applyNavMeshDelta(client, delta, 0);
+    expect(snapshotId).toBe(1);
+    expect(added).toBeGreaterThan(0);
+    expect(removed).toBe(added);
+
+    const query = new NavMeshQuery(client);
+    const { point } = query.findClosestPoint(position);
+    expect(
+      Math.hypot(point.x - position.x, point.z - position.z)
+    ).toBeGreaterThan(0.2);
+
+    // a delta from another snapshot is rejected
+    expect(() => applyNavMeshDelta(client, delta, snapshotId)).toThrow();
+
+    // a client at the latest snapshot has nothing to apply
+    const latest = applyNavMeshDelta(
+      client,
+      tracker.exportDelta(snapshotId),
+      snapshotId
+    );
+    expect(latest.added).toBe(0);
+
+    query.destroy();
+    tracker.destroy();
+    client.destroy();
+  });
+
+  test('invalid delta leaves the nav mesh unchanged', () => {
+    const tracker = new NavMeshDeltaTracker(navMesh);
+    const { navMesh: client } = importNavMesh(exportNavMesh(navMesh));
+
+    const a = { x: -4, y: 0.2, z: -4 };
+    const b = { x: 4, y: 0.2, z: 4 };
+    tileCache.addBoxObstacle(a, { x: 0.3, y: 1, z: 0.3 }, 0);
+    tileCache.addBoxObstacle(b, { x: 0.3, y: 1, z: 0.3 }, 0);
+    expect(updateUntilUpToDate()).toBe(true);
+
+    // the last tile is cut short, after the first tiles' entries
+    const delta = tracker.exportDelta(0);
+    const truncated = delta.subarray(0, delta.length - 1);
+
+    expect(() => applyNavMeshDelta(client, truncated, 0)).toThrow();
+
+    const query = new NavMeshQuery(client);
+    const distance = (position: typeof a) => {
+      const { point } = query.findClosestPoint(position);
+      return Math.hypot(point.x - position.x, point.z - position.z);
+    };
+
+    expect(distance(a)).toBeLessThan(0.1);
+    expect(distance(b)).toBeLessThan(0.1);
+
+    const { added } = applyNavMeshDelta(client, delta, 0);
+    expect(added).toBeGreaterThanOrEqual(2);
+    expect(distance(a)).toBeGreaterThan(0.2);
+    expect(distance(b)).toBeGreaterThan(0.2);
+
+    query.destroy();
+    tracker.destroy();
+    client.destroy();
+  });
+});